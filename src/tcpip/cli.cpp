@@ -8,7 +8,13 @@
 #include "layer2/layer2.h"
 #include "layer2/arp_table.h"
 #include "layer2/mac_table.h"
+#include "layer2/vlan_flood.h"
+#include "pcap.h"
 #include "utils.h"
+#include "phy.h"
+#include "pkt_pool.h"
+#include "prof.h"
+#include "trace.h"
 #include "cli.h"
 
 #define CLI_CMD_CODE_SHOW_TOPOLOGY 1
@@ -19,6 +25,22 @@
 #define CLI_CMD_CODE_CONFIG_NODE_ROUTE 5
 #define CLI_CMD_CODE_RUN_NODE_PING 6
 #define CLI_CMD_CODE_RUN_NODE_PING_ERO 7
+#define CLI_CMD_CODE_SHOW_PHY 8
+#define CLI_CMD_CODE_SHOW_NODE_LATENCY 9
+#define CLI_CMD_CODE_SHOW_NODE_INTF_STATS 10
+#define CLI_CMD_CODE_SHOW_NODE_INTF_STATS_JSON 11
+#define CLI_CMD_CODE_SHOW_NODE_DROPS 12
+#define CLI_CMD_CODE_SHOW_NODE_PROF 13
+#define CLI_CMD_CODE_CONFIG_PROF 14
+#define CLI_CMD_CODE_RUN_TRACE_ADD 15
+#define CLI_CMD_CODE_SHOW_TRACE 16
+#define CLI_CMD_CODE_CLEAR_TRACE 17
+#define CLI_CMD_CODE_RUN_NODE_CAPTURE_START 18
+#define CLI_CMD_CODE_RUN_NODE_CAPTURE_STOP 19
+#define CLI_CMD_CODE_SHOW_NODE_MAC_AGE 20
+#define CLI_CMD_CODE_CONFIG_NODE_MAC_AGING 21
+#define CLI_CMD_CODE_CONFIG_NODE_MAC_LIMIT 22
+#define CLI_CMD_CODE_SHOW_NODE_FLOOD 23
 
 static graph_t *__topology = nullptr;
 
@@ -29,7 +51,33 @@ int show_topology_callback_handler(param_t *p, ser_buff_t *tlvs, op_mode mode) {
     dump_line("No topology to show!\n");
     return -1; // TODO: return better error code
   }
+  // Hold every node's lock while dumping, under the graph lock so that nodes
+  // can't get added meanwhile. Receivers only ever hold a single node lock at
+  // a time (tx batches included, see `phy_tx_batch_flush()`) and never take
+  // the graph lock while holding one, so this can't deadlock.
+  graph_lock_guard_t guard(__topology);
+  glthread_t *curr = nullptr;
+  GLTHREAD_FOREACH_BEGIN(&__topology->node_list, curr) {
+    node_lock(node_ptr_from_graph_glue(curr));
+  } 
+  GLTHREAD_FOREACH_END();
   graph_dump(__topology);
+  GLTHREAD_FOREACH_BEGIN(&__topology->node_list, curr) {
+    node_unlock(node_ptr_from_graph_glue(curr));
+  } 
+  GLTHREAD_FOREACH_END();
+  return 0;
+}
+
+int show_phy_callback_handler(param_t *p, ser_buff_t *tlvs, op_mode mode) {
+  int code = EXTRACT_CMD_CODE(tlvs);
+  EXPECT_RETURN_VAL(code == CLI_CMD_CODE_SHOW_PHY, "Incorrect CMD code", -1);
+  dump_line("Phy stats\n");
+  dump_line("======================\n");
+  dump_line_indentation_guard_t guard;
+  dump_line_indentation_add(1);
+  phy_stats_dump();
+  pkt_pool_stats_dump(pkt_pool_default());
   return 0;
 }
 
@@ -60,18 +108,19 @@ int show_arp_callback_handler(param_t *p, ser_buff_t *tlvs, op_mode mode) {
   // Find node
   node_t *node = graph_find_node_by_name(__topology, node_name);
   EXPECT_RETURN_VAL(node != nullptr, "graph_find_node_by_name failed", -1);
+  node_lock_guard_t node_guard(node); // Keep the node's receiver out
   // Dump ARP table
   dump_line("ARP table for node: %s\n", node->node_name);
   dump_line("======================\n", node->node_name);
   dump_line_indentation_guard_t guard;
   dump_line_indentation_add(1);
-  arp_table_dump(node->netprop.arp_table);
+  arp_table_dump(node->netprop.arp_table, node);
   return 0;
 }
 
 int show_mac_callback_handler(param_t *p, ser_buff_t *tlvs, op_mode mode) {
   int code = EXTRACT_CMD_CODE(tlvs);
-  EXPECT_RETURN_VAL(code == CLI_CMD_CODE_SHOW_NODE_MAC, "Incorrect CMD code", -1);
+  EXPECT_RETURN_VAL(code == CLI_CMD_CODE_SHOW_NODE_MAC || code == CLI_CMD_CODE_SHOW_NODE_MAC_AGE, "Incorrect CMD code", -1);
   if (!__topology) {
     dump_line("No topology to show!\n");
     return -1; // TODO: return better error code
@@ -89,12 +138,15 @@ int show_mac_callback_handler(param_t *p, ser_buff_t *tlvs, op_mode mode) {
   // Find node
   node_t *node = graph_find_node_by_name(__topology, node_name);
   EXPECT_RETURN_VAL(node != nullptr, "graph_find_node_by_name failed", -1);
+  node_lock_guard_t node_guard(node); // Keep the node's receiver out
   // Dump MAC table
   dump_line("MAC table for node: %s\n", node->node_name);
   dump_line("======================\n", node->node_name);
   dump_line_indentation_guard_t guard;
   dump_line_indentation_add(1);
-  mac_table_dump(node->netprop.mac_table);
+  uint64_t now_ns = phy_node_clock_ns(node);
+  mac_table_age(node->netprop.mac_table, now_ns); // Don't show what's already aged out
+  mac_table_dump(node->netprop.mac_table, node, now_ns, code == CLI_CMD_CODE_SHOW_NODE_MAC_AGE);
   return 0;
 }
 
@@ -118,12 +170,234 @@ int show_rt_callback_handler(param_t *p, ser_buff_t *tlvs, op_mode mode) {
   // Find node
   node_t *node = graph_find_node_by_name(__topology, node_name);
   EXPECT_RETURN_VAL(node != nullptr, "graph_find_node_by_name failed", -1);
+  node_lock_guard_t node_guard(node); // Keep the node's receiver out
   // Dump MAC table
   dump_line("Routing Table for node: %s\n", node->node_name);
   dump_line("======================\n", node->node_name);
   dump_line_indentation_guard_t guard;
   dump_line_indentation_add(1);
-  rt_dump(node->netprop.r_table);
+  rt_dump(node->netprop.r_table, node);
+  return 0;
+}
+
+int show_flood_callback_handler(param_t *p, ser_buff_t *tlvs, op_mode mode) {
+  int code = EXTRACT_CMD_CODE(tlvs);
+  EXPECT_RETURN_VAL(code == CLI_CMD_CODE_SHOW_NODE_FLOOD, "Incorrect CMD code", -1);
+  if (!__topology) {
+    dump_line("No topology to show!\n");
+    return -1; // TODO: return better error code
+  }
+  // Parse out the node name
+  tlv_struct_t *tlv = nullptr;
+  char *node_name = nullptr; 
+  TLV_FOREACH_BEGIN(tlvs, tlv) {
+    if (strncmp(tlv->leaf_id, "node-name", strlen("node-name")) == 0) {
+      node_name = tlv->value;
+    }
+  } 
+  TLV_FOREACH_END();
+  EXPECT_RETURN_VAL(node_name != nullptr, "Couldn't parse node name", -1);
+  // Find node
+  node_t *node = graph_find_node_by_name(__topology, node_name);
+  EXPECT_RETURN_VAL(node != nullptr, "graph_find_node_by_name failed", -1);
+  node_lock_guard_t node_guard(node); // Keep the node's receiver out
+  // Dump VLAN flood lists
+  dump_line("VLAN flood lists for node: %s\n", node->node_name);
+  dump_line("==========================\n");
+  dump_line_indentation_guard_t guard;
+  dump_line_indentation_add(1);
+  vlan_flood_table_dump(node->netprop.flood_table, node);
+  return 0;
+}
+
+int show_latency_callback_handler(param_t *p, ser_buff_t *tlvs, op_mode mode) {
+  int code = EXTRACT_CMD_CODE(tlvs);
+  EXPECT_RETURN_VAL(code == CLI_CMD_CODE_SHOW_NODE_LATENCY, "Incorrect CMD code", -1);
+  if (!__topology) {
+    dump_line("No topology to show!\n");
+    return -1; // TODO: return better error code
+  }
+  // Parse out the node name
+  tlv_struct_t *tlv = nullptr;
+  char *node_name = nullptr; 
+  TLV_FOREACH_BEGIN(tlvs, tlv) {
+    if (strncmp(tlv->leaf_id, "node-name", strlen("node-name")) == 0) {
+      node_name = tlv->value;
+    }
+  } 
+  TLV_FOREACH_END();
+  EXPECT_RETURN_VAL(node_name != nullptr, "Couldn't parse node name", -1);
+  // Find node
+  node_t *node = graph_find_node_by_name(__topology, node_name);
+  EXPECT_RETURN_VAL(node != nullptr, "graph_find_node_by_name failed", -1);
+  node_lock_guard_t node_guard(node); // Keep the node's receiver out
+  // Dump every interface's histograms
+  dump_line("Latency for node: %s\n", node->node_name);
+  dump_line("======================\n", node->node_name);
+  dump_line_indentation_guard_t guard;
+  dump_line_indentation_add(1);
+  for (uint32_t i = 0; i < CONFIG_MAX_INTF_PER_NODE; i++) {
+    if (!node->intf[i]) { continue; }
+    phy_intf_latency_dump(node->intf[i]);
+  }
+  return 0;
+}
+
+int show_intf_stats_callback_handler(param_t *p, ser_buff_t *tlvs, op_mode mode) {
+  int code = EXTRACT_CMD_CODE(tlvs);
+  EXPECT_RETURN_VAL(
+    code == CLI_CMD_CODE_SHOW_NODE_INTF_STATS || code == CLI_CMD_CODE_SHOW_NODE_INTF_STATS_JSON,
+    "Incorrect CMD code", -1);
+  if (!__topology) {
+    dump_line("No topology to show!\n");
+    return -1; // TODO: return better error code
+  }
+  // Parse out the node name
+  tlv_struct_t *tlv = nullptr;
+  char *node_name = nullptr; 
+  TLV_FOREACH_BEGIN(tlvs, tlv) {
+    if (strncmp(tlv->leaf_id, "node-name", strlen("node-name")) == 0) {
+      node_name = tlv->value;
+    }
+  } 
+  TLV_FOREACH_END();
+  EXPECT_RETURN_VAL(node_name != nullptr, "Couldn't parse node name", -1);
+  // Find node
+  node_t *node = graph_find_node_by_name(__topology, node_name);
+  EXPECT_RETURN_VAL(node != nullptr, "graph_find_node_by_name failed", -1);
+  // Counters are read lock free
+  if (code == CLI_CMD_CODE_SHOW_NODE_INTF_STATS_JSON) {
+    node_stats_dump_json(node, stdout);
+    printf("\n");
+    return 0;
+  }
+  dump_line("Interface stats for node: %s\n", node->node_name);
+  dump_line("======================\n", node->node_name);
+  dump_line_indentation_guard_t guard;
+  dump_line_indentation_add(1);
+  for (uint32_t i = 0; i < CONFIG_MAX_INTF_PER_NODE; i++) {
+    if (!node->intf[i]) { continue; }
+    interface_stats_dump(node->intf[i]);
+  }
+  return 0;
+}
+
+int show_drops_callback_handler(param_t *p, ser_buff_t *tlvs, op_mode mode) {
+  int code = EXTRACT_CMD_CODE(tlvs);
+  EXPECT_RETURN_VAL(code == CLI_CMD_CODE_SHOW_NODE_DROPS, "Incorrect CMD code", -1);
+  if (!__topology) {
+    dump_line("No topology to show!\n");
+    return -1; // TODO: return better error code
+  }
+  // Parse out the node name
+  tlv_struct_t *tlv = nullptr;
+  char *node_name = nullptr; 
+  TLV_FOREACH_BEGIN(tlvs, tlv) {
+    if (strncmp(tlv->leaf_id, "node-name", strlen("node-name")) == 0) {
+      node_name = tlv->value;
+    }
+  } 
+  TLV_FOREACH_END();
+  EXPECT_RETURN_VAL(node_name != nullptr, "Couldn't parse node name", -1);
+  // Find node
+  node_t *node = graph_find_node_by_name(__topology, node_name);
+  EXPECT_RETURN_VAL(node != nullptr, "graph_find_node_by_name failed", -1);
+  // Counters are read lock free
+  dump_line("Drops for node: %s\n", node->node_name);
+  dump_line("======================\n", node->node_name);
+  dump_line_indentation_guard_t guard;
+  dump_line_indentation_add(1);
+  node_drops_dump(node);
+  return 0;
+}
+
+int show_prof_callback_handler(param_t *p, ser_buff_t *tlvs, op_mode mode) {
+  int code = EXTRACT_CMD_CODE(tlvs);
+  EXPECT_RETURN_VAL(code == CLI_CMD_CODE_SHOW_NODE_PROF, "Incorrect CMD code", -1);
+  if (!__topology) {
+    dump_line("No topology to show!\n");
+    return -1; // TODO: return better error code
+  }
+  // Parse out the node name
+  tlv_struct_t *tlv = nullptr;
+  char *node_name = nullptr; 
+  TLV_FOREACH_BEGIN(tlvs, tlv) {
+    if (strncmp(tlv->leaf_id, "node-name", strlen("node-name")) == 0) {
+      node_name = tlv->value;
+    }
+  } 
+  TLV_FOREACH_END();
+  EXPECT_RETURN_VAL(node_name != nullptr, "Couldn't parse node name", -1);
+  // Find node
+  node_t *node = graph_find_node_by_name(__topology, node_name);
+  EXPECT_RETURN_VAL(node != nullptr, "graph_find_node_by_name failed", -1);
+  node_lock_guard_t node_guard(node); // Keep the node's receiver out
+  dump_line("Stage latency for node: %s\n", node->node_name);
+  dump_line("======================\n", node->node_name);
+  dump_line_indentation_guard_t guard;
+  dump_line_indentation_add(1);
+  node_prof_dump(node);
+  return 0;
+}
+
+int config_prof_callback_handler(param_t *p, ser_buff_t *tlvs, op_mode mode) {
+  int code = EXTRACT_CMD_CODE(tlvs);
+  EXPECT_RETURN_VAL(code == CLI_CMD_CODE_CONFIG_PROF, "Incorrect CMD code", -1);
+  // `conf prof` turns stage profiling on, `no conf prof` off
+  prof_set_enabled(mode != CONFIG_DISABLE);
+  dump_line("Stage profiling %s\n", mode != CONFIG_DISABLE ? "enabled" : "disabled");
+  return 0;
+}
+
+int run_trace_add_callback_handler(param_t *p, ser_buff_t *tlvs, op_mode mode) {
+  int code = EXTRACT_CMD_CODE(tlvs);
+  EXPECT_RETURN_VAL(code == CLI_CMD_CODE_RUN_TRACE_ADD, "Incorrect CMD code", -1);
+  if (!__topology) {
+    dump_line("No topology to trace!\n");
+    return -1; // TODO: return better error code
+  }
+  // Parse out the node name and packet count
+  tlv_struct_t *tlv = nullptr;
+  char *node_name = nullptr; 
+  char *count_str = nullptr;
+  TLV_FOREACH_BEGIN(tlvs, tlv) {
+    if (strncmp(tlv->leaf_id, "node-name", strlen("node-name")) == 0) {
+      node_name = tlv->value;
+    }
+    else if (strncmp(tlv->leaf_id, "count", strlen("count")) == 0) {
+      count_str = tlv->value;
+    }
+  } 
+  TLV_FOREACH_END();
+  EXPECT_RETURN_VAL(node_name != nullptr, "Couldn't parse node name", -1);
+  EXPECT_RETURN_VAL(count_str != nullptr, "Couldn't parse packet count", -1);
+  uint32_t count = strtoul(count_str, nullptr, 10); // base 10
+  EXPECT_RETURN_VAL(count != 0, "strtoul failed", -1);
+  // Find node
+  node_t *node = graph_find_node_by_name(__topology, node_name);
+  EXPECT_RETURN_VAL(node != nullptr, "graph_find_node_by_name failed", -1);
+  node_lock_guard_t node_guard(node); // Keep the node's receiver out
+  trace_add(node, count);
+  dump_line("Tracing the next %u packet(s) on node: %s\n", node->trace_budget, node->node_name);
+  return 0;
+}
+
+int show_trace_callback_handler(param_t *p, ser_buff_t *tlvs, op_mode mode) {
+  int code = EXTRACT_CMD_CODE(tlvs);
+  EXPECT_RETURN_VAL(code == CLI_CMD_CODE_SHOW_TRACE, "Incorrect CMD code", -1);
+  // Records are read lock free
+  dump_line("Packet trace\n");
+  dump_line("======================\n");
+  dump_line_indentation_guard_t guard;
+  dump_line_indentation_add(1);
+  trace_dump();
+  return 0;
+}
+
+int clear_trace_callback_handler(param_t *p, ser_buff_t *tlvs, op_mode mode) {
+  int code = EXTRACT_CMD_CODE(tlvs);
+  EXPECT_RETURN_VAL(code == CLI_CMD_CODE_CLEAR_TRACE, "Incorrect CMD code", -1);
+  trace_clear();
   return 0;
 }
 
@@ -177,6 +451,7 @@ int config_node_route_callback_handler(param_t *p, ser_buff_t *tlvs, op_mode mod
   // Find node
   node_t *node = graph_find_node_by_name(__topology, node_name);
   EXPECT_RETURN_VAL(node != nullptr, "graph_find_node_by_name failed", -1);
+  node_lock_guard_t node_guard(node); // Keep the node's receiver out
   // Find interface
   interface_t *oif = node_get_interface_by_name(node, oif_name);
   EXPECT_RETURN_VAL(oif != nullptr, "node_get_interface_by_name failed", -1);
@@ -188,6 +463,49 @@ int config_node_route_callback_handler(param_t *p, ser_buff_t *tlvs, op_mode mod
   return 0;
 }
 
+int config_node_mac_callback_handler(param_t *p, ser_buff_t *tlvs, op_mode mode) {
+  int code = EXTRACT_CMD_CODE(tlvs);
+  EXPECT_RETURN_VAL(
+    code == CLI_CMD_CODE_CONFIG_NODE_MAC_AGING || code == CLI_CMD_CODE_CONFIG_NODE_MAC_LIMIT,
+    "Incorrect CMD code", -1);
+  if (!__topology) {
+    dump_line("No topology to config!\n");
+    return -1; // TODO: return better error code
+  }
+  // Parse out the node name and value
+  tlv_struct_t *tlv = nullptr;
+  char *node_name = nullptr; 
+  char *value_str = nullptr;
+  TLV_FOREACH_BEGIN(tlvs, tlv) {
+    if (strncmp(tlv->leaf_id, "node-name", strlen("node-name")) == 0) {
+      node_name = tlv->value;
+    }
+    else if (strncmp(tlv->leaf_id, "seconds", strlen("seconds")) == 0 ||
+             strncmp(tlv->leaf_id, "count", strlen("count")) == 0) {
+      value_str = tlv->value;
+    }
+  } 
+  TLV_FOREACH_END();
+  EXPECT_RETURN_VAL(node_name != nullptr, "Couldn't parse node name", -1);
+  EXPECT_RETURN_VAL(value_str != nullptr, "Couldn't parse value", -1);
+  uint32_t value = strtoul(value_str, nullptr, 10); // base 10
+  // Find node
+  node_t *node = graph_find_node_by_name(__topology, node_name);
+  EXPECT_RETURN_VAL(node != nullptr, "graph_find_node_by_name failed", -1);
+  node_lock_guard_t node_guard(node); // Keep the node's receiver out
+  if (code == CLI_CMD_CODE_CONFIG_NODE_MAC_AGING) {
+    // 0 turns aging off
+    mac_table_set_aging(node->netprop.mac_table, value * 1000000000ull);
+    dump_line("MAC aging time on node %s: %us\n", node->node_name, value);
+  }
+  else {
+    EXPECT_RETURN_VAL(value != 0, "strtoul failed", -1);
+    mac_table_set_max_entries(node->netprop.mac_table, value);
+    dump_line("MAC table limit on node %s: %u entries\n", node->node_name, value);
+  }
+  return 0;
+}
+
 int validate_ip_address(char *value) {
   ipv4_addr_t out;
   return ipv4_addr_try_parse(value, &out) ? VALIDATION_SUCCESS : VALIDATION_FAILED;
@@ -218,6 +536,7 @@ int run_node_resolve_arp_callback(param_t *p, ser_buff_t *tlvs, op_mode mode) {
   // Find node
   node_t *node = graph_find_node_by_name(__topology, node_name);
   EXPECT_RETURN_VAL(node != nullptr, "graph_find_node_by_name failed", -1);
+  node_lock_guard_t node_guard(node); // Keep the node's receiver out
   // Fine node interface that matches this subnet
   interface_t *ointf = nullptr;
   resp = node_get_interface_matching_subnet(node, &ip_addr, &ointf);
@@ -265,6 +584,7 @@ int run_node_ping_callback(param_t *p, ser_buff_t *tlvs, op_mode mode) {
   // Find node
   node_t *node = graph_find_node_by_name(__topology, node_name);
   EXPECT_RETURN_VAL(node != nullptr, "graph_find_node_by_name failed", -1);
+  node_lock_guard_t node_guard(node); // Keep the node's receiver out
   // Perform ping
   ipv4_addr_t *ero_addr_ptr = (ero_addr_str ? &ero_addr : nullptr);
   resp = layer5_perform_ping(node, &ip_addr, ero_addr_ptr);
@@ -272,6 +592,58 @@ int run_node_ping_callback(param_t *p, ser_buff_t *tlvs, op_mode mode) {
   return 0;
 }
 
+int run_node_capture_callback(param_t *p, ser_buff_t *tlvs, op_mode mode) {
+  int code = EXTRACT_CMD_CODE(tlvs);
+  EXPECT_RETURN_VAL(
+    code == CLI_CMD_CODE_RUN_NODE_CAPTURE_START || code == CLI_CMD_CODE_RUN_NODE_CAPTURE_STOP,
+    "Incorrect CMD code", -1
+  );
+  if (!__topology) {
+    dump_line("No topology to capture on!\n");
+    return -1; // TODO: return better error code
+  }
+  // Parse out the node name, interface name and file path
+  tlv_struct_t *tlv = nullptr;
+  char *node_name = nullptr; 
+  char *if_name = nullptr;
+  char *file_path = nullptr;
+  TLV_FOREACH_BEGIN(tlvs, tlv) {
+    if (strncmp(tlv->leaf_id, "node-name", strlen("node-name")) == 0) {
+      node_name = tlv->value;
+    }
+    else if (strncmp(tlv->leaf_id, "if-name", strlen("if-name")) == 0) {
+      if_name = tlv->value;
+    }
+    else if (strncmp(tlv->leaf_id, "file-path", strlen("file-path")) == 0) {
+      file_path = tlv->value;
+    }
+  } 
+  TLV_FOREACH_END();
+  EXPECT_RETURN_VAL(node_name != nullptr, "Couldn't parse node name", -1);
+  EXPECT_RETURN_VAL(if_name != nullptr, "Couldn't parse interface name", -1);
+  // Find node and interface
+  node_t *node = graph_find_node_by_name(__topology, node_name);
+  EXPECT_RETURN_VAL(node != nullptr, "graph_find_node_by_name failed", -1);
+  interface_t *intf = node_get_interface_by_name(node, if_name);
+  EXPECT_RETURN_VAL(intf != nullptr, "node_get_interface_by_name failed", -1);
+  // Start/stop (both take the node lock themselves)
+  if (code == CLI_CMD_CODE_RUN_NODE_CAPTURE_START) {
+    EXPECT_RETURN_VAL(file_path != nullptr, "Couldn't parse file path", -1);
+    bool resp = pcap_capture_start(intf, file_path);
+    EXPECT_RETURN_VAL(resp == true, "pcap_capture_start failed", -1);
+    dump_line("Capturing %s/%s to %s\n", node->node_name, intf->if_name, file_path);
+    return 0;
+  }
+  pcap_capture_stats_t stats;
+  bool resp = pcap_capture_stop(intf, &stats);
+  EXPECT_RETURN_VAL(resp == true, "pcap_capture_stop failed", -1);
+  dump_line(
+    "Captured %lu frames on %s/%s (%lu dropped, %lu truncated)\n", 
+    stats.frames, node->node_name, intf->if_name, stats.dropped, stats.truncated
+  );
+  return 0;
+}
+
 void cli_init() {
   // Initializes libcli
   init_libcli();
@@ -284,7 +656,21 @@ void cli_init() {
     libcli_register_param(show, &topology);
     set_param_cmd_code(&topology, CLI_CMD_CODE_SHOW_TOPOLOGY);
   }
-  // Setup `show node <...> arp | mac | rt`
+  // Setup `show phy`
+  {
+    static param_t phy;
+    init_param(&phy, CMD, "phy", show_phy_callback_handler, nullptr, INVALID, nullptr, "Help : phy");
+    libcli_register_param(show, &phy);
+    set_param_cmd_code(&phy, CLI_CMD_CODE_SHOW_PHY);
+  }
+  // Setup `show trace`
+  {
+    static param_t trace;
+    init_param(&trace, CMD, "trace", show_trace_callback_handler, nullptr, INVALID, nullptr, "Help : trace");
+    libcli_register_param(show, &trace);
+    set_param_cmd_code(&trace, CLI_CMD_CODE_SHOW_TRACE);
+  }
+  // Setup `show node <...> arp | mac [age] | rt | latency | interface stats [json] | drops | prof`
   {
     static param_t node;
     init_param(&node, CMD, "node", nullptr, nullptr, INVALID, nullptr, "Help : node");
@@ -304,6 +690,12 @@ void cli_init() {
         init_param(&mac, CMD, "mac", show_mac_callback_handler, nullptr, INVALID, nullptr, "Help : mac");
         libcli_register_param(&node_name, &mac);
         set_param_cmd_code(&mac, CLI_CMD_CODE_SHOW_NODE_MAC);
+        {
+          static param_t age;
+          init_param(&age, CMD, "age", show_mac_callback_handler, nullptr, INVALID, nullptr, "Help : age");
+          libcli_register_param(&mac, &age);
+          set_param_cmd_code(&age, CLI_CMD_CODE_SHOW_NODE_MAC_AGE);
+        }
       }
       {
         static param_t rt;
@@ -311,10 +703,51 @@ void cli_init() {
         libcli_register_param(&node_name, &rt);
         set_param_cmd_code(&rt, CLI_CMD_CODE_SHOW_NODE_RT);
       }
+      {
+        static param_t flood;
+        init_param(&flood, CMD, "flood", show_flood_callback_handler, nullptr, INVALID, nullptr, "Help : flood");
+        libcli_register_param(&node_name, &flood);
+        set_param_cmd_code(&flood, CLI_CMD_CODE_SHOW_NODE_FLOOD);
+      }
+      {
+        static param_t latency;
+        init_param(&latency, CMD, "latency", show_latency_callback_handler, nullptr, INVALID, nullptr, "Help : latency");
+        libcli_register_param(&node_name, &latency);
+        set_param_cmd_code(&latency, CLI_CMD_CODE_SHOW_NODE_LATENCY);
+      }
+      {
+        static param_t prof;
+        init_param(&prof, CMD, "prof", show_prof_callback_handler, nullptr, INVALID, nullptr, "Help : prof");
+        libcli_register_param(&node_name, &prof);
+        set_param_cmd_code(&prof, CLI_CMD_CODE_SHOW_NODE_PROF);
+      }
+      {
+        static param_t drops;
+        init_param(&drops, CMD, "drops", show_drops_callback_handler, nullptr, INVALID, nullptr, "Help : drops");
+        libcli_register_param(&node_name, &drops);
+        set_param_cmd_code(&drops, CLI_CMD_CODE_SHOW_NODE_DROPS);
+      }
+      {
+        static param_t interface;
+        init_param(&interface, CMD, "interface", nullptr, nullptr, INVALID, nullptr, "Help : interface");
+        libcli_register_param(&node_name, &interface);
+        {
+          static param_t stats;
+          init_param(&stats, CMD, "stats", show_intf_stats_callback_handler, nullptr, INVALID, nullptr, "Help : stats");
+          libcli_register_param(&interface, &stats);
+          set_param_cmd_code(&stats, CLI_CMD_CODE_SHOW_NODE_INTF_STATS);
+          {
+            static param_t json;
+            init_param(&json, CMD, "json", show_intf_stats_callback_handler, nullptr, INVALID, nullptr, "Help : json");
+            libcli_register_param(&stats, &json);
+            set_param_cmd_code(&json, CLI_CMD_CODE_SHOW_NODE_INTF_STATS_JSON);
+          }
+        }
+      }
     }
   }
   param_t *run = libcli_get_run_hook();
-  // Setup `run node <node-name> resolve-arp <ip-address>`
+  // Setup `run node <node-name> resolve-arp <ip-address> | capture <if-name> start <file-path> | capture <if-name> stop | ping ...`
   {
     static param_t node;
     init_param(&node, CMD, "node", nullptr, nullptr, INVALID, nullptr, "Help : node");
@@ -335,6 +768,34 @@ void cli_init() {
           set_param_cmd_code(&ip_address, CLI_CMD_CODE_RUN_NODE_RESOLVE_ARP);
         }
       }
+      // capture
+      {
+        static param_t capture;
+        init_param(&capture, CMD, "capture", nullptr, nullptr, INVALID, nullptr, "Help : capture");
+        libcli_register_param(&node_name, &capture);
+        {
+          static param_t if_name;
+          init_param(&if_name, LEAF, nullptr, nullptr, nullptr, STRING, "if-name", "Help : Interface name");
+          libcli_register_param(&capture, &if_name);
+          {
+            static param_t start;
+            init_param(&start, CMD, "start", nullptr, nullptr, INVALID, nullptr, "Help : start");
+            libcli_register_param(&if_name, &start);
+            {
+              static param_t file_path;
+              init_param(&file_path, LEAF, nullptr, run_node_capture_callback, nullptr, STRING, "file-path", "Help : Capture file (.pcap, pcapng otherwise)");
+              libcli_register_param(&start, &file_path);
+              set_param_cmd_code(&file_path, CLI_CMD_CODE_RUN_NODE_CAPTURE_START);
+            }
+          }
+          {
+            static param_t stop;
+            init_param(&stop, CMD, "stop", run_node_capture_callback, nullptr, INVALID, nullptr, "Help : stop");
+            libcli_register_param(&if_name, &stop);
+            set_param_cmd_code(&stop, CLI_CMD_CODE_RUN_NODE_CAPTURE_STOP);
+          }
+        }
+      }
       // ping
       {
         static param_t ping;
@@ -360,8 +821,45 @@ void cli_init() {
       }
     }
   }
+  // Setup `run trace add <node-name> <count>`
+  {
+    static param_t trace;
+    init_param(&trace, CMD, "trace", nullptr, nullptr, INVALID, nullptr, "Help : trace");
+    libcli_register_param(run, &trace);
+    {
+      static param_t add;
+      init_param(&add, CMD, "add", nullptr, nullptr, INVALID, nullptr, "Help : add");
+      libcli_register_param(&trace, &add);
+      {
+        static param_t node_name;
+        init_param(&node_name, LEAF, nullptr, nullptr, validate_node_name, STRING, "node-name", "Help : Node name");
+        libcli_register_param(&add, &node_name);
+        {
+          static param_t count;
+          init_param(&count, LEAF, nullptr, run_trace_add_callback_handler, nullptr, INT, "count", "Help : Number of packets to trace");
+          libcli_register_param(&node_name, &count);
+          set_param_cmd_code(&count, CLI_CMD_CODE_RUN_TRACE_ADD);
+        }
+      }
+    }
+  }
+  param_t *clear = libcli_get_clear_hook();
+  // Setup `clear trace`
+  {
+    static param_t trace;
+    init_param(&trace, CMD, "trace", clear_trace_callback_handler, nullptr, INVALID, nullptr, "Help : trace");
+    libcli_register_param(clear, &trace);
+    set_param_cmd_code(&trace, CLI_CMD_CODE_CLEAR_TRACE);
+  }
   param_t *config = libcli_get_config_hook();
-  // Setup `config node <node-name> route <dest> <mask> <gw-ip> <oif-name>`
+  // Setup `config prof` (stage profiling, `no config prof` turns it off)
+  {
+    static param_t prof;
+    init_param(&prof, CMD, "prof", config_prof_callback_handler, nullptr, INVALID, nullptr, "Help : prof");
+    libcli_register_param(config, &prof);
+    set_param_cmd_code(&prof, CLI_CMD_CODE_CONFIG_PROF);
+  }
+  // Setup `config node <node-name> route <dest> <mask> <gw-ip> <oif-name> | mac aging <seconds> | mac limit <count>`
   {
     static param_t node;
     init_param(&node, CMD, "node", nullptr, nullptr, INVALID, nullptr, "Help : node");
@@ -370,6 +868,33 @@ void cli_init() {
       static param_t node_name;
       init_param(&node_name, LEAF, nullptr, nullptr, validate_node_name, STRING, "node-name", "Help : Node name");
       libcli_register_param(&node, &node_name);
+      {
+        static param_t mac;
+        init_param(&mac, CMD, "mac", nullptr, nullptr, INVALID, nullptr, "Help : mac");
+        libcli_register_param(&node_name, &mac);
+        {
+          static param_t aging;
+          init_param(&aging, CMD, "aging", nullptr, nullptr, INVALID, nullptr, "Help : aging");
+          libcli_register_param(&mac, &aging);
+          {
+            static param_t seconds;
+            init_param(&seconds, LEAF, nullptr, config_node_mac_callback_handler, nullptr, INT, "seconds", "Help : Aging time (s), 0 to never age");
+            libcli_register_param(&aging, &seconds);
+            set_param_cmd_code(&seconds, CLI_CMD_CODE_CONFIG_NODE_MAC_AGING);
+          }
+        }
+        {
+          static param_t limit;
+          init_param(&limit, CMD, "limit", nullptr, nullptr, INVALID, nullptr, "Help : limit");
+          libcli_register_param(&mac, &limit);
+          {
+            static param_t count;
+            init_param(&count, LEAF, nullptr, config_node_mac_callback_handler, nullptr, INT, "count", "Help : Maximum number of entries");
+            libcli_register_param(&limit, &count);
+            set_param_cmd_code(&count, CLI_CMD_CODE_CONFIG_NODE_MAC_LIMIT);
+          }
+        }
+      }
       {
         static param_t route;
         init_param(&route, CMD, "route", nullptr, nullptr, INVALID, nullptr, "Help : route");
@@ -13,6 +13,55 @@
 
 #define CONFIG_MAX_PACKET_BUFFER_SIZE   2048
 
-// net.h related
+// pkt_buf.h related
 
-#define CONFIG_MAX_VLAN_PER_INTF 16
+#define CONFIG_PKT_BUF_HEADROOM 128
+#define CONFIG_PKT_BUF_PRIV_SIZE 128
+#define CONFIG_PKT_BUF_MAX_SEGS 8
+#define CONFIG_PKT_POOL_SIZE 4096
+#define CONFIG_PKT_POOL_CACHE_SIZE 64
+#define CONFIG_PKT_POOL_MAX_CACHE_SIZE 256
+#define CONFIG_PKT_POOL_MAX_POOLS 16
+
+// phy.h related
+
+#define CONFIG_MAX_PHY_RECEIVER_THREADS 64
+#define CONFIG_PHY_MAX_BURST 64
+#define CONFIG_PHY_DEFAULT_BURST 32
+#define CONFIG_PHY_TX_BATCH_SIZE 128
+#define CONFIG_PHY_RING_SIZE 256
+#define CONFIG_PHY_URING_SQ_ENTRIES 1024
+#define CONFIG_PHY_URING_CQ_ENTRIES 8192
+#define CONFIG_PHY_URING_RX_BUFFERS 512
+#define CONFIG_PHY_URING_TX_BUFFERS 256
+#define CONFIG_PHY_SIM_NS_PER_COST 1000
+#define CONFIG_PHY_SIM_POOL_SIZE 16384
+#define CONFIG_PHY_SHARED_NODE_CHUNK_SIZE 1024
+#define CONFIG_PHY_DEFAULT_SPIN_BUDGET 1000
+#define CONFIG_PHY_SHARED_MAX_NODE_CHUNKS 1024
+
+// hist.h related
+
+#define CONFIG_HIST_MAX_BITS 40       // Samples past 2^40 ns (~18 minutes) share the last bucket
+#define CONFIG_HIST_SUB_BUCKET_BITS 3 // 8 linear sub-buckets per power of 2 (<= 12.5% error)
+
+// trace.h related
+
+#define CONFIG_TRACE_RING_SIZE 4096
+
+// pcap.h related
+
+#define CONFIG_PCAP_CAPTURE_RING_SIZE 1024
+#define CONFIG_PCAP_CAPTURE_BUFFER_SIZE (1 << 20)
+#define CONFIG_PCAP_CAPTURE_FLUSH_MS 100
+
+// timer_wheel.h related
+
+#define CONFIG_TIMER_WHEEL_LEVELS 4
+#define CONFIG_TIMER_WHEEL_SLOT_BITS 6
+
+// mac_table.h related
+
+#define CONFIG_MAC_TABLE_MAX_ENTRIES 8192
+#define CONFIG_MAC_TABLE_AGING_SEC 300
+#define CONFIG_MAC_TABLE_AGING_TICK_MS 1000
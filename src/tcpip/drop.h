@@ -0,0 +1,60 @@
+// drop.h
+
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Why a node dropped a frame. Every drop site bumps its node's counter for
+ * the reason (see `node_count_drop()` in `graph.h`), so finding where traffic
+ * dies is a matter of `show node <node-name> drops`. Counters are indexed by
+ * reason, strings only come into play when dumping.
+ */
+
+#define DROP_REASONS(X) \
+  X(DROP_NONE,                  "none") \
+  X(DROP_PHY_BAD_HDR,           "phy: invalid phy header") \
+  X(DROP_PHY_UNKNOWN_INTF,      "phy: unknown interface index") \
+  X(DROP_PHY_RING_FULL,         "phy: tx ring full") \
+  X(DROP_PHY_SIM_POOL,          "phy: simulator pool exhausted") \
+  X(DROP_PHY_TX_FAILED,         "phy: send failed") \
+  X(DROP_POOL_EXHAUSTED,        "pool: no packet buffer available") \
+  X(DROP_L2_RUNT,               "l2: runt frame") \
+  X(DROP_L2_L3_TAGGED,          "l2: tagged frame on L3 interface") \
+  X(DROP_L2_L3_MAC_MISMATCH,    "l2: dst MAC not ours (L3 interface)") \
+  X(DROP_L2_NO_VLAN,            "l2: interface has no VLAN") \
+  X(DROP_L2_ACCESS_FOREIGN_VLAN,"l2: foreign VLAN tag on ACCESS interface") \
+  X(DROP_L2_TRUNK_UNTAGGED,     "l2: untagged frame on TRUNK interface") \
+  X(DROP_L2_TRUNK_FOREIGN_VLAN, "l2: foreign VLAN tag on TRUNK interface") \
+  X(DROP_L2_INTF_DOWN,          "l2: interface not in a functional mode") \
+  X(DROP_L2_SVI_MAC_MISMATCH,   "l2: dst MAC not ours (SVI)") \
+  X(DROP_L2_SVI_INGRESS,        "l2: frame received on an SVI") \
+  X(DROP_L2_UNKNOWN_ETHERTYPE,  "l2: unknown ether type") \
+  X(DROP_L2_TX_L3_INTF,         "l2: switched frame to L3 interface") \
+  X(DROP_L2_TX_UNTAGGED,        "l2: switched frame untagged") \
+  X(DROP_L2_TX_FOREIGN_VLAN,    "l2: switched frame to foreign VLAN") \
+  X(DROP_L2_NO_SUBNET,          "l2: next hop not in a connected subnet") \
+  X(DROP_ARP_UNKNOWN_OP,        "arp: unknown op code") \
+  X(DROP_ARP_NOT_FOR_US,        "arp: request for someone else's address") \
+  X(DROP_L3_NOT_IPV4,           "l3: not IPv4") \
+  X(DROP_L3_RUNT,               "l3: runt packet") \
+  X(DROP_L3_TRUNCATED,          "l3: truncated packet") \
+  X(DROP_L3_NO_ROUTE,           "l3: no route") \
+  X(DROP_L3_TTL_EXPIRED,        "l3: TTL expired") \
+  X(DROP_L3_BAD_ROUTE,          "l3: route with unusable oif")
+
+enum drop_reason_t {
+#define X(NAME, STR) NAME,
+  DROP_REASONS(X)
+#undef X
+  DROP_REASON_COUNT
+};
+
+static inline const char* drop_reason_str(drop_reason_t reason) {
+  switch (reason) {
+#define X(NAME, STR) case NAME: return STR;
+    DROP_REASONS(X)
+#undef X
+    default: return "unknown";
+  }
+}
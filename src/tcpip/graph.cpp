@@ -1,5 +1,6 @@
 // graph.cpp
 #include "graph.h"
+#include "phy_sim.h"
 #include "utils.h"
 #include "net.h"
 #include "phy.h"
@@ -42,12 +43,42 @@ void interface_dump(interface_t *interface) {
   }
 }
 
+// Counters in `interface_stats_t` order (shared by the text and JSON dumps)
+#define INTERFACE_STATS_FIELDS(X) \
+  X(rx_frames) X(rx_bytes) X(rx_drops) \
+  X(tx_frames) X(tx_bytes) X(tx_drops) \
+  X(flooded) \
+  X(arp_req_rx) X(arp_req_tx) X(arp_reply_rx) X(arp_reply_tx)
+
+void interface_stats_dump(interface_t *interface) {
+  if (!interface) { return; }
+  interface_stats_t *s = &interface->stats;
+  dump_line("%s:\n", interface->if_name);
+  dump_line_indentation_guard_t guard;
+  dump_line_indentation_add(1);
+  dump_line("RX: %lu frames, %lu bytes, %lu drops\n", s->rx_frames.load(), s->rx_bytes.load(), s->rx_drops.load());
+  dump_line("TX: %lu frames, %lu bytes, %lu drops\n", s->tx_frames.load(), s->tx_bytes.load(), s->tx_drops.load());
+  dump_line("Flooded: %lu frames\n", s->flooded.load());
+  dump_line("ARP: %lu/%lu requests (rx/tx), %lu/%lu replies (rx/tx)\n",
+    s->arp_req_rx.load(), s->arp_req_tx.load(), s->arp_reply_rx.load(), s->arp_reply_tx.load());
+}
+
+void interface_stats_reset(interface_t *interface) {
+  if (!interface) { return; }
+#define X(FIELD) interface->stats.FIELD.store(0, std::memory_order_relaxed);
+  INTERFACE_STATS_FIELDS(X)
+#undef X
+}
+
 #pragma mark -
 
 static inline bool next_mac_str(char *resp) {
-  static int counter = 1;
-  EXPECT_RETURN_BOOL(counter < 256, "Too many calls (>255) to next_mac", false);
-  snprintf(resp, 18, "aa:bb:cc:dd:ee:%02x", counter++);
+  // The lower 3 bytes act as a 24-bit counter. We start at dd:ee:01 so that
+  // the first 255 addresses remain aa:bb:cc:dd:ee:01 and onwards.
+  static uint32_t counter = 0xDDEE01;
+  EXPECT_RETURN_BOOL(counter <= 0xFFFFFF, "Too many calls to next_mac", false);
+  snprintf(resp, 18, "aa:bb:cc:%02x:%02x:%02x", (counter >> 16) & 0xFF, (counter >> 8) & 0xFF, counter & 0xFF);
+  counter++;
   return true;
 }
 
@@ -80,11 +111,14 @@ void link_nodes(node_t *n1, node_t *n2, const char *name1, const char *name2, ui
   // Fill out the cost
   new_link->cost = cost;
   // Find and populate an empty interface in n1
-  int slot_index = node_get_usable_interface_index(n1);
-  n1->intf[slot_index] = &new_link->intf1;
+  status = node_attach_interface(n1, &new_link->intf1);
+  EXPECT_RETURN(status == true, "node_attach_interface n1 failed");
   // Find and populate an empty interface in n2
-  slot_index = node_get_usable_interface_index(n2);
-  n2->intf[slot_index] = &new_link->intf2;
+  status = node_attach_interface(n2, &new_link->intf2);
+  EXPECT_RETURN(status == true, "node_attach_interface n2 failed");
+  // Setup the link's transport (one channel per direction)
+  status = phy_link_init(new_link);
+  EXPECT_RETURN(status == true, "phy_link_init failed");
 }
 
 bool link_get_other_interface(link_t *l, interface_t *intf, interface_t **otherptr) {
@@ -122,6 +156,18 @@ int node_get_usable_interface_index(node_t *node) {
   return -1;
 }
 
+bool node_attach_interface(node_t *node, interface_t *intf) {
+  EXPECT_RETURN_BOOL(node != nullptr, "Empty node param", false);
+  EXPECT_RETURN_BOOL(intf != nullptr, "Empty interface param", false);
+  int slot_index = node_get_usable_interface_index(node);
+  EXPECT_RETURN_BOOL(slot_index >= 0, "No usable interface slot", false);
+  node->intf[slot_index] = intf;
+  intf->ifindex = slot_index;
+  // Memberships set up before attaching start flooding now
+  interface_join_vlan_flood_lists(intf);
+  return true;
+}
+
 interface_t* node_get_interface_by_name(node_t *node, const char *if_name) {
   if (!node || !if_name) { return NULL; }
   for (int i = 0; i < CONFIG_MAX_INTF_PER_NODE; i++) {
@@ -134,6 +180,16 @@ interface_t* node_get_interface_by_name(node_t *node, const char *if_name) {
   return NULL; // Not found
 }
 
+void node_lock(node_t *node) {
+  EXPECT_RETURN(node != nullptr, "Empty node param");
+  pthread_mutex_lock(&node->phy.lock);
+}
+
+void node_unlock(node_t *node) {
+  EXPECT_RETURN(node != nullptr, "Empty node param");
+  pthread_mutex_unlock(&node->phy.lock);
+}
+
 void node_dump(node_t *node) {
   if (!node) { return; }
   dump_line_indentation_guard_t guard0;
@@ -155,6 +211,43 @@ void node_dump(node_t *node) {
   }
 }
 
+void node_stats_dump_json(node_t *node, FILE *out) {
+  EXPECT_RETURN(node != nullptr, "Empty node param");
+  EXPECT_RETURN(out != nullptr, "Empty file param");
+  fprintf(out, "{\"node\":\"%s\",\"interfaces\":[", node->node_name);
+  bool first = true;
+  for (int i = 0; i < CONFIG_MAX_INTF_PER_NODE; i++) {
+    if (!node->intf[i]) { continue; }
+    interface_t *intf = node->intf[i];
+    fprintf(out, "%s{\"name\":\"%s\",\"ifindex\":%u", first ? "" : ",", intf->if_name, intf->ifindex);
+#define X(FIELD) fprintf(out, ",\"" #FIELD "\":%lu", intf->stats.FIELD.load(std::memory_order_relaxed));
+    INTERFACE_STATS_FIELDS(X)
+#undef X
+    fprintf(out, "}");
+    first = false;
+  }
+  fprintf(out, "]}");
+}
+
+void node_drops_dump(node_t *node) {
+  EXPECT_RETURN(node != nullptr, "Empty node param");
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < DROP_REASON_COUNT; i++) {
+    uint64_t count = node->drops[i].load(std::memory_order_relaxed);
+    if (count == 0) { continue; }
+    dump_line("%-44s: %lu\n", drop_reason_str((drop_reason_t)i), count);
+    total += count;
+  }
+  dump_line("%-44s: %lu\n", "total", total);
+}
+
+void node_drops_reset(node_t *node) {
+  EXPECT_RETURN(node != nullptr, "Empty node param");
+  for (uint32_t i = 0; i < DROP_REASON_COUNT; i++) {
+    node->drops[i].store(0, std::memory_order_relaxed);
+  }
+}
+
 #pragma mark -
 
 // Graph
@@ -167,10 +260,32 @@ graph_t* graph_init(const char *topology_name) {
   COPY_STRING_TO(resp->topology_name, topology_name, CONFIG_GRAPH_NAME_SIZE);
   // Initialize node_list
   glthread_init(&resp->node_list);
+  pthread_mutex_init(&resp->lock, nullptr);
+  // Transport (as per the current default)
+  resp->phy.transport = phy_get_default_transport();
+  if (resp->phy.transport == PHY_TRANSPORT_SIM) {
+    resp->phy.sim = phy_sim_create();
+  }
+  if (resp->phy.transport == PHY_TRANSPORT_UDP_SHARED) {
+    resp->phy.shared = phy_shared_create();
+    EXPECT_RETURN_VAL(resp->phy.shared != nullptr, "phy_shared_create failed", nullptr);
+  }
+  // Single receiver thread unless told otherwise
+  resp->phy.thread_count = 1;
   // And, we're done.
   return resp;
 }
 
+void graph_lock(graph_t *graph) {
+  EXPECT_RETURN(graph != nullptr, "Empty graph param");
+  pthread_mutex_lock(&graph->lock);
+}
+
+void graph_unlock(graph_t *graph) {
+  EXPECT_RETURN(graph != nullptr, "Empty graph param");
+  pthread_mutex_unlock(&graph->lock);
+}
+
 void graph_dump(graph_t *graph) {
   dump_line("Topology name: %s\n", graph->topology_name);
   dump_line_indentation_guard_t guard0;
@@ -194,16 +309,45 @@ node_t *graph_add_node(graph_t *graph, const char *node_name) {
   COPY_STRING_TO(resp->node_name, node_name, CONFIG_NODE_NAME_SIZE);
   // Initialize thread
   glthread_init(&resp->graph_glue);
-  glthread_add_next(&graph->node_list, &resp->graph_glue);
   // Initialize network properties
   node_netprop_init(&resp->netprop);
-  // Start udp socket
-  bool status = phy_setup_udp_socket(&resp->udp.port, &resp->udp.fd);
-  EXPECT_RETURN_VAL(status == true, "node_setup_udp_socket failed", nullptr);
+  // Initialize phy properties
+  pthread_mutex_init(&resp->phy.lock, nullptr);
+  resp->phy.sim = graph->phy.sim;
+  resp->phy.shared = graph->phy.shared;
+  {
+    // Receivers walk node_list as they start up, so only publish the node
+    // once its transport is up (udp socket, ring doorbell or nothing at all)
+    graph_lock_guard_t guard(graph);
+    resp->phy.id = graph->phy.node_count++;
+    bool status = phy_node_init(resp, graph->phy.transport);
+    EXPECT_RETURN_VAL(status == true, "phy_node_init failed", nullptr);
+    glthread_add_next(&graph->node_list, &resp->graph_glue);
+  }
+  // Let the receiver know (if it is already running). Either it sees the
+  // node on its walk, or we see its published epoll instance / shard here.
+  bool status = phy_receiver_register_node(graph, resp);
+  EXPECT_RETURN_VAL(status == true, "phy_receiver_register_node failed", nullptr);
   return resp;
 }
 
+void graph_stats_dump_json(graph_t *g, FILE *out) {
+  EXPECT_RETURN(g != nullptr, "Empty graph param");
+  EXPECT_RETURN(out != nullptr, "Empty file param");
+  graph_lock_guard_t guard(g);
+  fprintf(out, "{\"topology\":\"%s\",\"nodes\":[", g->topology_name);
+  bool first = true;
+  glthread_t *curr = NULL;
+  GLTHREAD_FOREACH_BEGIN(&g->node_list, curr) {
+    if (!first) { fprintf(out, ","); }
+    node_stats_dump_json(node_ptr_from_graph_glue(curr), out);
+    first = false;
+  } GLTHREAD_FOREACH_END();
+  fprintf(out, "]}\n");
+}
+
 node_t* graph_find_node_by_name(graph_t *g, const char *node_name) {
+  graph_lock_guard_t guard(g);
   glthread_t *curr = NULL;
   GLTHREAD_FOREACH_BEGIN(&g->node_list, curr) {
     node_t *curr_node = node_ptr_from_graph_glue(curr);
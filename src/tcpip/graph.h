@@ -2,12 +2,16 @@
 
 #pragma once
 
+#include <atomic>
 #include <cmath>
+#include <pthread.h>
 #include <cstring>
 #include <iostream>
 #include "glthread.h"
 #include "net.h"
 #include "config.h"
+#include "phy_ring.h"
+#include "drop.h"
 
 // Forward declarations
 
@@ -15,20 +19,63 @@ typedef struct node_t node_t;
 typedef struct link_t link_t;
 typedef struct graph_t graph_t;
 typedef struct interface_t interface_t;
+typedef struct node_prof_t node_prof_t;
+typedef struct pcap_capture_t pcap_capture_t;
 
 #pragma mark -
 
 // Interface
 
+/*
+ * Traffic counters. Only ever written with the interface's node lock held
+ * (i.e. a single writer at a time), so bumping one is a plain relaxed load
+ * and store, no atomic read-modify-write. Readers don't need the lock.
+ */
+typedef struct interface_stats_t {
+  std::atomic<uint64_t> rx_frames;
+  std::atomic<uint64_t> rx_bytes;
+  std::atomic<uint64_t> rx_drops;     // Not qualified, or nothing to do with them
+  std::atomic<uint64_t> tx_frames;
+  std::atomic<uint64_t> tx_bytes;
+  std::atomic<uint64_t> tx_drops;     // Rejected by the transport
+  std::atomic<uint64_t> flooded;      // Received frames flooded to the other ports
+  std::atomic<uint64_t> arp_req_rx;
+  std::atomic<uint64_t> arp_req_tx;
+  std::atomic<uint64_t> arp_reply_rx;
+  std::atomic<uint64_t> arp_reply_tx;
+} interface_stats_t;
+
 struct interface_t {
   char if_name[CONFIG_IF_NAME_SIZE];
-  struct node_t *att_node;
+  uint16_t ifindex;   // Slot in the attached node's `intf` array. Never changes (tables store it)
+  struct node_t *att_node = nullptr;
   struct link_t *link;
   interface_netprop_t netprop;
+  struct {
+    int fd;   // Send socket, connected to the neighbor node's udp port
+  } udp;
+  struct {
+    phy_ring_t *tx;   // Frames to the neighbor (its interface's rx ring)
+    phy_ring_t *rx;   // Frames from the neighbor
+  } ring;
+  phy_intf_latency_t *latency; // Allocated on first sample (see `phy.h`)
+  interface_stats_t stats;
+  pcap_capture_t *capture;     // Set while capturing, under the node lock (see `pcap.h`)
 };
 
+#define INTF_STATS_INC(INTFPTR, FIELD) stats_counter_add(&(INTFPTR)->stats.FIELD, 1)
+#define INTF_STATS_ADD(INTFPTR, FIELD, N) stats_counter_add(&(INTFPTR)->stats.FIELD, (N))
+#define INTF_STATS_SUB(INTFPTR, FIELD, N) stats_counter_add(&(INTFPTR)->stats.FIELD, -(uint64_t)(N))
+
 node_t* interface_get_neighbor_node(interface_t *interface);
 void interface_dump(interface_t *interface);
+void interface_stats_dump(interface_t *interface);
+void interface_stats_reset(interface_t *interface); // Call with the node lock held
+
+// Call with the counter's node lock held
+static inline void stats_counter_add(std::atomic<uint64_t> *counter, uint64_t n) {
+  counter->store(counter->load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
 
 #pragma mark -
 
@@ -46,7 +93,7 @@ struct vlan_t {
 struct link_t {
   interface_t intf1;
   interface_t intf2;
-  unsigned int cost; /* unused */
+  unsigned int cost; /* Latency under PHY_TRANSPORT_SIM (x CONFIG_PHY_SIM_NS_PER_COST) */
 };
 
 void link_nodes(node_t *n0, node_t *n1, const char *name0, const char *name1, uint32_t cost);
@@ -64,6 +111,19 @@ struct node_t {
     uint32_t port;
     int fd;
   } udp;
+  struct {
+    uint32_t id;            // Unique within the graph, used to pick a receiver shard
+    pthread_mutex_t lock;   // Serializes frame processing and CLI access
+    phy_transport_t transport;
+    int doorbell_fd;        // eventfd, rung when frames land in an idle node's rings
+    std::atomic<bool> idle; // Set while the receiver has nothing left to drain
+    bool rx_armed;          // io_uring multishot recv in flight (receiver thread only)
+    phy_sim_t *sim;         // The graph's simulator (PHY_TRANSPORT_SIM only)
+    phy_shared_t *shared;   // The graph's sockets (PHY_TRANSPORT_UDP_SHARED only)
+  } phy;
+  std::atomic<uint64_t> drops[DROP_REASON_COUNT]; // Per reason, same rules as `interface_stats_t`
+  node_prof_t *prof;      // Stage histograms, allocated on first sample (see `prof.h`)
+  uint32_t trace_budget;  // Packets left to mark for tracing (see `trace.h`)
   glthread_t graph_glue;
 };
 
@@ -75,7 +135,38 @@ DEFINE_GLTHREAD_TO_STRUCT_FUNC(
 
 int node_get_usable_interface_index(node_t *node);
 interface_t* node_get_interface_by_name(node_t *node, const char *if_name);
+bool node_attach_interface(node_t *node, interface_t *intf); // Takes the first usable slot, sets `ifindex`
 void node_dump(node_t *node);
+void node_stats_dump_json(node_t *node, FILE *out); // One object, with every interface's counters. Lock free
+void node_drops_dump(node_t *node); // Lock free
+void node_drops_reset(node_t *node); // Call with the node lock held
+void node_lock(node_t *node);
+void node_unlock(node_t *node);
+
+// Call with the node lock held
+static inline void node_count_drop(node_t *node, drop_reason_t reason) {
+  stats_counter_add(&node->drops[reason], 1);
+}
+
+struct node_lock_guard_t {
+  node_t *node;
+  node_lock_guard_t(node_t *n) : node(n) {
+    node_lock(node);
+  }
+  virtual ~node_lock_guard_t() {
+    node_unlock(node);
+  }
+};
+
+static inline interface_t* node_get_interface_by_index(node_t *node, uint16_t ifindex) {
+  return ifindex < CONFIG_MAX_INTF_PER_NODE ? node->intf[ifindex] : nullptr;
+}
+
+// For dumps
+static inline const char* node_get_interface_name_by_index(node_t *node, uint16_t ifindex) {
+  interface_t *intf = node_get_interface_by_index(node, ifindex);
+  return intf ? intf->if_name : "-";
+}
 
 #define NODE_LO_ADDR(NODEPTR) &((NODEPTR)->netprop.loopback.addr)
 #define NODE_NETSTACK(NODEPTR) ((NODEPTR)->netprop.netstack)
@@ -86,12 +177,36 @@ void node_dump(node_t *node);
 
 struct graph_t {
   char topology_name[CONFIG_GRAPH_NAME_SIZE];
-  glthread_t node_list;
+  glthread_t node_list;     // Nodes are only linked in once fully set up, see `graph_add_node()`
+  pthread_mutex_t lock;     // Serializes adding nodes against walks that may run concurrently (receivers)
+  struct {
+    uint32_t node_count;      // Number of node ids handed out so far
+    phy_transport_t transport;
+    uint32_t thread_count;    // Number of receiver threads (shards)
+    std::atomic<int> epoll_fd[CONFIG_MAX_PHY_RECEIVER_THREADS]; // Set once each receiver is running
+    std::atomic<phy_uring_shard_t *> uring[CONFIG_MAX_PHY_RECEIVER_THREADS]; // Same, for PHY_TRANSPORT_URING
+    std::atomic<uint32_t> ready_count;
+    phy_sim_t *sim;           // PHY_TRANSPORT_SIM only
+    phy_shared_t *shared;     // PHY_TRANSPORT_UDP_SHARED only
+  } phy;
 };
 
 graph_t* graph_init(const char *topology_name);
 void graph_dump(graph_t *graph);
-node_t *graph_add_node(graph_t *graph, const char *node_name);
-node_t* graph_find_node_by_name(graph_t *g, const char *node_name);
+node_t *graph_add_node(graph_t *graph, const char *node_name); // Thread safe, even with receivers running
+node_t* graph_find_node_by_name(graph_t *g, const char *node_name); // Takes the graph lock
+void graph_stats_dump_json(graph_t *g, FILE *out); // Every node's `node_stats_dump_json()`, one line. Takes the graph lock, not node locks
+void graph_lock(graph_t *graph);
+void graph_unlock(graph_t *graph);
+
+struct graph_lock_guard_t {
+  graph_t *graph;
+  graph_lock_guard_t(graph_t *g) : graph(g) {
+    graph_lock(graph);
+  }
+  virtual ~graph_lock_guard_t() {
+    graph_unlock(graph);
+  }
+};
 
 
@@ -0,0 +1,87 @@
+// hist.cpp
+
+#include <algorithm>
+#include "hist.h"
+#include "utils.h"
+
+#define HIST_DUMP_BAR_WIDTH 40
+
+#pragma mark -
+
+// Private utility functions
+
+// Bucket bounds, in us
+static inline double hist_bucket_lower_us(uint32_t bucket) {
+  return (double)hist_bucket_lower(bucket) / 1000.0;
+}
+
+static inline double hist_bucket_upper_us(uint32_t bucket) {
+  return (double)hist_bucket_upper(bucket) / 1000.0;
+}
+
+#pragma mark -
+
+// Public functions
+
+void hist_init(hist_t *h) {
+  hist_reset(h);
+}
+
+void hist_reset(hist_t *h) {
+  EXPECT_RETURN(h != nullptr, "Empty histogram param");
+  for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+    h->buckets[i].store(0, std::memory_order_relaxed);
+  }
+  h->sum.store(0, std::memory_order_relaxed);
+}
+
+uint64_t hist_count(const hist_t *h) {
+  EXPECT_RETURN_VAL(h != nullptr, "Empty histogram param", 0);
+  uint64_t count = 0;
+  for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+    count += h->buckets[i].load(std::memory_order_relaxed);
+  }
+  return count;
+}
+
+uint64_t hist_percentile(const hist_t *h, double p) {
+  EXPECT_RETURN_VAL(h != nullptr, "Empty histogram param", 0);
+  EXPECT_RETURN_VAL(p >= 0.0 && p <= 100.0, "Invalid percentile param", 0);
+  uint64_t count = hist_count(h);
+  if (count == 0) { return 0; }
+  // Rank of the sample we're after (1-based)
+  uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(p / 100.0 * count));
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+    seen += h->buckets[i].load(std::memory_order_relaxed);
+    if (seen >= rank) { return hist_bucket_upper(i); }
+  }
+  return hist_bucket_upper(HIST_BUCKETS - 1);
+}
+
+void hist_dump(const hist_t *h, const char *label) {
+  EXPECT_RETURN(h != nullptr, "Empty histogram param");
+  uint64_t count = hist_count(h);
+  if (count == 0) {
+    dump_line("%s: no samples\n", label);
+    return;
+  }
+  double avg_us = (double)h->sum.load(std::memory_order_relaxed) / count / 1000.0;
+  dump_line("%s: %lu samples, avg %.2f us, p50 < %.2f us, p99 < %.2f us\n", label, count, avg_us,
+    hist_percentile(h, 50) / 1000.0, hist_percentile(h, 99) / 1000.0);
+  dump_line_indentation_guard_t guard;
+  dump_line_indentation_add(1);
+  uint64_t max = 0;
+  for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+    max = std::max(max, h->buckets[i].load(std::memory_order_relaxed));
+  }
+  for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+    uint64_t n = h->buckets[i].load(std::memory_order_relaxed);
+    if (n == 0) { continue; }
+    char bar[HIST_DUMP_BAR_WIDTH + 1];
+    uint32_t width = std::max<uint32_t>(1, (uint32_t)(n * HIST_DUMP_BAR_WIDTH / max));
+    memset(bar, '#', width);
+    bar[width] = '\0';
+    dump_line("[%10.3f, %10.3f) us : %10lu %s\n", hist_bucket_lower_us(i), hist_bucket_upper_us(i), n, bar);
+  }
+}
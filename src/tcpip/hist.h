@@ -0,0 +1,56 @@
+// hist.h
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "config.h"
+
+/*
+ * Log-linear (HDR-style) latency histogram. Every power of 2 range of ns,
+ * [2^m, 2^(m+1)), is split into `HIST_SUB_BUCKETS` equally wide buckets, so a
+ * bucket is never wider than 1/`HIST_SUB_BUCKETS` of its lower bound. Values
+ * below `HIST_SUB_BUCKETS` get a bucket each, everything past
+ * 2^`CONFIG_HIST_MAX_BITS` ends up in the last one. Recording is a couple of
+ * relaxed atomic adds, so any thread may record while others read (reads are
+ * consistent per bucket, not across buckets).
+ */
+
+#define HIST_SUB_BUCKETS (1u << CONFIG_HIST_SUB_BUCKET_BITS)
+#define HIST_BUCKETS ((CONFIG_HIST_MAX_BITS - CONFIG_HIST_SUB_BUCKET_BITS + 1) * HIST_SUB_BUCKETS)
+
+typedef struct hist_t {
+  std::atomic<uint64_t> buckets[HIST_BUCKETS];
+  std::atomic<uint64_t> sum;  // ns
+} hist_t;
+
+void hist_init(hist_t *h);
+void hist_reset(hist_t *h);
+uint64_t hist_count(const hist_t *h);
+uint64_t hist_percentile(const hist_t *h, double p); // Upper bound (ns) of the bucket the p-th percentile (0..100) falls in
+void hist_dump(const hist_t *h, const char *label);
+
+static inline uint32_t hist_bucket(uint64_t ns) {
+  if (ns < HIST_SUB_BUCKETS) { return (uint32_t)ns; }
+  // Power of 2 range, then the linear sub-bucket within it (the bits below
+  // the leading one)
+  uint32_t msb = 63 - __builtin_clzll(ns);
+  uint32_t shift = msb - CONFIG_HIST_SUB_BUCKET_BITS;
+  uint64_t bucket = (uint64_t)(shift + 1) * HIST_SUB_BUCKETS + ((ns >> shift) - HIST_SUB_BUCKETS);
+  return bucket < HIST_BUCKETS ? (uint32_t)bucket : HIST_BUCKETS - 1;
+}
+
+static inline uint64_t hist_bucket_lower(uint32_t bucket) {
+  if (bucket < HIST_SUB_BUCKETS) { return bucket; }
+  uint32_t shift = bucket / HIST_SUB_BUCKETS - 1;
+  return (uint64_t)(HIST_SUB_BUCKETS + bucket % HIST_SUB_BUCKETS) << shift;
+}
+
+static inline uint64_t hist_bucket_upper(uint32_t bucket) {
+  return bucket + 1 < HIST_BUCKETS ? hist_bucket_lower(bucket + 1) : 1ull << CONFIG_HIST_MAX_BITS;
+}
+
+static inline void hist_record(hist_t *h, uint64_t ns) {
+  h->buckets[hist_bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+  h->sum.fetch_add(ns, std::memory_order_relaxed);
+}
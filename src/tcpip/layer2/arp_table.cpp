@@ -6,6 +6,8 @@
 #include "arp_table.h"
 #include "layer2.h"
 #include "phy.h"
+#include "pkt_pool.h"
+#include "prof.h"
 
 // ARP table
 
@@ -24,14 +26,16 @@ bool arp_table_process_reply(arp_table_t *t, arp_hdr_t *hdr, interface_t *intf)
   // Fil out entry with new new info in the reply
   arp_entry->mac_addr = arp_hdr_read_src_mac(hdr);
   glthread_t *curr = nullptr;
-  strncpy((char *)arp_entry->oif_name, (char *)intf->if_name, CONFIG_IF_NAME_SIZE);
+  arp_entry->oif_ifindex = intf->ifindex;
   //printf("[%s] arp_table_process_reply got for intf: %s\n", intf->att_node->node_name, intf->if_name);
   // Process all pending lookups
   GLTHREAD_FOREACH_BEGIN(&arp_entry->aod.pending_lookups, curr) {
     arp_lookup_t *lookup = arp_lookup_ptr_from_arp_entry_glue(curr);
     lookup->cb(arp_entry, lookup);
     glthread_remove(&lookup->arp_entry_glue);
-    free(lookup);
+    pkt_buf_t *pkt = lookup->pkt;
+    lookup->~arp_lookup_t();
+    pkt_buf_destroy(pkt);
   }
   GLTHREAD_FOREACH_END();
   arp_entry->aod.is_resolved = true;
@@ -134,29 +138,41 @@ bool arp_table_clear(arp_table_t *t) {
   return true; // All entries deleted
 }
 
-void arp_table_dump(arp_table_t *t) {
+void arp_table_dump(arp_table_t *t, node_t *n) {
   EXPECT_RETURN(t != nullptr, "Empty table param");
+  EXPECT_RETURN(n != nullptr, "Empty node param");
   glthread_t *curr = nullptr;
   GLTHREAD_FOREACH_BEGIN(&t->arp_entries, curr) {
     arp_entry_t *entry = arp_entry_ptr_from_arp_table_glue(curr); 
     dump_line(
       "IP: " IPV4_ADDR_FMT ", Resolved?: %s, MAC: " MAC_ADDR_FMT ", OIF: %s\n",
       IPV4_ADDR_BYTES_BE(entry->ip_addr), (entry->aod.is_resolved ? "true" : "false"),
-      MAC_ADDR_BYTES_BE(entry->mac_addr), entry->oif_name
+      MAC_ADDR_BYTES_BE(entry->mac_addr), node_get_interface_name_by_index(n, entry->oif_ifindex)
     );
   }
   GLTHREAD_FOREACH_END();
 }
 
-bool arp_entry_add_pending_lookup(arp_entry_t *e, uint8_t *pay, uint32_t paylen, arp_lookup_processing_fn cb, uint16_t vlan_id) {
+bool arp_entry_add_pending_lookup(arp_entry_t *e, pkt_buf_t *pkt, arp_lookup_processing_fn cb, uint16_t vlan_id) {
+  static_assert(sizeof(arp_lookup_t) <= CONFIG_PKT_BUF_PRIV_SIZE, "arp_lookup_t doesn't fit the private area");
   EXPECT_RETURN_BOOL(e != nullptr, "Empty entry param", false);
-  EXPECT_RETURN_BOOL(pay != nullptr, "Empty payload ptr param", false);
-  uint32_t lookuplen = paylen + sizeof(arp_lookup_t);
-  auto lookup = (arp_lookup_t *)calloc(1, lookuplen);
+  EXPECT_RETURN_BOOL(pkt != nullptr, "Empty packet buffer param", false);
+  // Keep a copy of the packet (with headroom, so that headers can be pushed
+  // once resolved). The lookup itself lives in the copy's private area.
+  pkt_buf_t *copy = pkt_pool_alloc(pkt_pool_default());
+  EXPECT_RETURN_BOOL(copy != nullptr, "pkt_pool_alloc failed", false);
+  uint8_t *data = pkt_buf_append(copy, pkt->data_len);
+  if (!data || copy->priv_size < sizeof(arp_lookup_t)) {
+    pkt_buf_destroy(copy);
+    ERR_RETURN_BOOL("Packet doesn't fit a pooled buffer", false);
+  }
+  memcpy(data, PKT_BUF_MTOD(pkt, uint8_t *), pkt->data_len);
+  copy->trace_id = pkt->trace_id; // Still the same packet
+  auto lookup = new (pkt_buf_priv(copy)) arp_lookup_t();
   lookup->cb = cb;
-  lookup->bufflen = paylen;
   lookup->vlan_id = vlan_id;
-  memcpy((uint8_t *)(lookup + 1), pay, paylen);
+  lookup->pkt = copy;
+  lookup->queued = prof_begin();
   glthread_init(&lookup->arp_entry_glue);
   glthread_add_next(&e->aod.pending_lookups, &lookup->arp_entry_glue);
   return true;
@@ -7,11 +7,13 @@
 #include "utils.h"
 #include "config.h"
 #include "arp_hdr.h"
+#include "pkt_buf.h"
 
 typedef struct arp_entry_t arp_entry_t;
 typedef struct arp_table_t arp_table_t;
 typedef struct arp_lookup_t arp_lookup_t;
 typedef struct interface_t interface_t;
+typedef struct node_t node_t;
 
 #pragma mark -
 
@@ -24,7 +26,7 @@ struct arp_table_t {
 struct arp_entry_t {
   ipv4_addr_t ip_addr;
   mac_addr_t mac_addr;
-  char oif_name[CONFIG_IF_NAME_SIZE];
+  uint16_t oif_ifindex;
   glthread_t arp_table_glue;
   // ARP on Demand
   struct {
@@ -41,7 +43,7 @@ DEFINE_GLTHREAD_TO_STRUCT_FUNC(
 
 #define ARP_ENTRY_PTR_KEYS_ARE_EQUAL(ARP0, ARP1) \
   ((ARP0)->ip_addr.value == (ARP1)->ip_addr.value) && \
-  (strncmp((char *)(ARP0)->oif_name, (char *)(ARP1)->oif_name, CONFIG_IF_NAME_SIZE) == 0)
+  ((ARP0)->oif_ifindex == (ARP1)->oif_ifindex)
 
 #define ARP_ENTRY_PTRS_ARE_EQUAL(ARP0, ARP1) \
   ARP_ENTRY_PTR_KEYS_ARE_EQUAL(ARP0, ARP1) && \
@@ -55,7 +57,7 @@ bool arp_table_add_entry(arp_table_t *t, arp_entry_t *entry);
 bool arp_table_add_unresolved_entry(arp_table_t *t, ipv4_addr_t *addr, arp_entry_t **entry);
 bool arp_table_delete_entry(arp_table_t *t, ipv4_addr_t *ip_addr);
 bool arp_table_clear(arp_table_t *t);
-void arp_table_dump(arp_table_t *t);
+void arp_table_dump(arp_table_t *t, node_t *n); // Interface names come from `n`
 bool arp_table_process_reply(arp_table_t *t, arp_hdr_t *hdr, interface_t *intf);
 
 #pragma mark -
@@ -76,8 +78,9 @@ using arp_lookup_processing_fn = std::function<void(arp_entry_t*,arp_lookup_t*)>
 struct arp_lookup_t {
   glthread_t arp_entry_glue;
   arp_lookup_processing_fn cb;
-  uint32_t bufflen;
   uint16_t vlan_id; // VLAN ID for tagging trunk frames (0 = no VLAN)
+  pkt_buf_t *pkt;   // Pooled copy of the layer 3 packet (the lookup lives in its private area)
+  uint64_t queued;  // `prof_begin()` when parked (0 unless profiling)
 };
 
 DEFINE_GLTHREAD_TO_STRUCT_FUNC(
@@ -86,5 +89,5 @@ DEFINE_GLTHREAD_TO_STRUCT_FUNC(
   arp_entry_glue                        // glthread_t field in arp_lookup_t
 );
 
-bool arp_entry_add_pending_lookup(arp_entry_t *e, uint8_t *pay, uint32_t paylen, arp_lookup_processing_fn cb, uint16_t vlan_id);
+bool arp_entry_add_pending_lookup(arp_entry_t *e, pkt_buf_t *pkt, arp_lookup_processing_fn cb, uint16_t vlan_id);
 
@@ -5,6 +5,7 @@
 #include <functional>
 #include <arpa/inet.h>
 #include "utils.h"
+#include "pkt_buf.h"
 
 typedef struct node_t node_t;
 typedef struct interface_t interface_t;
@@ -15,14 +16,20 @@ typedef struct arp_entry_t arp_entry_t;
 
 // Layer 2 processing
 
-using layer2_promote_fn_t = std::function<int(node_t*,interface_t*,ether_hdr_t*,uint32_t)>;
-using layer2_demote_fn_t = std::function<void(node_t*,ipv4_addr_t*,interface_t*,uint8_t*,uint32_t,uint16_t)>;
+/*
+ * Promote takes a frame (data starts at the Ethernet header), demote takes the
+ * layer 3 packet and pushes the Ethernet header into the buffer's headroom.
+ */
+using layer2_promote_fn_t = std::function<int(node_t*,interface_t*,pkt_buf_t*)>;
+using layer2_demote_fn_t = std::function<void(node_t*,ipv4_addr_t*,interface_t*,pkt_buf_t*,uint16_t)>;
 
-int layer2_promote(node_t *n, interface_t *iintf, ether_hdr_t *ether_hdr, uint32_t framelen);
-void layer2_demote(node_t *n, ipv4_addr_t *nxt_hop_addr, interface_t *ointf, uint8_t *payload, uint32_t paylen, uint16_t ethertype);
+int layer2_promote(node_t *n, interface_t *iintf, pkt_buf_t *pkt);
+void layer2_demote(node_t *n, ipv4_addr_t *nxt_hop_addr, interface_t *ointf, pkt_buf_t *pkt, uint16_t ethertype);
 
 bool layer2_qualify_recv_frame_on_interface(interface_t *intf, ether_hdr_t *ethhdr, uint16_t *vlan_id);
-int layer2_node_recv_frame_bytes(node_t *n, interface_t *intf, uint8_t *frame, uint32_t framelen);
+int layer2_node_recv_frame(node_t *n, interface_t *intf, pkt_buf_t *pkt);
+int layer2_node_recv_frame_bytes(node_t *n, interface_t *intf, uint8_t *frame, uint32_t framelen); // Copies the frame
+int layer2_node_send_frame(node_t *n, interface_t *intf, pkt_buf_t *pkt); // Exit point, hands the frame to phy
 
 #pragma mark -
 
@@ -39,11 +46,13 @@ bool node_arp_send_reply_frame(node_t *n, interface_t *ointf, ether_hdr_t *in_et
 
 ether_hdr_t* ether_hdr_tag_vlan(ether_hdr_t *hdr, uint32_t len, uint16_t vlanid, uint32_t *newlen);
 ether_hdr_t* ether_hdr_untag_vlan(ether_hdr_t *hdr, uint32_t len, uint32_t *newlen);
+bool ether_frame_tag_vlan(pkt_buf_t *pkt, uint16_t vlanid);  // In place, uses 4 bytes of headroom
+bool ether_frame_untag_vlan(pkt_buf_t *pkt);                 // In place
 
 #pragma mark -
 
 // L2 switch
 
-int layer2_switch_recv_frame_bytes(node_t *n, interface_t *intf, uint8_t *frame, uint32_t framelen);
-void layer2_send_with_resolved_arp(node_t *n, arp_entry_t *entry, ether_hdr_t *hdr, uint32_t framelen, uint16_t ethertype, uint16_t vlan_id);
+int layer2_switch_recv_frame(node_t *n, interface_t *intf, pkt_buf_t *pkt);
+void layer2_send_with_resolved_arp(node_t *n, arp_entry_t *entry, pkt_buf_t *pkt, uint16_t ethertype, uint16_t vlan_id);
 
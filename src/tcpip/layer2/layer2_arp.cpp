@@ -3,15 +3,20 @@
 #include "layer2.h"
 #include "arp_table.h"
 #include "arp_hdr.h"
+#include "vlan_flood.h"
 #include "net.h"
 #include "graph.h"
 #include "ether_hdr.h"
 #include "vlan_tag.h"
+#include "pkt_pool.h"
 
-void layer2_send_with_resolved_arp(node_t *n, arp_entry_t *entry, ether_hdr_t *hdr, uint32_t framelen, uint16_t ethertype, uint16_t vlan_id) {
+void layer2_send_with_resolved_arp(node_t *n, arp_entry_t *entry, pkt_buf_t *pkt, uint16_t ethertype, uint16_t vlan_id) {
   // Get outgoing interface
-  interface_t *ointf = node_get_interface_by_name(n, entry->oif_name);
-  EXPECT_RETURN(ointf != nullptr, "node_get_interface_by_name failed");
+  interface_t *ointf = node_get_interface_by_index(n, entry->oif_ifindex);
+  EXPECT_RETURN(ointf != nullptr, "node_get_interface_by_index failed");
+  // Push the ethernet header
+  ether_hdr_t *hdr = (ether_hdr_t *)pkt_buf_prepend(pkt, sizeof(ether_hdr_t));
+  EXPECT_RETURN(hdr != nullptr, "pkt_buf_prepend failed");
   // Set ethernet header fields
   mac_addr_t *dst_mac = &entry->mac_addr;
   EXPECT_RETURN(dst_mac != nullptr, "Missing dst mac");
@@ -21,17 +26,13 @@ void layer2_send_with_resolved_arp(node_t *n, arp_entry_t *entry, ether_hdr_t *h
   ether_hdr_set_dst_mac(hdr, dst_mac);
   ether_hdr_set_type(hdr, ethertype);
   // Tag frame if sending over trunk interface
-  uint8_t *frame = (uint8_t *)hdr;
-  uint32_t actual_framelen = framelen;
   if (INTF_MODE(ointf) == INTF_MODE_L2_TRUNK && vlan_id != 0) {
-    // Need to tag the frame
-    ether_hdr_t *tagged_hdr = ether_hdr_tag_vlan(hdr, framelen, vlan_id, &actual_framelen);
-    EXPECT_RETURN(tagged_hdr != nullptr, "ether_hdr_tag_vlan failed");
-    frame = (uint8_t *)tagged_hdr;
+    bool resp = ether_frame_tag_vlan(pkt, vlan_id);
+    EXPECT_RETURN(resp == true, "ether_frame_tag_vlan failed");
   }
   // Send off the packet
-  int sentlen = NODE_NETSTACK(n).phy.send(n, ointf, frame, actual_framelen);
-  EXPECT_RETURN(sentlen == actual_framelen, "NODE_NETSTACK(n).phy.send failed");
+  int sentlen = layer2_node_send_frame(n, ointf, pkt);
+  EXPECT_RETURN(sentlen == (int)pkt->data_len, "layer2_node_send_frame failed");
 }
 
 #pragma mark -
@@ -51,7 +52,10 @@ bool node_arp_send_broadcast_request(node_t *n, interface_t *intf, ipv4_addr_t *
   }
   // Allocate Ethernet frame wide enough to fit the ARP header
   uint32_t framelen = sizeof(ether_hdr_t) + sizeof(arp_hdr_t);
-  ether_hdr_t *ether_hdr = (ether_hdr_t *)calloc(1, framelen + sizeof(vlan_tag_t)); // Extra room for possible tag
+  pkt_buf_t *pkt = pkt_pool_alloc(pkt_pool_default());
+  EXPECT_RETURN_BOOL(pkt != nullptr, "pkt_pool_alloc failed", false);
+  ether_hdr_t *ether_hdr = (ether_hdr_t *)pkt_buf_append(pkt, framelen + sizeof(vlan_tag_t)); // Extra room for possible tag
+  memset(ether_hdr, 0, framelen + sizeof(vlan_tag_t));
   // Send function (with SVIs, we will need to forward frames via multiple interfaces in the VLAN)
   auto send_fn = [&, intf](interface_t *ointf, uint16_t vlan_id) -> bool {
     // Fill out Ethernet header fields
@@ -89,28 +93,34 @@ bool node_arp_send_broadcast_request(node_t *n, interface_t *intf, ipv4_addr_t *
     arp_hdr_set_dst_mac(arp_hdr, MAC_ADDR_PTR_ZEROED);
     arp_hdr_set_dst_ip(arp_hdr, ip_addr->value); // <- The IPv4 address for which we want to know the MAC address
     // Pass frame to layer 1
-    int resp = NODE_NETSTACK(n).phy.send(n, ointf, (uint8_t *)ether_hdr, actual_framelen);
-    EXPECT_RETURN_BOOL((uint32_t)resp == actual_framelen, "NODE_NETSTACK(n).phy.send failed", false);
+    pkt->data_len = actual_framelen;
+    int resp = layer2_node_send_frame(n, ointf, pkt);
+    EXPECT_RETURN_BOOL((uint32_t)resp == actual_framelen, "layer2_node_send_frame failed", false);
+    INTF_STATS_INC(ointf, arp_req_tx);
     return true;
   };
   if (INTF_MODE(intf) == INTF_MODE_L3_SVI) {
-    for (int i = 0; i < CONFIG_MAX_INTF_PER_NODE; i++) {
-      if (!n->intf[i]) { continue; }
-      interface_t *candidate = n->intf[i];
-      if (candidate == intf) { continue; } // Ignore self
-      uint16_t vlan_id = INTF_NETPROP(intf).l2.vlan_memberships[0];
-      if (!interface_test_vlan_membership(candidate, vlan_id)) { continue; } // Not in VLAN
-      if (!INTF_IN_L2_MODE(candidate)) { continue; }
-      if (INTF_MODE(candidate) == INTF_MODE_L3_SVI) { continue; } // This isn't possible, still, just for sanity
+    // Every port flooding the SVI's VLAN, but SVIs (self included)
+    uint16_t vlan_id = INTF_NETPROP(intf).l2.port_vlan;
+    const vlan_flood_list_t *flood = vlan_flood_lookup(n->netprop.flood_table, vlan_id);
+    for (uint32_t i = 0; flood && i < flood->count; i++) {
+      if (flood->port[i].action == VLAN_FLOOD_PROMOTE) { continue; }
+      interface_t *candidate = n->intf[flood->port[i].ifindex];
       bool resp = send_fn(candidate, vlan_id);
-      EXPECT_RETURN_BOOL(resp == true, "senf_fn failed", false);
+      if (!resp) {
+        pkt_buf_destroy(pkt);
+        ERR_RETURN_BOOL("senf_fn failed", false);
+      }
     }
   }
   else {
     bool resp = send_fn(intf, 0);
-    EXPECT_RETURN_BOOL(resp == true, "senf_fn failed", false);
+    if (!resp) {
+      pkt_buf_destroy(pkt);
+      ERR_RETURN_BOOL("senf_fn failed", false);
+    }
   }
-  free(ether_hdr);
+  pkt_buf_destroy(pkt);
   return true;
 }
 
@@ -128,7 +138,9 @@ bool node_arp_recv_broadcast_request_frame(node_t *n, interface_t *iintf, ether_
   LOG_DEBUG("[%s] ARP broadcast request ignored (%s)\n", n->node_name, iintf->if_name);
   // Ignore packet
   // Note, this is not strictly an error, which is why we return a true return value.
-  return true; // TODO: Add log / counter to record dropped frame statistics
+  INTF_STATS_INC(iintf, rx_drops);
+  node_count_drop(n, DROP_ARP_NOT_FOR_US);
+  return true;
 }
 
 bool node_arp_send_reply_frame(node_t *n, interface_t *ointf, ether_hdr_t *in_ether_hdr) {
@@ -138,7 +150,10 @@ bool node_arp_send_reply_frame(node_t *n, interface_t *ointf, ether_hdr_t *in_et
   arp_hdr_t *in_arp_hdr = (arp_hdr_t *)(in_ether_hdr + 1);
   // Allocate frame
   uint32_t out_framelen = sizeof(ether_hdr_t) + sizeof(arp_hdr_t);
-  ether_hdr_t *out_ether_hdr = (ether_hdr_t *)calloc(1, out_framelen);
+  pkt_buf_t *pkt = pkt_pool_alloc(pkt_pool_default());
+  EXPECT_RETURN_BOOL(pkt != nullptr, "pkt_pool_alloc failed", false);
+  ether_hdr_t *out_ether_hdr = (ether_hdr_t *)pkt_buf_append(pkt, out_framelen);
+  memset(out_ether_hdr, 0, out_framelen);
   // Fill up Ethernet header fields (note: be mindful of host/net. byte order)
   mac_addr_t in_src_mac = ether_hdr_read_src_mac(in_ether_hdr);
   ether_hdr_set_dst_mac(out_ether_hdr, &in_src_mac);
@@ -157,16 +172,13 @@ bool node_arp_send_reply_frame(node_t *n, interface_t *ointf, ether_hdr_t *in_et
   arp_hdr_set_src_mac(out_arp_hdr, INTF_MAC_PTR(ointf));
   arp_hdr_set_src_ip(out_arp_hdr, INTF_IP_PTR(ointf)->value);
   // Send out packet
-  if (INTF_MODE(ointf) == INTF_MODE_L3_SVI && INTF_NETPROP(ointf).delegate != nullptr) {
-    // If the outgoing interface is a logical SVI, then we need to reply using its delegate interface
-    int resp = NODE_NETSTACK(n).phy.send(n, INTF_NETPROP(ointf).delegate, (uint8_t *)out_ether_hdr, out_framelen);
-    EXPECT_RETURN_BOOL(resp == (int)out_framelen, "NODE_NETSTACK(n).phy.send failed", false);
-  }
-  else {
-    int resp = NODE_NETSTACK(n).phy.send(n, ointf, (uint8_t *)out_ether_hdr, out_framelen);
-    EXPECT_RETURN_BOOL(resp == (int)out_framelen, "NODE_NETSTACK(n).phy.send failed", false);
-  }
-  free(out_ether_hdr);
+  // If the outgoing interface is a logical SVI, then we need to reply using its delegate interface
+  bool via_delegate = INTF_MODE(ointf) == INTF_MODE_L3_SVI && INTF_NETPROP(ointf).delegate != nullptr;
+  interface_t *tx_intf = via_delegate ? INTF_NETPROP(ointf).delegate : ointf;
+  int resp = layer2_node_send_frame(n, tx_intf, pkt);
+  pkt_buf_destroy(pkt);
+  EXPECT_RETURN_BOOL(resp == (int)out_framelen, "layer2_node_send_frame failed", false);
+  INTF_STATS_INC(tx_intf, arp_reply_tx);
   return true;
 }
 
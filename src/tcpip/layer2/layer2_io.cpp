@@ -10,78 +10,103 @@
 #include "mac_table.h"
 #include "phy.h"
 #include "pcap.h"
+#include "prof.h"
+#include "trace.h"
+
+// Forward declarations
+
+static drop_reason_t layer2_recv_frame_verdict(interface_t *intf, ether_hdr_t *ethhdr, uint16_t *vlan_id);
 
 #pragma mark -
 
 // Ingress
 
-int layer2_node_recv_frame_bytes(node_t *n, interface_t *intf, uint8_t *frame, uint32_t framelen) {
+int layer2_node_recv_frame(node_t *n, interface_t *intf, pkt_buf_t *pkt) {
   // Entry point into our TCP/IP stack
   EXPECT_RETURN_VAL(n != nullptr, "Empty node param", -1);
   EXPECT_RETURN_VAL(intf != nullptr, "Empty interface param", -1);
-  EXPECT_RETURN_VAL(frame != nullptr, "Empty frame ptr param", -1);
+  EXPECT_RETURN_VAL(pkt != nullptr, "Empty packet buffer param", -1);
+  prof_stage_guard_t prof(n, PROF_STAGE_L2_RX);
+  trace_mark(n, pkt);
+  pcap_capture_frame(intf, pkt, PCAP_CAPTURE_IN);
+  uint32_t framelen = pkt->data_len;
+  INTF_STATS_INC(intf, rx_frames);
+  INTF_STATS_ADD(intf, rx_bytes, framelen);
+  if (framelen < sizeof(ether_hdr_t)) {
+    INTF_STATS_INC(intf, rx_drops);
+    node_count_drop(n, DROP_L2_RUNT);
+    trace_pkt_drop(n, intf, pkt, PROF_STAGE_L2_RX, DROP_L2_RUNT);
+    return -1;
+  }
   // First check if we should even consider this frame
-  ether_hdr_t *ether_hdr = (ether_hdr_t *)frame;
-  uint16_t vlan_id = 0; // <- Overwritten by qualify fn below
-  if (!layer2_qualify_recv_frame_on_interface(intf, ether_hdr, &vlan_id)) {
+  ether_hdr_t *ether_hdr = PKT_BUF_MTOD(pkt, ether_hdr_t *);
+  uint16_t vlan_id = 0; // <- Overwritten by the verdict fn below
+  drop_reason_t reason = layer2_recv_frame_verdict(intf, ether_hdr, &vlan_id);
+  if (reason != DROP_NONE) {
     // Drop the frame
+    INTF_STATS_INC(intf, rx_drops);
+    node_count_drop(n, reason);
+    trace_pkt_drop(n, intf, pkt, PROF_STAGE_L2_RX, reason);
     return framelen;
   }
+  trace_pkt(n, intf, pkt, PROF_STAGE_L2_RX, TRACE_RECEIVED, vlan_id);
   if (INTF_MODE(intf) == INTF_MODE_L2_ACCESS || INTF_MODE(intf) == INTF_MODE_L2_TRUNK) {
     // Go ahead and act like the good little L2 switch that you are.
     if (!ETHER_HDR_VLAN_TAGGED(ether_hdr)) {
       // If not tagged, we need to tag an ingress frame (w/ `vlan_id`)
-      uint32_t new_framelen = 0; // <- Updated by fn below
-      ether_hdr_t *new_ether_hdr = ether_hdr_tag_vlan(ether_hdr, framelen, vlan_id, &new_framelen);
-      EXPECT_RETURN_VAL(new_ether_hdr != nullptr, "ether_hdr_tag_vlan failed", -1);
-      EXPECT_RETURN_VAL(new_framelen > framelen, "new_framelen too small", -1);
-      frame = (uint8_t *)new_ether_hdr;
-      framelen = new_framelen;
+      bool resp = ether_frame_tag_vlan(pkt, vlan_id);
+      EXPECT_RETURN_VAL(resp == true, "ether_frame_tag_vlan failed", -1);
     }
-    return layer2_switch_recv_frame_bytes(n, intf, frame, framelen);
+    return layer2_switch_recv_frame(n, intf, pkt);
   }
   else if (INTF_MODE(intf) == INTF_MODE_L3) { 
     // Interface is configured in L3 mode
-    return NODE_NETSTACK(n).l2.promote(n, intf, ether_hdr, framelen);
-  }
-  else if (INTF_MODE(intf) == INTF_MODE_L3_SVI) {
-    // Not possible (frames cannot flow in through virtual interfaces)
-    LOG_ERR("[%s] L2 received frame on SVI interface! (%s)\n", n->node_name, intf->if_name);
-    return 0;
+    return NODE_NETSTACK(n).l2.promote(n, intf, pkt);
   }
   // Interface is not in a functional state. 
   // Silently drop ingress frames.
-  // TODO: Probably add a hw counter to signal dropped packets (?)
+  INTF_STATS_INC(intf, rx_drops);
+  node_count_drop(n, DROP_L2_INTF_DOWN);
+  trace_pkt_drop(n, intf, pkt, PROF_STAGE_L2_RX, DROP_L2_INTF_DOWN);
   return 0;
 }
 
-bool layer2_qualify_recv_frame_on_interface(interface_t *intf, ether_hdr_t *ethhdr, uint16_t *vlan_id) {
-  EXPECT_RETURN_BOOL(intf != nullptr, "Empty interface param", false);
-  EXPECT_RETURN_BOOL(ethhdr != nullptr, "Empty ethernet header param", false);
-  EXPECT_RETURN_BOOL(vlan_id != nullptr, "Empty VLAN ID ptr param", false);
+int layer2_node_recv_frame_bytes(node_t *n, interface_t *intf, uint8_t *frame, uint32_t framelen) {
+  EXPECT_RETURN_VAL(frame != nullptr, "Empty frame ptr param", -1);
+  EXPECT_RETURN_VAL(framelen <= CONFIG_MAX_PACKET_BUFFER_SIZE, "Frame too large", -1);
+  // Copy into a buffer with enough headroom for the stack to work in place
+  uint8_t buffer[CONFIG_PKT_BUF_HEADROOM + CONFIG_MAX_PACKET_BUFFER_SIZE];
+  pkt_buf_t pkt;
+  pkt_buf_init(&pkt, buffer, sizeof(buffer), CONFIG_PKT_BUF_HEADROOM);
+  memcpy(pkt_buf_append(&pkt, framelen), frame, framelen);
+  return layer2_node_recv_frame(n, intf, &pkt);
+}
+
+// Why an ingress frame would be dropped (DROP_NONE if it qualifies)
+static drop_reason_t layer2_recv_frame_verdict(interface_t *intf, ether_hdr_t *ethhdr, uint16_t *vlan_id) {
   if (INTF_MODE(intf) == INTF_MODE_L3) {
     if (ETHER_HDR_VLAN_TAGGED(ethhdr)) {
       // We won't accept any VLAN tagged frames in L3 mode.
       // This is to separate the broadcast domain from spilling over.
       LOG_DEBUG("Reject: L3 and tagged\n");
-      return false;
+      return DROP_L2_L3_TAGGED;
     }
     // We will only respond if the frame is specially intended for this
     // interface (based on the dest MAC) or it's a broadcast MAC address.
     mac_addr_t dst_mac = ether_hdr_read_dst_mac(ethhdr);
     if (MAC_ADDR_IS_EQUAL(dst_mac, INTF_NETPROP(intf).l2.mac_addr) || MAC_ADDR_IS_BROADCAST(dst_mac)) {
       *vlan_id = 0;
-      return true;
+      return DROP_NONE;
     }
     // Frame not addressed to us - reject it
     LOG_DEBUG("Reject: L3 MAC mismatch\n");
-    return false;
+    return DROP_L2_L3_MAC_MISMATCH;
   }
   else if (INTF_MODE(intf) == INTF_MODE_L2_ACCESS || INTF_MODE(intf) == INTF_MODE_L2_TRUNK) {
-    if (INTF_NETPROP(intf).l2.vlan_memberships[0] == 0) {
+    if (INTF_NETPROP(intf).l2.port_vlan == 0) {
       // No assigned VLAN memberships for this interface: drop frame
       LOG_DEBUG("Reject: NO interface VLAN membership\n");
-      return false;
+      return DROP_L2_NO_VLAN;
     }
     if (INTF_MODE(intf) == INTF_MODE_L2_ACCESS) {
       if (ETHER_HDR_VLAN_TAGGED(ethhdr)) {
@@ -89,16 +114,16 @@ bool layer2_qualify_recv_frame_on_interface(interface_t *intf, ether_hdr_t *ethh
         vlan_tag_t *tag = (vlan_tag_t *)(ethhdr + 1);
         if (!interface_test_vlan_membership(intf, vlan_tag_read_vlan_id(tag))) {
           LOG_DEBUG("Reject: L2 ACCESS got tagged frame\n");
-          return false; // tag VLAN id does not match interface's VLAN
+          return DROP_L2_ACCESS_FOREIGN_VLAN; // tag VLAN id does not match interface's VLAN
         }
         *vlan_id = vlan_tag_read_vlan_id(tag);
-        return true;
+        return DROP_NONE;
       }
       else {
         // We're dealing with an untagged frame.
         // Caller needs to tag and L2 switch this frame.
-        *vlan_id = INTF_NETPROP(intf).l2.vlan_memberships[0];
-        return true;
+        *vlan_id = INTF_NETPROP(intf).l2.port_vlan;
+        return DROP_NONE;
       }
     }
     else if (INTF_MODE(intf) == INTF_MODE_L2_TRUNK) {
@@ -106,26 +131,36 @@ bool layer2_qualify_recv_frame_on_interface(interface_t *intf, ether_hdr_t *ethh
         // TRUNK interfaces must reject all untagged frames
         // regardless of interface VLAN membership(s)
         LOG_DEBUG("Reject: TRUNK got untagged frame\n");
-        return false;
+        return DROP_L2_TRUNK_UNTAGGED;
       }
       // We're dealing with a tagged frame
       vlan_tag_t *tag = (vlan_tag_t *)(ethhdr + 1);
       if (!interface_test_vlan_membership(intf, vlan_tag_read_vlan_id(tag))) {
         LOG_DEBUG("Reject: Trunk got foreign VLAN frame\n");
-        return false; // tag VLAN id does not match interface's VLAN(s)
+        return DROP_L2_TRUNK_FOREIGN_VLAN; // tag VLAN id does not match interface's VLAN(s)
       }
       *vlan_id = vlan_tag_read_vlan_id(tag);
-      return true;
+      return DROP_NONE;
     }
     LOG_DEBUG("Reject: unreachable\n");
-    return false; // unreachable
+    return DROP_L2_INTF_DOWN; // unreachable
   }
-  // We have received frames on an SVI, which is illegal.
-  LOG_DEBUG("Reject: SVI??\n");
-  return true; // TODO: Change this
+  // Frames can't flow in through SVIs (virtual interfaces), only get promoted
+  // to them when switched
+  LOG_DEBUG("Reject: SVI\n");
+  return DROP_L2_SVI_INGRESS;
 }
 
-int layer2_promote(node_t *n, interface_t *iintf, ether_hdr_t *ether_hdr, uint32_t framelen) {
+bool layer2_qualify_recv_frame_on_interface(interface_t *intf, ether_hdr_t *ethhdr, uint16_t *vlan_id) {
+  EXPECT_RETURN_BOOL(intf != nullptr, "Empty interface param", false);
+  EXPECT_RETURN_BOOL(ethhdr != nullptr, "Empty ethernet header param", false);
+  EXPECT_RETURN_BOOL(vlan_id != nullptr, "Empty VLAN ID ptr param", false);
+  return layer2_recv_frame_verdict(intf, ethhdr, vlan_id) == DROP_NONE;
+}
+
+int layer2_promote(node_t *n, interface_t *iintf, pkt_buf_t *pkt) {
+  ether_hdr_t *ether_hdr = PKT_BUF_MTOD(pkt, ether_hdr_t *);
+  uint32_t framelen = pkt->data_len;
   uint16_t hdr_type = ether_hdr_read_type(ether_hdr);
   // Check if it's an ARP message
   if (hdr_type == ETHER_TYPE_ARP) {
@@ -133,17 +168,24 @@ int layer2_promote(node_t *n, interface_t *iintf, ether_hdr_t *ether_hdr, uint32
     uint16_t arp_op_code = arp_hdr_read_op_code(arp_hdr);
     switch (arp_op_code) {
       case ARP_OP_CODE_REQUEST: {
+        INTF_STATS_INC(iintf, arp_req_rx);
+        trace_pkt(n, iintf, pkt, PROF_STAGE_L2_RX, TRACE_LOCAL, 0);
         bool resp = node_arp_recv_broadcast_request_frame(n, iintf, ether_hdr);
         EXPECT_RETURN_VAL(resp == true, "node_arp_recv_broadcast_request_frame failed", -1);
         return framelen;
       }
       case ARP_OP_CODE_REPLY: {
+        INTF_STATS_INC(iintf, arp_reply_rx);
+        trace_pkt(n, iintf, pkt, PROF_STAGE_L2_RX, TRACE_LOCAL, 0);
         bool resp = node_arp_recv_reply_frame(n, iintf, ether_hdr);
         EXPECT_RETURN_VAL(resp == true, "node_arp_recv_reply_frame failed", -1);
         return framelen;
       }
       default: {
         LOG_DEBUG("Unknown ARP op code received! Ignoring...\n");
+        INTF_STATS_INC(iintf, rx_drops);
+        node_count_drop(n, DROP_ARP_UNKNOWN_OP);
+        trace_pkt_drop(n, iintf, pkt, PROF_STAGE_L2_RX, DROP_ARP_UNKNOWN_OP);
         return -1;
       }
     }
@@ -154,17 +196,22 @@ int layer2_promote(node_t *n, interface_t *iintf, ether_hdr_t *ether_hdr, uint32
       "Droped because " MAC_ADDR_FMT " != " MAC_ADDR_FMT "\n", 
       MAC_ADDR_BYTES_BE(dst_mac), MAC_ADDR_BYTES_BE(INTF_NETPROP(iintf).l2.mac_addr)
     );
+    INTF_STATS_INC(iintf, rx_drops);
+    node_count_drop(n, DROP_L2_SVI_MAC_MISMATCH);
+    trace_pkt_drop(n, iintf, pkt, PROF_STAGE_L2_RX, DROP_L2_SVI_MAC_MISMATCH);
     return framelen; // We can't process any frames not intended for us is this is an SVI
   }
   if (hdr_type == ETHER_TYPE_IPV4) {
-    // We need to delegate processing of this packet to L3
-    uint8_t *pkt = (uint8_t *)(ether_hdr + 1);
-    uint32_t pktlen = framelen - sizeof(ether_hdr_t); // We ignore FCS
-    NODE_NETSTACK(n).l3.promote(n, iintf, pkt, pktlen, hdr_type);
+    // We need to delegate processing of this packet to L3 (we ignore FCS)
+    EXPECT_RETURN_VAL(pkt_buf_adj(pkt, sizeof(ether_hdr_t)) != nullptr, "pkt_buf_adj failed", -1);
+    NODE_NETSTACK(n).l3.promote(n, iintf, pkt, hdr_type);
     return framelen;
   }
   else {
-    ; // Discard
+    // Discard
+    INTF_STATS_INC(iintf, rx_drops);
+    node_count_drop(n, DROP_L2_UNKNOWN_ETHERTYPE);
+    trace_pkt_drop(n, iintf, pkt, PROF_STAGE_L2_RX, DROP_L2_UNKNOWN_ETHERTYPE);
   }
   return -1;
 }
@@ -173,33 +220,58 @@ int layer2_promote(node_t *n, interface_t *iintf, ether_hdr_t *ether_hdr, uint32
 
 // Egress
 
-void layer2_demote(node_t *n, ipv4_addr_t *nxt_hop_addr, interface_t *ointf, uint8_t *payload, uint32_t paylen, uint16_t ethertype) {
+int layer2_node_send_frame(node_t *n, interface_t *intf, pkt_buf_t *pkt) {
+  pcap_capture_frame(intf, pkt, PCAP_CAPTURE_OUT);
+  uint64_t prof_start = prof_begin();
+  int resp = NODE_NETSTACK(n).phy.send(n, intf, pkt);
+  prof_end(n, PROF_STAGE_PHY_TX, prof_start);
+  if (resp < 0) {
+    INTF_STATS_INC(intf, tx_drops);
+    node_count_drop(n, DROP_PHY_TX_FAILED);
+    trace_pkt_drop(n, intf, pkt, PROF_STAGE_PHY_TX, DROP_PHY_TX_FAILED);
+    return resp;
+  }
+  if (resp == 0) {
+    // Tail dropped, the transport counted why
+    INTF_STATS_INC(intf, tx_drops);
+    return resp;
+  }
+  trace_pkt(n, intf, pkt, PROF_STAGE_PHY_TX, TRACE_SENT, 0);
+  INTF_STATS_INC(intf, tx_frames);
+  INTF_STATS_ADD(intf, tx_bytes, resp);
+  return resp;
+}
+
+void layer2_demote(node_t *n, ipv4_addr_t *nxt_hop_addr, interface_t *ointf, pkt_buf_t *pkt, uint16_t ethertype) {
   EXPECT_RETURN(n != nullptr, "Empty node param");
   EXPECT_RETURN(nxt_hop_addr != nullptr, "Empty next hop address param");
   // We will to handle ointf == nullptr case manually
   EXPECT_RETURN(n != nullptr, "Empty node param");
-  EXPECT_RETURN(payload != nullptr, "Empty payload ptr param");
+  EXPECT_RETURN(pkt != nullptr, "Empty packet buffer param");
+  prof_stage_guard_t prof(n, PROF_STAGE_L2_DEMOTE);
   if (!ointf && node_is_local_address(n, nxt_hop_addr)) {
     // Self-ping case
-    NODE_NETSTACK(n).l3.promote(n, nullptr, payload, paylen, ethertype);
+    NODE_NETSTACK(n).l3.promote(n, nullptr, pkt, ethertype);
     return;
   }
   if (!ointf) {
     // Direct delivery case
     bool resp = node_get_interface_matching_subnet(n, nxt_hop_addr, &ointf); // <-- Overwrites ointf
-    EXPECT_RETURN(resp == true, "node_get_interface_matching_subnet failed");
+    if (!resp) {
+      node_count_drop(n, DROP_L2_NO_SUBNET);
+      trace_pkt_drop(n, nullptr, pkt, PROF_STAGE_L2_DEMOTE, DROP_L2_NO_SUBNET);
+      return;
+    }
   }
   // Capture VLAN ID if routing from an SVI
   uint16_t vlan_id = 0;
   if (INTF_MODE(ointf) == INTF_MODE_L3_SVI) {
-    vlan_id = INTF_NETPROP(ointf).l2.vlan_memberships[0];
+    vlan_id = INTF_NETPROP(ointf).l2.port_vlan;
   }
   // Resolve src and dst mac addresses
   auto pending_lookup_processing_cb = [n, ethertype](arp_entry_t *entry, arp_lookup_t *pending) {
-    uint8_t *payload = (uint8_t *)(pending + 1);
-    uint32_t framelen = pending->bufflen;
-    ether_hdr_t *hdr = (ether_hdr_t *)payload;
-    layer2_send_with_resolved_arp(n, entry, hdr, framelen, ethertype, pending->vlan_id);
+    prof_end(n, PROF_STAGE_ARP_WAIT, pending->queued);
+    layer2_send_with_resolved_arp(n, entry, pending->pkt, ethertype, pending->vlan_id);
   };
   arp_table_t *t = n->netprop.arp_table;
   arp_entry_t *arp_entry = nullptr;
@@ -208,25 +280,29 @@ void layer2_demote(node_t *n, ipv4_addr_t *nxt_hop_addr, interface_t *ointf, uin
     bool resp = arp_table_add_unresolved_entry(t, nxt_hop_addr, &arp_entry);
     EXPECT_RETURN(resp == true, "arp_table_add_unresolved_entry failed");
     EXPECT_RETURN(arp_entry_is_resolved(arp_entry) == false, "arp_table_add_unresolved_entry failed");
-    uint8_t *hdr_payload = payload - sizeof(ether_hdr_t);
-    uint32_t hdr_paylen = paylen + sizeof(ether_hdr_t);
-    resp = arp_entry_add_pending_lookup(arp_entry, hdr_payload, hdr_paylen, pending_lookup_processing_cb, vlan_id);
-    EXPECT_RETURN(resp == true, "arp_entry_add_pending_lookup failed");
+    resp = arp_entry_add_pending_lookup(arp_entry, pkt, pending_lookup_processing_cb, vlan_id);
+    if (!resp) {
+      // No buffer to park the packet in (the request would need one too)
+      node_count_drop(n, DROP_POOL_EXHAUSTED);
+      trace_pkt_drop(n, ointf, pkt, PROF_STAGE_L2_DEMOTE, DROP_POOL_EXHAUSTED);
+      return;
+    }
+    trace_pkt_hop(n, ointf, pkt, PROF_STAGE_ARP_WAIT, TRACE_ARP_PENDING, nxt_hop_addr);
     resp = node_arp_send_broadcast_request(n, ointf, nxt_hop_addr);
     EXPECT_RETURN(resp == true, "node_arp_send_broadcast_request failed");
   }
   else if (!arp_entry_is_resolved(arp_entry)) {
     // Entry found, but it is pending
-    uint8_t *hdr_payload = payload - sizeof(ether_hdr_t);
-    uint32_t hdr_paylen = paylen + sizeof(ether_hdr_t);
-    bool resp = arp_entry_add_pending_lookup(arp_entry, hdr_payload, hdr_paylen, pending_lookup_processing_cb, vlan_id);
-    EXPECT_RETURN(resp == true, "arp_entry_add_pending_lookup failed");
+    bool resp = arp_entry_add_pending_lookup(arp_entry, pkt, pending_lookup_processing_cb, vlan_id);
+    if (!resp) {
+      node_count_drop(n, DROP_POOL_EXHAUSTED);
+      trace_pkt_drop(n, ointf, pkt, PROF_STAGE_L2_DEMOTE, DROP_POOL_EXHAUSTED);
+      return;
+    }
+    trace_pkt_hop(n, ointf, pkt, PROF_STAGE_ARP_WAIT, TRACE_ARP_PENDING, nxt_hop_addr);
   }
   else {
     // Found resolved entry - send immediately
-    ether_hdr_t *hdr = (ether_hdr_t *)(payload - sizeof(ether_hdr_t));
-    uint32_t framelen = sizeof(ether_hdr_t) + paylen;
-    layer2_send_with_resolved_arp(n, arp_entry, hdr, framelen, ethertype, vlan_id);
+    layer2_send_with_resolved_arp(n, arp_entry, pkt, ethertype, vlan_id);
   }
 }
-
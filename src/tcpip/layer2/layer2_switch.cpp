@@ -5,32 +5,37 @@
 #include "layer2.h"
 #include "graph.h"
 #include "mac_table.h"
+#include "vlan_flood.h"
 #include "phy.h"
 #include "pcap.h"
 #include "ether_hdr.h"
 #include "vlan_tag.h"
+#include "pkt_pool.h"
+#include "prof.h"
+#include "trace.h"
 
 // Forward declarations
 
-int layer2_switch_flood_frame_bytes(node_t *n, interface_t *ignored, uint8_t *frame, uint32_t framelen);
-int layer2_switch_send_frame_bytes(node_t *n, interface_t *intf, uint8_t *frame, uint32_t framelen);
+int layer2_switch_flood_frame(node_t *n, interface_t *ignored, pkt_buf_t *pkt);
+int layer2_switch_send_frame(node_t *n, interface_t *intf, pkt_buf_t *pkt);
 
 #pragma mark -
 
 // Ingress
 
-int layer2_switch_recv_frame_bytes(node_t *n, interface_t *iintf, uint8_t *frame, uint32_t framelen) {
+int layer2_switch_recv_frame(node_t *n, interface_t *iintf, pkt_buf_t *pkt) {
   EXPECT_RETURN_VAL(n != nullptr, "Empty node param", -1);
   EXPECT_RETURN_VAL(iintf != nullptr, "Empty ingress interface param", -1);
-  EXPECT_RETURN_VAL(frame != nullptr, "Empty frame ptr param", -1);
-  ether_hdr_t *ether_hdr = (ether_hdr_t *)frame;
+  EXPECT_RETURN_VAL(pkt != nullptr, "Empty packet buffer param", -1);
+  prof_stage_guard_t prof(n, PROF_STAGE_L2_SWITCH);
+  ether_hdr_t *ether_hdr = PKT_BUF_MTOD(pkt, ether_hdr_t *);
   // Every time we see a frame, we want to update said table
-  bool status = mac_table_process_reply(n->netprop.mac_table, ether_hdr, iintf);
+  bool status = mac_table_process_reply(n->netprop.mac_table, ether_hdr, iintf, phy_node_clock_ns(n));
 #pragma unused(status)
   // First, handle broadcast frames
   mac_addr_t src_mac = ether_hdr_read_src_mac(ether_hdr);
   if (MAC_ADDR_IS_BROADCAST(src_mac)) {
-    return layer2_switch_flood_frame_bytes(n, iintf, frame, framelen);
+    return layer2_switch_flood_frame(n, iintf, pkt);
   }
   // Else, if we see a destination mac address, we will read the table to find the interface
   mac_entry_t *mac_entry = nullptr;
@@ -38,37 +43,37 @@ int layer2_switch_recv_frame_bytes(node_t *n, interface_t *iintf, uint8_t *frame
   mac_addr_t dst_mac = ether_hdr_read_dst_mac(ether_hdr);
   if (mac_table_lookup(n->netprop.mac_table, &dst_mac, &mac_entry)) {
     // Found entry in MAC table
-    interface_t *ointf = node_get_interface_by_name(n, (const char *)mac_entry->oif_name);
-    EXPECT_RETURN_VAL(ointf != nullptr, "node_get_interface_by_name failed", -1);
+    interface_t *ointf = node_get_interface_by_index(n, mac_entry->oif_ifindex);
+    EXPECT_RETURN_VAL(ointf != nullptr, "node_get_interface_by_index failed", -1);
+    trace_pkt(n, ointf, pkt, PROF_STAGE_L2_SWITCH, TRACE_FORWARDED, vlan_tag_read_vlan_id((vlan_tag_t *)(ether_hdr + 1)));
     if (INTF_MODE(ointf) == INTF_MODE_L3_SVI) {
       INTF_NETPROP(ointf).delegate = iintf;
-      bool resp = layer2_switch_send_frame_bytes(n, ointf, frame, framelen);
+      bool resp = layer2_switch_send_frame(n, ointf, pkt);
       INTF_NETPROP(ointf).delegate = nullptr;
       return resp;
     }
     else {
-      return layer2_switch_send_frame_bytes(n, ointf, frame, framelen);
+      return layer2_switch_send_frame(n, ointf, pkt);
     }
   }
   // If not, we will flood all interfaces like we already do below.
-  return layer2_switch_flood_frame_bytes(n, iintf, frame, framelen);
+  return layer2_switch_flood_frame(n, iintf, pkt);
 }
 
 #pragma mark -
 
 // Egress
 
-bool layer2_switch_qualify_send_frame_on_interface(interface_t *intf, ether_hdr_t *ethhdr) {
-  EXPECT_RETURN_BOOL(intf != nullptr, "Empty interface param", false);
-  EXPECT_RETURN_BOOL(ethhdr != nullptr, "Empty ethernet header param", false);
+// Why a switched frame can't leave via `intf` (DROP_NONE if it can)
+static drop_reason_t layer2_switch_send_frame_verdict(interface_t *intf, ether_hdr_t *ethhdr) {
   if (INTF_MODE(intf) == INTF_MODE_L3) {
     LOG_DEBUG("Reject: L3 mode (%s)\n", intf->if_name);
-    return false;
+    return DROP_L2_TX_L3_INTF;
   }
   if (!ETHER_HDR_VLAN_TAGGED(ethhdr)) {
     // Every packet being sent out must be tagged until this point.
     LOG_DEBUG("Reject: Untagged (%s)\n", intf->if_name);
-    return false;
+    return DROP_L2_TX_UNTAGGED;
   }
   vlan_tag_t *tag = (vlan_tag_t *)(ethhdr + 1);
   uint16_t vlan_id = vlan_tag_read_vlan_id(tag);
@@ -76,93 +81,126 @@ bool layer2_switch_qualify_send_frame_on_interface(interface_t *intf, ether_hdr_
     // Not part of the intended VLAN. Enforce separation.
     // Note that for TRUNK interfaces, this checks against
     // all registered VLAN memberships.
-    LOG_DEBUG("Reject: VLAN (%s, %u vs %u)\n", intf->if_name, vlan_id, INTF_NETPROP(intf).l2.vlan_memberships[0]);
-    return false;
+    LOG_DEBUG("Reject: VLAN (%s, %u vs %u)\n", intf->if_name, vlan_id, INTF_NETPROP(intf).l2.port_vlan);
+    return DROP_L2_TX_FOREIGN_VLAN;
   }
-  return true;
+  return DROP_NONE;
+}
+
+bool layer2_switch_qualify_send_frame_on_interface(interface_t *intf, ether_hdr_t *ethhdr) {
+  EXPECT_RETURN_BOOL(intf != nullptr, "Empty interface param", false);
+  EXPECT_RETURN_BOOL(ethhdr != nullptr, "Empty ethernet header param", false);
+  return layer2_switch_send_frame_verdict(intf, ethhdr) == DROP_NONE;
 }
 
-int layer2_switch_send_frame_bytes(node_t *n, interface_t *intf, uint8_t *frame, uint32_t framelen) {
+int layer2_switch_send_frame(node_t *n, interface_t *intf, pkt_buf_t *pkt) {
   EXPECT_RETURN_VAL(n != nullptr, "Empty node ptr param", -1);
   EXPECT_RETURN_VAL(intf != nullptr, "Empty node ptr param", -1);
-  EXPECT_RETURN_VAL(frame != nullptr, "Empty packet ptr param", -1);
-  if (!layer2_switch_qualify_send_frame_on_interface(intf, (ether_hdr_t *)frame)) {
-    return 0;
-  }
-  ether_hdr_t *ether_hdr = (ether_hdr_t *)frame;
-  if (!ETHER_HDR_VLAN_TAGGED(ether_hdr)) {
+  EXPECT_RETURN_VAL(pkt != nullptr, "Empty packet buffer param", -1);
+  ether_hdr_t *ether_hdr = PKT_BUF_MTOD(pkt, ether_hdr_t *);
+  // (Flooding skips unqualified ports instead, those aren't drops)
+  drop_reason_t reason = layer2_switch_send_frame_verdict(intf, ether_hdr);
+  if (reason != DROP_NONE) {
+    node_count_drop(n, reason);
+    trace_pkt_drop(n, intf, pkt, PROF_STAGE_L2_SWITCH, reason);
     return 0;
   }
   if (INTF_MODE(intf) == INTF_MODE_L2_ACCESS) {
     // Strip VLAN tag before egress from ACCESS interfaces
-    uint32_t untagged_framelen = 0;
-    ether_hdr_t *untagged_hdr = ether_hdr_untag_vlan(ether_hdr, framelen, &untagged_framelen);
-    EXPECT_RETURN_VAL(untagged_hdr != nullptr, "ether_hdr_untag_vlan failed", -1);
-    int resp = NODE_NETSTACK(n).phy.send(n, intf, (uint8_t *)untagged_hdr, untagged_framelen); 
-    EXPECT_CONTINUE(resp == untagged_framelen, "NODE_NETSTACK(n).phy.send failed");
+    bool untagged = ether_frame_untag_vlan(pkt);
+    EXPECT_RETURN_VAL(untagged == true, "ether_frame_untag_vlan failed", -1);
+    int resp = layer2_node_send_frame(n, intf, pkt);
+    EXPECT_CONTINUE(resp == (int)pkt->data_len, "layer2_node_send_frame failed");
     return resp;
   }
   else if (INTF_MODE(intf) == INTF_MODE_L2_TRUNK) {
     // Forward tagged frames out of TRUNK interface
-    int resp = NODE_NETSTACK(n).phy.send(n, intf, (uint8_t *)ether_hdr, framelen); 
-    EXPECT_CONTINUE(resp == framelen, "NODE_NETSTACK(n).phy.send failed");
+    int resp = layer2_node_send_frame(n, intf, pkt);
+    EXPECT_CONTINUE(resp == (int)pkt->data_len, "layer2_node_send_frame failed");
     return resp;
   }
   else if (INTF_MODE(intf) == INTF_MODE_L3_SVI) {
     // Strip VLAN tag before egress from L3_SVI interfaces
-    uint32_t untagged_framelen = 0;
-    ether_hdr_t *untagged_hdr = ether_hdr_untag_vlan(ether_hdr, framelen, &untagged_framelen);
-    EXPECT_RETURN_VAL(untagged_hdr != nullptr, "ether_hdr_untag_vlan failed", -1);
+    bool untagged = ether_frame_untag_vlan(pkt);
+    EXPECT_RETURN_VAL(untagged == true, "ether_frame_untag_vlan failed", -1);
     // Promote untagged frame to layer2 (will handle ARP broadcast + l3 promotion)
-    int resp = NODE_NETSTACK(n).l2.promote(n, intf, untagged_hdr, untagged_framelen);
+    int untagged_framelen = pkt->data_len;
+    int resp = NODE_NETSTACK(n).l2.promote(n, intf, pkt);
     EXPECT_CONTINUE(resp == untagged_framelen, "NODE_NETSTACK(n).l2.promote failed");
     return resp;
   }
   return -1;
 }
 
-int layer2_switch_flood_frame_bytes(node_t *n, interface_t *ignored, uint8_t *frame, uint32_t framelen) {
+int layer2_switch_flood_frame(node_t *n, interface_t *ignored, pkt_buf_t *pkt) {
   EXPECT_RETURN_VAL(n != nullptr, "Empty node ptr param", -1);
-  EXPECT_RETURN_VAL(frame != nullptr, "Empty packet ptr param", -1);
+  EXPECT_RETURN_VAL(pkt != nullptr, "Empty packet buffer param", -1);
   int acc = 0;
-  // Prepare untagged version of input frame to send out via ACCESS interfaces
-  ether_hdr_t *tagged_hdr = (ether_hdr_t *)frame;
+  ether_hdr_t *tagged_hdr = PKT_BUF_MTOD(pkt, ether_hdr_t *);
   EXPECT_RETURN_VAL(ETHER_HDR_VLAN_TAGGED(tagged_hdr) == true, "Untagged frame param", -1);
-  // Untag frame in advance. Untagging is destructive so make a temporary copy.
-  uint8_t temp[1500] = {0};
-  memcpy(temp, frame, framelen);
-  ether_hdr_t *untagged_hdr = (ether_hdr_t *)temp;
-  uint32_t untagged_framelen = framelen;
-  untagged_hdr = ether_hdr_untag_vlan(untagged_hdr, framelen, &untagged_framelen);
-  EXPECT_RETURN_VAL(untagged_hdr != nullptr, "ether_hdr_untag_vlan failed", -1);
-  // Flood (selectively)
-  for (int i = 0; i < CONFIG_MAX_INTF_PER_NODE; i++) {
-    if (!n->intf[i]) { continue; }
-    interface_t *intf = n->intf[i];
+  EXPECT_RETURN_VAL(pkt->data_len >= sizeof(ether_hdr_t) + sizeof(vlan_tag_t), "Runt tagged frame", -1);
+  int framelen = pkt->data_len;
+  // TRUNK interfaces get the (tagged) input frame as is. Every other interface
+  // gets an untagged view: a private header, chained to a clone of the input
+  // frame's payload. The payload itself is never copied (nor modified).
+  pkt_buf_t payload = {};
+  bool resp = pkt_buf_attach(&payload, pkt);
+  EXPECT_RETURN_VAL(resp == true, "pkt_buf_attach failed", -1);
+  pkt_buf_adj(&payload, sizeof(ether_hdr_t) + sizeof(vlan_tag_t));
+  uint8_t hdr_storage[sizeof(ether_hdr_t)];
+  pkt_buf_t untagged;
+  pkt_buf_init(&untagged, hdr_storage, sizeof(hdr_storage), 0);
+  ether_hdr_t *untagged_hdr = (ether_hdr_t *)pkt_buf_append(&untagged, sizeof(ether_hdr_t));
+  memcpy(untagged_hdr, tagged_hdr, offsetof(ether_hdr_t, type));
+  ether_hdr_set_type(untagged_hdr, vlan_tag_read_ether_type((vlan_tag_t *)(tagged_hdr + 1)));
+  untagged.next = &payload;
+  untagged.trace_id = pkt->trace_id;
+  int untagged_framelen = untagged.data_len + payload.data_len;
+  uint16_t vlan_id = vlan_tag_read_vlan_id((vlan_tag_t *)(tagged_hdr + 1));
+  if (ignored) {
+    INTF_STATS_INC(ignored, flooded);
+  }
+  trace_pkt(n, ignored, pkt, PROF_STAGE_L2_SWITCH, TRACE_FLOODED, vlan_id);
+  // Flood, only to the ports in the frame's VLAN (see `vlan_flood.h`)
+  const vlan_flood_list_t *flood = vlan_flood_lookup(n->netprop.flood_table, vlan_id);
+  for (uint32_t i = 0; flood && i < flood->count; i++) {
+    interface_t *intf = n->intf[flood->port[i].ifindex];
     if (intf == ignored) { continue; } // ignored interface
-    if (!layer2_switch_qualify_send_frame_on_interface(intf, tagged_hdr)) {
-      continue;
-    }
-    if (INTF_MODE(intf) == INTF_MODE_L2_ACCESS) {
-      // Strip VLAN tag before egress
-      int resp = NODE_NETSTACK(n).phy.send(n, intf, (uint8_t *)untagged_hdr, untagged_framelen); 
-      EXPECT_CONTINUE(resp == untagged_framelen, "NODE_NETSTACK(n).phy.send failed");
-      acc += resp;
-    }
-    else if (INTF_MODE(intf) == INTF_MODE_L2_TRUNK) {
-      int resp = NODE_NETSTACK(n).phy.send(n, intf, (uint8_t *)tagged_hdr, framelen); 
-      EXPECT_CONTINUE(resp == framelen, "NODE_NETSTACK(n).phy.send failed");
-      acc += resp;
-    }
-    else if (INTF_MODE(intf) == INTF_MODE_L3_SVI) {
-      // Promote untagged frame to layer2 (will handle ARP broadcast + l3 promotion)
-      INTF_NETPROP(intf).delegate = ignored;
-      int resp = NODE_NETSTACK(n).l2.promote(n, intf, untagged_hdr, untagged_framelen);
-      INTF_NETPROP(intf).delegate = nullptr;
-      EXPECT_CONTINUE(resp == untagged_framelen, "NODE_NETSTACK(n).l2.promote failed");
-      acc += resp;
+    switch (flood->port[i].action) {
+      case VLAN_FLOOD_UNTAG: {
+        // Strip VLAN tag before egress
+        int resp = layer2_node_send_frame(n, intf, &untagged);
+        EXPECT_CONTINUE(resp == untagged_framelen, "layer2_node_send_frame failed");
+        acc += resp;
+        break;
+      }
+      case VLAN_FLOOD_TAGGED: {
+        int resp = layer2_node_send_frame(n, intf, pkt);
+        EXPECT_CONTINUE(resp == framelen, "layer2_node_send_frame failed");
+        acc += resp;
+        break;
+      }
+      case VLAN_FLOOD_PROMOTE: {
+        // Promote untagged frame to layer2 (will handle ARP broadcast + l3 promotion).
+        // Layers above expect a single, writable segment, so this one gets a copy.
+        pkt_buf_t *copy = pkt_pool_alloc(pkt_pool_default());
+        if (!copy) {
+          node_count_drop(n, DROP_POOL_EXHAUSTED);
+          trace_pkt_drop(n, intf, pkt, PROF_STAGE_L2_SWITCH, DROP_POOL_EXHAUSTED);
+          break;
+        }
+        pkt_buf_copy_data(&untagged, pkt_buf_append(copy, untagged_framelen), untagged_framelen);
+        copy->trace_id = pkt->trace_id;
+        INTF_NETPROP(intf).delegate = ignored;
+        int resp = NODE_NETSTACK(n).l2.promote(n, intf, copy);
+        INTF_NETPROP(intf).delegate = nullptr;
+        pkt_buf_destroy(copy);
+        EXPECT_CONTINUE(resp == untagged_framelen, "NODE_NETSTACK(n).l2.promote failed");
+        acc += resp;
+        break;
+      }
     }
   }
+  pkt_buf_detach(&payload);
   return acc; // Number of bytes sent
 }
-
@@ -85,3 +85,49 @@ ether_hdr_t* ether_hdr_untag_vlan(ether_hdr_t *hdr, uint32_t len, uint32_t *newl
   return new_hdr;
 }
 
+
+#pragma mark -
+
+// In place (pkt_buf_t) tagging
+
+/*
+ * Only the MAC addresses move (into/out of the headroom). The original ether
+ * type already sits where the tag's `ether_type` goes, and the payload stays
+ * put.
+ */
+
+bool ether_frame_tag_vlan(pkt_buf_t *pkt, uint16_t vlanid) {
+  EXPECT_RETURN_BOOL(pkt != nullptr, "Empty packet buffer param", false);
+  EXPECT_RETURN_BOOL(pkt->data_len >= sizeof(ether_hdr_t), "Runt frame", false);
+  ether_hdr_t *hdr = PKT_BUF_MTOD(pkt, ether_hdr_t *);
+  if (ETHER_HDR_VLAN_TAGGED(hdr)) {
+    return true; // No need to do anything
+  }
+  uint16_t orig_type = ether_hdr_read_type(hdr);
+  uint8_t *front = pkt_buf_prepend(pkt, sizeof(vlan_tag_t));
+  EXPECT_RETURN_BOOL(front != nullptr, "pkt_buf_prepend failed", false);
+  memmove(front, front + sizeof(vlan_tag_t), offsetof(ether_hdr_t, type));
+  ether_hdr_t *new_hdr = (ether_hdr_t *)front;
+  ether_hdr_set_type(new_hdr, ETHER_TYPE_VLAN);
+  vlan_tag_t *tag = (vlan_tag_t *)(new_hdr + 1);
+  vlan_tag_init(tag);
+  vlan_tag_set_vlan_id(tag, vlanid);
+  vlan_tag_set_ether_type(tag, orig_type);
+  return true;
+}
+
+bool ether_frame_untag_vlan(pkt_buf_t *pkt) {
+  EXPECT_RETURN_BOOL(pkt != nullptr, "Empty packet buffer param", false);
+  EXPECT_RETURN_BOOL(pkt->data_len >= sizeof(ether_hdr_t), "Runt frame", false);
+  ether_hdr_t *hdr = PKT_BUF_MTOD(pkt, ether_hdr_t *);
+  if (!ETHER_HDR_VLAN_TAGGED(hdr)) {
+    return true; // No need to do anything
+  }
+  EXPECT_RETURN_BOOL(pkt->data_len >= sizeof(ether_hdr_t) + sizeof(vlan_tag_t), "Runt tagged frame", false);
+  uint16_t orig_type = vlan_tag_read_ether_type((vlan_tag_t *)(hdr + 1));
+  uint8_t *front = (uint8_t *)hdr;
+  memmove(front + sizeof(vlan_tag_t), front, offsetof(ether_hdr_t, type));
+  ether_hdr_t *new_hdr = (ether_hdr_t *)pkt_buf_adj(pkt, sizeof(vlan_tag_t));
+  ether_hdr_set_type(new_hdr, orig_type);
+  return true;
+}
@@ -9,12 +9,61 @@
 
 #pragma mark -
 
+// Private utility functions
+
+DEFINE_GLTHREAD_TO_STRUCT_FUNC(
+  mac_entry_ptr_from_aging_timer,   // fn name
+  mac_entry_t,                      // return type
+  aging_timer.glue                  // glthread_t field in mac_entry_t
+);
+
+// Appends a new entry (caller made sure there's none for `addr` yet)
+static void mac_table_insert(mac_table_t *t, mac_addr_t addr, uint16_t oif_ifindex, bool is_static, uint64_t now_ns) {
+  auto owned_entry = (mac_entry_t *)calloc(1, sizeof(mac_entry_t));
+  owned_entry->mac_addr = addr;
+  owned_entry->oif_ifindex = oif_ifindex;
+  owned_entry->is_static = is_static;
+  owned_entry->last_seen_ns = now_ns;
+  timer_wheel_timer_init(&owned_entry->aging_timer);
+  if (!is_static && t->aging_ns) {
+    timer_wheel_schedule(&t->aging, &owned_entry->aging_timer, now_ns + t->aging_ns);
+  }
+  glthread_init(&owned_entry->mac_table_glue);
+  glthread_add_next(&t->mac_entries, &owned_entry->mac_table_glue);
+  t->entry_count++;
+}
+
+static void mac_table_remove(mac_table_t *t, mac_entry_t *entry) {
+  timer_wheel_cancel(&t->aging, &entry->aging_timer);
+  glthread_remove(&entry->mac_table_glue);
+  free(entry);
+  t->entry_count--;
+}
+
+static void mac_table_aging_expired(timer_wheel_timer_t *timer, uint64_t now_ns, void *ctx) {
+  auto t = (mac_table_t *)ctx;
+  mac_entry_t *entry = mac_entry_ptr_from_aging_timer(&timer->glue);
+  uint64_t expires_ns = entry->last_seen_ns + t->aging_ns;
+  if (expires_ns > now_ns) {
+    // Seen since the timer was set
+    timer_wheel_schedule(&t->aging, timer, expires_ns);
+    return;
+  }
+  mac_table_remove(t, entry);
+  t->aged_out++;
+}
+
+#pragma mark -
+
 // MAC table
 
 void mac_table_init(mac_table_t **t) {
   EXPECT_RETURN(t != nullptr, "Empty table ptr param");
   auto resp = (mac_table_t *)calloc(1, sizeof(mac_table_t));
   glthread_init(&resp->mac_entries);
+  resp->max_entries = CONFIG_MAC_TABLE_MAX_ENTRIES;
+  resp->aging_ns = CONFIG_MAC_TABLE_AGING_SEC * 1000000000ull;
+  timer_wheel_init(&resp->aging, CONFIG_MAC_TABLE_AGING_TICK_MS * 1000000ull, 0);
   *t = resp;
 }
 
@@ -40,17 +89,14 @@ bool mac_table_add_entry(mac_table_t *t, mac_entry_t *entry) {
   EXPECT_RETURN_BOOL(entry != nullptr, "Empty mac param", false);
   mac_entry_t *__entry = nullptr;
   if (mac_table_lookup(t, &entry->mac_addr, &__entry)) {
-    if (MAC_ENTRY_PTR_KEYS_ARE_EQUAL(entry, __entry)) {
-      // Table already contains entry with the same mac_addr primary key
-      // Just update it
-      strncpy(__entry->oif_name, entry->oif_name, CONFIG_IF_NAME_SIZE);
-      return true;
-    }
+    // Table already contains entry with the same mac_addr primary key
+    // Just update it
+    __entry->oif_ifindex = entry->oif_ifindex;
+    __entry->is_static = true;
+    timer_wheel_cancel(&t->aging, &__entry->aging_timer);
+    return true;
   }
-  auto owned_entry = (mac_entry_t *)calloc(1, sizeof(mac_entry_t));
-  memcpy((void *)owned_entry, (void *)entry, sizeof(mac_entry_t));
-  glthread_init(&owned_entry->mac_table_glue);
-  glthread_add_next(&t->mac_entries, &owned_entry->mac_table_glue);
+  mac_table_insert(t, entry->mac_addr, entry->oif_ifindex, true, 0);
   return true;
 }
 
@@ -65,9 +111,7 @@ bool mac_table_delete_entry(mac_table_t *t, mac_addr_t *addr) {
     }
     // This is ok to do since curr is never the head of the thread (the
     // glthread_t instance held by the owner).
-    bool resp = glthread_remove(curr);
-    EXPECT_RETURN_BOOL(resp == true, "glthread_remove failed", false);
-    free(entry);
+    mac_table_remove(t, entry);
     return true;
   }
   GLTHREAD_FOREACH_END();
@@ -81,39 +125,112 @@ bool mac_table_clear(mac_table_t *t) {
     mac_entry_t *entry = mac_entry_ptr_from_mac_table_glue(curr); 
     // This is ok to do since curr is never the head of the thread (the
     // glthread_t instance held by the owner).
-    bool resp = glthread_remove(curr);
-    EXPECT_RETURN_BOOL(resp == true, "glthread_remove failed", false);
-    free(entry);
+    mac_table_remove(t, entry);
   }
   GLTHREAD_FOREACH_END();
   return true; // All entries deleted
 }
 
-void mac_table_dump(mac_table_t *t) {
+void mac_table_set_aging(mac_table_t *t, uint64_t aging_ns) {
   EXPECT_RETURN(t != nullptr, "Empty table param");
+  t->aging_ns = aging_ns;
+  // Config time, so walking the table is fine. Entries already past the new
+  // aging time go on the next tick.
+  glthread_t *curr = nullptr;
+  GLTHREAD_FOREACH_BEGIN(&t->mac_entries, curr) {
+    mac_entry_t *entry = mac_entry_ptr_from_mac_table_glue(curr);
+    if (entry->is_static) { continue; }
+    if (aging_ns) {
+      timer_wheel_schedule(&t->aging, &entry->aging_timer, entry->last_seen_ns + aging_ns);
+    }
+    else {
+      timer_wheel_cancel(&t->aging, &entry->aging_timer);
+    }
+  }
+  GLTHREAD_FOREACH_END();
+}
+
+void mac_table_set_max_entries(mac_table_t *t, uint32_t max_entries) {
+  EXPECT_RETURN(t != nullptr, "Empty table param");
+  t->max_entries = max_entries;
+}
+
+uint32_t mac_table_age(mac_table_t *t, uint64_t now_ns) {
+  EXPECT_RETURN_VAL(t != nullptr, "Empty table param", 0);
+  uint64_t aged_out = t->aged_out;
+  timer_wheel_advance(&t->aging, now_ns, mac_table_aging_expired, t);
+  return (uint32_t)(t->aged_out - aged_out);
+}
+
+void mac_table_dump(mac_table_t *t, node_t *n, uint64_t now_ns, bool show_age) {
+  EXPECT_RETURN(t != nullptr, "Empty table param");
+  EXPECT_RETURN(n != nullptr, "Empty node param");
   glthread_t *curr = nullptr;
   GLTHREAD_FOREACH_BEGIN(&t->mac_entries, curr) {
     mac_entry_t *entry = mac_entry_ptr_from_mac_table_glue(curr); 
-    dump_line(
-      "MAC: " MAC_ADDR_FMT ", OIF: %s\n",
-      MAC_ADDR_BYTES_BE(entry->mac_addr),
-      entry->oif_name
-    );
+    if (!show_age) {
+      dump_line(
+        "MAC: " MAC_ADDR_FMT ", OIF: %s\n",
+        MAC_ADDR_BYTES_BE(entry->mac_addr),
+        node_get_interface_name_by_index(n, entry->oif_ifindex)
+      );
+    }
+    else if (entry->is_static) {
+      dump_line(
+        "MAC: " MAC_ADDR_FMT ", OIF: %s, Age: static\n",
+        MAC_ADDR_BYTES_BE(entry->mac_addr),
+        node_get_interface_name_by_index(n, entry->oif_ifindex)
+      );
+    }
+    else {
+      uint64_t age_ns = now_ns > entry->last_seen_ns ? now_ns - entry->last_seen_ns : 0;
+      dump_line(
+        "MAC: " MAC_ADDR_FMT ", OIF: %s, Age: %lus\n",
+        MAC_ADDR_BYTES_BE(entry->mac_addr),
+        node_get_interface_name_by_index(n, entry->oif_ifindex),
+        age_ns / 1000000000ull
+      );
+    }
   }
   GLTHREAD_FOREACH_END();
+  dump_line("Entries: %u (max %u), aging time: %lus\n", t->entry_count, t->max_entries, t->aging_ns / 1000000000ull);
+  dump_line("Station moves: %lu, aged out: %lu, not learnt (full): %lu\n", t->station_moves, t->aged_out, t->learn_refused);
 }
 
-bool mac_table_process_reply(mac_table_t *t, ether_hdr_t *ether_hdr, interface_t *intf) {
+bool mac_table_process_reply(mac_table_t *t, ether_hdr_t *ether_hdr, interface_t *intf, uint64_t now_ns) {
   EXPECT_RETURN_BOOL(t != nullptr, "Empty table param", false);
   EXPECT_RETURN_BOOL(ether_hdr != nullptr, "Empty header param", false);
   EXPECT_RETURN_BOOL(intf != nullptr, "Empty interface param", false);
-  // Fill out entry fields
-  mac_entry_t entry = {0};
-  entry.mac_addr = ether_hdr_read_src_mac(ether_hdr);
-  strncpy((char *)entry.oif_name, (char *)intf->if_name, CONFIG_IF_NAME_SIZE);
-  glthread_init(&entry.mac_table_glue);
-  // Add entry to thread (function will memcpy entry fields)
-  bool resp = mac_table_add_entry(t, &entry);
-  EXPECT_RETURN_BOOL(resp == true, "mac_table_add_entry failed", false);
+  // Expire whatever's due, a tick at a time
+  if (unlikely(timer_wheel_is_due(&t->aging, now_ns))) {
+    mac_table_age(t, now_ns);
+  }
+  // Single lookup. Known stations that didn't move (i.e. steady traffic)
+  // only read the entry (but for one write per aging tick), so its cache
+  // line mostly stays clean.
+  mac_addr_t src_mac = ether_hdr_read_src_mac(ether_hdr);
+  mac_entry_t *entry = nullptr;
+  if (!mac_table_lookup(t, &src_mac, &entry)) {
+    if (unlikely(t->entry_count >= t->max_entries)) {
+      t->learn_refused++;
+      return true;
+    }
+    mac_table_insert(t, src_mac, intf->ifindex, false, now_ns);
+    return true;
+  }
+  if (unlikely(entry->is_static)) {
+    // Configured entries (e.g. SVIs) never move: a frame spoofing their MAC
+    // mustn't steal their traffic
+    return true;
+  }
+  if (unlikely(now_ns - entry->last_seen_ns >= t->aging.tick_ns)) {
+    entry->last_seen_ns = now_ns;
+  }
+  if (likely(entry->oif_ifindex == intf->ifindex)) {
+    return true;
+  }
+  // Station move
+  entry->oif_ifindex = intf->ifindex;
+  t->station_moves++;
   return true;
 }
@@ -5,6 +5,7 @@
 #include "glthread.h"
 #include "utils.h"
 #include "config.h"
+#include "timer_wheel.h"
 
 typedef struct node_t node_t;
 typedef struct interface_t interface_t;
@@ -14,16 +15,39 @@ typedef struct ether_hdr_t ether_hdr_t;
 
 // mac table
 
+/*
+ * Learnt entries age out once unseen for `aging_ns`. Their last seen time is
+ * only rewritten when it's a whole aging tick old, and expiry runs off a timer
+ * wheel advanced by the learning path: an entry's timer is set when it's
+ * learnt, and when it fires, the entry either goes, or (seen since) has its
+ * timer pushed back. No scans of the table.
+ *
+ * The table holds at most `max_entries` entries. Once full, new stations
+ * aren't learnt (frames to them keep being flooded) until entries age out, so
+ * a MAC flood can't push out established stations. Configured entries (see
+ * `mac_table_add_entry()`) never age, and are always added.
+ */
+
 typedef struct mac_entry_t mac_entry_t;
 typedef struct mac_table_t mac_table_t;
 
 struct mac_table_t {
   glthread_t mac_entries;
+  uint32_t entry_count;
+  uint32_t max_entries;
+  uint64_t aging_ns;        // 0 to never age
+  timer_wheel_t aging;
+  uint64_t station_moves;   // Learnt MACs seen again on another interface
+  uint64_t learn_refused;   // New MACs not learnt, table full
+  uint64_t aged_out;
 };
 
 struct mac_entry_t {
   mac_addr_t mac_addr;
-  char oif_name[CONFIG_IF_NAME_SIZE];
+  uint16_t oif_ifindex;
+  bool is_static;           // Configured, never ages
+  uint64_t last_seen_ns;    // To within an aging tick
+  timer_wheel_timer_t aging_timer;
   glthread_t mac_table_glue;
 };
 
@@ -38,13 +62,16 @@ DEFINE_GLTHREAD_TO_STRUCT_FUNC(
 
 #define MAC_ENTRY_PTRS_ARE_EQUAL(MAC0, MAC1) \
   MAC_ENTRY_PTR_KEYS_ARE_EQUAL(MAC0, MAC1) && \
-  (strncmp((char *)(MAC0)->oif_name, (char *)(MAC1)->oif_name, CONFIG_IF_NAME_SIZE) == 0)
+  ((MAC0)->oif_ifindex == (MAC1)->oif_ifindex)
 
 void mac_table_init(mac_table_t **t);
 bool mac_table_lookup(mac_table_t *t, mac_addr_t *addr, mac_entry_t **out);
 bool mac_table_add_entry(mac_table_t *t, mac_entry_t *entry);
 bool mac_table_delete_entry(mac_table_t *t, mac_addr_t *addr);
 bool mac_table_clear(mac_table_t *t);
-void mac_table_dump(mac_table_t *t);
-bool mac_table_process_reply(mac_table_t *t, ether_hdr_t *ether_hdr, interface_t *intf);
+void mac_table_set_aging(mac_table_t *t, uint64_t aging_ns);
+void mac_table_set_max_entries(mac_table_t *t, uint32_t max_entries); // Doesn't evict: a table over the limit shrinks as entries age out
+uint32_t mac_table_age(mac_table_t *t, uint64_t now_ns); // Removes entries aged out by `now_ns`, returns how many
+void mac_table_dump(mac_table_t *t, node_t *n, uint64_t now_ns, bool show_age); // Interface names come from `n`
+bool mac_table_process_reply(mac_table_t *t, ether_hdr_t *ether_hdr, interface_t *intf, uint64_t now_ns); // Learns the source MAC, only writes if it's new, moved, or last seen a tick ago
 
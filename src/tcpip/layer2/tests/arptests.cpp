@@ -21,7 +21,7 @@ TEST_CASE("ARP table add single entry", "[arp][add]") {
   arp_entry_t entry = {0};
   entry.ip_addr = {.bytes = {192, 168, 1, 100}};
   entry.mac_addr = {.bytes = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF}};
-  strncpy(entry.oif_name, "eth0/0", CONFIG_IF_NAME_SIZE);
+  entry.oif_ifindex = 0;
   // Add an entry
   bool result = arp_table_add_entry(table, &entry);
   REQUIRE(result == true);
@@ -39,7 +39,7 @@ TEST_CASE("ARP table add multiple entries", "[arp][add]") {
     arp_entry_t entry = {0};
     entry.ip_addr = {.bytes = {192, 168, 1, (uint8_t)(100 + i)}};
     entry.mac_addr = {.bytes = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, (uint8_t)(0x00 + i)}};
-    strncpy(entry.oif_name, "eth0/0", CONFIG_IF_NAME_SIZE);
+    entry.oif_ifindex = 0;
     bool result = arp_table_add_entry(table, &entry);
     REQUIRE(result == true);
   }
@@ -56,7 +56,7 @@ TEST_CASE("ARP table lookup", "[arp][lookup]") {
   arp_entry_t entry = {0};
   entry.ip_addr = {.bytes = {10, 0, 0, 1}};
   entry.mac_addr = {.bytes = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66}};
-  strncpy(entry.oif_name, "eth0/1", CONFIG_IF_NAME_SIZE);
+  entry.oif_ifindex = 1;
   arp_table_add_entry(table, &entry);
   // Perform lookups
   SECTION("Lookup existing entry") {
@@ -90,7 +90,7 @@ TEST_CASE("ARP table add duplicate entry", "[arp][add][duplicate]") {
   arp_entry_t entry = {0};
   entry.ip_addr = {.bytes = {172, 16, 0, 10}};
   entry.mac_addr = {.bytes = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF}};
-  strncpy(entry.oif_name, "eth0/0", CONFIG_IF_NAME_SIZE);
+  entry.oif_ifindex = 0;
   bool result1 = arp_table_add_entry(table, &entry);
   REQUIRE(result1 == true);
   // Try to add duplicate (same IP and interface)
@@ -109,14 +109,14 @@ TEST_CASE("ARP table same IP with different interfaces", "[arp][add][interface]"
   arp_entry_t entry1 = {0};
   entry1.ip_addr = {.bytes = {192, 168, 100, 1}};
   entry1.mac_addr = {.bytes = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0x01}};
-  strncpy(entry1.oif_name, "eth0/0", CONFIG_IF_NAME_SIZE);
+  entry1.oif_ifindex = 0;
   bool result1 = arp_table_add_entry(table, &entry1);
   REQUIRE(result1 == true);
   // Add second entry with same IP but different interface
   arp_entry_t entry2 = {0};
   entry2.ip_addr = {.bytes = {192, 168, 100, 1}};  // Same IP
   entry2.mac_addr = {.bytes = {0xFF, 0xEE, 0xDD, 0xCC, 0xBB, 0x02}};
-  strncpy(entry2.oif_name, "eth0/1", CONFIG_IF_NAME_SIZE);  // Different interface
+  entry2.oif_ifindex = 1;  // Different interface
   bool result2 = arp_table_add_entry(table, &entry2);
   REQUIRE(result2 == true);
   // Verify by looking up - should find one of them
@@ -138,7 +138,7 @@ TEST_CASE("ARP table delete operations", "[arp][delete]") {
   arp_entry_t entry = {0};
   entry.ip_addr = {.bytes = {10, 10, 10, 10}};
   entry.mac_addr = {.bytes = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06}};
-  strncpy(entry.oif_name, "eth0/0", CONFIG_IF_NAME_SIZE);
+  entry.oif_ifindex = 0;
   arp_table_add_entry(table, &entry);
   // Delete entries
   SECTION("Delete existing entry") {
@@ -170,7 +170,7 @@ TEST_CASE("ARP table clear", "[arp][clear]") {
     arp_entry_t entry = {0};
     entry.ip_addr = {.bytes = {192, 168, 0, (uint8_t)(1 + i)}};
     entry.mac_addr = {.bytes = {0x00, 0x11, 0x22, 0x33, 0x44, (uint8_t)(0x50 + i)}};
-    strncpy(entry.oif_name, "eth0/0", CONFIG_IF_NAME_SIZE);
+    entry.oif_ifindex = 0;
     arp_table_add_entry(table, &entry);
   }
   // Clear table
@@ -1,63 +1,706 @@
 // layer2test.cpp
 
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
 #include "catch2.hpp"
 #include "layer2.h"
 #include "phy.h"
 #include "graph.h"
+#include "topo.h"
 #include "ether_hdr.h"
 #include "vlan_tag.h"
 #include "arp_hdr.h"
+#include "mac_table.h"
+#include "vlan_flood.h"
+#include "prof.h"
+#include "trace.h"
+#include "pcap.h"
+#include "pkt_pool.h"
 
-extern bool phy_frame_buffer_shift_right(uint8_t **pktptr, uint32_t pktlen, uint32_t buflen);
+TEST_CASE("Packet buffer headroom and tailroom", "[layer2][buffer]") {
+  uint8_t storage[64];
+  pkt_buf_t pkt;
+  REQUIRE(pkt_buf_init(&pkt, storage, sizeof(storage), 16) == true);
+  REQUIRE(pkt.data_len == 0);
+  REQUIRE(pkt_buf_headroom(&pkt) == 16);
+  REQUIRE(pkt_buf_tailroom(&pkt) == 48);
+  SECTION("Append and trim work at the tail") {
+    uint8_t *tail = pkt_buf_append(&pkt, 8);
+    REQUIRE(tail == storage + 16);
+    REQUIRE(pkt.data_len == 8);
+    REQUIRE(pkt_buf_tailroom(&pkt) == 40);
+    REQUIRE(pkt_buf_trim(&pkt, 3) == true);
+    REQUIRE(pkt.data_len == 5);
+    REQUIRE(pkt_buf_headroom(&pkt) == 16);
+  }
+  SECTION("Prepend and adj work at the head, without moving the data") {
+    uint8_t *payload = pkt_buf_append(&pkt, 4);
+    memcpy(payload, "abcd", 4);
+    uint8_t *hdr = pkt_buf_prepend(&pkt, 10);
+    REQUIRE(hdr == payload - 10);
+    REQUIRE(PKT_BUF_MTOD(&pkt, uint8_t *) == hdr);
+    REQUIRE(pkt.data_len == 14);
+    REQUIRE(pkt_buf_headroom(&pkt) == 6);
+    REQUIRE(pkt_buf_adj(&pkt, 10) == payload);
+    REQUIRE(pkt.data_len == 4);
+    REQUIRE(memcmp(PKT_BUF_MTOD(&pkt, uint8_t *), "abcd", 4) == 0);
+  }
+}
+
+TEST_CASE("Packet buffer boundary conditions", "[layer2][buffer][boundary]") {
+  err_logging_disable_guard_t guard; // We expect errors, so silence err logging
+  uint8_t storage[32];
+  pkt_buf_t pkt;
+  REQUIRE(pkt_buf_init(&pkt, storage, sizeof(storage), 8) == true);
+  REQUIRE(pkt_buf_append(&pkt, 4) != nullptr);
+  SECTION("Headroom is bounded") {
+    REQUIRE(pkt_buf_prepend(&pkt, 9) == nullptr);
+    REQUIRE(pkt_buf_prepend(&pkt, 8) == storage);
+    REQUIRE(pkt_buf_prepend(&pkt, 1) == nullptr);
+  }
+  SECTION("Tailroom is bounded") {
+    REQUIRE(pkt_buf_append(&pkt, 21) == nullptr);
+    REQUIRE(pkt_buf_append(&pkt, 20) != nullptr);
+    REQUIRE(pkt_buf_tailroom(&pkt) == 0);
+  }
+  SECTION("Can't strip more than the data") {
+    REQUIRE(pkt_buf_adj(&pkt, 5) == nullptr);
+    REQUIRE(pkt_buf_trim(&pkt, 5) == false);
+    REQUIRE(pkt.data_len == 4);
+  }
+  SECTION("Headroom can't exceed the buffer") {
+    REQUIRE(pkt_buf_init(&pkt, storage, sizeof(storage), 33) == false);
+    REQUIRE(pkt_buf_create(16, 17) == nullptr);
+  }
+  SECTION("Owned buffers") {
+    pkt_buf_t *owned = pkt_buf_create(128, 32);
+    REQUIRE(owned != nullptr);
+    REQUIRE(owned->owned == true);
+    REQUIRE(pkt_buf_headroom(owned) == 32);
+    REQUIRE(pkt_buf_tailroom(owned) == 96);
+    pkt_buf_destroy(owned);
+  }
+}
+
+TEST_CASE("In place VLAN tagging", "[layer2][buffer][vlan]") {
+  uint8_t storage[128] = {0};
+  pkt_buf_t pkt;
+  pkt_buf_init(&pkt, storage, sizeof(storage), 32);
+  ether_hdr_t *hdr = (ether_hdr_t *)pkt_buf_append(&pkt, sizeof(ether_hdr_t) + 4);
+  mac_addr_t src = {.bytes = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0x01}};
+  mac_addr_t dst = {.bytes = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0x02}};
+  ether_hdr_set_src_mac(hdr, &src);
+  ether_hdr_set_dst_mac(hdr, &dst);
+  ether_hdr_set_type(hdr, ETHER_TYPE_IPV4);
+  uint8_t *payload = (uint8_t *)(hdr + 1);
+  memcpy(payload, "abcd", 4);
+  REQUIRE(ether_frame_tag_vlan(&pkt, 100) == true);
+  ether_hdr_t *tagged_hdr = PKT_BUF_MTOD(&pkt, ether_hdr_t *);
+  vlan_tag_t *tag = (vlan_tag_t *)(tagged_hdr + 1);
+  REQUIRE(pkt.data_len == sizeof(ether_hdr_t) + sizeof(vlan_tag_t) + 4);
+  REQUIRE(ETHER_HDR_VLAN_TAGGED(tagged_hdr));
+  REQUIRE(vlan_tag_read_vlan_id(tag) == 100);
+  REQUIRE(vlan_tag_read_ether_type(tag) == ETHER_TYPE_IPV4);
+  REQUIRE(MAC_ADDR_IS_EQUAL(ether_hdr_read_src_mac(tagged_hdr), src));
+  REQUIRE(MAC_ADDR_IS_EQUAL(ether_hdr_read_dst_mac(tagged_hdr), dst));
+  REQUIRE((uint8_t *)(tag + 1) == payload); // Payload didn't move
+  SECTION("Tagging a tagged frame is a no-op") {
+    REQUIRE(ether_frame_tag_vlan(&pkt, 200) == true);
+    REQUIRE(PKT_BUF_MTOD(&pkt, ether_hdr_t *) == tagged_hdr);
+    REQUIRE(vlan_tag_read_vlan_id(tag) == 100);
+  }
+  SECTION("Untagging restores the original frame") {
+    REQUIRE(ether_frame_untag_vlan(&pkt) == true);
+    ether_hdr_t *untagged_hdr = PKT_BUF_MTOD(&pkt, ether_hdr_t *);
+    REQUIRE(untagged_hdr == hdr);
+    REQUIRE(pkt.data_len == sizeof(ether_hdr_t) + 4);
+    REQUIRE(ether_hdr_read_type(untagged_hdr) == ETHER_TYPE_IPV4);
+    REQUIRE(MAC_ADDR_IS_EQUAL(ether_hdr_read_src_mac(untagged_hdr), src));
+    REQUIRE(MAC_ADDR_IS_EQUAL(ether_hdr_read_dst_mac(untagged_hdr), dst));
+    REQUIRE(memcmp(payload, "abcd", 4) == 0);
+  }
+}
+
+static mac_addr_t TEST_FLOOD_SRC_MAC {.bytes = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0x03}};
+static mac_addr_t TEST_FLOOD_BCAST_MAC {.bytes = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}};
+
+static void test_flood_build_arp_request(uint8_t *frame) {
+  ether_hdr_t *hdr = (ether_hdr_t *)frame;
+  ether_hdr_set_src_mac(hdr, &TEST_FLOOD_SRC_MAC);
+  ether_hdr_set_dst_mac(hdr, &TEST_FLOOD_BCAST_MAC);
+  ether_hdr_set_type(hdr, ETHER_TYPE_ARP);
+  arp_hdr_t *arp_hdr = (arp_hdr_t *)(hdr + 1);
+  arp_hdr_set_hw_type(arp_hdr, ARP_HW_TYPE_ETHERNET);
+  arp_hdr_set_proto_type(arp_hdr, ETHER_TYPE_IPV4);
+  arp_hdr_set_hw_addr_len(arp_hdr, 6);
+  arp_hdr_set_proto_addr_len(arp_hdr, 4);
+  arp_hdr_set_op_code(arp_hdr, ARP_OP_CODE_REQUEST);
+  arp_hdr_set_src_mac(arp_hdr, &TEST_FLOOD_SRC_MAC);
+  arp_hdr_set_dst_ip(arp_hdr, 0x0A000063); // 10.0.0.99
+}
+
+TEST_CASE("Flooding shares the payload across egress ports", "[layer2][buffer][flood]") {
+  graph_t *topo = graph_create_dual_switch_topology();
+  node_t *SW1 = graph_find_node_by_name(topo, "SW1");
+  interface_t *iintf = node_get_interface_by_name(SW1, "eth0/2"); // ACCESS (VLAN 10)
+  REQUIRE(iintf != nullptr);
+  // Record whatever goes out
+  std::map<std::string, std::vector<uint8_t>> sent;
+  NODE_NETSTACK(SW1).phy.send = [&sent](node_t *n, interface_t *intf, pkt_buf_t *pkt) -> int {
+    std::vector<uint8_t> frame(pkt_buf_pkt_len(pkt));
+    pkt_buf_copy_data(pkt, frame.data(), frame.size());
+    sent[intf->if_name] = frame;
+    return frame.size();
+  };
+  // Broadcast ARP request for an address nobody owns (so that the SVI stays quiet)
+  uint8_t frame[sizeof(ether_hdr_t) + sizeof(arp_hdr_t)] = {0};
+  test_flood_build_arp_request(frame);
+  uint8_t storage[CONFIG_PKT_BUF_HEADROOM + sizeof(frame)];
+  pkt_buf_t pkt;
+  pkt_buf_init(&pkt, storage, sizeof(storage), CONFIG_PKT_BUF_HEADROOM);
+  memcpy(pkt_buf_append(&pkt, sizeof(frame)), frame, sizeof(frame));
+  layer2_node_recv_frame(SW1, iintf, &pkt);
+  // Other VLAN 10 ACCESS port gets the frame as it came in
+  REQUIRE(sent.count("eth0/7") == 1);
+  REQUIRE(sent["eth0/7"] == std::vector<uint8_t>(frame, frame + sizeof(frame)));
+  // TRUNK gets it tagged
+  REQUIRE(sent.count("eth0/5") == 1);
+  std::vector<uint8_t> &tagged = sent["eth0/5"];
+  REQUIRE(tagged.size() == sizeof(frame) + sizeof(vlan_tag_t));
+  ether_hdr_t *tagged_hdr = (ether_hdr_t *)tagged.data();
+  REQUIRE(ETHER_HDR_VLAN_TAGGED(tagged_hdr));
+  REQUIRE(vlan_tag_read_vlan_id((vlan_tag_t *)(tagged_hdr + 1)) == 10);
+  REQUIRE(memcmp(tagged.data() + sizeof(ether_hdr_t) + sizeof(vlan_tag_t), frame + sizeof(ether_hdr_t), sizeof(arp_hdr_t)) == 0);
+  // Nothing leaks into VLAN 11
+  REQUIRE(sent.count("eth0/6") == 0);
+  // The input frame is left alone, and no references are left behind
+  REQUIRE(pkt.data_len == tagged.size());
+  REQUIRE(memcmp(PKT_BUF_MTOD(&pkt, uint8_t *), tagged.data(), tagged.size()) == 0);
+  REQUIRE(pkt_buf_refcnt_read(&pkt) == 1);
+}
+
+TEST_CASE("Interface counters track frames, floods and ARP", "[layer2][stats]") {
+  graph_t *topo = graph_create_dual_switch_topology();
+  node_t *SW1 = graph_find_node_by_name(topo, "SW1");
+  NODE_NETSTACK(SW1).phy.send = [](node_t *n, interface_t *intf, pkt_buf_t *pkt) -> int {
+    return strcmp(intf->if_name, "eth0/5") == 0 ? -1 : (int)pkt_buf_pkt_len(pkt); // TRUNK is down
+  };
+  uint8_t frame[sizeof(ether_hdr_t) + sizeof(arp_hdr_t)] = {0};
+  test_flood_build_arp_request(frame);
+  interface_t *iintf = node_get_interface_by_name(SW1, "eth0/2");
+  for (uint32_t i = 0; i < 3; i++) {
+    uint8_t storage[CONFIG_PKT_BUF_HEADROOM + sizeof(frame)];
+    pkt_buf_t pkt;
+    pkt_buf_init(&pkt, storage, sizeof(storage), CONFIG_PKT_BUF_HEADROOM);
+    memcpy(pkt_buf_append(&pkt, sizeof(frame)), frame, sizeof(frame));
+    layer2_node_recv_frame(SW1, iintf, &pkt);
+  }
+  // Ingress
+  REQUIRE(iintf->stats.rx_frames.load() == 3);
+  REQUIRE(iintf->stats.rx_bytes.load() == 3 * sizeof(frame));
+  REQUIRE(iintf->stats.rx_drops.load() == 0);
+  REQUIRE(iintf->stats.flooded.load() == 3);
+  // Egress
+  interface_t *access = node_get_interface_by_name(SW1, "eth0/7");
+  REQUIRE(access->stats.tx_frames.load() == 3);
+  REQUIRE(access->stats.tx_bytes.load() == 3 * sizeof(frame));
+  interface_t *trunk = node_get_interface_by_name(SW1, "eth0/5");
+  REQUIRE(trunk->stats.tx_frames.load() == 0);
+  REQUIRE(trunk->stats.tx_drops.load() == 3);
+  REQUIRE(node_get_interface_by_name(SW1, "eth0/6")->stats.tx_frames.load() == 0);
+  // The SVI saw the requests, and ignored them (not its address)
+  interface_t *svi = node_get_interface_by_name(SW1, "svi1/10");
+  REQUIRE(svi->stats.arp_req_rx.load() == 3);
+  REQUIRE(svi->stats.arp_reply_tx.load() == 0);
+  REQUIRE(svi->stats.rx_drops.load() == 3);
+  // Per node, by reason
+  REQUIRE(SW1->drops[DROP_PHY_TX_FAILED].load() == 3);
+  REQUIRE(SW1->drops[DROP_ARP_NOT_FOR_US].load() == 3);
+  REQUIRE(SW1->drops[DROP_L2_TX_FOREIGN_VLAN].load() == 0); // Flooding skips ports, doesn't drop
+  SECTION("JSON export") {
+    char *json = nullptr;
+    size_t len = 0;
+    FILE *out = open_memstream(&json, &len);
+    node_stats_dump_json(SW1, out);
+    fclose(out);
+    std::string s(json, len);
+    free(json);
+    REQUIRE(s.rfind("{\"node\":\"SW1\",\"interfaces\":[", 0) == 0);
+    REQUIRE(s.find("{\"name\":\"eth0/2\",\"ifindex\":") != std::string::npos);
+    REQUIRE(s.find("\"rx_frames\":3,\"rx_bytes\":" + std::to_string(3 * sizeof(frame))) != std::string::npos);
+    REQUIRE(s.back() == '}');
+  }
+  SECTION("Reset") {
+    interface_stats_reset(iintf);
+    REQUIRE(iintf->stats.rx_frames.load() == 0);
+    REQUIRE(iintf->stats.flooded.load() == 0);
+  }
+}
+
+TEST_CASE("Layer 2 drops are counted by reason", "[layer2][stats][drops]") {
+  err_logging_disable_guard_t guard; // We expect errors, so silence err logging
+  graph_t *topo = graph_create_dual_switch_topology();
+  node_t *SW1 = graph_find_node_by_name(topo, "SW1");
+  uint8_t frame[sizeof(ether_hdr_t) + sizeof(arp_hdr_t)] = {0};
+  test_flood_build_arp_request(frame);
+  auto recv = [SW1, &frame](const char *if_name, uint32_t len) {
+    uint8_t storage[CONFIG_PKT_BUF_HEADROOM + sizeof(frame)];
+    pkt_buf_t pkt;
+    pkt_buf_init(&pkt, storage, sizeof(storage), CONFIG_PKT_BUF_HEADROOM);
+    memcpy(pkt_buf_append(&pkt, len), frame, len);
+    layer2_node_recv_frame(SW1, node_get_interface_by_name(SW1, if_name), &pkt);
+  };
+  recv("eth0/5", sizeof(frame));         // Untagged on a TRUNK
+  recv("eth0/2", sizeof(ether_hdr_t) - 1); // Runt
+  recv("svi1/10", sizeof(frame));        // Nothing comes in through an SVI
+  REQUIRE(SW1->drops[DROP_L2_TRUNK_UNTAGGED].load() == 1);
+  REQUIRE(SW1->drops[DROP_L2_RUNT].load() == 1);
+  REQUIRE(SW1->drops[DROP_L2_SVI_INGRESS].load() == 1);
+  REQUIRE(node_get_interface_by_name(SW1, "svi1/10")->stats.rx_drops.load() == 1);
+  REQUIRE(node_get_interface_by_name(SW1, "eth0/5")->stats.rx_drops.load() == 1);
+  REQUIRE(strcmp(drop_reason_str(DROP_L2_RUNT), "l2: runt frame") == 0);
+  // Demoting to a next hop we have no subnet for
+  uint8_t payload[64] = {0};
+  pkt_buf_t pkt;
+  pkt_buf_init(&pkt, payload, sizeof(payload), 0);
+  pkt_buf_append(&pkt, sizeof(payload));
+  ipv4_addr_t far = {.bytes = {99, 0, 0, 1}};
+  layer2_demote(SW1, &far, nullptr, &pkt, ETHER_TYPE_IPV4);
+  REQUIRE(SW1->drops[DROP_L2_NO_SUBNET].load() == 1);
+  // Out of pooled buffers, to promote a flooded frame to the SVI or park a
+  // packet until ARP resolves
+  std::vector<pkt_buf_t *> drained;
+  while (pkt_buf_t *b = pkt_pool_alloc(pkt_pool_default())) {
+    drained.push_back(b);
+  }
+  phy_set_frame_logging(false);
+  recv("eth0/2", sizeof(frame)); // Flooded in VLAN 10, svi1/10 included
+  phy_set_frame_logging(true);
+  ipv4_addr_t near = {.bytes = {10, 0, 0, 99}};
+  layer2_demote(SW1, &near, nullptr, &pkt, ETHER_TYPE_IPV4);
+  for (pkt_buf_t *b : drained) {
+    pkt_buf_destroy(b);
+  }
+  REQUIRE(SW1->drops[DROP_POOL_EXHAUSTED].load() == 2);
+  node_drops_reset(SW1);
+  for (uint32_t i = 0; i < DROP_REASON_COUNT; i++) {
+    REQUIRE(SW1->drops[i].load() == 0);
+  }
+}
+
+TEST_CASE("Stage profiling records per node, only while enabled", "[layer2][prof]") {
+  graph_t *topo = graph_create_dual_switch_topology();
+  node_t *SW1 = graph_find_node_by_name(topo, "SW1");
+  NODE_NETSTACK(SW1).phy.send = [](node_t *n, interface_t *intf, pkt_buf_t *pkt) -> int {
+    return (int)pkt_buf_pkt_len(pkt);
+  };
+  uint8_t frame[sizeof(ether_hdr_t) + sizeof(arp_hdr_t)] = {0};
+  test_flood_build_arp_request(frame);
+  auto recv = [SW1, &frame]() {
+    uint8_t storage[CONFIG_PKT_BUF_HEADROOM + sizeof(frame)];
+    pkt_buf_t pkt;
+    pkt_buf_init(&pkt, storage, sizeof(storage), CONFIG_PKT_BUF_HEADROOM);
+    memcpy(pkt_buf_append(&pkt, sizeof(frame)), frame, sizeof(frame));
+    layer2_node_recv_frame(SW1, node_get_interface_by_name(SW1, "eth0/2"), &pkt);
+  };
+  recv();
+  REQUIRE(SW1->prof == nullptr); // Off by default
+  prof_set_enabled(true);
+  recv();
+  prof_set_enabled(false);
+  recv();
+  REQUIRE(SW1->prof != nullptr);
+  REQUIRE(hist_count(&SW1->prof->stages[PROF_STAGE_L2_RX]) == 1);
+  REQUIRE(hist_count(&SW1->prof->stages[PROF_STAGE_L2_SWITCH]) == 1);
+  REQUIRE(hist_count(&SW1->prof->stages[PROF_STAGE_PHY_TX]) == 2); // ACCESS and TRUNK ports
+  REQUIRE(hist_count(&SW1->prof->stages[PROF_STAGE_L3_PROMOTE]) == 0);
+  // Stages nest, so the outer one can't be faster than the inner one
+  REQUIRE(SW1->prof->stages[PROF_STAGE_L2_RX].sum.load() >= SW1->prof->stages[PROF_STAGE_L2_SWITCH].sum.load());
+  node_prof_reset(SW1);
+  REQUIRE(hist_count(&SW1->prof->stages[PROF_STAGE_L2_RX]) == 0);
+}
+
+TEST_CASE("Packet tracer records marked packets only", "[layer2][trace]") {
+  graph_t *topo = graph_create_dual_switch_topology();
+  node_t *SW1 = graph_find_node_by_name(topo, "SW1");
+  NODE_NETSTACK(SW1).phy.send = [](node_t *n, interface_t *intf, pkt_buf_t *pkt) -> int {
+    return (int)pkt_buf_pkt_len(pkt);
+  };
+  interface_t *iintf = node_get_interface_by_name(SW1, "eth0/2");
+  uint8_t frame[sizeof(ether_hdr_t) + sizeof(arp_hdr_t)] = {0};
+  test_flood_build_arp_request(frame);
+  auto recv = [SW1, iintf](uint8_t *frame, uint32_t framelen) {
+    uint8_t storage[CONFIG_PKT_BUF_HEADROOM + CONFIG_MAX_PACKET_BUFFER_SIZE];
+    pkt_buf_t pkt;
+    pkt_buf_init(&pkt, storage, sizeof(storage), CONFIG_PKT_BUF_HEADROOM);
+    memcpy(pkt_buf_append(&pkt, framelen), frame, framelen);
+    layer2_node_recv_frame(SW1, iintf, &pkt);
+  };
+  trace_clear();
+  recv(frame, sizeof(frame));
+  REQUIRE(trace_records().empty()); // Nothing marked
+  trace_add(SW1, 2);
+  recv(frame, sizeof(frame));
+  recv(frame, 10); // Runt
+  recv(frame, sizeof(frame)); // Out of marks
+  REQUIRE(SW1->trace_budget == 0);
+  std::vector<trace_rec_t> recs = trace_records();
+  REQUIRE(recs.size() == 6);
+  // Flooded packet
+  uint32_t id = recs[0].trace_id;
+  REQUIRE(id != 0);
+  REQUIRE(recs[0].node == SW1);
+  REQUIRE(recs[0].ifindex == iintf->ifindex);
+  REQUIRE(recs[0].stage == PROF_STAGE_L2_RX);
+  REQUIRE(recs[0].decision == TRACE_RECEIVED);
+  REQUIRE(recs[0].vlan_id == INTF_NETPROP(iintf).l2.port_vlan);
+  REQUIRE(recs[1].trace_id == id);
+  REQUIRE(recs[1].stage == PROF_STAGE_L2_SWITCH);
+  REQUIRE(recs[1].decision == TRACE_FLOODED);
+  uint32_t sent = 0, local = 0;
+  for (uint32_t i = 2; i < 5; i++) {
+    REQUIRE(recs[i].trace_id == id);
+    REQUIRE(recs[i].ifindex != iintf->ifindex);
+    sent += recs[i].stage == PROF_STAGE_PHY_TX && recs[i].decision == TRACE_SENT;
+    local += recs[i].stage == PROF_STAGE_L2_RX && recs[i].decision == TRACE_LOCAL;
+  }
+  REQUIRE(sent == 2); // ACCESS and TRUNK ports
+  REQUIRE(local == 1); // The SVI's copy (ARP)
+  // Runt
+  REQUIRE(recs[5].trace_id > id);
+  REQUIRE(recs[5].decision == TRACE_DROPPED);
+  REQUIRE(recs[5].reason == DROP_L2_RUNT);
+  trace_dump();
+  trace_clear();
+  REQUIRE(trace_records().empty());
+}
+
+TEST_CASE("Interface capture writes pcap and pcapng files", "[layer2][pcap]") {
+  graph_t *topo = graph_create_dual_switch_topology();
+  node_t *SW1 = graph_find_node_by_name(topo, "SW1");
+  NODE_NETSTACK(SW1).phy.send = [](node_t *n, interface_t *intf, pkt_buf_t *pkt) -> int {
+    return (int)pkt_buf_pkt_len(pkt);
+  };
+  interface_t *iintf = node_get_interface_by_name(SW1, "eth0/2");
+  interface_t *ointf = node_get_interface_by_name(SW1, "eth0/7");
+  uint8_t frame[sizeof(ether_hdr_t) + sizeof(arp_hdr_t)] = {0};
+  test_flood_build_arp_request(frame);
+  char in_path[] = "/tmp/layer2tests_in.pcap";
+  char out_path[] = "/tmp/layer2tests_out.pcapng";
+  REQUIRE(pcap_capture_start(iintf, in_path) == true);
+  REQUIRE(pcap_capture_start(iintf, in_path) == false); // One at a time
+  {
+    // A rejected start leaves its file alone
+    char other_path[] = "/tmp/layer2tests_other.pcap";
+    FILE *f = fopen(other_path, "wb");
+    REQUIRE(f != nullptr);
+    fputs("keep", f);
+    fclose(f);
+    REQUIRE(pcap_capture_start(iintf, other_path) == false);
+    struct stat st;
+    REQUIRE(stat(other_path, &st) == 0);
+    REQUIRE(st.st_size == 4);
+    unlink(other_path);
+  }
+  REQUIRE(pcap_capture_start(ointf, out_path) == true);
+  {
+    node_lock_guard_t guard(SW1);
+    REQUIRE(layer2_node_recv_frame_bytes(SW1, iintf, frame, sizeof(frame)) >= 0);
+  }
+  pcap_capture_stats_t stats;
+  REQUIRE(pcap_capture_stop(iintf, &stats) == true);
+  REQUIRE(stats.frames == 1);
+  REQUIRE(stats.dropped == 0);
+  REQUIRE(pcap_capture_stop(ointf, &stats) == true);
+  REQUIRE(stats.frames == 1);
+  REQUIRE(pcap_capture_stop(ointf, &stats) == false); // Already stopped
+  auto read_file = [](const char *path) {
+    std::vector<uint8_t> data;
+    FILE *f = fopen(path, "rb");
+    REQUIRE(f != nullptr);
+    uint8_t buf[4096];
+    size_t len = 0;
+    while ((len = fread(buf, 1, sizeof(buf), f)) > 0) {
+      data.insert(data.end(), buf, buf + len);
+    }
+    fclose(f);
+    return data;
+  };
+  auto u32 = [](const uint8_t *p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; };
+  SECTION("libpcap: global header and the ingress frame as is") {
+    std::vector<uint8_t> data = read_file(in_path);
+    REQUIRE(data.size() == 24 + 16 + sizeof(frame));
+    REQUIRE(u32(&data[0]) == 0xA1B23C4D); // ns timestamps
+    REQUIRE(u32(&data[20]) == 1); // Ethernet
+    REQUIRE(u32(&data[24 + 8]) == sizeof(frame));
+    REQUIRE(u32(&data[24 + 12]) == sizeof(frame));
+    REQUIRE(memcmp(&data[24 + 16], frame, sizeof(frame)) == 0);
+  }
+  SECTION("pcapng: interface name in the IDB, direction in the EPB") {
+    std::vector<uint8_t> data = read_file(out_path);
+    REQUIRE(data.size() > 28);
+    REQUIRE(u32(&data[0]) == 0x0A0D0D0A);
+    REQUIRE(u32(&data[8]) == 0x1A2B3C4D);
+    uint32_t off = u32(&data[4]);
+    REQUIRE(u32(&data[off]) == 1); // IDB
+    REQUIRE(memcmp(&data[off + 16 + 4], "eth0/7", 6) == 0); // First option is `if_name`
+    off += u32(&data[off + 4]);
+    REQUIRE(u32(&data[off]) == 6); // EPB
+    uint32_t block_len = u32(&data[off + 4]);
+    REQUIRE(off + block_len == data.size());
+    REQUIRE(u32(&data[off + block_len - 4]) == block_len);
+    uint32_t caplen = u32(&data[off + 20]);
+    REQUIRE(caplen == sizeof(frame)); // Left untagged through the ACCESS port
+    REQUIRE(memcmp(&data[off + 28], frame, caplen) == 0);
+    uint32_t opt = off + 28 + ((caplen + 3) & ~3);
+    REQUIRE(u32(&data[opt]) == ((4 << 16) | 2)); // `epb_flags`, 4 bytes
+    REQUIRE(u32(&data[opt + 4]) == PCAP_CAPTURE_OUT);
+  }
+  unlink(in_path);
+  unlink(out_path);
+}
+
+TEST_CASE("MAC learning only writes new or moved stations", "[layer2][mac]") {
+  graph_t *topo = graph_create_dual_switch_topology();
+  node_t *SW1 = graph_find_node_by_name(topo, "SW1");
+  interface_t *eth2 = node_get_interface_by_name(SW1, "eth0/2");
+  interface_t *eth7 = node_get_interface_by_name(SW1, "eth0/7");
+  mac_addr_t src = {.bytes = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01}};
+  ether_hdr_t hdr = {0};
+  ether_hdr_set_src_mac(&hdr, &src);
+  mac_table_t *t = nullptr;
+  mac_table_init(&t);
+  auto count = [t]() {
+    uint32_t n = 0;
+    glthread_t *curr = nullptr;
+    GLTHREAD_FOREACH_BEGIN(&t->mac_entries, curr) { n++; }
+    GLTHREAD_FOREACH_END();
+    return n;
+  };
+  mac_entry_t *entry = nullptr;
+  // New station
+  REQUIRE(mac_table_process_reply(t, &hdr, eth2, 0));
+  REQUIRE(mac_table_lookup(t, &src, &entry));
+  REQUIRE(entry->oif_ifindex == eth2->ifindex);
+  // Seen again on the same interface
+  REQUIRE(mac_table_process_reply(t, &hdr, eth2, 0));
+  REQUIRE(t->station_moves == 0);
+  REQUIRE(count() == 1);
+  // Moved
+  REQUIRE(mac_table_process_reply(t, &hdr, eth7, 0));
+  REQUIRE(mac_table_lookup(t, &src, &entry));
+  REQUIRE(entry->oif_ifindex == eth7->ifindex);
+  REQUIRE(t->station_moves == 1);
+  REQUIRE(count() == 1);
+  mac_table_clear(t);
+}
+
+TEST_CASE("Configured MAC entries don't move", "[layer2][mac]") {
+  graph_t *topo = graph_create_dual_switch_topology();
+  node_t *SW1 = graph_find_node_by_name(topo, "SW1");
+  interface_t *svi = node_get_interface_by_name(SW1, "svi1/10");
+  interface_t *eth2 = node_get_interface_by_name(SW1, "eth0/2");
+  mac_table_t *t = SW1->netprop.mac_table;
+  // A frame spoofing the SVI's MAC, on a user port
+  ether_hdr_t hdr = {0};
+  ether_hdr_set_src_mac(&hdr, INTF_MAC_PTR(svi));
+  REQUIRE(mac_table_process_reply(t, &hdr, eth2, phy_node_clock_ns(SW1)));
+  mac_entry_t *entry = nullptr;
+  REQUIRE(mac_table_lookup(t, INTF_MAC_PTR(svi), &entry));
+  REQUIRE(entry->is_static);
+  REQUIRE(entry->oif_ifindex == svi->ifindex);
+  REQUIRE(t->station_moves == 0);
+}
+
+TEST_CASE("MAC entries age out, and learning stops when full", "[layer2][mac]") {
+  graph_t *topo = graph_create_dual_switch_topology();
+  node_t *SW1 = graph_find_node_by_name(topo, "SW1");
+  interface_t *eth2 = node_get_interface_by_name(SW1, "eth0/2");
+  const uint64_t sec = 1000000000ull;
+  auto frame = [](uint8_t station) {
+    mac_addr_t src = {.bytes = {0x02, 0x00, 0x00, 0x00, 0x00, station}};
+    ether_hdr_t hdr = {0};
+    ether_hdr_set_src_mac(&hdr, &src);
+    return hdr;
+  };
+  mac_table_t *t = nullptr;
+  mac_table_init(&t);
+  mac_table_set_aging(t, 10 * sec);
+  mac_table_set_max_entries(t, 3);
+  // A configured entry, which never ages
+  mac_entry_t configured = {0};
+  configured.mac_addr = {.bytes = {0x02, 0x00, 0x00, 0x00, 0x00, 0xff}};
+  configured.oif_ifindex = node_get_interface_by_name(SW1, "eth0/7")->ifindex;
+  REQUIRE(mac_table_add_entry(t, &configured));
+  // Fill up: the third station isn't learnt
+  ether_hdr_t hdr1 = frame(1), hdr2 = frame(2), hdr3 = frame(3);
+  REQUIRE(mac_table_process_reply(t, &hdr1, eth2, 100 * sec));
+  REQUIRE(mac_table_process_reply(t, &hdr2, eth2, 100 * sec));
+  REQUIRE(mac_table_process_reply(t, &hdr3, eth2, 100 * sec));
+  REQUIRE(t->entry_count == 3);
+  REQUIRE(t->learn_refused == 1);
+  mac_entry_t *entry = nullptr;
+  REQUIRE(!mac_table_lookup(t, &hdr3.src_mac, &entry));
+  // Station 1 keeps talking, station 2 goes quiet
+  for (uint64_t s = 101; s <= 115; s++) {
+    REQUIRE(mac_table_process_reply(t, &hdr1, eth2, s * sec));
+  }
+  REQUIRE(t->aged_out == 1);
+  REQUIRE(!mac_table_lookup(t, &hdr2.src_mac, &entry));
+  REQUIRE(mac_table_lookup(t, &hdr1.src_mac, &entry));
+  REQUIRE(entry->last_seen_ns == 115 * sec);
+  // Room again
+  REQUIRE(mac_table_process_reply(t, &hdr3, eth2, 115 * sec));
+  REQUIRE(mac_table_lookup(t, &hdr3.src_mac, &entry));
+  // Everyone quiet: learnt entries go, the configured one stays
+  REQUIRE(mac_table_age(t, 200 * sec) == 2);
+  REQUIRE(t->entry_count == 1);
+  REQUIRE(mac_table_lookup(t, &configured.mac_addr, &entry));
+  // No aging
+  mac_table_set_aging(t, 0);
+  REQUIRE(mac_table_process_reply(t, &hdr1, eth2, 300 * sec));
+  REQUIRE(mac_table_age(t, 100000 * sec) == 0);
+  REQUIRE(t->entry_count == 2);
+  mac_table_clear(t);
+  REQUIRE(t->entry_count == 0);
+  REQUIRE(t->aging.pending == 0);
+}
+
+// "<port>:<action>,..." for `vlan_id`'s flood list
+static std::string test_flood_list_str(node_t *n, uint16_t vlan_id) {
+  static const char *actions[] = {"?", "untag", "tagged", "promote"};
+  std::string s;
+  const vlan_flood_list_t *flood = vlan_flood_lookup(n->netprop.flood_table, vlan_id);
+  for (uint32_t i = 0; flood && i < flood->count; i++) {
+    REQUIRE(flood->ports & (1u << flood->port[i].ifindex));
+    s += std::string(s.empty() ? "" : ",") + n->intf[flood->port[i].ifindex]->if_name + ":" + actions[flood->port[i].action];
+  }
+  REQUIRE((flood ? __builtin_popcount(flood->ports) : 0) == (int)(flood ? flood->count : 0));
+  return s;
+}
 
-TEST_CASE("Packet buffer shift right with different packet lengths", "[layer2][phy][buffer]") {
-  SECTION("Shift right with pktlen=2") {
-    uint8_t buf[] = {0xFF, 0xFF, 0x00, 0x00};
-    uint8_t *buf_ptr = buf;
-    bool result = phy_frame_buffer_shift_right(&buf_ptr, 2, 4);
-    REQUIRE(result == true);
-    uint8_t buf_exp[] = {0x00, 0x00, 0xFF, 0xFF};
-    REQUIRE(memcmp((void *)buf, (void *)buf_exp, 4) == 0);
-  }
-  SECTION("Shift right with pktlen=3") {
-    uint8_t buf[] = {0xFF, 0xFF, 0x00, 0x00};
-    uint8_t *buf_ptr = buf;
-    bool result = phy_frame_buffer_shift_right(&buf_ptr, 3, 4);
-    REQUIRE(result == true);
-    uint8_t buf_exp[] = {0x00, 0xFF, 0xFF, 0x00};
-    REQUIRE(memcmp((void *)buf, (void *)buf_exp, 4) == 0);
-  }
-  SECTION("Shift right with pktlen=1") {
-    uint8_t buf[] = {0xFF, 0xFF, 0x00, 0x00};
-    uint8_t *buf_ptr = buf;
-    bool result = phy_frame_buffer_shift_right(&buf_ptr, 1, 4);
-    REQUIRE(result == true);
-    uint8_t buf_exp[] = {0x00, 0x00, 0x00, 0xFF};
-    REQUIRE(memcmp((void *)buf, (void *)buf_exp, 4) == 0);
+TEST_CASE("VLAN flood lists follow interface modes and memberships", "[layer2][flood]") {
+  graph_t *topo = graph_create_dual_switch_topology();
+  node_t *SW1 = graph_find_node_by_name(topo, "SW1");
+  // As set up by the topology (sorted by ifindex)
+  REQUIRE(test_flood_list_str(SW1, 10) == "eth0/2:untag,eth0/7:untag,eth0/5:tagged,svi1/10:promote");
+  REQUIRE(test_flood_list_str(SW1, 11) == "eth0/6:untag,eth0/5:tagged,svi1/11:promote");
+  REQUIRE(vlan_flood_lookup(SW1->netprop.flood_table, 12) == nullptr);
+  SECTION("Trunk memberships") {
+    vlan_t vlan12 = {.id = 12};
+    REQUIRE(node_interface_add_vlan_membership(SW1, "eth0/5", &vlan12));
+    REQUIRE(test_flood_list_str(SW1, 12) == "eth0/5:tagged");
+    REQUIRE(interface_clear_vlan_memberships(node_get_interface_by_name(SW1, "eth0/5")));
+    REQUIRE(test_flood_list_str(SW1, 10) == "eth0/2:untag,eth0/7:untag,svi1/10:promote");
+    REQUIRE(test_flood_list_str(SW1, 11) == "eth0/6:untag,svi1/11:promote");
+    REQUIRE(vlan_flood_lookup(SW1->netprop.flood_table, 12) == nullptr);
+  }
+  SECTION("Mode changes") {
+    // ACCESS -> TRUNK keeps the VLAN, tagged
+    REQUIRE(node_interface_set_mode(SW1, "eth0/7", INTF_MODE_L2_TRUNK));
+    REQUIRE(test_flood_list_str(SW1, 10) == "eth0/2:untag,eth0/7:tagged,eth0/5:tagged,svi1/10:promote");
+    // TRUNK -> ACCESS keeps the first VLAN only
+    REQUIRE(node_interface_set_mode(SW1, "eth0/5", INTF_MODE_L2_ACCESS));
+    REQUIRE(test_flood_list_str(SW1, 10) == "eth0/2:untag,eth0/7:tagged,eth0/5:untag,svi1/10:promote");
+    REQUIRE(test_flood_list_str(SW1, 11) == "eth0/6:untag,svi1/11:promote");
+    // L3 ports never flood
+    REQUIRE(node_interface_set_mode(SW1, "eth0/2", INTF_MODE_L3));
+    REQUIRE(test_flood_list_str(SW1, 10) == "eth0/7:tagged,eth0/5:untag,svi1/10:promote");
+  }
+  SECTION("Flooding and SVI ARP requests use the lists") {
+    static std::vector<std::string> sent;
+    sent.clear();
+    NODE_NETSTACK(SW1).phy.send = [](node_t *n, interface_t *intf, pkt_buf_t *pkt) -> int {
+      sent.push_back(intf->if_name);
+      return (int)pkt_buf_pkt_len(pkt);
+    };
+    REQUIRE(node_interface_set_mode(SW1, "eth0/7", INTF_MODE_L3));
+    ipv4_addr_t addr = {0};
+    REQUIRE(ipv4_addr_try_parse("10.0.0.1", &addr));
+    REQUIRE(node_arp_send_broadcast_request(SW1, node_get_interface_by_name(SW1, "svi1/10"), &addr));
+    REQUIRE(sent == std::vector<std::string>{"eth0/2", "eth0/5"});
   }
 }
 
-TEST_CASE("Packet buffer shift right boundary conditions", "[layer2][phy][buffer][boundary]") {
+TEST_CASE("VLAN sets", "[layer2][vlan]") {
+  vlan_set_t a = {};
+  REQUIRE(vlan_set_is_empty(&a));
+  REQUIRE(vlan_set_next(&a, 0) == VLAN_SET_SIZE);
+  for (uint16_t vlan_id : {1, 63, 64, 200, 4094}) {
+    vlan_set_add(&a, vlan_id);
+  }
+  REQUIRE(vlan_set_count(&a) == 5);
+  REQUIRE(vlan_set_test(&a, 64));
+  REQUIRE(vlan_set_test(&a, 4094));
+  REQUIRE(!vlan_set_test(&a, 0));
+  REQUIRE(!vlan_set_test(&a, 65));
+  REQUIRE(!vlan_set_test(&a, 4095));
+  // Out of range IDs don't wrap around
+  vlan_set_add(&a, VLAN_SET_SIZE + 4);
+  REQUIRE(vlan_set_count(&a) == 5);
+  REQUIRE(!vlan_set_test(&a, 4));
+  vlan_set_remove(&a, VLAN_SET_SIZE + 1);
+  REQUIRE(vlan_set_test(&a, 1));
+  // Walk (in order)
+  std::vector<uint32_t> walked;
+  for (uint32_t id = vlan_set_next(&a, 0); id < VLAN_SET_SIZE; id = vlan_set_next(&a, id + 1)) {
+    walked.push_back(id);
+  }
+  REQUIRE(walked == std::vector<uint32_t>{1, 63, 64, 200, 4094});
+  REQUIRE(vlan_set_next(&a, 65) == 200);
+  // Set operations
+  vlan_set_t b = {};
+  vlan_set_add(&b, 64);
+  vlan_set_add(&b, 100);
+  vlan_set_t out;
+  vlan_set_or(&out, &a, &b);
+  REQUIRE(vlan_set_count(&out) == 6);
+  vlan_set_and(&out, &a, &b);
+  REQUIRE(vlan_set_count(&out) == 1);
+  REQUIRE(vlan_set_test(&out, 64));
+  vlan_set_andnot(&a, &a, &b); // In place
+  REQUIRE(vlan_set_count(&a) == 4);
+  REQUIRE(!vlan_set_test(&a, 64));
+  vlan_set_remove(&a, 4094);
+  REQUIRE(vlan_set_next(&a, 201) == VLAN_SET_SIZE);
+  vlan_set_clear(&a);
+  REQUIRE(vlan_set_is_empty(&a));
+}
+
+TEST_CASE("Trunks carry the full VLAN range", "[layer2][vlan][flood]") {
   err_logging_disable_guard_t guard; // We expect errors, so silence err logging
-  SECTION("Shift with pktlen equal to buflen") {
-    uint8_t buf[] = {0xFF, 0xFF, 0x00, 0x00};
-    uint8_t *buf_ptr = buf;
-    bool result = phy_frame_buffer_shift_right(&buf_ptr, 4, 4);
-    REQUIRE(result == true);
-    uint8_t buf_exp[] = {0xFF, 0xFF, 0x00, 0x00};
-    REQUIRE(memcmp((void *)buf, (void *)buf_exp, 4) == 0);
-  }
-  SECTION("Shift with pktlen greater than buflen") {
-    uint8_t buf[] = {0xFF, 0xFF, 0x00, 0x00};
-    uint8_t *buf_ptr = buf;
-    bool result = phy_frame_buffer_shift_right(&buf_ptr, 5, 4);
-    REQUIRE(result == false); // Illegal
-  }
-  SECTION("Shift with pktlen=0") {
-    uint8_t buf[] = {0xFF, 0xFF, 0x00, 0x00};
-    uint8_t *buf_ptr = buf;
-    bool result = phy_frame_buffer_shift_right(&buf_ptr, 0, 4);
-    REQUIRE(result == false); // Illegal
+  graph_t *topo = graph_create_dual_switch_topology();
+  node_t *SW1 = graph_find_node_by_name(topo, "SW1");
+  interface_t *trunk = node_get_interface_by_name(SW1, "eth0/5");
+  bool added = true;
+  for (uint16_t vlan_id = VLAN_ID_MIN; vlan_id <= VLAN_ID_MAX; vlan_id++) {
+    added &= interface_add_vlan_membership(trunk, vlan_id);
+  }
+  REQUIRE(added);
+  REQUIRE(!interface_add_vlan_membership(trunk, 0));
+  REQUIRE(!interface_add_vlan_membership(trunk, 4095));
+  REQUIRE(vlan_set_count(&INTF_NETPROP(trunk).l2.vlans) == VLAN_ID_MAX);
+  REQUIRE(interface_test_vlan_membership(trunk, VLAN_ID_MIN));
+  REQUIRE(interface_test_vlan_membership(trunk, VLAN_ID_MAX));
+  REQUIRE(!interface_test_vlan_membership(trunk, 4095));
+  REQUIRE(test_flood_list_str(SW1, 10) == "eth0/2:untag,eth0/7:untag,eth0/5:tagged,svi1/10:promote");
+  REQUIRE(test_flood_list_str(SW1, VLAN_ID_MAX) == "eth0/5:tagged");
+  SECTION("Turning ACCESS keeps the first VLAN added") {
+    REQUIRE(interface_set_mode(trunk, INTF_MODE_L2_ACCESS));
+    REQUIRE(INTF_NETPROP(trunk).l2.port_vlan == 10);
+    REQUIRE(vlan_set_count(&INTF_NETPROP(trunk).l2.vlans) == 1);
+    REQUIRE(!interface_test_vlan_membership(trunk, 11));
+    REQUIRE(test_flood_list_str(SW1, 10) == "eth0/2:untag,eth0/7:untag,eth0/5:untag,svi1/10:promote");
+    REQUIRE(test_flood_list_str(SW1, 11) == "eth0/6:untag,svi1/11:promote");
+    REQUIRE(vlan_flood_lookup(SW1->netprop.flood_table, VLAN_ID_MAX) == nullptr);
+  }
+  SECTION("Clearing") {
+    REQUIRE(interface_clear_vlan_memberships(trunk));
+    REQUIRE(!interface_test_vlan_membership(trunk, 10));
+    REQUIRE(vlan_flood_lookup(SW1->netprop.flood_table, VLAN_ID_MAX) == nullptr);
+    REQUIRE(test_flood_list_str(SW1, 10) == "eth0/2:untag,eth0/7:untag,svi1/10:promote");
   }
 }
 
@@ -170,7 +813,7 @@ TEST_CASE("L2 ACCESS Mode", "[layer2][interface][qualify]") {
       SECTION("0th VLAN ID doesn't match but Nth does") {
         // We manually add VLAN ID because interface_add_vlan_membership won't
         // allow us to add more than one VLANs in L2 ACCESS mode.
-        intf.netprop.l2.vlan_memberships[1] = TEST_VLAN_ID_VALID0;
+        vlan_set_add(&intf.netprop.l2.vlans, TEST_VLAN_ID_VALID0);
         // L2 ACCESS mode should not allow ingress frames with different VLAN ID
         uint16_t vlan_id = 0;
         bool resp = layer2_qualify_recv_frame_on_interface(&intf, tagged_hdr, &vlan_id);
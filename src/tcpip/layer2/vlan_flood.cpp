@@ -0,0 +1,100 @@
+// vlan_flood.cpp
+
+#include <cstdlib>
+#include "vlan_flood.h"
+#include "graph.h"
+#include "utils.h"
+
+#pragma mark -
+
+// Public functions
+
+void vlan_flood_table_init(vlan_flood_table_t **t) {
+  EXPECT_RETURN(t != nullptr, "Empty table ptr param");
+  *t = (vlan_flood_table_t *)calloc(1, sizeof(vlan_flood_table_t));
+}
+
+bool vlan_flood_port_add(vlan_flood_table_t *t, uint16_t vlan_id, uint16_t ifindex, vlan_flood_action_t action) {
+  EXPECT_RETURN_BOOL(t != nullptr, "Empty table param", false);
+  EXPECT_RETURN_BOOL(VLAN_ID_IS_VALID(vlan_id), "Invalid VLAN ID param", false);
+  EXPECT_RETURN_BOOL(ifindex < CONFIG_MAX_INTF_PER_NODE, "Invalid ifindex param", false);
+  vlan_flood_list_t *list = t->vlans[vlan_id];
+  if (!list) {
+    list = (vlan_flood_list_t *)calloc(1, sizeof(vlan_flood_list_t));
+    t->vlans[vlan_id] = list;
+  }
+  // Find the port's spot (the array stays sorted by ifindex)
+  uint32_t pos = 0;
+  while (pos < list->count && list->port[pos].ifindex < ifindex) {
+    pos++;
+  }
+  if (list->ports & (1u << ifindex)) {
+    // Already there, the interface changed modes
+    list->port[pos].action = action;
+    return true;
+  }
+  memmove(&list->port[pos + 1], &list->port[pos], (list->count - pos) * sizeof(vlan_flood_port_t));
+  list->port[pos] = {.ifindex = ifindex, .action = (uint8_t)action};
+  list->ports |= (1u << ifindex);
+  list->count++;
+  return true;
+}
+
+bool vlan_flood_port_remove(vlan_flood_table_t *t, uint16_t vlan_id, uint16_t ifindex) {
+  EXPECT_RETURN_BOOL(t != nullptr, "Empty table param", false);
+  EXPECT_RETURN_BOOL(VLAN_ID_IS_VALID(vlan_id), "Invalid VLAN ID param", false);
+  EXPECT_RETURN_BOOL(ifindex < CONFIG_MAX_INTF_PER_NODE, "Invalid ifindex param", false);
+  vlan_flood_list_t *list = t->vlans[vlan_id];
+  if (!list || !(list->ports & (1u << ifindex))) { return true; }
+  uint32_t pos = 0;
+  while (list->port[pos].ifindex != ifindex) {
+    pos++;
+  }
+  list->count--;
+  memmove(&list->port[pos], &list->port[pos + 1], (list->count - pos) * sizeof(vlan_flood_port_t));
+  list->ports &= ~(1u << ifindex);
+  if (list->count == 0) {
+    // Last port gone
+    free(list);
+    t->vlans[vlan_id] = nullptr;
+  }
+  return true;
+}
+
+bool vlan_flood_port_join(vlan_flood_table_t *t, const vlan_set_t *vlans, uint16_t ifindex, vlan_flood_action_t action) {
+  EXPECT_RETURN_BOOL(vlans != nullptr, "Empty VLAN set param", false);
+  for (uint32_t vlan_id = vlan_set_next(vlans, 0); vlan_id < VLAN_SET_SIZE; vlan_id = vlan_set_next(vlans, vlan_id + 1)) {
+    bool resp = vlan_flood_port_add(t, vlan_id, ifindex, action);
+    EXPECT_RETURN_BOOL(resp == true, "vlan_flood_port_add failed", false);
+  }
+  return true;
+}
+
+bool vlan_flood_port_leave(vlan_flood_table_t *t, const vlan_set_t *vlans, uint16_t ifindex) {
+  EXPECT_RETURN_BOOL(vlans != nullptr, "Empty VLAN set param", false);
+  for (uint32_t vlan_id = vlan_set_next(vlans, 0); vlan_id < VLAN_SET_SIZE; vlan_id = vlan_set_next(vlans, vlan_id + 1)) {
+    bool resp = vlan_flood_port_remove(t, vlan_id, ifindex);
+    EXPECT_RETURN_BOOL(resp == true, "vlan_flood_port_remove failed", false);
+  }
+  return true;
+}
+
+void vlan_flood_table_dump(vlan_flood_table_t *t, node_t *n) {
+  EXPECT_RETURN(t != nullptr, "Empty table param");
+  EXPECT_RETURN(n != nullptr, "Empty node param");
+  static const char *action_names[] = {"?", "untag", "tagged", "promote"};
+  for (uint32_t vlan_id = 1; vlan_id < VLAN_FLOOD_MAX_VLANS; vlan_id++) {
+    vlan_flood_list_t *list = t->vlans[vlan_id];
+    if (!list) { continue; }
+    dump_line("VLAN: %u, Ports: %u\n", vlan_id, list->count);
+    dump_line_indentation_guard_t guard;
+    dump_line_indentation_add(1);
+    for (uint32_t i = 0; i < list->count; i++) {
+      dump_line(
+        "%s (%s)\n",
+        node_get_interface_name_by_index(n, list->port[i].ifindex),
+        action_names[list->port[i].action]
+      );
+    }
+  }
+}
@@ -0,0 +1,62 @@
+// vlan_flood.h
+
+#pragma once
+
+#include <cstdint>
+#include "config.h"
+#include "vlan_set.h"
+
+typedef struct node_t node_t;
+
+#pragma mark -
+
+// VLAN flood lists
+
+/*
+ * Per VLAN, the ports a flooded frame leaves through, each with what's done
+ * to the frame on the way out (untagged, sent as is, or promoted via an SVI).
+ * Lists are kept up to date as interface modes and VLAN memberships change
+ * (see `net.cpp`), so flooding walks only the ports that will transmit,
+ * instead of qualifying every port of the node for every frame.
+ *
+ * A list is both a bitmap of ifindexes, for membership tests, and a dense
+ * array sorted by ifindex, for the flood walk. It's allocated when its VLAN
+ * gets its first port, and freed along with the last one.
+ */
+
+#define VLAN_FLOOD_MAX_VLANS VLAN_SET_SIZE
+
+static_assert(CONFIG_MAX_INTF_PER_NODE <= 32, "Flood list bitmap doesn't fit the node's interfaces");
+
+enum vlan_flood_action_t {
+  VLAN_FLOOD_UNTAG = 1,     // L2_ACCESS: strip the tag
+  VLAN_FLOOD_TAGGED = 2,    // L2_TRUNK: send as is
+  VLAN_FLOOD_PROMOTE = 3    // L3_SVI: strip the tag, promote
+};
+
+typedef struct vlan_flood_port_t {
+  uint16_t ifindex;
+  uint8_t action;           // vlan_flood_action_t
+} vlan_flood_port_t;
+
+typedef struct vlan_flood_list_t {
+  uint32_t ports;           // Bitmap, by ifindex
+  uint32_t count;
+  vlan_flood_port_t port[CONFIG_MAX_INTF_PER_NODE];
+} vlan_flood_list_t;
+
+typedef struct vlan_flood_table_t {
+  vlan_flood_list_t *vlans[VLAN_FLOOD_MAX_VLANS];
+} vlan_flood_table_t;
+
+void vlan_flood_table_init(vlan_flood_table_t **t);
+bool vlan_flood_port_add(vlan_flood_table_t *t, uint16_t vlan_id, uint16_t ifindex, vlan_flood_action_t action); // Updates the action of a port already there
+bool vlan_flood_port_remove(vlan_flood_table_t *t, uint16_t vlan_id, uint16_t ifindex); // No-op if the port isn't there
+bool vlan_flood_port_join(vlan_flood_table_t *t, const vlan_set_t *vlans, uint16_t ifindex, vlan_flood_action_t action); // Adds the port to every VLAN in `vlans`
+bool vlan_flood_port_leave(vlan_flood_table_t *t, const vlan_set_t *vlans, uint16_t ifindex); // Removes the port from every VLAN in `vlans`
+void vlan_flood_table_dump(vlan_flood_table_t *t, node_t *n); // Interface names come from `n`
+
+// nullptr if no port floods `vlan_id`
+static inline const vlan_flood_list_t* vlan_flood_lookup(const vlan_flood_table_t *t, uint16_t vlan_id) {
+  return vlan_id < VLAN_FLOOD_MAX_VLANS ? t->vlans[vlan_id] : nullptr;
+}
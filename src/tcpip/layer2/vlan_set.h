@@ -0,0 +1,93 @@
+// vlan_set.h
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+/*
+ * A set of VLAN IDs: one bit per ID, all 4096 of them (512 bytes). Adding,
+ * removing and testing an ID are O(1). Set operations are plain loops over
+ * 64 bit words (vectorized by the compiler), and walking the members skips
+ * over empty words.
+ */
+
+#define VLAN_SET_SIZE 4096
+#define VLAN_SET_WORDS (VLAN_SET_SIZE / 64)
+
+#define VLAN_ID_MIN 1
+#define VLAN_ID_MAX 4094   // 0 and 4095 are reserved
+#define VLAN_ID_IS_VALID(ID) ((ID) >= VLAN_ID_MIN && (ID) <= VLAN_ID_MAX)
+
+typedef struct vlan_set_t {
+  uint64_t words[VLAN_SET_WORDS];
+} vlan_set_t;
+
+static inline void vlan_set_clear(vlan_set_t *s) {
+  memset((void *)s->words, 0, sizeof(s->words));
+}
+
+// IDs past VLAN_SET_SIZE are ignored (and never members, see `vlan_set_test()`)
+static inline void vlan_set_add(vlan_set_t *s, uint16_t vlan_id) {
+  if (vlan_id >= VLAN_SET_SIZE) { return; }
+  s->words[vlan_id / 64] |= (1ull << (vlan_id % 64));
+}
+
+static inline void vlan_set_remove(vlan_set_t *s, uint16_t vlan_id) {
+  if (vlan_id >= VLAN_SET_SIZE) { return; }
+  s->words[vlan_id / 64] &= ~(1ull << (vlan_id % 64));
+}
+
+static inline bool vlan_set_test(const vlan_set_t *s, uint16_t vlan_id) {
+  return vlan_id < VLAN_SET_SIZE && (s->words[vlan_id / 64] & (1ull << (vlan_id % 64)));
+}
+
+static inline bool vlan_set_is_empty(const vlan_set_t *s) {
+  uint64_t acc = 0;
+  for (uint32_t i = 0; i < VLAN_SET_WORDS; i++) {
+    acc |= s->words[i];
+  }
+  return acc == 0;
+}
+
+static inline uint32_t vlan_set_count(const vlan_set_t *s) {
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < VLAN_SET_WORDS; i++) {
+    count += __builtin_popcountll(s->words[i]);
+  }
+  return count;
+}
+
+// Smallest member >= `from`, VLAN_SET_SIZE if none. Walk a set with:
+//   for (uint32_t id = vlan_set_next(s, 0); id < VLAN_SET_SIZE; id = vlan_set_next(s, id + 1))
+static inline uint32_t vlan_set_next(const vlan_set_t *s, uint32_t from) {
+  if (from >= VLAN_SET_SIZE) { return VLAN_SET_SIZE; }
+  uint32_t i = from / 64;
+  uint64_t word = s->words[i] & (~0ull << (from % 64));
+  while (word == 0) {
+    if (++i == VLAN_SET_WORDS) { return VLAN_SET_SIZE; }
+    word = s->words[i];
+  }
+  return i * 64 + __builtin_ctzll(word);
+}
+
+// Set operations. `out` may be one of the operands.
+
+static inline void vlan_set_or(vlan_set_t *out, const vlan_set_t *a, const vlan_set_t *b) {
+  for (uint32_t i = 0; i < VLAN_SET_WORDS; i++) {
+    out->words[i] = a->words[i] | b->words[i];
+  }
+}
+
+static inline void vlan_set_and(vlan_set_t *out, const vlan_set_t *a, const vlan_set_t *b) {
+  for (uint32_t i = 0; i < VLAN_SET_WORDS; i++) {
+    out->words[i] = a->words[i] & b->words[i];
+  }
+}
+
+// Members of `a` that aren't in `b`
+static inline void vlan_set_andnot(vlan_set_t *out, const vlan_set_t *a, const vlan_set_t *b) {
+  for (uint32_t i = 0; i < VLAN_SET_WORDS; i++) {
+    out->words[i] = a->words[i] & ~b->words[i];
+  }
+}
@@ -5,21 +5,26 @@
 #include "layer5/layer5.h"
 #include "graph.h"
 #include "phy.h"
+#include "prof.h"
+#include "trace.h"
 
-void __layer3_demote(node_t *n, uint8_t *payload, uint32_t paylen, uint8_t prot, ipv4_addr_t *dst_addr) {
+void __layer3_demote(node_t *n, pkt_buf_t *pkt, uint8_t prot, ipv4_addr_t *dst_addr) {
   EXPECT_RETURN(n != nullptr, "Empty node param");
-  EXPECT_RETURN(payload != nullptr, "Empty payload param");
+  EXPECT_RETURN(pkt != nullptr, "Empty packet buffer param");
   EXPECT_RETURN(dst_addr != nullptr, "Empty destination address param");
+  prof_stage_guard_t prof(n, PROF_STAGE_L3_DEMOTE);
+  trace_mark(n, pkt); // Locally originated
   // Decide on next hop address and outgoing interface
   ipv4_addr_t *next_hop_addr = nullptr;
   interface_t *ointf = nullptr;
   bool resp = layer3_resolve_next_hop(n, dst_addr, &next_hop_addr, &ointf);
   EXPECT_RETURN(resp == true, "layer3_resolve_next_hop failed");
-  // Prepare ipv4 packet
-  uint8_t *buffer = (uint8_t *)malloc(CONFIG_MAX_PACKET_BUFFER_SIZE);
-  memset(buffer, 0, CONFIG_MAX_PACKET_BUFFER_SIZE);
+  // Push the IPv4 header in front of the payload
+  uint32_t paylen = pkt->data_len;
+  ipv4_hdr_t *hdr = (ipv4_hdr_t *)pkt_buf_prepend(pkt, sizeof(ipv4_hdr_t));
+  EXPECT_RETURN(hdr != nullptr, "pkt_buf_prepend failed");
+  memset(hdr, 0, sizeof(ipv4_hdr_t));
   // Setup IPv4 header
-  ipv4_hdr_t *hdr = (ipv4_hdr_t *)buffer;
   ipv4_hdr_set_version(hdr, 4);
   ipv4_hdr_set_ihl(hdr, 5);
   uint32_t pktlen = (5 * 4) + paylen;
@@ -32,46 +37,53 @@ void __layer3_demote(node_t *n, uint8_t *payload, uint32_t paylen, uint8_t prot,
     ipv4_hdr_set_src_addr(hdr, &INTF_NETPROP(ointf).l3.addr);
   }
   ipv4_hdr_set_dst_addr(hdr, dst_addr); // <= This is NOT next hop address
-  // Next, find the start of payload and copy provided pkt
-  uint8_t *pkt_payload = (uint8_t *)(hdr + 1);
-  memcpy(pkt_payload, payload, paylen);
-  // Next, shift the contents to the right
-  uint8_t *ptr = buffer;
-  resp = phy_frame_buffer_shift_right(&ptr, pktlen, CONFIG_MAX_PACKET_BUFFER_SIZE);
-  EXPECT_RETURN(resp == true, "phy_frame_buffer_shift_right failed");
   // Finally, hand over the packet to Layer2
-  NODE_NETSTACK(n).l2.demote(n, next_hop_addr, ointf, ptr, pktlen, ETHER_TYPE_IPV4);
-  // Free memory
-  free(buffer);
+  trace_pkt_hop(n, ointf, pkt, PROF_STAGE_L3_DEMOTE, TRACE_ROUTED, next_hop_addr);
+  NODE_NETSTACK(n).l2.demote(n, next_hop_addr, ointf, pkt, ETHER_TYPE_IPV4);
 }
 
-void __layer3_promote(node_t *n, interface_t *intf, uint8_t *pkt, uint32_t pktlen, uint16_t ether_type) {
+void __layer3_promote(node_t *n, interface_t *intf, pkt_buf_t *pkt, uint16_t ether_type) {
+  EXPECT_RETURN(n != nullptr, "Empty node param");
+  EXPECT_RETURN(pkt != nullptr, "Empty packet buffer param");
+  prof_stage_guard_t prof(n, PROF_STAGE_L3_PROMOTE);
   if (ether_type != ETHER_TYPE_IPV4) {
     // We only accept IPV4 packets
+    node_count_drop(n, DROP_L3_NOT_IPV4);
+    trace_pkt_drop(n, intf, pkt, PROF_STAGE_L3_PROMOTE, DROP_L3_NOT_IPV4);
     return;
   } 
-  ipv4_hdr_t *hdr = (ipv4_hdr_t *)pkt;
-  EXPECT_RETURN(n != nullptr, "Empty node param");
-  EXPECT_RETURN(hdr != nullptr, "Empty pkt header param");
+  if (pkt->data_len < sizeof(ipv4_hdr_t)) {
+    node_count_drop(n, DROP_L3_RUNT);
+    trace_pkt_drop(n, intf, pkt, PROF_STAGE_L3_PROMOTE, DROP_L3_RUNT);
+    return;
+  }
+  ipv4_hdr_t *hdr = PKT_BUF_MTOD(pkt, ipv4_hdr_t *);
   // Check if we can find an entry for the destination address in the routing table
   ipv4_addr_t dst_addr = ipv4_hdr_read_dst_addr(hdr);
   rt_entry_t *rt_entry = nullptr;
   if (!rt_lookup(n->netprop.r_table, &dst_addr, &rt_entry)) {
+    node_count_drop(n, DROP_L3_NO_ROUTE);
+    trace_pkt_drop(n, intf, pkt, PROF_STAGE_L3_PROMOTE, DROP_L3_NO_ROUTE);
     return; // Discard packet since no route was found
   }
   // Not direct route?
   if (!rt_entry_is_direct(rt_entry)) {
     // Update dst ip (to gateway ip) and hand it over to L2 for forwarding
-    EXPECT_RETURN(rt_entry_oif_is_configured(rt_entry), "Missing OIF name in RT entry");
-    EXPECT_RETURN(rt_entry_gw_is_configured(rt_entry), "Missing GW IP address in RT entry");
-    interface_t *ointf = node_get_interface_by_name(n, rt_entry_get_oif_name(rt_entry));
-    EXPECT_RETURN(ointf != nullptr, "node_get_interface_by_name failed");
+    interface_t *ointf = rt_entry_oif_is_configured(rt_entry) && rt_entry_gw_is_configured(rt_entry) ?
+      node_get_interface_by_index(n, rt_entry_get_oif_ifindex(rt_entry)) : nullptr;
+    if (!ointf) {
+      node_count_drop(n, DROP_L3_BAD_ROUTE);
+      trace_pkt_drop(n, intf, pkt, PROF_STAGE_L3_PROMOTE, DROP_L3_BAD_ROUTE);
+      return;
+    }
     ipv4_hdr_set_ttl(hdr, ipv4_hdr_read_ttl(hdr) - 1);
     if (ipv4_hdr_read_ttl(hdr) == 0) {
-      printf("TTL == 0\n");
-      return; // drop
+      node_count_drop(n, DROP_L3_TTL_EXPIRED);
+      trace_pkt_drop(n, intf, pkt, PROF_STAGE_L3_PROMOTE, DROP_L3_TTL_EXPIRED);
+      return;
     }
-    NODE_NETSTACK(n).l2.demote(n, rt_entry_get_gw_ip(rt_entry), ointf, (uint8_t *)hdr, pktlen, ETHER_TYPE_IPV4);
+    trace_pkt_hop(n, ointf, pkt, PROF_STAGE_L3_PROMOTE, TRACE_ROUTED, rt_entry_get_gw_ip(rt_entry));
+    NODE_NETSTACK(n).l2.demote(n, rt_entry_get_gw_ip(rt_entry), ointf, pkt, ETHER_TYPE_IPV4);
     return;
   }
   // Local address?
@@ -79,13 +91,22 @@ void __layer3_promote(node_t *n, interface_t *intf, uint8_t *pkt, uint32_t pktle
   ipv4_addr_t src_addr = ipv4_hdr_read_src_addr(hdr);
   if (node_is_local_address(n, &dst_addr)) {
     uint16_t prot = ipv4_hdr_read_protocol(hdr);
-    uint8_t *payload = (uint8_t *)(hdr + 1);
-    uint32_t payloadsize = ipv4_hdr_read_total_length(hdr) - (ipv4_hdr_read_ihl(hdr) * 4);
+    uint32_t hdrlen = ipv4_hdr_read_ihl(hdr) * 4;
+    uint32_t payloadsize = ipv4_hdr_read_total_length(hdr) - hdrlen;
+    if (hdrlen + payloadsize > pkt->data_len) {
+      node_count_drop(n, DROP_L3_TRUNCATED);
+    trace_pkt_drop(n, intf, pkt, PROF_STAGE_L3_PROMOTE, DROP_L3_TRUNCATED);
+      return;
+    }
+    // Pop the IPv4 header (and anything trailing the payload)
+    uint8_t *payload = pkt_buf_adj(pkt, hdrlen);
+    pkt_buf_trim(pkt, pkt->data_len - payloadsize);
+    trace_pkt(n, intf, pkt, PROF_STAGE_L3_PROMOTE, TRACE_LOCAL, 0);
     if (prot == PROT_IPIP) {
       // Handle IP-in-IP tunneling
       // The packet has reached the ERO destination. We now need to strip the outer IPv4 header
       // and send it off to its destination. 
-      bool resp = layer3_forward_ipnp(n, payload, payloadsize);
+      bool resp = layer3_forward_ipnp(n, pkt);
       EXPECT_RETURN(resp == true, "layer3_forward_ipnp failed");
       return;  
     }
@@ -94,27 +115,34 @@ void __layer3_promote(node_t *n, interface_t *intf, uint8_t *pkt, uint32_t pktle
   }
   else if (rt_entry_is_direct(rt_entry) && rt_entry_oif_is_configured(rt_entry)) {
     // SVI routes are direct but have a specified outgoing interface
-    interface_t *ointf = node_get_interface_by_name(n, rt_entry_get_oif_name(rt_entry));
-    EXPECT_RETURN(ointf != nullptr, "node_get_interface_by_name failed");
-    EXPECT_RETURN(INTF_MODE(ointf) == INTF_MODE_L3_SVI, "Encountered non-SVI local interface!");
+    interface_t *ointf = node_get_interface_by_index(n, rt_entry_get_oif_ifindex(rt_entry));
+    if (!ointf || INTF_MODE(ointf) != INTF_MODE_L3_SVI) {
+      node_count_drop(n, DROP_L3_BAD_ROUTE); // Missing, or non-SVI local interface
+      trace_pkt_drop(n, intf, pkt, PROF_STAGE_L3_PROMOTE, DROP_L3_BAD_ROUTE);
+      return;
+    }
     ipv4_hdr_set_ttl(hdr, ipv4_hdr_read_ttl(hdr) - 1);
     if (ipv4_hdr_read_ttl(hdr) == 0) {
-      printf("TTL == 0\n");
-      return; // drop
+      node_count_drop(n, DROP_L3_TTL_EXPIRED);
+      trace_pkt_drop(n, intf, pkt, PROF_STAGE_L3_PROMOTE, DROP_L3_TTL_EXPIRED);
+      return;
     }
     if (rt_entry_gw_is_configured(rt_entry) && !node_is_local_address(n, rt_entry_get_gw_ip(rt_entry))) {
       // A GW address has been configured for this SVI (use that as the next hop)
-      NODE_NETSTACK(n).l2.demote(n, rt_entry_get_gw_ip(rt_entry), ointf, (uint8_t *)hdr, pktlen, ETHER_TYPE_IPV4);
+      trace_pkt_hop(n, ointf, pkt, PROF_STAGE_L3_PROMOTE, TRACE_ROUTED, rt_entry_get_gw_ip(rt_entry));
+      NODE_NETSTACK(n).l2.demote(n, rt_entry_get_gw_ip(rt_entry), ointf, pkt, ETHER_TYPE_IPV4);
     }
     else {
       // No GW address has been configured for this SVI. In this we expect the destination to be within the
       // broadcast domain. Use that as the next hop address.
-      NODE_NETSTACK(n).l2.demote(n, &dst_addr, ointf, (uint8_t *)hdr, pktlen, ETHER_TYPE_IPV4);
+      trace_pkt_hop(n, ointf, pkt, PROF_STAGE_L3_PROMOTE, TRACE_ROUTED, &dst_addr);
+      NODE_NETSTACK(n).l2.demote(n, &dst_addr, ointf, pkt, ETHER_TYPE_IPV4);
     }
     return;
   }
   // Local subnet
-  NODE_NETSTACK(n).l2.demote(n, &dest_addr, nullptr, (uint8_t *)hdr, pktlen, ETHER_TYPE_IPV4);
+  trace_pkt_hop(n, nullptr, pkt, PROF_STAGE_L3_PROMOTE, TRACE_ROUTED, &dest_addr);
+  NODE_NETSTACK(n).l2.demote(n, &dest_addr, nullptr, pkt, ETHER_TYPE_IPV4);
 }
 
 #pragma mark -
@@ -147,8 +175,8 @@ bool layer3_resolve_next_hop(node_t *n, ipv4_addr_t *dst_addr, ipv4_addr_t **hop
   }
   else {
     next_hop_addr = rt_entry_get_gw_ip(entry);
-    intf = node_get_interface_by_name(n, rt_entry_get_oif_name(entry));
-    EXPECT_RETURN_BOOL(intf != nullptr, "node_get_interface_by_name failed", false);
+    intf = node_get_interface_by_index(n, rt_entry_get_oif_ifindex(entry));
+    EXPECT_RETURN_BOOL(intf != nullptr, "node_get_interface_by_index failed", false);
   }
   *ointf = intf;
   *hop_addr = next_hop_addr;
@@ -169,13 +197,13 @@ bool layer3_resolve_src_for_dst(node_t *n, ipv4_addr_t *dst_addr, ipv4_addr_t **
     return false;
   }
   if (!rt_entry_is_direct(entry)) {
-    interface_t *intf = node_get_interface_by_name(n, rt_entry_get_oif_name(entry));
+    interface_t *intf = node_get_interface_by_index(n, rt_entry_get_oif_ifindex(entry));
     if (ointf) {
       *ointf = intf;
     }
     *src_addr = &INTF_NETPROP(intf).l3.addr;
     if (ointf) {
-      EXPECT_RETURN_BOOL(*ointf != nullptr, "node_get_interface_by_name failed", false);
+      EXPECT_RETURN_BOOL(*ointf != nullptr, "node_get_interface_by_index failed", false);
     }
     return true;
   }
@@ -206,12 +234,11 @@ bool layer3_resolve_src_for_dst(node_t *n, ipv4_addr_t *dst_addr, ipv4_addr_t **
 
 // IP-in-IP Encapsulation 
 
-void layer3_demote_ipnip(node_t *n, uint8_t *pkt, uint32_t pktlen, uint8_t prot, ipv4_addr_t *dst_addr, ipv4_addr_t *ero_addr) {
+void layer3_demote_ipnip(node_t *n, pkt_buf_t *pkt, uint8_t prot, ipv4_addr_t *dst_addr, ipv4_addr_t *ero_addr) {
   EXPECT_RETURN(n != nullptr, "Empty node param");
   EXPECT_RETURN(pkt != nullptr, "Empty pkt param");
   EXPECT_RETURN(dst_addr != nullptr, "Empty destination address param");
   EXPECT_RETURN(ero_addr != nullptr, "Empty ERO address param");
-  EXPECT_RETURN(pktlen < CONFIG_MAX_PACKET_BUFFER_SIZE - sizeof(ipv4_hdr_t), "Invalid pktlen param");
   // First, resolve the source address and/or outgoing interface for the
   // provided ERO address. Note how we're not using the final destination
   // address (even though the inner header we prepare here embeds that
@@ -224,10 +251,12 @@ void layer3_demote_ipnip(node_t *n, uint8_t *pkt, uint32_t pktlen, uint8_t prot,
   bool resp = layer3_resolve_src_for_dst(n, ero_addr, &src_addr, &ointf);
   EXPECT_RETURN(resp == true, "layer3_resolve_src_for_dst failed");
   EXPECT_RETURN(src_addr != nullptr, "layer3_resolve_src_for_dst failed");
-  // Append an IPv4 header with the actual destination address and PROTOCOL type.
+  // Push an IPv4 header with the actual destination address and PROTOCOL type.
   // Then, demote it to layer3 using the ERO address as the dest.
-  uint8_t *buffer = (uint8_t *)calloc(1, CONFIG_MAX_PACKET_BUFFER_SIZE);
-  ipv4_hdr_t *hdr = (ipv4_hdr_t *)buffer;
+  uint32_t pktlen = pkt->data_len;
+  ipv4_hdr_t *hdr = (ipv4_hdr_t *)pkt_buf_prepend(pkt, sizeof(ipv4_hdr_t));
+  EXPECT_RETURN(hdr != nullptr, "pkt_buf_prepend failed");
+  memset(hdr, 0, sizeof(ipv4_hdr_t));
   ipv4_hdr_set_version(hdr, 4);
   ipv4_hdr_set_ihl(hdr, 5);
   uint32_t bufflen = (5 * 4) + pktlen;
@@ -238,13 +267,8 @@ void layer3_demote_ipnip(node_t *n, uint8_t *pkt, uint32_t pktlen, uint8_t prot,
   ipv4_hdr_set_checksum(hdr, 0);
   ipv4_hdr_set_src_addr(hdr, src_addr);
   ipv4_hdr_set_dst_addr(hdr, dst_addr); // <= This is NOT ERO address
-  // Next, find the start of payload and copy provided pkt
-  uint8_t *encap_payload = (uint8_t *)(hdr + 1);
-  memcpy(encap_payload, pkt, pktlen);
   // Demote the packet (in the usual fashion) to layer3.
-  NODE_NETSTACK(n).l3.demote(n, buffer, sizeof(ipv4_hdr_t) + bufflen, PROT_IPIP, ero_addr);
-  // Finally, free the buffer (layer3 will copy it out to its own buffer)
-  free(buffer);
+  NODE_NETSTACK(n).l3.demote(n, pkt, PROT_IPIP, ero_addr);
 }
 
 /*
@@ -253,10 +277,11 @@ void layer3_demote_ipnip(node_t *n, uint8_t *pkt, uint32_t pktlen, uint8_t prot,
  *    - Find the next hop address / interface
  *    - Demote to layer2 (if the address is local, it'll work like self-ping)
  */
-bool layer3_forward_ipnp(node_t *n, uint8_t *payload, uint32_t paylen) {
+bool layer3_forward_ipnp(node_t *n, pkt_buf_t *pkt) {
   EXPECT_RETURN_BOOL(n != nullptr, "Empty node param", false);
-  EXPECT_RETURN_BOOL(payload != nullptr, "Empty payload param", false);
-  ipv4_hdr_t *hdr = (ipv4_hdr_t *)payload;
+  EXPECT_RETURN_BOOL(pkt != nullptr, "Empty payload param", false);
+  EXPECT_RETURN_BOOL(pkt->data_len >= sizeof(ipv4_hdr_t), "Runt packet", false);
+  ipv4_hdr_t *hdr = PKT_BUF_MTOD(pkt, ipv4_hdr_t *);
   // Read final destination address
   ipv4_addr_t dst_addr = ipv4_hdr_read_dst_addr(hdr);
   // Resolve source address to use
@@ -271,6 +296,6 @@ bool layer3_forward_ipnp(node_t *n, uint8_t *payload, uint32_t paylen) {
   // Update IPv4 header fields
   ipv4_hdr_set_src_addr(hdr, src_addr);
   // Demote to layer2 using next hop address and interface
-  NODE_NETSTACK(n).l2.demote(n, hop_addr, ointf, payload, paylen, ETHER_TYPE_IPV4);
+  NODE_NETSTACK(n).l2.demote(n, hop_addr, ointf, pkt, ETHER_TYPE_IPV4);
   return true;
 }
@@ -7,6 +7,7 @@
 #include <functional>
 #include "utils.h"
 #include "rt.h"
+#include "pkt_buf.h"
 
 typedef struct node_t node_t;
 typedef struct interface_t interface_t;
@@ -42,13 +43,17 @@ struct __PACK__ ipv4_hdr_t {
 #define PROT_IPIP   4
 #define PROT_UDP    17
 
-using layer3_promote_fn_t = std::function<void(node_t*,interface_t*,uint8_t*,uint32_t,uint16_t)>;
-using layer3_demote_fn_t = std::function<void(node_t*,uint8_t*,uint32_t,uint8_t,ipv4_addr_t*)>;
+/*
+ * Promote takes an IPv4 packet (data starts at the IPv4 header), demote takes
+ * the payload and pushes the IPv4 header into the buffer's headroom.
+ */
+using layer3_promote_fn_t = std::function<void(node_t*,interface_t*,pkt_buf_t*,uint16_t)>;
+using layer3_demote_fn_t = std::function<void(node_t*,pkt_buf_t*,uint8_t,ipv4_addr_t*)>;
 
 // Not to be called directly (use node's netstack function pointers instead)
 
-void __layer3_promote(node_t *n, interface_t *intf, uint8_t *pkt, uint32_t pktlen, uint16_t ether_type);
-void __layer3_demote(node_t *n, uint8_t *pkt, uint32_t pktlen, uint8_t prot, ipv4_addr_t *dst_addr);
+void __layer3_promote(node_t *n, interface_t *intf, pkt_buf_t *pkt, uint16_t ether_type);
+void __layer3_demote(node_t *n, pkt_buf_t *pkt, uint8_t prot, ipv4_addr_t *dst_addr);
 
 // Utils
 
@@ -59,8 +64,8 @@ bool layer3_resolve_src_for_dst(node_t *n, ipv4_addr_t *dst_addr, ipv4_addr_t **
 
 // IP-in-IP encapsulation
 
-void layer3_demote_ipnip(node_t *n, uint8_t *pkt, uint32_t pktlen, uint8_t prot, ipv4_addr_t *dst_addr, ipv4_addr_t *ero_addr);
-bool layer3_forward_ipnp(node_t *n, uint8_t *payload, uint32_t paylen);
+void layer3_demote_ipnip(node_t *n, pkt_buf_t *pkt, uint8_t prot, ipv4_addr_t *dst_addr, ipv4_addr_t *ero_addr);
+bool layer3_forward_ipnp(node_t *n, pkt_buf_t *pkt);
 
 #pragma mark -
 
@@ -20,7 +20,7 @@ struct rt_entry_t {
     bool configured;
   } gw;
   struct {
-    char name[CONFIG_IF_NAME_SIZE];
+    uint16_t ifindex;
     bool configured;
   } oif;
   glthread_t rt_glue;
@@ -95,7 +95,7 @@ bool rt_add_route(rt_t *t, ipv4_addr_t *addr, uint8_t mask, ipv4_addr_t *gw_ip,
   entry->is_direct = is_direct;
   entry->gw.ip = {.value = gw_ip->value};
   entry->gw.configured = true;
-  strncpy((char *)entry->oif.name, (char *)ointf->if_name, CONFIG_IF_NAME_SIZE);
+  entry->oif.ifindex = ointf->ifindex;
   entry->oif.configured = true;
   glthread_init(&entry->rt_glue);
   glthread_add_next(&t->rt_entries, &entry->rt_glue);
@@ -166,8 +166,9 @@ bool rt_clear(rt_t *t) {
   return true; // All entries deleted
 }
 
-void rt_dump(rt_t *t) {
+void rt_dump(rt_t *t, node_t *n) {
   EXPECT_RETURN(t != nullptr, "Empty rt param");
+  EXPECT_RETURN(n != nullptr, "Empty node param");
   glthread_t *curr = nullptr;
   GLTHREAD_FOREACH_BEGIN(&t->rt_entries, curr) {
     rt_entry_t *entry = rt_entry_ptr_from_rt_glue(curr);
@@ -177,7 +178,7 @@ void rt_dump(rt_t *t) {
       printf(" GW: " IPV4_ADDR_FMT, IPV4_ADDR_BYTES_BE(entry->gw.ip));
     }
     if (entry->oif.configured) {
-      printf(" OIF: %s", entry->oif.name);
+      printf(" OIF: %s", node_get_interface_name_by_index(n, entry->oif.ifindex));
     }
     printf("\n");
   }
@@ -204,8 +205,8 @@ bool rt_entry_oif_is_configured(rt_entry_t *entry) {
   return entry->oif.configured;
 }
 
-const char* rt_entry_get_oif_name(rt_entry_t *entry) {
-  return (const char*)entry->oif.name;
+uint16_t rt_entry_get_oif_ifindex(rt_entry_t *entry) {
+  return entry->oif.ifindex;
 }
 
 bool rt_entry_gw_is_configured(rt_entry_t *entry) {
@@ -2,6 +2,7 @@
 
 #include "catch2.hpp"
 #include "layer3/layer3.h"
+#include "layer2/ether_hdr.h"
 #include "graph.h"
 #include "topo.h"
 
@@ -30,3 +31,35 @@ TEST_CASE("Local delivery test", "[layer3][promote]") {
   SECTION("-") {
   }
 }
+
+TEST_CASE("Layer 3 drops are counted by reason", "[layer3][promote][drops]") {
+  graph_t *topo = graph_create_three_node_ring_topology();
+  node_t *H0 = graph_find_node_by_name(topo, "H0");
+  ipv4_addr_t prefix, gw;
+  REQUIRE(ipv4_addr_try_parse("50.0.0.0", &prefix));
+  REQUIRE(ipv4_addr_try_parse("20.1.1.2", &gw));
+  REQUIRE(rt_add_route(H0->netprop.r_table, &prefix, 24, &gw, node_get_interface_by_name(H0, "eth0/0")));
+  auto promote = [H0](const char *dst, uint8_t ttl, uint32_t len) {
+    uint8_t storage[CONFIG_PKT_BUF_HEADROOM + 64] = {0};
+    pkt_buf_t pkt;
+    pkt_buf_init(&pkt, storage, sizeof(storage), CONFIG_PKT_BUF_HEADROOM);
+    ipv4_hdr_t *hdr = (ipv4_hdr_t *)pkt_buf_append(&pkt, len);
+    ipv4_addr_t dst_addr;
+    REQUIRE(ipv4_addr_try_parse(dst, &dst_addr));
+    ipv4_hdr_set_version(hdr, 4);
+    ipv4_hdr_set_ihl(hdr, 5);
+    ipv4_hdr_set_total_length(hdr, sizeof(ipv4_hdr_t));
+    ipv4_hdr_set_ttl(hdr, ttl);
+    if (len >= sizeof(ipv4_hdr_t)) {
+      ipv4_hdr_set_dst_addr(hdr, &dst_addr);
+    }
+    __layer3_promote(H0, nullptr, &pkt, ETHER_TYPE_IPV4);
+  };
+  promote("99.0.0.1", 10, sizeof(ipv4_hdr_t)); // No route
+  promote("50.0.0.1", 1, sizeof(ipv4_hdr_t));  // Routed, but out of hops
+  promote("50.0.0.1", 10, sizeof(ipv4_hdr_t) - 1); // Runt
+  REQUIRE(H0->drops[DROP_L3_NO_ROUTE].load() == 1);
+  REQUIRE(H0->drops[DROP_L3_TTL_EXPIRED].load() == 1);
+  REQUIRE(H0->drops[DROP_L3_RUNT].load() == 1);
+  REQUIRE(H0->drops[DROP_L3_NOT_IPV4].load() == 0);
+}
@@ -17,9 +17,8 @@
 
 // Helper to create an interface for routes that need one
 static interface_t *make_test_interface(const char *name) {
-  static interface_t iface;
-  memset(&iface, 0, sizeof(iface));
-  strncpy(iface.if_name, name, CONFIG_IF_NAME_SIZE - 1);
+  static interface_t iface{};
+  snprintf(iface.if_name, sizeof(iface.if_name), "%s", name);
   return &iface;
 }
 
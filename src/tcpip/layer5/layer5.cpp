@@ -3,18 +3,24 @@
 #include "layer5.h"
 #include "graph.h"
 #include "layer3/layer3.h"
+#include "pkt_pool.h"
 
 bool layer5_perform_ping(node_t *n, ipv4_addr_t *addr, ipv4_addr_t *ero_addr) {
   EXPECT_RETURN_BOOL(n != nullptr, "Empty node param", false);
   EXPECT_RETURN_BOOL(addr != nullptr, "Empty destination address param", false);
   uint32_t payload = 659;
+  // Leave headroom for the lower layers' headers
+  pkt_buf_t *pkt = pkt_pool_alloc(pkt_pool_default());
+  EXPECT_RETURN_BOOL(pkt != nullptr, "pkt_pool_alloc failed", false);
+  memcpy(pkt_buf_append(pkt, sizeof(uint32_t)), &payload, sizeof(uint32_t));
   if (ero_addr != nullptr) {
     // Perform IP-in-IP encapsulation
-    layer3_demote_ipnip(n, (uint8_t *)&payload, sizeof(uint32_t), PROT_ICMP, addr, ero_addr);
+    layer3_demote_ipnip(n, pkt, PROT_ICMP, addr, ero_addr);
   }
   else {
-    NODE_NETSTACK(n).l3.demote(n, (uint8_t *)&payload, sizeof(uint32_t), PROT_ICMP, addr);
+    NODE_NETSTACK(n).l3.demote(n, pkt, PROT_ICMP, addr);
   }
+  pkt_buf_destroy(pkt);
   return true;
 }
 
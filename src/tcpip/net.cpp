@@ -6,6 +6,7 @@
 #include "layer2/mac_table.h"
 #include "layer2/vlan_tag.h"
 #include "layer2/arp_table.h"
+#include "layer2/vlan_flood.h"
 
 #pragma mark -
 
@@ -23,7 +24,7 @@ vlan_t* node_vlan_create(node_t *n, uint16_t vlanid, const char *svi_name, const
     if (!n->intf[i]) { continue; }
     interface_t *candidate = n->intf[i];
     if (INTF_MODE(candidate) != INTF_MODE_L3_SVI) { continue; }
-    bool svi_exists = (INTF_NETPROP(candidate).l2.vlan_memberships[0] == vlanid);
+    bool svi_exists = (INTF_NETPROP(candidate).l2.port_vlan == vlanid);
     EXPECT_RETURN_VAL(svi_exists == false, "Existing VLAN ID!", nullptr);
   }
   // Parse SVI IP address
@@ -53,9 +54,8 @@ vlan_t* node_vlan_create(node_t *n, uint16_t vlanid, const char *svi_name, const
   resp = interface_assign_ip_address(svi, svi_addr, svi_mask);
   EXPECT_RETURN_VAL(resp == true, "interface_add_vlan_membership failed", nullptr); // TODO: Leaks `svi`
   // Attach SVI to node
-  int slot_index = node_get_usable_interface_index(n);
-  EXPECT_RETURN_VAL(slot_index >= 0, "node_get_usable_interface_index failed", nullptr); // TODO: Leaks `svi`
-  n->intf[slot_index] = svi;
+  resp = node_attach_interface(n, svi);
+  EXPECT_RETURN_VAL(resp == true, "node_attach_interface failed", nullptr); // TODO: Leaks `svi`
   // Add SVI to routing table
   ipv4_addr_t svi_prefix;
   resp = ipv4_addr_apply_mask(&svi_addr, svi_mask, &svi_prefix);
@@ -65,7 +65,7 @@ vlan_t* node_vlan_create(node_t *n, uint16_t vlanid, const char *svi_name, const
   // Add SVI to mac table as well
   mac_entry_t entry = {0};
   entry.mac_addr = INTF_NETPROP(svi).l2.mac_addr;
-  strncpy((char *)entry.oif_name, (char *)svi_name, CONFIG_IF_NAME_SIZE);
+  entry.oif_ifindex = svi->ifindex;
   glthread_init(&entry.mac_table_glue);
   resp = mac_table_add_entry(n->netprop.mac_table, &entry);
   EXPECT_RETURN_VAL(resp == true, "mac_table_add_entry failed", nullptr);
@@ -75,6 +75,42 @@ vlan_t* node_vlan_create(node_t *n, uint16_t vlanid, const char *svi_name, const
 
 #pragma mark -
 
+// Private utility functions
+
+// Flood lists only track interfaces attached to their node (standalone ones have no lists to be in)
+static vlan_flood_table_t* interface_flood_table(interface_t *intf) {
+  node_t *n = intf->att_node;
+  if (!n || node_get_interface_by_index(n, intf->ifindex) != intf) { return nullptr; }
+  return n->netprop.flood_table;
+}
+
+// What flooding does with frames leaving via `intf` (false if nothing, L3 interfaces never flood)
+static bool interface_flood_action(interface_t *intf, vlan_flood_action_t *action) {
+  switch (INTF_MODE(intf)) {
+    case INTF_MODE_L2_ACCESS: { *action = VLAN_FLOOD_UNTAG; return true; }
+    case INTF_MODE_L2_TRUNK: { *action = VLAN_FLOOD_TAGGED; return true; }
+    case INTF_MODE_L3_SVI: { *action = VLAN_FLOOD_PROMOTE; return true; }
+    default: { return false; }
+  }
+}
+
+static void interface_join_vlan_flood_list(interface_t *intf, uint16_t vlan_id) {
+  vlan_flood_table_t *t = interface_flood_table(intf);
+  vlan_flood_action_t action;
+  if (!t || !interface_flood_action(intf, &action)) { return; }
+  bool resp = vlan_flood_port_add(t, vlan_id, intf->ifindex, action);
+  EXPECT_RETURN(resp == true, "vlan_flood_port_add failed");
+}
+
+static void interface_leave_vlan_flood_lists(interface_t *intf, const vlan_set_t *vlans) {
+  vlan_flood_table_t *t = interface_flood_table(intf);
+  if (!t) { return; }
+  bool resp = vlan_flood_port_leave(t, vlans, intf->ifindex);
+  EXPECT_RETURN(resp == true, "vlan_flood_port_leave failed");
+}
+
+#pragma mark -
+
 // Interface Network Properties
 
 void interface_netprop_init(interface_netprop_t *prop) {
@@ -88,31 +124,35 @@ void interface_netprop_init(interface_netprop_t *prop) {
 bool interface_set_mode(interface_t *intf, interface_mode_t mode) {
   EXPECT_RETURN_BOOL(intf != nullptr, "Empty interface param", false);
   if (INTF_MODE(intf) == mode) { return true; } 
+  vlan_set_t left = INTF_NETPROP(intf).l2.vlans;
   INTF_MODE(intf) = mode;
   // Update VLAN memberships
   switch (mode) {
     case INTF_MODE_L3: {
-      // Remove all memberships (we're calling memset manually because
-      // interface_clear_vlan_memberships cannot be called for a non-L2
-      // interface.
-      memset((void *)INTF_NETPROP(intf).l2.vlan_memberships, 0, sizeof(uint8_t) * CONFIG_MAX_VLAN_PER_INTF);
-      return true;
+      // Remove all memberships
+      INTF_NETPROP(intf).l2.port_vlan = 0;
+      vlan_set_clear(&INTF_NETPROP(intf).l2.vlans);
+      break;
     }
     case INTF_MODE_L3_SVI:
     case INTF_MODE_L2_ACCESS: {
-      // Remove all but the first membership
-      uint16_t saved = INTF_NETPROP(intf).l2.vlan_memberships[0];
-      bool resp = interface_clear_vlan_memberships(intf);
-      EXPECT_RETURN_BOOL(resp == true, "interface_clear_vlan_memberships failed", false);
-      resp = interface_add_vlan_membership(intf, saved);
-      EXPECT_RETURN_BOOL(resp == true, "interface_add_vlan_membership failed", false);
-      return true;
+      // Remove all but the port VLAN
+      vlan_set_clear(&INTF_NETPROP(intf).l2.vlans);
+      if (INTF_NETPROP(intf).l2.port_vlan != 0) {
+        vlan_set_add(&INTF_NETPROP(intf).l2.vlans, INTF_NETPROP(intf).l2.port_vlan);
+      }
+      break;
     }
     default: {
       // Leave as is
-      return true;
+      break;
     }
   }
+  // Flood lists: leave the VLANs dropped, and rejoin the rest under the new mode
+  vlan_set_andnot(&left, &left, &INTF_NETPROP(intf).l2.vlans);
+  interface_leave_vlan_flood_lists(intf, &left);
+  interface_join_vlan_flood_lists(intf);
+  return true;
 }
 
 bool interface_assign_mac_address(interface_t *intf, const char *addrstr) {
@@ -143,27 +183,29 @@ bool interface_assign_ip_address(interface_t *intf, ipv4_addr_t addr, uint8_t ma
 
 bool interface_add_vlan_membership(interface_t *intf, uint16_t vlan_id) {
   EXPECT_RETURN_BOOL(intf != nullptr, "Empty interface param", false);
+  EXPECT_RETURN_BOOL(VLAN_ID_IS_VALID(vlan_id), "Invalid VLAN ID param", false);
   if (!INTF_IN_L2_MODE(intf)) {   // Note: SVIs are in L2 mode too
     return false;
   }
   switch (INTF_MODE(intf)) {
     case INTF_MODE_L3_SVI:
     case INTF_MODE_L2_ACCESS: {
-      if (INTF_NETPROP(intf).l2.vlan_memberships[0] != 0) {
+      if (INTF_NETPROP(intf).l2.port_vlan != 0) {
         // Max 1 VLAN membership in L2_ACCESS/L3_SVI mode
         return false;
       }
-      INTF_NETPROP(intf).l2.vlan_memberships[0] = vlan_id;
+      INTF_NETPROP(intf).l2.port_vlan = vlan_id;
+      vlan_set_add(&INTF_NETPROP(intf).l2.vlans, vlan_id);
+      interface_join_vlan_flood_list(intf, vlan_id);
       return true;
     }
     case INTF_MODE_L2_TRUNK: {
-      for (int j = 0; j < CONFIG_MAX_VLAN_PER_INTF; j++) {
-        if (INTF_NETPROP(intf).l2.vlan_memberships[j] == 0) {
-          INTF_NETPROP(intf).l2.vlan_memberships[j] = vlan_id;
-          return true;
-        }
+      if (INTF_NETPROP(intf).l2.port_vlan == 0) {
+        INTF_NETPROP(intf).l2.port_vlan = vlan_id;
       }
-      return false;
+      vlan_set_add(&INTF_NETPROP(intf).l2.vlans, vlan_id);
+      interface_join_vlan_flood_list(intf, vlan_id);
+      return true;
     }
   }
   // Should never reach this point!
@@ -174,7 +216,9 @@ bool interface_add_vlan_membership(interface_t *intf, uint16_t vlan_id) {
 bool interface_clear_vlan_memberships(interface_t *intf) {
   EXPECT_RETURN_BOOL(intf != nullptr, "Empty interface param", false);
   EXPECT_RETURN_BOOL(INTF_IN_L2_MODE(intf), "Interface not in L2 mode", false);
-  memset((void *)INTF_NETPROP(intf).l2.vlan_memberships, 0, sizeof(uint8_t) * CONFIG_MAX_VLAN_PER_INTF);
+  interface_leave_vlan_flood_lists(intf, &INTF_NETPROP(intf).l2.vlans);
+  INTF_NETPROP(intf).l2.port_vlan = 0;
+  vlan_set_clear(&INTF_NETPROP(intf).l2.vlans);
   return true;
 }
 
@@ -184,19 +228,24 @@ bool interface_test_vlan_membership(interface_t *intf, uint16_t vlan_id) {
   switch (INTF_MODE(intf)) {
     case INTF_MODE_L3_SVI: 
     case INTF_MODE_L2_ACCESS: {
-      return INTF_NETPROP(intf).l2.vlan_memberships[0] == vlan_id;
+      return vlan_id != 0 && INTF_NETPROP(intf).l2.port_vlan == vlan_id;
     }
     case INTF_MODE_L2_TRUNK: {
-      for (int i = 0; i < CONFIG_MAX_VLAN_PER_INTF; i++) {
-        if (INTF_NETPROP(intf).l2.vlan_memberships[i] == vlan_id) {
-          return true;
-        }
-      }
+      return vlan_set_test(&INTF_NETPROP(intf).l2.vlans, vlan_id);
     }
   }
   return false;
 }
 
+void interface_join_vlan_flood_lists(interface_t *intf) {
+  EXPECT_RETURN(intf != nullptr, "Empty interface param");
+  vlan_flood_table_t *t = interface_flood_table(intf);
+  vlan_flood_action_t action;
+  if (!t || !interface_flood_action(intf, &action)) { return; }
+  bool resp = vlan_flood_port_join(t, &INTF_NETPROP(intf).l2.vlans, intf->ifindex, action);
+  EXPECT_RETURN(resp == true, "vlan_flood_port_join failed");
+}
+
 void interface_dump_netprop(interface_t *intf) {
   dump_line_indentation_guard_t guard0;
   EXPECT_RETURN(intf != nullptr, "Empty interface param");
@@ -204,7 +253,7 @@ void interface_dump_netprop(interface_t *intf) {
   switch (INTF_MODE(intf)) {
     case INTF_MODE_L2_ACCESS: {
       printf("L2_ACCESS ");
-      uint16_t vlan = INTF_NETPROP(intf).l2.vlan_memberships[0];
+      uint16_t vlan = INTF_NETPROP(intf).l2.port_vlan;
       printf("VLAN-");
       if (vlan == 0) {
         printf("x ");
@@ -216,19 +265,23 @@ void interface_dump_netprop(interface_t *intf) {
     }
     case INTF_MODE_L2_TRUNK: {
       printf("L2_TRUNK "); 
-      uint16_t vlan0 = INTF_NETPROP(intf).l2.vlan_memberships[0];
+      const vlan_set_t *vlans = &INTF_NETPROP(intf).l2.vlans;
       printf("VLAN-");
-      if (vlan0 == 0) {
+      if (vlan_set_is_empty(vlans)) {
         printf("x ");
       }
       else {
-        for (int i = 0; i < CONFIG_MAX_VLAN_PER_INTF; i++) {
-          uint16_t vlan = INTF_NETPROP(intf).l2.vlan_memberships[i];
-          if (i != 0 && vlan != 0) {
-            printf(",");
+        // Runs of consecutive VLANs print as ranges (e.g. 10,20-29)
+        uint32_t vlan = vlan_set_next(vlans, 0);
+        while (vlan < VLAN_SET_SIZE) {
+          uint32_t last = vlan;
+          while (vlan_set_test(vlans, last + 1)) {
+            last++;
           }
-          if (vlan != 0) {
-            printf("%u", vlan);
+          printf(last == vlan ? "%u" : "%u-%u", vlan, last);
+          vlan = vlan_set_next(vlans, last + 1);
+          if (vlan < VLAN_SET_SIZE) {
+            printf(",");
           }
         }
         printf(" ");
@@ -249,7 +302,7 @@ void interface_dump_netprop(interface_t *intf) {
     }
     case INTF_MODE_L3_SVI: {
       printf("L3_SVI ");
-      uint16_t vlan = INTF_NETPROP(intf).l2.vlan_memberships[0];
+      uint16_t vlan = INTF_NETPROP(intf).l2.port_vlan;
       printf("VLAN-");
       if (vlan == 0) {
         printf("-x ");
@@ -280,6 +333,7 @@ void node_netprop_init(node_netprop_t *prop) {
   prop->loopback.addr.value = 0;
   arp_table_init(&prop->arp_table);
   mac_table_init(&prop->mac_table);
+  vlan_flood_table_init(&prop->flood_table);
   rt_init(&prop->r_table);
   prop->netstack = node_netstack_t();
 }
@@ -5,6 +5,7 @@
 #include <cstdint>
 #include "utils.h"
 #include "layer2/layer2.h"
+#include "layer2/vlan_set.h"
 #include "layer3/layer3.h"
 #include "layer5/layer5.h"
 #include "phy.h"
@@ -16,6 +17,7 @@ typedef struct interface_t interface_t;
 typedef struct graph_t graph_t;
 typedef struct arp_table_t arp_table_t;
 typedef struct mac_table_t mac_table_t;
+typedef struct vlan_flood_table_t vlan_flood_table_t;
 typedef struct vlan_t vlan_t;
 
 #pragma mark -
@@ -35,7 +37,7 @@ struct node_netstack_t {
     layer2_demote_fn_t demote     = &layer2_demote;
   } l2;
   struct {
-    phy_send_frame_fn_t send      = &__phy_node_send_frame_bytes;
+    phy_send_frame_fn_t send      = &__phy_node_send_frame;
   } phy;
 };
 
@@ -60,7 +62,8 @@ struct interface_netprop_t {
   // L2 properties
   struct {
     mac_addr_t mac_addr;
-    uint16_t vlan_memberships[CONFIG_MAX_VLAN_PER_INTF] = {0};
+    uint16_t port_vlan = 0;   // ACCESS/SVI: its VLAN. TRUNK: the first one added (kept if it turns ACCESS). 0 if none
+    vlan_set_t vlans = {};    // Every VLAN membership, `port_vlan` included
   } l2;
   // L3 properties
   struct {
@@ -95,9 +98,10 @@ bool interface_set_mode(interface_t *i, interface_mode_t mode);
 bool interface_assign_mac_address(interface_t *i, const char *addrstr);
 bool interface_assign_mac_address(interface_t *i, mac_addr_t *addr);
 bool interface_assign_ip_address(interface_t *i, ipv4_addr_t addr, uint8_t mask);
-bool interface_add_vlan_membership(interface_t *i, uint16_t vlan_id);
+bool interface_add_vlan_membership(interface_t *i, uint16_t vlan_id); // Any of VLAN_ID_MIN..VLAN_ID_MAX
 bool interface_clear_vlan_memberships(interface_t *i);
-bool interface_test_vlan_membership(interface_t *i, uint16_t vlan_id);
+bool interface_test_vlan_membership(interface_t *i, uint16_t vlan_id); // O(1)
+void interface_join_vlan_flood_lists(interface_t *i); // Called once `i` is attached to its node (see `vlan_flood.h`)
 void interface_dump_netprop(interface_t *i);
 
 #pragma mark -
@@ -108,6 +112,7 @@ struct node_netprop_t {
   // L2 properties
   arp_table_t *arp_table = nullptr;
   mac_table_t *mac_table = nullptr;
+  vlan_flood_table_t *flood_table = nullptr;
   // L3 properties 
   rt_t *r_table = nullptr;
   struct {
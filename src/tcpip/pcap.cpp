@@ -1,13 +1,63 @@
 // pcap.cpp
 
+#include <algorithm>
 #include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
 #include "pcap.h"
+#include "phy_ring.h"
 #include "layer2/arp_hdr.h"
 #include "layer2/ether_hdr.h"
 #include "layer2/vlan_tag.h"
 #include "layer3/layer3.h"
 #include "utils.h"
 
+// Capture record, in front of the frame in a ring slot (unaligned)
+typedef struct pcap_capture_rec_hdr_t {
+  uint64_t ts;    // CLOCK_REALTIME (ns)
+  uint32_t len;   // Original frame length
+  uint32_t dir;   // pcap_capture_dir_t
+} pcap_capture_rec_hdr_t;
+
+static_assert(sizeof(pcap_capture_rec_hdr_t) + PCAP_CAPTURE_SNAPLEN <= CONFIG_MAX_PACKET_BUFFER_SIZE, "Capture record doesn't fit a ring slot");
+
+struct pcap_capture_t {
+  int fd;
+  bool pcapng;
+  phy_ring_t *ring;         // Datapath -> writer
+  std::thread writer;
+  std::atomic<bool> stop;
+  uint8_t *buf;             // File bytes not written yet (writer only)
+  uint32_t buf_len;
+  std::atomic<uint64_t> frames;     // Written by the writer
+  std::atomic<uint64_t> dropped;    // Written under the node lock
+  std::atomic<uint64_t> truncated;  // Same
+};
+
+// pcapng (https://www.ietf.org/archive/id/draft-ietf-opsawg-pcapng-02.html)
+#define PCAPNG_BLOCK_SHB 0x0A0D0D0A
+#define PCAPNG_BLOCK_IDB 0x00000001
+#define PCAPNG_BLOCK_EPB 0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+#define PCAPNG_OPT_ENDOFOPT 0
+#define PCAPNG_OPT_IF_NAME 2
+#define PCAPNG_OPT_IF_DESCRIPTION 3
+#define PCAPNG_OPT_IF_TSRESOL 9
+#define PCAPNG_OPT_EPB_FLAGS 2
+// libpcap
+#define PCAP_MAGIC_NSEC 0xA1B23C4D
+#define PCAP_LINKTYPE_ETHERNET 1
+// Largest record we'll ever append (pcapng EPB, with its options)
+#define PCAP_CAPTURE_MAX_REC_SIZE (32 + PCAP_CAPTURE_SNAPLEN + 3 + 12 + 4)
+
+#pragma mark -
+
+// Pretty printing
+
 void pcap_pkt_dump(uint8_t *frame, uint32_t framelen) {
   pcap_pkt_dump_ethernet(frame, framelen);
 }
@@ -147,3 +197,242 @@ void pcap_pkt_dump_ipv4(uint8_t *hdr, uint32_t len) {
   ipv4_addr_t dst_addr = ipv4_hdr_read_dst_addr(ipv4_hdr);
   dump_line("Dst. IPv4 Addr.: " IPV4_ADDR_FMT "\n", IPV4_ADDR_BYTES_BE(dst_addr));
 }
+
+#pragma mark -
+
+// Capture (private utility functions)
+
+static uint64_t pcap_realtime_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Appends to the capture's file buffer (files are in host byte order)
+static void pcap_capture_put(pcap_capture_t *cap, const void *data, uint32_t len) {
+  memcpy(cap->buf + cap->buf_len, data, len);
+  cap->buf_len += len;
+}
+
+static void pcap_capture_put_u16(pcap_capture_t *cap, uint16_t v) { pcap_capture_put(cap, &v, sizeof(v)); }
+static void pcap_capture_put_u32(pcap_capture_t *cap, uint32_t v) { pcap_capture_put(cap, &v, sizeof(v)); }
+
+static void pcap_capture_put_pad(pcap_capture_t *cap, uint32_t len) {
+  static const uint8_t zeros[4] = {0};
+  pcap_capture_put(cap, zeros, (4 - (len & 3)) & 3);
+}
+
+static void pcapng_put_option(pcap_capture_t *cap, uint16_t code, const void *value, uint16_t len) {
+  pcap_capture_put_u16(cap, code);
+  pcap_capture_put_u16(cap, len);
+  pcap_capture_put(cap, value, len);
+  pcap_capture_put_pad(cap, len);
+}
+
+static bool pcap_capture_flush(pcap_capture_t *cap) {
+  uint32_t off = 0;
+  while (off < cap->buf_len) {
+    ssize_t resp = write(cap->fd, cap->buf + off, cap->buf_len - off);
+    if (resp < 0 && errno == EINTR) { continue; }
+    if (resp <= 0) {
+      cap->buf_len = 0;
+      ERR_RETURN_BOOL("write failed", false);
+    }
+    off += resp;
+  }
+  cap->buf_len = 0;
+  return true;
+}
+
+static void pcap_capture_put_file_header(pcap_capture_t *cap, interface_t *intf) {
+  if (!cap->pcapng) {
+    pcap_capture_put_u32(cap, PCAP_MAGIC_NSEC);
+    pcap_capture_put_u16(cap, 2); // Version 2.4
+    pcap_capture_put_u16(cap, 4);
+    pcap_capture_put_u32(cap, 0); // GMT
+    pcap_capture_put_u32(cap, 0); // Timestamp accuracy
+    pcap_capture_put_u32(cap, PCAP_CAPTURE_SNAPLEN);
+    pcap_capture_put_u32(cap, PCAP_LINKTYPE_ETHERNET);
+    return;
+  }
+  // Section Header Block
+  pcap_capture_put_u32(cap, PCAPNG_BLOCK_SHB);
+  pcap_capture_put_u32(cap, 28);
+  pcap_capture_put_u32(cap, PCAPNG_BYTE_ORDER_MAGIC);
+  pcap_capture_put_u16(cap, 1); // Version 1.0
+  pcap_capture_put_u16(cap, 0);
+  pcap_capture_put_u32(cap, 0xFFFFFFFF); // Section length not known
+  pcap_capture_put_u32(cap, 0xFFFFFFFF);
+  pcap_capture_put_u32(cap, 28);
+  // Interface Description Block (interface ID 0)
+  char description[CONFIG_NODE_NAME_SIZE + 8];
+  snprintf(description, sizeof(description), "node %s", intf->att_node->node_name);
+  uint16_t name_len = strlen(intf->if_name);
+  uint16_t description_len = strlen(description);
+  uint8_t tsresol = 9; // ns
+  uint32_t opts_len = 4 + ((name_len + 3) & ~3) + 4 + ((description_len + 3) & ~3) + 4 + 4 + 4;
+  uint32_t block_len = 20 + opts_len;
+  uint32_t start = cap->buf_len;
+  pcap_capture_put_u32(cap, PCAPNG_BLOCK_IDB);
+  pcap_capture_put_u32(cap, block_len);
+  pcap_capture_put_u16(cap, PCAP_LINKTYPE_ETHERNET);
+  pcap_capture_put_u16(cap, 0);
+  pcap_capture_put_u32(cap, PCAP_CAPTURE_SNAPLEN);
+  pcapng_put_option(cap, PCAPNG_OPT_IF_NAME, intf->if_name, name_len);
+  pcapng_put_option(cap, PCAPNG_OPT_IF_DESCRIPTION, description, description_len);
+  pcapng_put_option(cap, PCAPNG_OPT_IF_TSRESOL, &tsresol, sizeof(tsresol));
+  pcapng_put_option(cap, PCAPNG_OPT_ENDOFOPT, nullptr, 0);
+  pcap_capture_put_u32(cap, block_len);
+  EXPECT_CONTINUE(cap->buf_len - start == block_len, "IDB length mismatch");
+}
+
+// Turns a ring slot into a file record
+static void pcap_capture_put_record(pcap_capture_t *cap, phy_ring_slot_t *slot) {
+  pcap_capture_rec_hdr_t hdr;
+  memcpy(&hdr, slot->data, sizeof(hdr));
+  uint8_t *frame = slot->data + sizeof(hdr);
+  uint32_t caplen = slot->len - sizeof(hdr);
+  if (!cap->pcapng) {
+    pcap_capture_put_u32(cap, hdr.ts / 1000000000ull);
+    pcap_capture_put_u32(cap, hdr.ts % 1000000000ull);
+    pcap_capture_put_u32(cap, caplen);
+    pcap_capture_put_u32(cap, hdr.len);
+    pcap_capture_put(cap, frame, caplen);
+    return;
+  }
+  // Enhanced Packet Block
+  uint32_t block_len = 28 + ((caplen + 3) & ~3) + 8 + 4 + 4;
+  pcap_capture_put_u32(cap, PCAPNG_BLOCK_EPB);
+  pcap_capture_put_u32(cap, block_len);
+  pcap_capture_put_u32(cap, 0); // Interface ID
+  pcap_capture_put_u32(cap, hdr.ts >> 32);
+  pcap_capture_put_u32(cap, hdr.ts & 0xFFFFFFFF);
+  pcap_capture_put_u32(cap, caplen);
+  pcap_capture_put_u32(cap, hdr.len);
+  pcap_capture_put(cap, frame, caplen);
+  pcap_capture_put_pad(cap, caplen);
+  pcapng_put_option(cap, PCAPNG_OPT_EPB_FLAGS, &hdr.dir, sizeof(hdr.dir));
+  pcapng_put_option(cap, PCAPNG_OPT_ENDOFOPT, nullptr, 0);
+  pcap_capture_put_u32(cap, block_len);
+}
+
+static void pcap_capture_writer_main(pcap_capture_t *cap) {
+  auto last_flush = std::chrono::steady_clock::now();
+  while (true) {
+    // Frames queued before `stop` was set are still written out
+    bool stopping = cap->stop.load(std::memory_order_acquire);
+    uint32_t written = 0;
+    phy_ring_slot_t *slot = nullptr;
+    while ((slot = phy_ring_consumer_slot(cap->ring)) != nullptr) {
+      if (cap->buf_len + PCAP_CAPTURE_MAX_REC_SIZE > CONFIG_PCAP_CAPTURE_BUFFER_SIZE) {
+        pcap_capture_flush(cap);
+        last_flush = std::chrono::steady_clock::now();
+      }
+      pcap_capture_put_record(cap, slot);
+      phy_ring_consume(cap->ring);
+      written++;
+    }
+    cap->frames.fetch_add(written, std::memory_order_relaxed);
+    if (stopping) { break; }
+    if (written > 0) { continue; }
+    // Idle: don't sit on a partial buffer for too long
+    auto now = std::chrono::steady_clock::now();
+    if (cap->buf_len > 0 && now - last_flush >= std::chrono::milliseconds(CONFIG_PCAP_CAPTURE_FLUSH_MS)) {
+      pcap_capture_flush(cap);
+      last_flush = now;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  pcap_capture_flush(cap);
+}
+
+static void pcap_capture_destroy(pcap_capture_t *cap) {
+  if (cap->fd >= 0) { close(cap->fd); }
+  phy_ring_destroy(cap->ring);
+  free(cap->buf);
+  delete cap;
+}
+
+#pragma mark -
+
+// Capture
+
+bool pcap_capture_start(interface_t *intf, const char *path) {
+  EXPECT_RETURN_BOOL(intf != nullptr, "Empty interface param", false);
+  EXPECT_RETURN_BOOL(intf->att_node != nullptr, "Interface not attached to a node", false);
+  EXPECT_RETURN_BOOL(path != nullptr, "Empty path param", false);
+  pcap_capture_t *cap = new pcap_capture_t();
+  uint32_t path_len = strlen(path);
+  cap->pcapng = !(path_len >= 5 && strcmp(path + path_len - 5, ".pcap") == 0);
+  // Not truncated yet: the file may be the one a capture on `intf` is writing
+  cap->fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+  cap->ring = phy_ring_create(CONFIG_PCAP_CAPTURE_RING_SIZE);
+  cap->buf = (uint8_t *)malloc(CONFIG_PCAP_CAPTURE_BUFFER_SIZE);
+  if (cap->fd < 0 || !cap->ring || !cap->buf) {
+    pcap_capture_destroy(cap);
+    ERR_RETURN_BOOL("Couldn't set up the capture", false);
+  }
+  pcap_capture_put_file_header(cap, intf);
+  {
+    node_lock_guard_t guard(intf->att_node);
+    if (intf->capture) {
+      pcap_capture_destroy(cap);
+      ERR_RETURN_BOOL("Already capturing on this interface", false);
+    }
+    if (ftruncate(cap->fd, 0) != 0 || !pcap_capture_flush(cap)) {
+      pcap_capture_destroy(cap);
+      ERR_RETURN_BOOL("Couldn't write the capture file header", false);
+    }
+    cap->writer = std::thread(pcap_capture_writer_main, cap);
+    intf->capture = cap;
+  }
+  return true;
+}
+
+bool pcap_capture_stop(interface_t *intf, pcap_capture_stats_t *stats) {
+  EXPECT_RETURN_BOOL(intf != nullptr, "Empty interface param", false);
+  EXPECT_RETURN_BOOL(intf->att_node != nullptr, "Interface not attached to a node", false);
+  pcap_capture_t *cap = nullptr;
+  {
+    // Once detached, the datapath can't reach the capture anymore
+    node_lock_guard_t guard(intf->att_node);
+    cap = intf->capture;
+    intf->capture = nullptr;
+  }
+  EXPECT_RETURN_BOOL(cap != nullptr, "Not capturing on this interface", false);
+  cap->stop.store(true, std::memory_order_release);
+  cap->writer.join();
+  if (stats) {
+    stats->frames = cap->frames.load(std::memory_order_relaxed);
+    stats->dropped = cap->dropped.load(std::memory_order_relaxed);
+    stats->truncated = cap->truncated.load(std::memory_order_relaxed);
+  }
+  pcap_capture_destroy(cap);
+  return true;
+}
+
+void __pcap_capture_frame(pcap_capture_t *cap, const pkt_buf_t *pkt, pcap_capture_dir_t dir) {
+  phy_ring_slot_t *slot = phy_ring_producer_slot(cap->ring);
+  if (!slot) {
+    stats_counter_add(&cap->dropped, 1);
+    return;
+  }
+  pcap_capture_rec_hdr_t hdr = {
+    .ts = pcap_realtime_ns(),
+    .len = pkt_buf_pkt_len(pkt),
+    .dir = dir
+  };
+  memcpy(slot->data, &hdr, sizeof(hdr));
+  // Gather the chain, up to the snap length
+  uint32_t caplen = 0;
+  for (const pkt_buf_t *seg = pkt; seg && caplen < PCAP_CAPTURE_SNAPLEN; seg = seg->next) {
+    uint32_t len = std::min(seg->data_len, PCAP_CAPTURE_SNAPLEN - caplen);
+    memcpy(slot->data + sizeof(hdr) + caplen, seg->buf + seg->data_off, len);
+    caplen += len;
+  }
+  if (caplen < hdr.len) {
+    stats_counter_add(&cap->truncated, 1);
+  }
+  slot->len = sizeof(hdr) + caplen;
+  phy_ring_produce(cap->ring);
+}
@@ -3,9 +3,53 @@
 #pragma once
 
 #include <cstdint>
+#include "graph.h"
+#include "pkt_buf.h"
 
 void pcap_pkt_dump(uint8_t *frame, uint32_t framelen);
 void pcap_pkt_dump_ethernet(uint8_t *frame, uint32_t framelen);
 void pcap_pkt_dump_vlan(uint8_t *hdr, uint32_t len);
 void pcap_pkt_dump_arp(uint8_t *hdr, uint32_t len);
 void pcap_pkt_dump_ipv4(uint8_t *hdr, uint32_t len);
+
+#pragma mark -
+
+// Capture
+
+/*
+ * Per-interface capture to a file, readable by Wireshark/tcpdump. Paths
+ * ending in `.pcap` get the classic libpcap format (nanosecond timestamps),
+ * anything else gets pcapng, with the interface (and node) name in the
+ * Interface Description Block and the direction of every frame.
+ *
+ * The datapath only copies frames (up to PCAP_CAPTURE_SNAPLEN bytes) into a
+ * SPSC ring (see `phy_ring.h`). A writer thread per capture turns them into
+ * records, and writes them out in large chunks (CONFIG_PCAP_CAPTURE_BUFFER_SIZE).
+ * If the writer falls behind, frames are dropped from the capture rather
+ * than stalling the receiver.
+ */
+
+// Room for the record header in a ring slot
+#define PCAP_CAPTURE_SNAPLEN (CONFIG_MAX_PACKET_BUFFER_SIZE - 16)
+
+enum pcap_capture_dir_t {
+  PCAP_CAPTURE_IN = 1,  // Values as in pcapng's `epb_flags`
+  PCAP_CAPTURE_OUT = 2
+};
+
+typedef struct pcap_capture_stats_t {
+  uint64_t frames;      // Written to the file
+  uint64_t dropped;     // Ring full
+  uint64_t truncated;   // Longer than PCAP_CAPTURE_SNAPLEN
+} pcap_capture_stats_t;
+
+// Neither takes the node lock (they take it themselves)
+bool pcap_capture_start(interface_t *intf, const char *path);
+bool pcap_capture_stop(interface_t *intf, pcap_capture_stats_t *stats); // Blocks until everything queued is written
+void __pcap_capture_frame(pcap_capture_t *cap, const pkt_buf_t *pkt, pcap_capture_dir_t dir);
+
+// Call with the node lock held
+static inline void pcap_capture_frame(interface_t *intf, const pkt_buf_t *pkt, pcap_capture_dir_t dir) {
+  if (likely(intf->capture == nullptr)) { return; }
+  __pcap_capture_frame(intf->capture, pkt, dir);
+}
@@ -1,119 +1,810 @@
 // phy.cpp
 
 #include <atomic>
+#include <vector>
 #include <cstdint>
+#include <poll.h>
 #include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <arpa/inet.h>
-#include <CommandParser/libcli.h>
 #include "layer2/layer2.h"
 #include "phy.h"
 #include "config.h"
 #include "pcap.h"
 #include "graph.h"
+#include "phy_uring.h"
+#include "phy_sim.h"
+#include "phy_hdr.h"
+#include "pkt_buf.h"
+#include "prof.h"
+
+#define PHY_RECEIVER_MAX_EVENTS 64
+
+// io_uring user_data tags (stored in the low bits)
+#define PHY_URING_TAG_MASK 0x7
+#define PHY_URING_TAG_RX 0      // Multishot recv, user_data is the node ptr
+#define PHY_URING_TAG_TX 1      // Fixed buffer write, user_data has the buffer index
+#define PHY_URING_TAG_WAKE 2    // Multishot poll on the shard's wake eventfd
 
 #pragma mark -
 
 // Private static variables
 
-static uint8_t __recv_buffer[CONFIG_MAX_PACKET_BUFFER_SIZE];
-static uint8_t __temp_buffer[CONFIG_MAX_PACKET_BUFFER_SIZE];
-static uint8_t __send_buffer[CONFIG_MAX_PACKET_BUFFER_SIZE];
-static std::atomic<bool> __receiver_thread_ready(false);
+typedef struct phy_tx_slot_t {
+  interface_t *intf;
+  uint32_t len;
+  uint32_t framelen;      // Without the phy header, as counted in the interface's tx stats
+  uint8_t data[CONFIG_MAX_PACKET_BUFFER_SIZE];
+} phy_tx_slot_t;
+
+static thread_local uint8_t __recv_buffer[CONFIG_PHY_MAX_BURST][CONFIG_PKT_BUF_HEADROOM + CONFIG_MAX_PACKET_BUFFER_SIZE];
+static thread_local uint8_t __recv_cmsg[CONFIG_PHY_MAX_BURST][CMSG_SPACE(sizeof(struct timespec))];
+static thread_local uint64_t __rx_dequeue_ns = 0; // Set while the stack processes a received burst
+static thread_local uint64_t __rx_frame_ns = 0;   // Set when the stack starts on each frame of the burst
+static thread_local struct {
+  bool enabled;
+  uint32_t count;
+  bool sent[CONFIG_PHY_TX_BATCH_SIZE];
+  phy_tx_slot_t slots[CONFIG_PHY_TX_BATCH_SIZE];
+} __tx_batch;
+struct phy_uring_shard_t {
+  phy_uring_t ring;
+  phy_uring_buf_ring_t rx;            // Provided buffers for multishot recv
+  uint8_t *tx_buffers;                // Registered (fixed) buffers
+  uint16_t tx_free[CONFIG_PHY_URING_TX_BUFFERS];
+  uint32_t tx_free_count;
+  int wake_fd;                        // Rung when nodes get registered
+  pthread_mutex_t pending_lock;
+  std::vector<node_t *> pending;      // Nodes waiting to be armed
+};
+
+struct phy_shared_t {
+  uint32_t shard_count;
+  int fd[CONFIG_MAX_PHY_RECEIVER_THREADS];    // Bound socket, one per shard (receives and sends)
+  struct sockaddr_in addr[CONFIG_MAX_PHY_RECEIVER_THREADS];
+  std::atomic<node_t **> nodes[CONFIG_PHY_SHARED_MAX_NODE_CHUNKS]; // Node id -> node (chunks never move)
+};
+
+static thread_local phy_uring_shard_t *__uring_shard = nullptr; // Set on uring receivers
+static std::atomic<bool> __frame_logging(true);
+static std::atomic<bool> __tx_timestamps(false);
+static std::atomic<bool> __kernel_timestamps(false);
+static std::atomic<phy_poll_mode_t> __poll_mode(PHY_POLL_BLOCK);
+static std::atomic<uint32_t> __spin_budget(CONFIG_PHY_DEFAULT_SPIN_BUDGET);
+static std::atomic<uint32_t> __socket_busy_poll(0);
+static std::atomic<uint32_t> __burst_size(CONFIG_PHY_DEFAULT_BURST);
+static std::atomic<phy_transport_t> __default_transport(PHY_TRANSPORT_UDP);
+static struct {
+  std::atomic<uint64_t> rx_bursts;
+  std::atomic<uint64_t> rx_frames;
+  std::atomic<uint64_t> tx_batches;
+  std::atomic<uint64_t> tx_frames;
+  std::atomic<uint64_t> ring_rx_frames;
+  std::atomic<uint64_t> ring_tx_drops;
+  std::atomic<uint64_t> ring_doorbells;
+  std::atomic<uint64_t> uring_enters;
+  std::atomic<uint64_t> uring_rx_frames;
+  std::atomic<uint64_t> uring_tx_frames;
+  std::atomic<uint64_t> uring_tx_fallbacks;
+  std::atomic<uint64_t> tstamp_frames;
+  std::atomic<uint64_t> tstamp_latency_ns;
+  std::atomic<uint64_t> poll_spins;
+  std::atomic<uint64_t> poll_sleeps;
+} __stats;
 
 #pragma mark -
 
 // Private utility functions
 
-bool phy_frame_buffer_shift_right(uint8_t **frameptr, uint32_t framelen, uint32_t buflen) {
-  EXPECT_RETURN_BOOL(frameptr != nullptr, "Empty frame out param", false);
-  EXPECT_RETURN_BOOL(framelen <= buflen, "Params framelen greater than buflen", false);
-  EXPECT_RETURN_BOOL(framelen != 0, "Zero framelen param", false);
-  uint32_t offset = buflen - framelen; // Make sure buffer is at least 2 x MTU
-  if (likely(framelen * 2 < buflen)) {
-    memcpy(*frameptr + offset, *frameptr, framelen);
-    memset(*frameptr, 0, offset);
+static inline uint32_t phy_node_shard(graph_t *topo, node_t *n) {
+  return n->phy.id % topo->phy.thread_count;
+}
+
+// Timeout (ms) for a receiver's next wait, as per the poll mode. `empty`
+// counts the polls in a row that came back with nothing.
+static inline int phy_poll_timeout(uint32_t empty) {
+  switch (__poll_mode.load(std::memory_order_relaxed)) {
+    case PHY_POLL_BLOCK: break;
+    case PHY_POLL_BUSY: return 0;
+    case PHY_POLL_ADAPTIVE:
+      if (empty < __spin_budget.load(std::memory_order_relaxed)) { return 0; }
+      break;
+  }
+  return -1;
+}
+
+static inline void phy_poll_account(int timeout, int nready) {
+  if (timeout < 0) {
+    __stats.poll_sleeps.fetch_add(1, std::memory_order_relaxed);
   }
-  else {
-    // Expensive
-    memcpy(__temp_buffer, *frameptr, framelen);
-    memset(*frameptr, 0, offset);
-    memcpy(*frameptr + offset, __temp_buffer, framelen);
+  else if (nready == 0) {
+    __stats.poll_spins.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+// Same clock as kernel (SO_TIMESTAMPNS) timestamps
+static inline uint64_t phy_realtime_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Call with the interface's node lock held
+static phy_intf_latency_t* phy_intf_latency(interface_t *intf) {
+  if (unlikely(!intf->latency)) {
+    phy_intf_latency_t *latency = new phy_intf_latency_t();
+    hist_init(&latency->kernel);
+    hist_init(&latency->stack);
+    intf->latency = latency;
   }
-  *frameptr += offset;
-  return true; 
+  return intf->latency;
 }
 
-int phy_node_receive_interface_frame_bytes(node_t *n, interface_t *intf, uint8_t *frame, uint32_t framelen) {
-  EXPECT_RETURN_BOOL(n != nullptr, "Empty node ptr param", false);
-  EXPECT_RETURN_BOOL(intf != nullptr, "Empty interface ptr param", false);
-  EXPECT_RETURN_BOOL(frame != nullptr, "Empty packet ptr param", false);
-  // TODO: Why exactly are we shifting the data since we distinguish between
-  // send and receive buffers, and as such, they are two different allocations?
-  bool resp = phy_frame_buffer_shift_right(&frame, framelen, CONFIG_MAX_PACKET_BUFFER_SIZE - CONFIG_IF_NAME_SIZE);
-  EXPECT_RETURN_VAL(resp == true, "phy_frame_buffer_shift_right failed", -1);
-  return layer2_node_recv_frame_bytes(n, intf, frame, framelen); // Entry point into Layer 2
+// Stack latency of a frame handed off via `intf` (sent, or queued for a tx
+// batch), if it was produced while processing a received one
+static inline void phy_intf_record_egress(interface_t *intf) {
+  if (!__rx_frame_ns) { return; }
+  uint64_t now = phy_realtime_ns();
+  hist_record(&phy_intf_latency(intf)->stack, now > __rx_frame_ns ? now - __rx_frame_ns : 0);
+}
+
+static inline node_t* phy_shared_find_node(phy_shared_t *s, uint32_t id) {
+  if (id >= CONFIG_PHY_SHARED_NODE_CHUNK_SIZE * CONFIG_PHY_SHARED_MAX_NODE_CHUNKS) { return nullptr; }
+  node_t **nodes = s->nodes[id / CONFIG_PHY_SHARED_NODE_CHUNK_SIZE].load(std::memory_order_acquire);
+  return nodes ? __atomic_load_n(&nodes[id % CONFIG_PHY_SHARED_NODE_CHUNK_SIZE], __ATOMIC_ACQUIRE) : nullptr;
+}
+
+// Node creation is single threaded, receivers only ever read
+static bool phy_shared_add_node(phy_shared_t *s, node_t *n) {
+  uint32_t chunk = n->phy.id / CONFIG_PHY_SHARED_NODE_CHUNK_SIZE;
+  EXPECT_RETURN_BOOL(chunk < CONFIG_PHY_SHARED_MAX_NODE_CHUNKS, "Too many nodes", false);
+  node_t **nodes = s->nodes[chunk].load(std::memory_order_acquire);
+  if (!nodes) {
+    nodes = (node_t **)calloc(CONFIG_PHY_SHARED_NODE_CHUNK_SIZE, sizeof(node_t *));
+    EXPECT_RETURN_BOOL(nodes != nullptr, "calloc failed", false);
+    s->nodes[chunk].store(nodes, std::memory_order_release);
+  }
+  __atomic_store_n(&nodes[n->phy.id % CONFIG_PHY_SHARED_NODE_CHUNK_SIZE], n, __ATOMIC_RELEASE);
+  return true;
+}
+
+// Socket for frames leaving `intf`, and their destination address (only
+// shared sockets need one, the others are pre-connected)
+static inline int phy_intf_send_fd(node_t *n, interface_t *intf, interface_t *intf2, struct sockaddr_in **dst) {
+  phy_shared_t *s = n->phy.shared;
+  if (!s) {
+    *dst = nullptr;
+    return intf->udp.fd;
+  }
+  *dst = &s->addr[intf2->att_node->phy.id % s->shard_count];
+  return s->fd[n->phy.id % s->shard_count];
+}
+
+// Writes the phy header for a frame headed to `intf2` (the link's far end)
+static inline uint32_t phy_node_write_hdr(node_t *n, interface_t *intf2, uint8_t *buf) {
+  uint8_t flags = 0;
+  uint32_t node_id = 0;
+  uint64_t tstamp = 0;
+  if (n->phy.shared) {
+    flags |= PHY_HDR_F_NODE;
+    node_id = intf2->att_node->phy.id;
+  }
+  if (__tx_timestamps.load(std::memory_order_relaxed)) {
+    flags |= PHY_HDR_F_TSTAMP;
+    tstamp = phy_node_clock_ns(n);
+  }
+  return phy_hdr_write(buf, intf2->ifindex, flags, node_id, tstamp);
+}
+
+// Datagrams carry a phy header (see `phy_hdr.h`), followed by the frame
+static void phy_node_receive_datagram(node_t *n, pkt_buf_t *pkt) {
+  prof_stage_guard_t prof(n, PROF_STAGE_PHY_RX);
+  phy_hdr_t hdr;
+  uint32_t node_id = 0;
+  uint64_t tstamp = 0;
+  uint32_t hdrlen = phy_hdr_parse(PKT_BUF_MTOD(pkt, uint8_t *), pkt->data_len, &hdr, &node_id, &tstamp);
+  if (hdrlen == 0 || pkt->data_len <= hdrlen) {
+    node_count_drop(n, DROP_PHY_BAD_HDR);
+    return;
+  }
+  interface_t *target_intf = node_get_interface_by_index(n, hdr.ifindex);
+  if (!target_intf) {
+    node_count_drop(n, DROP_PHY_UNKNOWN_INTF);
+    return;
+  }
+  if (__frame_logging.load(std::memory_order_relaxed)) {
+    printf("[%s] Read %u bytes on %s\n", n->node_name, pkt->data_len, target_intf->if_name);
+  }
+  if (hdr.flags & PHY_HDR_F_TSTAMP) {
+    uint64_t now = phy_node_clock_ns(n);
+    __stats.tstamp_frames.fetch_add(1, std::memory_order_relaxed);
+    __stats.tstamp_latency_ns.fetch_add(now > tstamp ? now - tstamp : 0, std::memory_order_relaxed);
+  }
+  if (pkt->rx_tstamp) {
+    hist_record(&phy_intf_latency(target_intf)->kernel, __rx_dequeue_ns > pkt->rx_tstamp ? __rx_dequeue_ns - pkt->rx_tstamp : 0);
+  }
+  pkt_buf_adj(pkt, hdrlen);
+  //pcap_pkt_dump(PKT_BUF_MTOD(pkt, uint8_t *), pkt->data_len);
+  (void)layer2_node_recv_frame(n, target_intf, pkt); // Entry point into Layer 2 (counts its own drops)
+}
+
+// Kernel rx timestamp (ns) of a received datagram, 0 if it has none
+static inline uint64_t phy_msg_rx_tstamp(struct msghdr *msg) {
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+      struct timespec ts;
+      memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+      return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+  }
+  return 0;
+}
+
+// Node named by the phy header of a datagram received on a shared socket
+static inline node_t* phy_shared_demux(phy_shared_t *s, pkt_buf_t *pkt) {
+  phy_hdr_t hdr;
+  uint32_t node_id = 0;
+  uint64_t tstamp = 0;
+  uint32_t hdrlen = phy_hdr_parse(PKT_BUF_MTOD(pkt, uint8_t *), pkt->data_len, &hdr, &node_id, &tstamp);
+  EXPECT_RETURN_VAL(hdrlen > 0 && (hdr.flags & PHY_HDR_F_NODE), "Invalid phy header", nullptr);
+  node_t *n = phy_shared_find_node(s, node_id);
+  EXPECT_RETURN_VAL(n != nullptr, "Packet received for unknown node", nullptr);
+  return n;
+}
+
+// Drains a socket, a burst at a time. Frames go to `n`, or (on a shared
+// socket, where `n` is null) to whichever node their header names. Frames
+// are processed with their node's lock held.
+static void phy_receive_bursts(int fd, node_t *n, phy_shared_t *shared) {
+  struct mmsghdr msgs[CONFIG_PHY_MAX_BURST];
+  struct iovec iovs[CONFIG_PHY_MAX_BURST];
+  uint32_t burst = __burst_size.load(std::memory_order_relaxed);
+  bool kernel_timestamps = __kernel_timestamps.load(std::memory_order_relaxed);
+  while (true) {
+    memset(msgs, 0, sizeof(struct mmsghdr) * burst);
+    for (uint32_t i = 0; i < burst; i++) {
+      // Receive past the headroom, so that the stack can push headers in place
+      iovs[i].iov_base = __recv_buffer[i] + CONFIG_PKT_BUF_HEADROOM;
+      iovs[i].iov_len = CONFIG_MAX_PACKET_BUFFER_SIZE;
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      if (kernel_timestamps) {
+        msgs[i].msg_hdr.msg_control = __recv_cmsg[i];
+        msgs[i].msg_hdr.msg_controllen = sizeof(__recv_cmsg[i]);
+      }
+    }
+    int count = recvmmsg(fd, msgs, burst, MSG_DONTWAIT, nullptr);
+    if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { break; }
+    if (count < 0 && errno == EINTR) { continue; }
+    EXPECT_FATAL(count >= 0, "recvmmsg failed");
+    // The whole burst was dequeued at once
+    __rx_dequeue_ns = kernel_timestamps ? phy_realtime_ns() : 0;
+    __stats.rx_bursts.fetch_add(1, std::memory_order_relaxed);
+    __stats.rx_frames.fetch_add(count, std::memory_order_relaxed);
+    // Process the burst, and send whatever it produced in one go
+    phy_tx_batch_begin();
+    node_t *locked = nullptr; // Shared sockets only (runs of frames for the same node share a lock)
+    for (int i = 0; i < count; i++) {
+      pkt_buf_t pkt;
+      pkt_buf_init(&pkt, __recv_buffer[i], sizeof(__recv_buffer[i]), CONFIG_PKT_BUF_HEADROOM);
+      pkt_buf_append(&pkt, msgs[i].msg_len);
+      pkt.rx_tstamp = kernel_timestamps ? phy_msg_rx_tstamp(&msgs[i].msg_hdr) : 0;
+      __rx_frame_ns = kernel_timestamps ? phy_realtime_ns() : 0;
+      if (n) {
+        phy_node_receive_datagram(n, &pkt);
+        continue;
+      }
+      node_t *dst = phy_shared_demux(shared, &pkt);
+      if (!dst) { continue; }
+      if (dst != locked) {
+        if (locked) {
+          // A batch only ever holds frames of the node whose lock we hold
+          phy_tx_batch_flush();
+          phy_tx_batch_begin();
+          node_unlock(locked);
+        }
+        node_lock(dst);
+        locked = dst;
+      }
+      phy_node_receive_datagram(dst, &pkt);
+    }
+    __rx_frame_ns = 0;
+    phy_tx_batch_flush(); // Still under the node's lock (ours or the caller's)
+    if (locked) { node_unlock(locked); }
+    __rx_dequeue_ns = 0;
+    // A short burst means the socket is drained. Anything arriving after this
+    // point raises a fresh edge on the epoll set, so we don't need to spend
+    // another syscall waiting for EAGAIN.
+    if ((uint32_t)count < burst) { break; }
+  }
+}
+
+static bool phy_node_rings_empty(node_t *n) {
+  for (int i = 0; i < CONFIG_MAX_INTF_PER_NODE; i++) {
+    interface_t *intf = n->intf[i];
+    if (intf && intf->ring.rx && !phy_ring_empty(intf->ring.rx)) { return false; }
+  }
+  return true;
+}
+
+// Drains all of a node's rx rings (round robin, a burst per ring at a time)
+static void phy_node_receive_rings(node_t *n) {
+  uint64_t doorbell;
+  ssize_t resp = read(n->phy.doorbell_fd, &doorbell, sizeof(doorbell)); // Reset doorbell
+#pragma unused(resp);
+  uint32_t burst = __burst_size.load(std::memory_order_relaxed);
+  while (true) {
+    n->phy.idle.store(false, std::memory_order_relaxed);
+    uint64_t count = 0;
+    for (int i = 0; i < CONFIG_MAX_INTF_PER_NODE; i++) {
+      interface_t *intf = n->intf[i];
+      if (!intf || !intf->ring.rx) { continue; }
+      for (uint32_t j = 0; j < burst; j++) {
+        phy_ring_slot_t *slot = phy_ring_consumer_slot(intf->ring.rx);
+        if (!slot) { break; }
+        if (__frame_logging.load(std::memory_order_relaxed)) {
+          printf("[%s] Read %u bytes on %s\n", n->node_name, slot->len, intf->if_name);
+        }
+        // Frames are processed in place (no copy), and the slot is only
+        // handed back to the producer once we're done with it
+        uint64_t prof_start = prof_begin();
+        pkt_buf_t pkt;
+        pkt_buf_init(&pkt, slot->data, sizeof(slot->data), CONFIG_PKT_BUF_HEADROOM);
+        pkt_buf_append(&pkt, slot->len);
+        (void)layer2_node_recv_frame(n, intf, &pkt); // Counts its own drops
+        prof_end(n, PROF_STAGE_PHY_RX, prof_start);
+        phy_ring_consume(intf->ring.rx);
+        count++;
+      }
+    }
+    __stats.ring_rx_frames.fetch_add(count, std::memory_order_relaxed);
+    if (count > 0) { continue; }
+    // Nothing left. Announce that we're going idle, then check one last time
+    // (pairs with the fence in the send path, so that a frame produced
+    // concurrently either gets seen here or rings the doorbell).
+    n->phy.idle.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (phy_node_rings_empty(n)) { break; }
+  }
 }
 
 #pragma mark -
 
-// Public functions
+// io_uring backend
 
-void phy_receiver_thread_main(graph_t *topo) {
-  // First, gather all node socket descriptors
-  fd_set fds; FD_ZERO(&fds);
-  int max_fd = 0;
-  glthread_t *curr;
-  GLTHREAD_FOREACH_BEGIN(&topo->node_list, curr) {
-    node_t *n = node_ptr_from_graph_glue(curr);
-    if (!n->udp.fd) { continue; }
-    max_fd = std::max(max_fd, n->udp.fd);
-    FD_SET(n->udp.fd, &fds);
-  }
-  GLTHREAD_FOREACH_END();
-  __receiver_thread_ready.store(true);
-  // Poll for ready to read fds in a busy loop
+static struct io_uring_sqe* phy_uring_shard_get_sqe(phy_uring_shard_t *s) {
+  struct io_uring_sqe *sqe = phy_uring_get_sqe(&s->ring);
+  if (likely(sqe != nullptr)) { return sqe; }
+  // SQ full, hand what we have to the kernel and try again
+  int resp = phy_uring_submit_and_wait(&s->ring, 0);
+  EXPECT_RETURN_VAL(resp >= 0, "io_uring_enter failed", nullptr);
+  __stats.uring_enters.fetch_add(1, std::memory_order_relaxed);
+  return phy_uring_get_sqe(&s->ring);
+}
+
+static bool phy_uring_arm_recv(phy_uring_shard_t *s, node_t *n) {
+  if (n->phy.rx_armed) { return true; }
+  struct io_uring_sqe *sqe = phy_uring_shard_get_sqe(s);
+  EXPECT_RETURN_BOOL(sqe != nullptr, "phy_uring_shard_get_sqe failed", false);
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = n->udp.fd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = s->rx.bgid;
+  sqe->user_data = (uint64_t)n | PHY_URING_TAG_RX;
+  n->phy.rx_armed = true;
+  return true;
+}
+
+static bool phy_uring_arm_wake(phy_uring_shard_t *s) {
+  struct io_uring_sqe *sqe = phy_uring_shard_get_sqe(s);
+  EXPECT_RETURN_BOOL(sqe != nullptr, "phy_uring_shard_get_sqe failed", false);
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = s->wake_fd;
+  sqe->poll32_events = POLLIN;
+  sqe->len = IORING_POLL_ADD_MULTI;
+  sqe->user_data = PHY_URING_TAG_WAKE;
+  return true;
+}
+
+static phy_uring_shard_t* phy_uring_shard_create() {
+  phy_uring_shard_t *s = new phy_uring_shard_t();
+  bool resp = phy_uring_init(&s->ring, CONFIG_PHY_URING_SQ_ENTRIES, CONFIG_PHY_URING_CQ_ENTRIES);
+  EXPECT_RETURN_VAL(resp == true, "phy_uring_init failed", nullptr);
+  // RX: provided buffer ring, the kernel picks a buffer per datagram
+  resp = phy_uring_setup_buf_ring(&s->ring, &s->rx, 0, CONFIG_PHY_URING_RX_BUFFERS, CONFIG_PKT_BUF_HEADROOM + CONFIG_MAX_PACKET_BUFFER_SIZE, CONFIG_PKT_BUF_HEADROOM);
+  EXPECT_RETURN_VAL(resp == true, "phy_uring_setup_buf_ring failed", nullptr);
+  // TX: frame sized buffers, registered once so that writes skip the
+  // per-request page pinning
+  s->tx_buffers = (uint8_t *)calloc(CONFIG_PHY_URING_TX_BUFFERS, CONFIG_MAX_PACKET_BUFFER_SIZE);
+  EXPECT_RETURN_VAL(s->tx_buffers != nullptr, "calloc failed", nullptr);
+  struct iovec iovs[CONFIG_PHY_URING_TX_BUFFERS];
+  for (uint32_t i = 0; i < CONFIG_PHY_URING_TX_BUFFERS; i++) {
+    iovs[i].iov_base = s->tx_buffers + (size_t)i * CONFIG_MAX_PACKET_BUFFER_SIZE;
+    iovs[i].iov_len = CONFIG_MAX_PACKET_BUFFER_SIZE;
+    s->tx_free[i] = CONFIG_PHY_URING_TX_BUFFERS - 1 - i;
+  }
+  s->tx_free_count = CONFIG_PHY_URING_TX_BUFFERS;
+  resp = phy_uring_register_buffers(&s->ring, iovs, CONFIG_PHY_URING_TX_BUFFERS);
+  EXPECT_RETURN_VAL(resp == true, "phy_uring_register_buffers failed", nullptr);
+  // Wakeups (for nodes registered from other threads)
+  s->wake_fd = eventfd(0, EFD_NONBLOCK);
+  EXPECT_RETURN_VAL(s->wake_fd >= 0, "eventfd failed", nullptr);
+  pthread_mutex_init(&s->pending_lock, nullptr);
+  resp = phy_uring_arm_wake(s);
+  EXPECT_RETURN_VAL(resp == true, "phy_uring_arm_wake failed", nullptr);
+  return s;
+}
+
+static bool phy_uring_shard_enqueue_node(phy_uring_shard_t *s, node_t *n) {
+  pthread_mutex_lock(&s->pending_lock);
+  s->pending.push_back(n);
+  pthread_mutex_unlock(&s->pending_lock);
+  uint64_t one = 1;
+  ssize_t resp = write(s->wake_fd, &one, sizeof(one));
+  EXPECT_RETURN_BOOL(resp == sizeof(one), "Wake write failed", false);
+  return true;
+}
+
+static void phy_uring_handle_cqe(phy_uring_shard_t *s, struct io_uring_cqe *cqe, uint64_t *rx_frames, uint64_t *tx_frames) {
+  uint64_t tag = cqe->user_data & PHY_URING_TAG_MASK;
+  if (tag == PHY_URING_TAG_RX) {
+    node_t *n = (node_t *)(cqe->user_data & ~(uint64_t)PHY_URING_TAG_MASK);
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+      uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+      if (cqe->res > 0) {
+        node_lock_guard_t guard(n);
+        pkt_buf_t pkt;
+        pkt_buf_init(&pkt, phy_uring_buf_ring_buffer(&s->rx, bid), s->rx.buffer_size, s->rx.headroom);
+        pkt_buf_append(&pkt, cqe->res);
+        phy_node_receive_datagram(n, &pkt);
+        (*rx_frames)++;
+      }
+      phy_uring_buf_ring_recycle(&s->rx, bid);
+    }
+    else if (cqe->res < 0 && cqe->res != -ENOBUFS) {
+      LOG_ERR("[%s] io_uring recv failed (%s)\n", n->node_name, strerror(-cqe->res));
+    }
+    // Multishot requests end on errors (e.g. running out of buffers)
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+      n->phy.rx_armed = false;
+      phy_uring_arm_recv(s, n);
+    }
+  }
+  else if (tag == PHY_URING_TAG_TX) {
+    s->tx_free[s->tx_free_count++] = (uint16_t)(cqe->user_data >> 3);
+    if (cqe->res < 0) {
+      LOG_ERR("io_uring send failed (%s)\n", strerror(-cqe->res));
+    }
+    else {
+      (*tx_frames)++;
+    }
+  }
+  else if (tag == PHY_URING_TAG_WAKE) {
+    uint64_t value;
+    ssize_t resp = read(s->wake_fd, &value, sizeof(value));
+#pragma unused(resp);
+    std::vector<node_t *> pending;
+    pthread_mutex_lock(&s->pending_lock);
+    pending.swap(s->pending);
+    pthread_mutex_unlock(&s->pending_lock);
+    for (node_t *n : pending) {
+      phy_uring_arm_recv(s, n);
+    }
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+      phy_uring_arm_wake(s);
+    }
+  }
+}
+
+static void phy_uring_receiver_thread_main(graph_t *topo, uint32_t shard) {
+  phy_uring_shard_t *s = phy_uring_shard_create();
+  EXPECT_FATAL(s != nullptr, "phy_uring_shard_create failed");
+  __uring_shard = s;
+  // Publish the shard first, so that nodes added from here on get queued up
+  // by graph_add_node(). Then arm the nodes we already know of (arming is
+  // idempotent, so any overlap is harmless).
+  topo->phy.uring[shard].store(s);
+  {
+    graph_lock_guard_t guard(topo); // Nodes may be getting added
+    glthread_t *curr;
+    GLTHREAD_FOREACH_BEGIN(&topo->node_list, curr) {
+      node_t *n = node_ptr_from_graph_glue(curr);
+      if (phy_node_shard(topo, n) != shard) { continue; }
+      bool resp = phy_uring_arm_recv(s, n);
+      EXPECT_FATAL(resp == true, "phy_uring_arm_recv failed");
+    }
+    GLTHREAD_FOREACH_END();
+  }
+  topo->phy.ready_count.fetch_add(1);
+  // Submit whatever got queued up (re-arms, sends) and wait for completions,
+  // one syscall per round
+  while (true) {
+    int resp = phy_uring_submit_and_wait(&s->ring, 1);
+    __stats.uring_enters.fetch_add(1, std::memory_order_relaxed);
+    EXPECT_FATAL(resp >= 0 || resp == -EINTR || resp == -EAGAIN || resp == -EBUSY, "io_uring_enter failed");
+    uint64_t rx_frames = 0;
+    uint64_t tx_frames = 0;
+    struct io_uring_cqe *cqe;
+    while ((cqe = phy_uring_peek_cqe(&s->ring)) != nullptr) {
+      phy_uring_handle_cqe(s, cqe, &rx_frames, &tx_frames);
+      phy_uring_cqe_seen(&s->ring);
+    }
+    __stats.uring_rx_frames.fetch_add(rx_frames, std::memory_order_relaxed);
+    __stats.uring_tx_frames.fetch_add(tx_frames, std::memory_order_relaxed);
+  }
+}
+
+static void phy_shared_receiver_thread_main(graph_t *topo, uint32_t shard) {
+  phy_shared_t *s = topo->phy.shared;
+  int fd = s->fd[shard];
+  topo->phy.ready_count.fetch_add(1);
+  struct pollfd pfd;
+  memset(&pfd, 0, sizeof(pfd));
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  uint32_t empty = 0;
   while (true) {
-    fd_set ready_fds; FD_ZERO(&ready_fds);
-    memcpy(&ready_fds, &fds, sizeof(fd_set));
-    int resp = select(max_fd + 1, &ready_fds, nullptr, nullptr, nullptr);
-    EXPECT_FATAL(resp >= 0, "selct failed");
-    if (resp == 0) { continue; } // select timed-out
-    command_parser_lock();
-    // Process ready fds
+    int timeout = phy_poll_timeout(empty);
+    int resp = poll(&pfd, 1, timeout);
+    if (resp < 0 && errno == EINTR) { continue; }
+    EXPECT_FATAL(resp >= 0, "poll failed");
+    phy_poll_account(timeout, resp);
+    if (resp == 0) {
+      empty++;
+      continue;
+    }
+    empty = 0;
+    phy_receive_bursts(fd, nullptr, s);
+  }
+}
+
+static void phy_sim_receiver_thread_main(graph_t *topo, uint32_t shard) {
+  topo->phy.ready_count.fetch_add(1);
+  // Events run one at a time (that's what makes runs deterministic), so
+  // there's nothing for other shards to do
+  if (shard != 0) { return; }
+  while (true) {
+    phy_sim_wait(topo->phy.sim);
+    phy_sim_run(topo->phy.sim);
+  }
+}
+
+#pragma mark -
+
+// Public functions
+
+void phy_set_default_transport(phy_transport_t transport) {
+  __default_transport.store(transport);
+}
+
+phy_transport_t phy_get_default_transport() {
+  return __default_transport.load();
+}
+
+const char* phy_transport_str(phy_transport_t transport) {
+  switch (transport) {
+    case PHY_TRANSPORT_UDP: return "udp";
+    case PHY_TRANSPORT_RING: return "ring";
+    case PHY_TRANSPORT_URING: return "uring";
+    case PHY_TRANSPORT_SIM: return "sim";
+    case PHY_TRANSPORT_UDP_SHARED: return "udp-shared";
+  }
+  return "unknown";
+}
+
+bool phy_node_init(node_t *n, phy_transport_t transport) {
+  EXPECT_RETURN_BOOL(n != nullptr, "Empty node param", false);
+  n->phy.transport = transport;
+  if (transport == PHY_TRANSPORT_RING) {
+    int fd = eventfd(0, EFD_NONBLOCK);
+    EXPECT_RETURN_BOOL(fd >= 0, "eventfd failed", false);
+    n->phy.doorbell_fd = fd;
+    n->phy.idle.store(true);
+    NODE_NETSTACK(n).phy.send = &__phy_node_ring_send_frame;
+    return true;
+  }
+  if (transport == PHY_TRANSPORT_SIM) {
+    EXPECT_RETURN_BOOL(n->phy.sim != nullptr, "Node has no simulator", false);
+    NODE_NETSTACK(n).phy.send = &__phy_node_sim_send_frame;
+    return true;
+  }
+  if (transport == PHY_TRANSPORT_UDP_SHARED) {
+    EXPECT_RETURN_BOOL(n->phy.shared != nullptr, "Node has no shared sockets", false);
+    return phy_shared_add_node(n->phy.shared, n); // No syscalls
+  }
+  bool resp = phy_setup_udp_socket(&n->udp.port, &n->udp.fd);
+  EXPECT_RETURN_BOOL(resp == true, "phy_setup_udp_socket failed", false);
+  if (transport == PHY_TRANSPORT_URING) {
+    NODE_NETSTACK(n).phy.send = &__phy_node_uring_send_frame;
+  }
+  return true;
+}
+
+bool phy_link_init(link_t *l) {
+  EXPECT_RETURN_BOOL(l != nullptr, "Empty link param", false);
+  node_t *n1 = l->intf1.att_node;
+  node_t *n2 = l->intf2.att_node;
+  EXPECT_RETURN_BOOL(n1 != nullptr && n2 != nullptr, "Link not attached to nodes", false);
+  EXPECT_RETURN_BOOL(n1->phy.transport == n2->phy.transport, "Link nodes use different transports", false);
+  if (n1->phy.transport == PHY_TRANSPORT_SIM) {
+    return true; // Links only exist as latencies
+  }
+  if (n1->phy.transport == PHY_TRANSPORT_UDP_SHARED) {
+    return true; // Frames go through the shards' sockets
+  }
+  if (n1->phy.transport == PHY_TRANSPORT_RING) {
+    // One ring per direction
+    phy_ring_t *r12 = phy_ring_create(CONFIG_PHY_RING_SIZE);
+    EXPECT_RETURN_BOOL(r12 != nullptr, "phy_ring_create failed", false);
+    phy_ring_t *r21 = phy_ring_create(CONFIG_PHY_RING_SIZE);
+    EXPECT_RETURN_BOOL(r21 != nullptr, "phy_ring_create failed", false);
+    l->intf1.ring.tx = r12;
+    l->intf2.ring.rx = r12;
+    l->intf2.ring.tx = r21;
+    l->intf1.ring.rx = r21;
+    return true;
+  }
+  // Long-lived send sockets (one per direction)
+  bool resp = phy_setup_udp_send_socket(n2->udp.port, &l->intf1.udp.fd);
+  EXPECT_RETURN_BOOL(resp == true, "phy_setup_udp_send_socket intf1 failed", false);
+  resp = phy_setup_udp_send_socket(n1->udp.port, &l->intf2.udp.fd);
+  EXPECT_RETURN_BOOL(resp == true, "phy_setup_udp_send_socket intf2 failed", false);
+  return true;
+}
+
+phy_shared_t* phy_shared_create() {
+  phy_shared_t *s = new phy_shared_t();
+  s->shard_count = 0;
+  for (uint32_t i = 0; i < CONFIG_PHY_SHARED_MAX_NODE_CHUNKS; i++) {
+    s->nodes[i].store(nullptr);
+  }
+  bool resp = phy_shared_set_shard_count(s, 1);
+  if (!resp) {
+    // Fds are zeroed by new, close whichever socket got created
+    for (uint32_t i = 0; i < CONFIG_MAX_PHY_RECEIVER_THREADS; i++) {
+      if (s->fd[i] > 0) { close(s->fd[i]); }
+    }
+    delete s;
+    ERR_RETURN_BOOL("phy_shared_set_shard_count failed", nullptr);
+  }
+  return s;
+}
+
+bool phy_shared_set_shard_count(phy_shared_t *shared, uint32_t count) {
+  EXPECT_RETURN_BOOL(shared != nullptr, "Empty shared sockets param", false);
+  EXPECT_RETURN_BOOL(count > 0 && count <= CONFIG_MAX_PHY_RECEIVER_THREADS, "Invalid shard count param", false);
+  // Sockets are only ever added (shrinking leaves the extra ones unused)
+  for (uint32_t i = shared->shard_count; i < count; i++) {
+    uint32_t port = 0;
+    bool resp = phy_setup_udp_socket(&port, &shared->fd[i]);
+    EXPECT_RETURN_BOOL(resp == true, "phy_setup_udp_socket failed", false);
+    memset(&shared->addr[i], 0, sizeof(struct sockaddr_in));
+    shared->addr[i].sin_family = AF_INET;
+    shared->addr[i].sin_port = htons(port);
+    shared->addr[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  }
+  shared->shard_count = count;
+  return true;
+}
+
+bool phy_receiver_set_thread_count(graph_t *topo, uint32_t count) {
+  EXPECT_RETURN_BOOL(topo != nullptr, "Empty topology param", false);
+  EXPECT_RETURN_BOOL(count > 0 && count <= CONFIG_MAX_PHY_RECEIVER_THREADS, "Invalid thread count param", false);
+  EXPECT_RETURN_BOOL(topo->phy.ready_count.load() == 0, "Receivers already running", false);
+  if (topo->phy.transport == PHY_TRANSPORT_UDP_SHARED) {
+    bool resp = phy_shared_set_shard_count(topo->phy.shared, count);
+    EXPECT_RETURN_BOOL(resp == true, "phy_shared_set_shard_count failed", false);
+  }
+  topo->phy.thread_count = count;
+  return true;
+}
+
+void phy_receiver_thread_main(graph_t *topo, uint32_t shard) {
+  EXPECT_RETURN(topo != nullptr, "Empty topology param");
+  EXPECT_RETURN(shard < topo->phy.thread_count, "Invalid shard param");
+  if (topo->phy.transport == PHY_TRANSPORT_URING) {
+    phy_uring_receiver_thread_main(topo, shard);
+    return;
+  }
+  if (topo->phy.transport == PHY_TRANSPORT_SIM) {
+    phy_sim_receiver_thread_main(topo, shard);
+    return;
+  }
+  if (topo->phy.transport == PHY_TRANSPORT_UDP_SHARED) {
+    phy_shared_receiver_thread_main(topo, shard);
+    return;
+  }
+  int epoll_fd = epoll_create1(0);
+  EXPECT_FATAL(epoll_fd >= 0, "epoll_create1 failed");
+  // Publish the epoll instance first, so that nodes added from here on get
+  // registered by graph_add_node(). Then register the nodes we already know
+  // of (registration is idempotent, so any overlap is harmless).
+  topo->phy.epoll_fd[shard].store(epoll_fd);
+  {
+    graph_lock_guard_t guard(topo); // Nodes may be getting added
+    glthread_t *curr;
     GLTHREAD_FOREACH_BEGIN(&topo->node_list, curr) {
       node_t *n = node_ptr_from_graph_glue(curr);
-      if (FD_ISSET(n->udp.fd, &ready_fds)) {
-        socklen_t addrlen = sizeof(struct sockaddr);
-        memset(__recv_buffer, 0, CONFIG_MAX_PACKET_BUFFER_SIZE);
-        struct sockaddr_in sender;
-        size_t bytes = recvfrom(n->udp.fd, (char *)__recv_buffer, CONFIG_MAX_PACKET_BUFFER_SIZE, 0, (struct sockaddr *)&sender, &addrlen);
-        EXPECT_FATAL(bytes >= 0, "recvfrom failed");
-        // Do something with received data
-        char *target_intf_name = (char *)__recv_buffer; // of size IF_NAME_SIZE
-        printf("[%s] Read %lu bytes on %s\n", n->node_name, bytes, target_intf_name);
-        //pcap_pkt_dump(__recv_buffer + CONFIG_IF_NAME_SIZE, bytes - CONFIG_IF_NAME_SIZE);
-        interface_t *target_intf = node_get_interface_by_name(n, target_intf_name);
-        EXPECT_CONTINUE(target_intf != nullptr, "Packet received on unknown interface");
-        resp = phy_node_receive_interface_frame_bytes(n, target_intf, __recv_buffer + CONFIG_IF_NAME_SIZE, bytes - CONFIG_IF_NAME_SIZE);
-#pragma unused(resp); // TODO: Fixme
-      }
+      if (phy_node_shard(topo, n) != shard) { continue; }
+      bool resp = phy_receiver_register_node(topo, n);
+      EXPECT_FATAL(resp == true, "phy_receiver_register_node failed");
     }
     GLTHREAD_FOREACH_END();
-    command_parser_unlock();
   }
+  topo->phy.ready_count.fetch_add(1);
+  // Wait for ready to read sockets. Each event carries its owning node, so we
+  // only ever touch nodes that actually have pending frames.
+  struct epoll_event events[PHY_RECEIVER_MAX_EVENTS];
+  uint32_t empty = 0;
+  while (true) {
+    int timeout = phy_poll_timeout(empty);
+    int nready = epoll_wait(epoll_fd, events, PHY_RECEIVER_MAX_EVENTS, timeout);
+    if (nready < 0 && errno == EINTR) { continue; }
+    EXPECT_FATAL(nready >= 0, "epoll_wait failed");
+    phy_poll_account(timeout, nready);
+    empty = (nready == 0 ? empty + 1 : 0);
+    for (int i = 0; i < nready; i++) {
+      node_t *n = (node_t *)events[i].data.ptr;
+      node_lock_guard_t guard(n);
+      // Descriptors are registered as edge-triggered, so drain completely
+      if (n->phy.transport == PHY_TRANSPORT_RING) {
+        phy_node_receive_rings(n);
+      }
+      else {
+        phy_receive_bursts(n->udp.fd, n, nullptr);
+      }
+    }
+  }
+}
+
+bool phy_receiver_threads_ready(graph_t *topo) {
+  EXPECT_RETURN_BOOL(topo != nullptr, "Empty topology param", false);
+  return topo->phy.ready_count.load() == topo->phy.thread_count;
 }
 
-bool phy_receiver_thread_ready() {
-  return __receiver_thread_ready.load();
+bool phy_receiver_register_node(graph_t *topo, node_t *n) {
+  EXPECT_RETURN_BOOL(topo != nullptr, "Empty topology param", false);
+  EXPECT_RETURN_BOOL(n != nullptr, "Empty node param", false);
+  if (n->phy.transport == PHY_TRANSPORT_URING) {
+    phy_uring_shard_t *s = topo->phy.uring[phy_node_shard(topo, n)].load();
+    return s ? phy_uring_shard_enqueue_node(s, n) : true;
+  }
+  if (n->phy.transport == PHY_TRANSPORT_SIM || n->phy.transport == PHY_TRANSPORT_UDP_SHARED) {
+    return true; // Nothing to poll (per node)
+  }
+  int epoll_fd = topo->phy.epoll_fd[phy_node_shard(topo, n)].load();
+  int fd = (n->phy.transport == PHY_TRANSPORT_RING ? n->phy.doorbell_fd : n->udp.fd);
+  if (epoll_fd <= 0 || fd <= 0) {
+    return true; // Receiver not running yet (it'll pick up the node itself)
+  }
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.ptr = n;
+  int resp = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+  EXPECT_RETURN_BOOL(resp == 0 || errno == EEXIST, "epoll_ctl failed", false);
+  return true;
 }
 
 bool phy_setup_udp_socket(uint32_t *port, int *fd) {
   EXPECT_RETURN_BOOL(port != nullptr, "Empty port ptr param", false);
   EXPECT_RETURN_BOOL(fd != nullptr, "Empty socket fd ptr param", false);
   // Create a socket
-  int resp = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  int resp = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, IPPROTO_UDP); // Non-blocking (for epoll)
   EXPECT_RETURN_BOOL(resp != -1, "socket failed", false);
   *fd = resp;
+  // Optionally, spin in the kernel for a while before blocking on reads
+  uint32_t busy_poll = __socket_busy_poll.load(std::memory_order_relaxed);
+  if (busy_poll > 0 && setsockopt(*fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll)) < 0) {
+    LOG_ERR("setsockopt(SO_BUSY_POLL) failed (%s), ignored\n", strerror(errno));
+  }
+  // Optionally, have the kernel timestamp received datagrams
+  int timestamps = __kernel_timestamps.load(std::memory_order_relaxed) ? 1 : 0;
+  if (timestamps && setsockopt(*fd, SOL_SOCKET, SO_TIMESTAMPNS, &timestamps, sizeof(timestamps)) < 0) {
+    LOG_ERR("setsockopt(SO_TIMESTAMPNS) failed (%s), ignored\n", strerror(errno));
+  }
   struct sockaddr_in addr;
   addr.sin_family = AF_INET;
   addr.sin_port = htons(*port);
@@ -141,36 +832,367 @@ bool phy_setup_udp_socket(uint32_t *port, int *fd) {
   return true;
 }
 
-int __phy_node_send_frame_bytes(node_t *n, interface_t *intf, uint8_t *frame, uint32_t framelen) {
-  EXPECT_RETURN_BOOL(frame != nullptr, "Empty packet ptr param", false);
-  EXPECT_RETURN_BOOL(intf != nullptr, "Empty interface ptr param", false);
-  // Create socket
-  int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-  EXPECT_RETURN_VAL(fd >= 0, "socket failed", -1);
+void phy_set_frame_logging(bool enabled) {
+  __frame_logging.store(enabled);
+}
+
+void phy_set_tx_timestamps(bool enabled) {
+  __tx_timestamps.store(enabled);
+}
+
+void phy_set_kernel_timestamps(bool enabled) {
+  __kernel_timestamps.store(enabled);
+}
+
+void phy_intf_latency_dump(interface_t *intf) {
+  EXPECT_RETURN(intf != nullptr, "Empty interface param");
+  dump_line("%s:\n", intf->if_name);
+  dump_line_indentation_guard_t guard;
+  dump_line_indentation_add(1);
+  if (!intf->latency) {
+    dump_line("no samples\n");
+    return;
+  }
+  hist_dump(&intf->latency->kernel, "kernel (socket queueing)");
+  hist_dump(&intf->latency->stack, "stack (dequeue to egress)");
+}
+
+void phy_intf_latency_reset(interface_t *intf) {
+  EXPECT_RETURN(intf != nullptr, "Empty interface param");
+  if (!intf->latency) { return; }
+  hist_reset(&intf->latency->kernel);
+  hist_reset(&intf->latency->stack);
+}
+
+void phy_set_poll_mode(phy_poll_mode_t mode, uint32_t spin_budget) {
+  __spin_budget.store(spin_budget);
+  __poll_mode.store(mode);
+}
+
+phy_poll_mode_t phy_get_poll_mode() {
+  return __poll_mode.load();
+}
+
+const char* phy_poll_mode_str(phy_poll_mode_t mode) {
+  switch (mode) {
+    case PHY_POLL_BLOCK: return "block";
+    case PHY_POLL_BUSY: return "busy";
+    case PHY_POLL_ADAPTIVE: return "adaptive";
+  }
+  return "unknown";
+}
+
+void phy_set_socket_busy_poll(uint32_t usecs) {
+  __socket_busy_poll.store(usecs);
+}
+
+bool phy_set_burst_size(uint32_t burst) {
+  EXPECT_RETURN_BOOL(burst > 0 && burst <= CONFIG_PHY_MAX_BURST, "Invalid burst size param", false);
+  __burst_size.store(burst);
+  return true;
+}
+
+void phy_tx_batch_begin() {
+  __tx_batch.enabled = true;
+}
+
+// Backs a frame that never made it out of the interface's tx stats (it got
+// counted when it was queued). Flushes run under the node's lock already.
+static void phy_tx_slot_drop(phy_tx_slot_t *slot) {
+  interface_t *intf = slot->intf;
+  INTF_STATS_SUB(intf, tx_frames, 1);
+  INTF_STATS_SUB(intf, tx_bytes, slot->framelen);
+  INTF_STATS_INC(intf, tx_drops);
+  node_count_drop(intf->att_node, DROP_PHY_TX_FAILED);
+}
+
+void phy_tx_batch_flush() {
+  __tx_batch.enabled = false;
+  uint32_t count = __tx_batch.count;
+  if (count == 0) { return; }
+  memset(__tx_batch.sent, 0, sizeof(bool) * count);
+  struct mmsghdr msgs[CONFIG_PHY_TX_BATCH_SIZE];
+  struct iovec iovs[CONFIG_PHY_TX_BATCH_SIZE];
+  phy_tx_slot_t *slots[CONFIG_PHY_TX_BATCH_SIZE];
+  for (uint32_t i = 0; i < count; i++) {
+    if (__tx_batch.sent[i]) { continue; }
+    // Gather every queued frame for this interface (in queue order)
+    interface_t *intf = __tx_batch.slots[i].intf;
+    interface_t *intf2 = nullptr;
+    link_get_other_interface(intf->link, intf, &intf2);
+    struct sockaddr_in *dst = nullptr;
+    int fd = phy_intf_send_fd(intf->att_node, intf, intf2, &dst);
+    uint32_t nmsgs = 0;
+    for (uint32_t j = i; j < count; j++) {
+      phy_tx_slot_t *slot = &__tx_batch.slots[j];
+      if (__tx_batch.sent[j] || slot->intf != intf) { continue; }
+      iovs[nmsgs].iov_base = slot->data;
+      iovs[nmsgs].iov_len = slot->len;
+      memset(&msgs[nmsgs], 0, sizeof(struct mmsghdr));
+      msgs[nmsgs].msg_hdr.msg_iov = &iovs[nmsgs];
+      msgs[nmsgs].msg_hdr.msg_iovlen = 1;
+      msgs[nmsgs].msg_hdr.msg_name = dst;
+      msgs[nmsgs].msg_hdr.msg_namelen = dst ? sizeof(struct sockaddr_in) : 0;
+      __tx_batch.sent[j] = true;
+      slots[nmsgs++] = slot;
+    }
+    // Send them over the interface's (pre-connected or shared) socket
+    uint32_t offset = 0;
+    while (offset < nmsgs) {
+      int resp = sendmmsg(fd, msgs + offset, nmsgs - offset, 0);
+      if (resp < 0 && errno == EINTR) { continue; }
+      if (resp < 0) {
+        LOG_ERR("sendmmsg failed (%s), dropped %u frames\n", strerror(errno), nmsgs - offset);
+        for (uint32_t k = offset; k < nmsgs; k++) {
+          phy_tx_slot_drop(slots[k]);
+        }
+        break;
+      }
+      __stats.tx_batches.fetch_add(1, std::memory_order_relaxed);
+      __stats.tx_frames.fetch_add(resp, std::memory_order_relaxed);
+      offset += resp;
+    }
+  }
+  __tx_batch.count = 0;
+}
+
+void phy_stats_get(phy_stats_t *stats) {
+  EXPECT_RETURN(stats != nullptr, "Empty stats param");
+  stats->rx_bursts = __stats.rx_bursts.load(std::memory_order_relaxed);
+  stats->rx_frames = __stats.rx_frames.load(std::memory_order_relaxed);
+  stats->tx_batches = __stats.tx_batches.load(std::memory_order_relaxed);
+  stats->tx_frames = __stats.tx_frames.load(std::memory_order_relaxed);
+  stats->ring_rx_frames = __stats.ring_rx_frames.load(std::memory_order_relaxed);
+  stats->ring_tx_drops = __stats.ring_tx_drops.load(std::memory_order_relaxed);
+  stats->ring_doorbells = __stats.ring_doorbells.load(std::memory_order_relaxed);
+  stats->uring_enters = __stats.uring_enters.load(std::memory_order_relaxed);
+  stats->uring_rx_frames = __stats.uring_rx_frames.load(std::memory_order_relaxed);
+  stats->uring_tx_frames = __stats.uring_tx_frames.load(std::memory_order_relaxed);
+  stats->uring_tx_fallbacks = __stats.uring_tx_fallbacks.load(std::memory_order_relaxed);
+  stats->tstamp_frames = __stats.tstamp_frames.load(std::memory_order_relaxed);
+  stats->tstamp_latency_ns = __stats.tstamp_latency_ns.load(std::memory_order_relaxed);
+  stats->poll_spins = __stats.poll_spins.load(std::memory_order_relaxed);
+  stats->poll_sleeps = __stats.poll_sleeps.load(std::memory_order_relaxed);
+  phy_sim_stats_t sim_stats;
+  phy_sim_stats_get(&sim_stats);
+  stats->sim_events = sim_stats.events;
+  stats->sim_drops = sim_stats.drops;
+}
+
+void phy_stats_reset() {
+  __stats.rx_bursts.store(0);
+  __stats.rx_frames.store(0);
+  __stats.tx_batches.store(0);
+  __stats.tx_frames.store(0);
+  __stats.ring_rx_frames.store(0);
+  __stats.ring_tx_drops.store(0);
+  __stats.ring_doorbells.store(0);
+  __stats.uring_enters.store(0);
+  __stats.uring_rx_frames.store(0);
+  __stats.uring_tx_frames.store(0);
+  __stats.uring_tx_fallbacks.store(0);
+  __stats.tstamp_frames.store(0);
+  __stats.tstamp_latency_ns.store(0);
+  __stats.poll_spins.store(0);
+  __stats.poll_sleeps.store(0);
+  phy_sim_stats_reset();
+}
+
+void phy_stats_dump() {
+  phy_stats_t stats;
+  phy_stats_get(&stats);
+  double rx_avg = stats.rx_bursts ? (double)stats.rx_frames / stats.rx_bursts : 0.0;
+  double tx_avg = stats.tx_batches ? (double)stats.tx_frames / stats.tx_batches : 0.0;
+  dump_line("Burst size (max): %u\n", __burst_size.load());
+  dump_line("RX: %lu frames in %lu recvmmsg calls (avg burst: %.2f)\n", stats.rx_frames, stats.rx_bursts, rx_avg);
+  dump_line("TX: %lu frames in %lu sendmmsg calls (avg batch: %.2f)\n", stats.tx_frames, stats.tx_batches, tx_avg);
+  dump_line("Ring: %lu frames received, %lu dropped (ring full), %lu doorbells\n", stats.ring_rx_frames, stats.ring_tx_drops, stats.ring_doorbells);
+  dump_line("io_uring: %lu frames received, %lu sent (+%lu synchronously) in %lu io_uring_enter calls\n", stats.uring_rx_frames, stats.uring_tx_frames, stats.uring_tx_fallbacks, stats.uring_enters);
+  dump_line("Sim: %lu frames delivered, %lu dropped (pool exhausted)\n", stats.sim_events, stats.sim_drops);
+  dump_line("Poll mode: %s (%lu empty polls, %lu blocking waits)\n", phy_poll_mode_str(phy_get_poll_mode()), stats.poll_spins, stats.poll_sleeps);
+  if (stats.tstamp_frames) {
+    dump_line("Timestamped: %lu frames (avg one-way latency: %.2f us)\n", stats.tstamp_frames, (double)stats.tstamp_latency_ns / stats.tstamp_frames / 1000.0);
+  }
+}
+
+bool phy_setup_udp_send_socket(uint32_t dst_port, int *fd) {
+  EXPECT_RETURN_BOOL(fd != nullptr, "Empty socket fd ptr param", false);
+  EXPECT_RETURN_BOOL(dst_port != 0, "Invalid destination port param", false);
+  // Create a socket
+  int resp = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  EXPECT_RETURN_BOOL(resp != -1, "socket failed", false);
+  // Connect it to the destination (so that we can use send() and skip the
+  // per-datagram route lookup that sendto() would incur)
+  struct sockaddr_in addr;
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(dst_port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(resp, (struct sockaddr *)&addr, sizeof(struct sockaddr)) < 0) {
+    printf("error: %s\n", strerror(errno));
+    close(resp);
+    ERR_RETURN_BOOL("connect failed", false);
+  }
+  *fd = resp;
+  return true;
+}
+
+int __phy_node_send_frame(node_t *n, interface_t *intf, pkt_buf_t *pkt) {
+  EXPECT_RETURN_VAL(pkt != nullptr, "Empty packet buffer param", -1);
+  EXPECT_RETURN_VAL(intf != nullptr, "Empty interface ptr param", -1);
+  uint32_t framelen = pkt_buf_pkt_len(pkt);
+  EXPECT_RETURN_VAL(framelen + PHY_HDR_MAX_LEN <= CONFIG_MAX_PACKET_BUFFER_SIZE, "Frame too large", -1);
   // Begin preparing data payload (including aux info)
   interface_t *intf2 = nullptr;
   bool found = link_get_other_interface(intf->link, intf, &intf2);
   EXPECT_RETURN_VAL(found == true, "link_get_other_interface failed", -1);
-  node_t *nbr = intf2->att_node;
-  memset(__send_buffer, 0, CONFIG_MAX_PACKET_BUFFER_SIZE);
-  // Append null terminated dest interface name
-  strncpy((char *)__send_buffer, intf2->if_name, CONFIG_IF_NAME_SIZE);
-  __send_buffer[CONFIG_IF_NAME_SIZE] = '\0';
-  uint32_t auxlen = CONFIG_IF_NAME_SIZE;
-  // Append rest of the data
-  memcpy((void *)(__send_buffer + CONFIG_IF_NAME_SIZE), (void *)frame, framelen);
-  // Finally, send packet
-  struct sockaddr_in addr;
-  addr.sin_family = AF_INET;
-  addr.sin_port = htons(nbr->udp.port);
-  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
-  int resp = sendto(fd, __send_buffer, framelen + auxlen, 0, (struct sockaddr *)&addr, sizeof(struct sockaddr));
-  EXPECT_RETURN_VAL(resp >= 0, "sendto failed", -1);
-  printf("[%s] Sent %u bytes via %s\n", n->node_name, framelen + auxlen, intf->if_name);
-  //pcap_pkt_dump(frame, framelen);
-  // Cleanup
-  close(fd);
-  return resp - auxlen ; // Number of bytes sent ()
+  struct sockaddr_in *dst = nullptr;
+  int fd = phy_intf_send_fd(n, intf, intf2, &dst);
+  EXPECT_RETURN_VAL(fd > 0, "Interface has no send socket", -1);
+  if (__tx_batch.enabled) {
+    // Queue the frame, flushing first when the batch is full. The frame has
+    // to outlive this call, so gather it into the slot.
+    if (__tx_batch.count == CONFIG_PHY_TX_BATCH_SIZE) {
+      phy_tx_batch_flush();
+      phy_tx_batch_begin();
+    }
+    phy_tx_slot_t *slot = &__tx_batch.slots[__tx_batch.count++];
+    uint32_t hdrlen = phy_node_write_hdr(n, intf2, slot->data);
+    pkt_buf_copy_data(pkt, slot->data + hdrlen, CONFIG_MAX_PACKET_BUFFER_SIZE - hdrlen);
+    slot->intf = intf;
+    slot->len = framelen + hdrlen;
+    slot->framelen = framelen;
+    phy_intf_record_egress(intf);
+    if (__frame_logging.load(std::memory_order_relaxed)) {
+      printf("[%s] Sent %u bytes via %s\n", n->node_name, slot->len, intf->if_name);
+    }
+    return framelen; // Sent on flush
+  }
+  // Phy header, followed by the frame's segments (the kernel gathers them,
+  // no need to flatten the frame first)
+  uint8_t hdr[PHY_HDR_MAX_LEN];
+  uint32_t hdrlen = phy_node_write_hdr(n, intf2, hdr);
+  if (__frame_logging.load(std::memory_order_relaxed)) {
+    printf("[%s] Sent %u bytes via %s\n", n->node_name, framelen + hdrlen, intf->if_name);
+  }
+  struct iovec iovs[1 + CONFIG_PKT_BUF_MAX_SEGS];
+  iovs[0].iov_base = hdr;
+  iovs[0].iov_len = hdrlen;
+  uint32_t iovcnt = 1;
+  for (pkt_buf_t *seg = pkt; seg; seg = seg->next) {
+    EXPECT_RETURN_VAL(iovcnt <= CONFIG_PKT_BUF_MAX_SEGS, "Too many segments", -1);
+    iovs[iovcnt].iov_base = PKT_BUF_MTOD(seg, uint8_t *);
+    iovs[iovcnt].iov_len = seg->data_len;
+    iovcnt++;
+  }
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iovs;
+  msg.msg_iovlen = iovcnt;
+  msg.msg_name = dst;
+  msg.msg_namelen = dst ? sizeof(struct sockaddr_in) : 0;
+  // Finally, send packet over the interface's (pre-connected or shared) socket
+  int resp = sendmsg(fd, &msg, 0);
+  EXPECT_RETURN_VAL(resp >= 0, "sendmsg failed", -1);
+  phy_intf_record_egress(intf);
+  return resp - hdrlen; // Number of frame bytes sent
+}
+
+int __phy_node_ring_send_frame(node_t *n, interface_t *intf, pkt_buf_t *pkt) {
+  EXPECT_RETURN_VAL(pkt != nullptr, "Empty packet buffer param", -1);
+  EXPECT_RETURN_VAL(intf != nullptr, "Empty interface ptr param", -1);
+  EXPECT_RETURN_VAL(intf->ring.tx != nullptr, "Interface has no tx ring", -1);
+  uint32_t framelen = pkt_buf_pkt_len(pkt);
+  EXPECT_RETURN_VAL(framelen + CONFIG_PKT_BUF_HEADROOM <= CONFIG_MAX_PACKET_BUFFER_SIZE, "Frame too large", -1);
+  node_t *nbr = interface_get_neighbor_node(intf);
+  EXPECT_RETURN_VAL(nbr != nullptr, "interface_get_neighbor_node failed", -1);
+  phy_ring_slot_t *slot = phy_ring_producer_slot(intf->ring.tx);
+  if (!slot) {
+    // Ring full. Tail drop, like a NIC would.
+    __stats.ring_tx_drops.fetch_add(1, std::memory_order_relaxed);
+    node_count_drop(n, DROP_PHY_RING_FULL);
+    return 0;
+  }
+  // Leave headroom, the receiver processes the frame in place
+  pkt_buf_copy_data(pkt, slot->data + CONFIG_PKT_BUF_HEADROOM, CONFIG_MAX_PACKET_BUFFER_SIZE - CONFIG_PKT_BUF_HEADROOM);
+  slot->len = framelen;
+  phy_ring_produce(intf->ring.tx);
+  if (__frame_logging.load(std::memory_order_relaxed)) {
+    printf("[%s] Sent %u bytes via %s\n", n->node_name, framelen, intf->if_name);
+  }
+  // Wake up the neighbor's receiver, but only if it went idle
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (nbr->phy.idle.load(std::memory_order_relaxed) && nbr->phy.idle.exchange(false)) {
+    uint64_t one = 1;
+    ssize_t resp = write(nbr->phy.doorbell_fd, &one, sizeof(one));
+    EXPECT_RETURN_VAL(resp == sizeof(one), "Doorbell write failed", -1);
+    __stats.ring_doorbells.fetch_add(1, std::memory_order_relaxed);
+  }
+  return framelen;
 }
 
+int __phy_node_uring_send_frame(node_t *n, interface_t *intf, pkt_buf_t *pkt) {
+  phy_uring_shard_t *s = __uring_shard;
+  if (!s || s->tx_free_count == 0) {
+    // Not on a receiver thread (e.g. CLI), or all buffers are in flight
+    __stats.uring_tx_fallbacks.fetch_add(1, std::memory_order_relaxed);
+    return __phy_node_send_frame(n, intf, pkt);
+  }
+  EXPECT_RETURN_VAL(pkt != nullptr, "Empty packet buffer param", -1);
+  EXPECT_RETURN_VAL(intf != nullptr, "Empty interface ptr param", -1);
+  EXPECT_RETURN_VAL(intf->udp.fd > 0, "Interface has no send socket", -1);
+  uint32_t framelen = pkt_buf_pkt_len(pkt);
+  EXPECT_RETURN_VAL(framelen + PHY_HDR_MAX_LEN <= CONFIG_MAX_PACKET_BUFFER_SIZE, "Frame too large", -1);
+  interface_t *intf2 = nullptr;
+  bool found = link_get_other_interface(intf->link, intf, &intf2);
+  EXPECT_RETURN_VAL(found == true, "link_get_other_interface failed", -1);
+  struct io_uring_sqe *sqe = phy_uring_shard_get_sqe(s);
+  EXPECT_RETURN_VAL(sqe != nullptr, "phy_uring_shard_get_sqe failed", -1);
+  // Same payload as the udp transport, built in a registered buffer
+  uint16_t index = s->tx_free[--s->tx_free_count];
+  uint8_t *buffer = s->tx_buffers + (size_t)index * CONFIG_MAX_PACKET_BUFFER_SIZE;
+  uint32_t hdrlen = phy_node_write_hdr(n, intf2, buffer);
+  pkt_buf_copy_data(pkt, buffer + hdrlen, CONFIG_MAX_PACKET_BUFFER_SIZE - hdrlen);
+  // Write to the interface's (pre-connected) socket, submitted with the
+  // receiver's next io_uring_enter()
+  sqe->opcode = IORING_OP_WRITE_FIXED;
+  sqe->fd = intf->udp.fd;
+  sqe->addr = (uint64_t)buffer;
+  sqe->len = framelen + hdrlen;
+  sqe->buf_index = index;
+  sqe->user_data = ((uint64_t)index << 3) | PHY_URING_TAG_TX;
+  if (__frame_logging.load(std::memory_order_relaxed)) {
+    printf("[%s] Sent %u bytes via %s\n", n->node_name, framelen + hdrlen, intf->if_name);
+  }
+  return framelen;
+}
 
+int __phy_node_sim_send_frame(node_t *n, interface_t *intf, pkt_buf_t *pkt) {
+  EXPECT_RETURN_VAL(pkt != nullptr, "Empty packet buffer param", -1);
+  EXPECT_RETURN_VAL(intf != nullptr, "Empty interface ptr param", -1);
+  EXPECT_RETURN_VAL(n->phy.sim != nullptr, "Node has no simulator", -1);
+  interface_t *intf2 = nullptr;
+  bool found = link_get_other_interface(intf->link, intf, &intf2);
+  EXPECT_RETURN_VAL(found == true, "link_get_other_interface failed", -1);
+  uint32_t framelen = pkt_buf_pkt_len(pkt);
+  EXPECT_RETURN_VAL(framelen <= CONFIG_MAX_PACKET_BUFFER_SIZE, "Frame too large", -1);
+  // Lands on the other end once the link's latency has elapsed
+  uint64_t latency = (uint64_t)intf->link->cost * CONFIG_PHY_SIM_NS_PER_COST;
+  if (!phy_sim_schedule(n->phy.sim, latency, intf2, pkt)) {
+    // Pool exhausted. Tail drop, like with a full ring.
+    node_count_drop(n, DROP_PHY_SIM_POOL);
+    return 0;
+  }
+  if (__frame_logging.load(std::memory_order_relaxed)) {
+    printf("[%s] Sent %u bytes via %s\n", n->node_name, framelen, intf->if_name);
+  }
+  return framelen;
+}
+
+uint64_t phy_node_clock_ns(node_t *n) {
+  if (n && n->phy.sim) {
+    return phy_sim_now(n->phy.sim);
+  }
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
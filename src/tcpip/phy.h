@@ -5,35 +5,211 @@
 #include <atomic>
 #include <cstdint>
 #include <functional>
+#include "config.h"
+#include "hist.h"
 
 // Forward declarations
 
 typedef struct graph_t graph_t;
 typedef struct node_t node_t;
+typedef struct link_t link_t;
 typedef struct interface_t interface_t;
+typedef struct phy_uring_shard_t phy_uring_shard_t;
+typedef struct phy_sim_t phy_sim_t;
+typedef struct phy_shared_t phy_shared_t;
+typedef struct pkt_buf_t pkt_buf_t;
+
+#pragma mark -
+
+// Transport
+
+/*
+ * How frames travel between nodes. Picked per graph (from the default in
+ * effect when `graph_init()` runs), so every topology in `topo.cpp` can run
+ * on either transport.
+ *
+ * PHY_TRANSPORT_UDP: Each node owns a loopback UDP socket, frames are
+ * prefixed with a compact header naming the destination interface by index
+ * (see `phy_hdr.h`).
+ * PHY_TRANSPORT_RING: Each link direction is an in-process SPSC ring (see
+ * `phy_ring.h`). Receivers drain rings without any syscalls, and only get
+ * woken up through an eventfd doorbell when they've gone idle.
+ * PHY_TRANSPORT_URING: Same sockets and wire format as PHY_TRANSPORT_UDP, but
+ * receivers drive them through io_uring (see `phy_uring.h`): multishot recv
+ * into a provided buffer ring, and sends from registered buffers, all
+ * completion driven.
+ * PHY_TRANSPORT_SIM: No I/O at all, frames become events of the graph's
+ * discrete-event simulator (see `phy_sim.h`), delivered after the link's
+ * latency has elapsed in virtual time. A single receiver thread runs them
+ * (or call `phy_sim_run()` on `topo->phy.sim` directly, to run a scenario to
+ * completion).
+ * PHY_TRANSPORT_UDP_SHARED: Same wire format as PHY_TRANSPORT_UDP, but over a
+ * single loopback socket per receiver thread, shared by all the nodes of its
+ * shard. The phy header carries the destination node id, and receivers
+ * demultiplex in user space. Nodes and links open no sockets at all, so
+ * topologies of any size start in O(1) syscalls.
+ */
+enum phy_transport_t {
+  PHY_TRANSPORT_UDP = 0,
+  PHY_TRANSPORT_RING = 1,
+  PHY_TRANSPORT_URING = 2,
+  PHY_TRANSPORT_SIM = 3,
+  PHY_TRANSPORT_UDP_SHARED = 4
+};
+
+void phy_set_default_transport(phy_transport_t transport); // Thread safe
+phy_transport_t phy_get_default_transport(); // Thread safe
+const char* phy_transport_str(phy_transport_t transport);
+bool phy_node_init(node_t *n, phy_transport_t transport);
+bool phy_link_init(link_t *l);
+
+// Sockets of a PHY_TRANSPORT_UDP_SHARED graph (one per shard)
+phy_shared_t* phy_shared_create();
+bool phy_shared_set_shard_count(phy_shared_t *shared, uint32_t count); // Opens sockets as needed
 
 #pragma mark -
 
 // General
 
 /*
- * Upon receiving a frame, the thread will pass on the parsed frame to
- * `layer2_frame_recv()` function. See `layer2/layer2.cpp`
+ * Frames are received by a pool of `topo->phy.thread_count` threads. Every
+ * node is owned by exactly one of them (its shard, picked from the node id),
+ * so a node's frames are always processed in order, by the same thread, and
+ * with the node's lock held. Each thread should run
+ * `phy_receiver_thread_main()` with its own shard index.
+ *
+ * Upon receiving a frame, the thread will pass on the frame (wrapped in a
+ * `pkt_buf_t` with headroom, so that it's processed in place) to
+ * `layer2_node_recv_frame()`. See `layer2/layer2_io.cpp`
  */
-void phy_receiver_thread_main(graph_t *topo);
-bool phy_receiver_thread_ready(); // Thread safe
+bool phy_receiver_set_thread_count(graph_t *topo, uint32_t count); // Call before starting receivers
+void phy_receiver_thread_main(graph_t *topo, uint32_t shard);
+bool phy_receiver_threads_ready(graph_t *topo); // Thread safe
+bool phy_receiver_register_node(graph_t *topo, node_t *n); // Thread safe
 bool phy_setup_udp_socket(uint32_t *port, int *fd);
+bool phy_setup_udp_send_socket(uint32_t dst_port, int *fd);
+void phy_set_frame_logging(bool enabled); // Thread safe
+void phy_set_tx_timestamps(bool enabled); // Stamps socket transport frames with their send time. Thread safe
+bool phy_set_burst_size(uint32_t burst); // Thread safe
+uint64_t phy_node_clock_ns(node_t *n); // Simulation clock under PHY_TRANSPORT_SIM, monotonic clock otherwise
 
 #pragma mark -
 
-// Utils
+// Poll modes
 
-bool phy_frame_buffer_shift_right(uint8_t **frameptr, uint32_t framelen, uint32_t buflen);
+/*
+ * How receivers wait for frames (epoll and udp-shared receivers):
+ *
+ * PHY_POLL_BLOCK: Sleep in the kernel until something arrives. Cheapest, but
+ * every hop pays for a wakeup.
+ * PHY_POLL_BUSY: Never sleep, keep polling (non-blocking) for frames. Lowest
+ * latency, burns a core per receiver thread.
+ * PHY_POLL_ADAPTIVE: Spin for up to `spin_budget` empty polls in a row, then
+ * block. Busy links stay hot, idle ones stop burning CPU.
+ *
+ * Optionally, sockets can also be set up with SO_BUSY_POLL, so that blocking
+ * reads spin in the kernel for a while first (sockets created after the
+ * call only, and capped by net.core.busy_read unless CAP_NET_ADMIN).
+ */
+enum phy_poll_mode_t {
+  PHY_POLL_BLOCK = 0,
+  PHY_POLL_BUSY = 1,
+  PHY_POLL_ADAPTIVE = 2
+};
+
+void phy_set_poll_mode(phy_poll_mode_t mode, uint32_t spin_budget = CONFIG_PHY_DEFAULT_SPIN_BUDGET); // Thread safe
+phy_poll_mode_t phy_get_poll_mode(); // Thread safe
+const char* phy_poll_mode_str(phy_poll_mode_t mode);
+void phy_set_socket_busy_poll(uint32_t usecs); // SO_BUSY_POLL for new sockets (0 disables). Thread safe
+
+#pragma mark -
+
+// Latency
+
+/*
+ * Per-interface latency histograms (socket transports only):
+ *
+ * kernel: From the kernel receiving a frame (its SO_TIMESTAMPNS timestamp)
+ * to the receiver dequeuing it, i.e. time spent queued on the socket.
+ * Recorded against the ingress interface.
+ * stack: From the stack starting on a received frame to each frame it
+ * produced being handed to the kernel (or queued for a tx batch), i.e. time
+ * spent in the stack on that frame alone. Recorded against the egress
+ * interface.
+ *
+ * Only sockets created after enabling kernel timestamps are stamped.
+ * Histograms are allocated on an interface's first sample, with its node's
+ * lock held.
+ */
+typedef struct phy_intf_latency_t {
+  hist_t kernel;
+  hist_t stack;
+} phy_intf_latency_t;
+
+void phy_set_kernel_timestamps(bool enabled); // Thread safe
+void phy_intf_latency_dump(interface_t *intf); // Call with the interface's node lock held
+void phy_intf_latency_reset(interface_t *intf); // Same
+
+#pragma mark -
+
+// Batched I/O
+
+/*
+ * While batching is enabled (on the calling thread), frames sent by
+ * `__phy_node_send_frame()` are queued per interface instead of being
+ * sent right away, and go out with one `sendmmsg()` per interface when the
+ * batch is flushed (or fills up). Receiver threads enable batching for the
+ * duration of every receive burst. Queued frames already count as sent in
+ * their interface's stats, the ones `sendmmsg()` fails to send get moved
+ * over to its tx drops (`DROP_PHY_TX_FAILED`) on flush. A batch only ever
+ * holds frames of a single node, and is flushed with that node's lock held
+ * (no other node lock gets taken).
+ */
+void phy_tx_batch_begin();
+void phy_tx_batch_flush(); // Sends queued frames and disables batching, call with the lock of the node that queued them held
+
+#pragma mark -
+
+// Stats
+
+typedef struct phy_stats_t {
+  uint64_t rx_bursts;   // recvmmsg() calls that returned frames
+  uint64_t rx_frames;
+  uint64_t tx_batches;  // sendmmsg() calls
+  uint64_t tx_frames;   // Frames sent via sendmmsg()
+  uint64_t ring_rx_frames;
+  uint64_t ring_tx_drops;   // Frames dropped because the ring was full
+  uint64_t ring_doorbells;  // eventfd writes (i.e. receiver wakeups)
+  uint64_t uring_enters;    // io_uring_enter() calls made by receivers
+  uint64_t uring_rx_frames;
+  uint64_t uring_tx_frames; // Frames sent from registered buffers
+  uint64_t uring_tx_fallbacks; // Frames sent synchronously (off-receiver, or no free buffer)
+  uint64_t sim_events;      // Frames delivered by simulators
+  uint64_t sim_drops;       // Frames dropped (simulator pool exhausted)
+  uint64_t tstamp_frames;   // Frames received with a tx timestamp
+  uint64_t tstamp_latency_ns; // Sum of their one-way latencies
+  uint64_t poll_spins;      // Receiver polls that came back empty (without sleeping)
+  uint64_t poll_sleeps;     // Blocking receiver waits
+} phy_stats_t;
+
+void phy_stats_get(phy_stats_t *stats); // Thread safe
+void phy_stats_reset(); // Thread safe
+void phy_stats_dump();
 
 #pragma mark -
 
 // Frame I/O
 
-using phy_send_frame_fn_t = std::function<int(node_t*,interface_t*,uint8_t*,uint32_t)>;
+/*
+ * Frames may be chained `pkt_buf_t`s (e.g. a private header segment in front
+ * of a payload shared with other egress ports), every transport gathers the
+ * segments on the way out. The frame still belongs to the caller afterwards.
+ * Returns the number of frame bytes sent, 0 if the transport tail dropped the
+ * frame (e.g. full ring, counted under its own drop reason) or -1 on failure.
+ */
+using phy_send_frame_fn_t = std::function<int(node_t*,interface_t*,pkt_buf_t*)>;
 
-int __phy_node_send_frame_bytes(node_t *n, interface_t *intf, uint8_t *frame, uint32_t framelen);
+int __phy_node_send_frame(node_t *n, interface_t *intf, pkt_buf_t *pkt);
+int __phy_node_ring_send_frame(node_t *n, interface_t *intf, pkt_buf_t *pkt);
+int __phy_node_uring_send_frame(node_t *n, interface_t *intf, pkt_buf_t *pkt);
+int __phy_node_sim_send_frame(node_t *n, interface_t *intf, pkt_buf_t *pkt);
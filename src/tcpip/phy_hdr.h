@@ -0,0 +1,83 @@
+// phy_hdr.h
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include "utils.h"
+
+/*
+ * Encapsulation header in front of every frame on the socket transports
+ * (PHY_TRANSPORT_UDP, PHY_TRANSPORT_URING and PHY_TRANSPORT_UDP_SHARED). It
+ * names the receiving interface by its index in the destination node's
+ * `intf` array, so the receiver finds it with a single array lookup (no
+ * string compares):
+ *
+ *   | version (8) | flags (8) | ifindex (16) | [node id (32)] | [tx timestamp (64)] | frame
+ *
+ * Optional fields are only there when their flag is set: the destination
+ * node id (PHY_HDR_F_NODE, for sockets shared by many nodes) and the tx
+ * timestamp (PHY_HDR_F_TSTAMP, ns, see `phy_node_clock_ns()`). Both ends live
+ * in the same process, so fields are in host byte order.
+ */
+
+#define PHY_HDR_VERSION 1
+#define PHY_HDR_F_TSTAMP 0x01
+#define PHY_HDR_F_NODE 0x02
+#define PHY_HDR_MAX_LEN (sizeof(phy_hdr_t) + sizeof(uint32_t) + sizeof(uint64_t))
+
+typedef struct phy_hdr_t phy_hdr_t;
+
+struct __PACK__ phy_hdr_t {
+  uint8_t version;
+  uint8_t flags;
+  uint16_t ifindex;
+};
+
+#pragma mark -
+
+// Accessors for `phy_hdr_t`
+
+static inline uint32_t phy_hdr_len(uint8_t flags) {
+  return sizeof(phy_hdr_t) +
+    ((flags & PHY_HDR_F_NODE) ? sizeof(uint32_t) : 0) +
+    ((flags & PHY_HDR_F_TSTAMP) ? sizeof(uint64_t) : 0);
+}
+
+// Writes a header (at most PHY_HDR_MAX_LEN bytes) to `buf`. Returns its length.
+static inline uint32_t phy_hdr_write(uint8_t *buf, uint16_t ifindex, uint8_t flags, uint32_t node_id, uint64_t tstamp) {
+  phy_hdr_t *hdr = (phy_hdr_t *)buf;
+  hdr->version = PHY_HDR_VERSION;
+  hdr->flags = flags;
+  hdr->ifindex = ifindex;
+  uint8_t *opt = (uint8_t *)(hdr + 1);
+  if (flags & PHY_HDR_F_NODE) {
+    memcpy(opt, &node_id, sizeof(node_id));
+    opt += sizeof(node_id);
+  }
+  if (flags & PHY_HDR_F_TSTAMP) {
+    memcpy(opt, &tstamp, sizeof(tstamp));
+  }
+  return phy_hdr_len(flags);
+}
+
+// Returns the header's length, or 0 if `buf` doesn't start with a valid one.
+// Absent optional fields read as 0.
+static inline uint32_t phy_hdr_parse(const uint8_t *buf, uint32_t len, phy_hdr_t *hdr, uint32_t *node_id, uint64_t *tstamp) {
+  if (len < sizeof(phy_hdr_t)) { return 0; }
+  memcpy(hdr, buf, sizeof(phy_hdr_t));
+  if (hdr->version != PHY_HDR_VERSION) { return 0; }
+  uint32_t hdrlen = phy_hdr_len(hdr->flags);
+  if (len < hdrlen) { return 0; }
+  const uint8_t *opt = buf + sizeof(phy_hdr_t);
+  *node_id = 0;
+  if (hdr->flags & PHY_HDR_F_NODE) {
+    memcpy(node_id, opt, sizeof(*node_id));
+    opt += sizeof(*node_id);
+  }
+  *tstamp = 0;
+  if (hdr->flags & PHY_HDR_F_TSTAMP) {
+    memcpy(tstamp, opt, sizeof(*tstamp));
+  }
+  return hdrlen;
+}
@@ -0,0 +1,27 @@
+// phy_ring.cpp
+
+#include <cstdlib>
+#include <new>
+#include "phy_ring.h"
+#include "utils.h"
+
+phy_ring_t* phy_ring_create(uint32_t size) {
+  EXPECT_RETURN_VAL(size > 1 && (size & (size - 1)) == 0, "Ring size must be a power of 2", nullptr);
+  void *mem = aligned_alloc(PHY_RING_CACHELINE_SIZE, sizeof(phy_ring_t));
+  EXPECT_RETURN_VAL(mem != nullptr, "aligned_alloc failed", nullptr);
+  phy_ring_t *resp = new (mem) phy_ring_t();
+  resp->mask = size - 1;
+  resp->slots = (phy_ring_slot_t *)calloc(size, sizeof(phy_ring_slot_t));
+  if (resp->slots == nullptr) {
+    free(mem);
+    ERR_RETURN_BOOL("calloc failed", nullptr);
+  }
+  return resp;
+}
+
+void phy_ring_destroy(phy_ring_t *r) {
+  if (!r) { return; }
+  free(r->slots);
+  r->~phy_ring_t();
+  free(r);
+}
@@ -0,0 +1,72 @@
+// phy_ring.h
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "config.h"
+
+/*
+ * Lock-free single-producer/single-consumer ring of preallocated frame slots.
+ * The producer fills the slot returned by `phy_ring_producer_slot()` and
+ * publishes it with `phy_ring_produce()`. The consumer processes the slot
+ * returned by `phy_ring_consumer_slot()` in place, then hands it back with
+ * `phy_ring_consume()`.
+ */
+
+#define PHY_RING_CACHELINE_SIZE 64
+
+typedef struct phy_ring_slot_t {
+  uint32_t len;
+  uint8_t data[CONFIG_MAX_PACKET_BUFFER_SIZE];
+} phy_ring_slot_t;
+
+typedef struct phy_ring_t {
+  uint32_t mask;                // Slot count - 1 (slot count is a power of 2)
+  phy_ring_slot_t *slots;
+  alignas(PHY_RING_CACHELINE_SIZE) std::atomic<uint32_t> head; // Written by producer
+  uint32_t cached_tail;         // Producer's (possibly stale) view of tail
+  alignas(PHY_RING_CACHELINE_SIZE) std::atomic<uint32_t> tail; // Written by consumer
+  uint32_t cached_head;         // Consumer's (possibly stale) view of head
+} phy_ring_t;
+
+phy_ring_t* phy_ring_create(uint32_t size);
+void phy_ring_destroy(phy_ring_t *r);
+
+#pragma mark -
+
+// Producer
+
+static inline phy_ring_slot_t* phy_ring_producer_slot(phy_ring_t *r) {
+  uint32_t head = r->head.load(std::memory_order_relaxed);
+  if (head - r->cached_tail > r->mask) {
+    r->cached_tail = r->tail.load(std::memory_order_acquire);
+    if (head - r->cached_tail > r->mask) { return nullptr; } // Full
+  }
+  return &r->slots[head & r->mask];
+}
+
+static inline void phy_ring_produce(phy_ring_t *r) {
+  r->head.store(r->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+#pragma mark -
+
+// Consumer
+
+static inline phy_ring_slot_t* phy_ring_consumer_slot(phy_ring_t *r) {
+  uint32_t tail = r->tail.load(std::memory_order_relaxed);
+  if (tail == r->cached_head) {
+    r->cached_head = r->head.load(std::memory_order_acquire);
+    if (tail == r->cached_head) { return nullptr; } // Empty
+  }
+  return &r->slots[tail & r->mask];
+}
+
+static inline void phy_ring_consume(phy_ring_t *r) {
+  r->tail.store(r->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+static inline bool phy_ring_empty(phy_ring_t *r) {
+  return r->head.load(std::memory_order_acquire) == r->tail.load(std::memory_order_relaxed);
+}
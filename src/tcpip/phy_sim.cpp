@@ -0,0 +1,179 @@
+// phy_sim.cpp
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <pthread.h>
+#include "phy_sim.h"
+#include "graph.h"
+#include "pkt_buf.h"
+#include "pkt_pool.h"
+#include "layer2/layer2.h"
+#include "utils.h"
+
+#pragma mark -
+
+// Private types
+
+typedef struct phy_sim_event_t {
+  uint64_t due;         // Simulation time (ns)
+  uint64_t seq;         // Scheduling order (breaks ties)
+  interface_t *intf;    // Receiving interface
+  pkt_buf_t *pkt;
+} phy_sim_event_t;
+
+// Min-heap order (std heaps are max-heaps)
+static inline bool phy_sim_event_later(const phy_sim_event_t &a, const phy_sim_event_t &b) {
+  return a.due != b.due ? a.due > b.due : a.seq > b.seq;
+}
+
+struct phy_sim_t {
+  pthread_mutex_t lock;         // Guards everything below
+  pthread_cond_t cond;          // Signaled when an event gets scheduled
+  std::vector<phy_sim_event_t> queue;
+  uint64_t seq;
+  std::atomic<uint64_t> now;
+  pthread_mutex_t run_lock;     // Held while running
+};
+
+#pragma mark -
+
+// Private static variables
+
+static struct {
+  std::atomic<uint64_t> events;
+  std::atomic<uint64_t> drops;
+} __stats;
+
+#pragma mark -
+
+// Public functions
+
+phy_sim_t* phy_sim_create() {
+  phy_sim_t *sim = new phy_sim_t();
+  pthread_mutex_init(&sim->lock, nullptr);
+  pthread_cond_init(&sim->cond, nullptr);
+  pthread_mutex_init(&sim->run_lock, nullptr);
+  sim->seq = 0;
+  sim->now.store(0);
+  return sim;
+}
+
+void phy_sim_destroy(phy_sim_t *sim) {
+  if (!sim) { return; }
+  for (phy_sim_event_t &e : sim->queue) {
+    pkt_buf_destroy(e.pkt);
+  }
+  pthread_mutex_destroy(&sim->lock);
+  pthread_cond_destroy(&sim->cond);
+  pthread_mutex_destroy(&sim->run_lock);
+  delete sim;
+}
+
+pkt_pool_t* phy_sim_pool() {
+  static pkt_pool_t *pool = pkt_pool_create(
+    CONFIG_PHY_SIM_POOL_SIZE,
+    CONFIG_PKT_POOL_CACHE_SIZE,
+    CONFIG_PKT_BUF_HEADROOM + CONFIG_MAX_PACKET_BUFFER_SIZE,
+    0
+  );
+  return pool;
+}
+
+bool phy_sim_schedule(phy_sim_t *sim, uint64_t delay, interface_t *intf, const pkt_buf_t *pkt) {
+  EXPECT_RETURN_BOOL(sim != nullptr, "Empty simulator param", false);
+  EXPECT_RETURN_BOOL(intf != nullptr, "Empty interface param", false);
+  EXPECT_RETURN_BOOL(pkt != nullptr, "Empty packet buffer param", false);
+  // The sender keeps its frame, the receiver gets a private copy (with
+  // headroom, as with every other transport)
+  pkt_buf_t *copy = pkt_pool_alloc(phy_sim_pool());
+  if (!copy) {
+    // Like a full ring, tail drop
+    __stats.drops.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  uint32_t framelen = pkt_buf_pkt_len(pkt);
+  uint8_t *data = pkt_buf_append(copy, framelen);
+  if (!data || pkt_buf_copy_data(pkt, data, framelen) != framelen) {
+    pkt_buf_destroy(copy);
+    ERR_RETURN_BOOL("Frame too large", false);
+  }
+  pthread_mutex_lock(&sim->lock);
+  phy_sim_event_t e = {
+    .due = sim->now.load(std::memory_order_relaxed) + delay,
+    .seq = sim->seq++,
+    .intf = intf,
+    .pkt = copy
+  };
+  sim->queue.push_back(e);
+  std::push_heap(sim->queue.begin(), sim->queue.end(), phy_sim_event_later);
+  pthread_cond_signal(&sim->cond);
+  pthread_mutex_unlock(&sim->lock);
+  return true;
+}
+
+uint64_t phy_sim_run(phy_sim_t *sim, uint64_t until) {
+  EXPECT_RETURN_VAL(sim != nullptr, "Empty simulator param", 0);
+  pthread_mutex_lock(&sim->run_lock);
+  uint64_t count = 0;
+  while (true) {
+    // Pop the next due event, and move the clock up to it
+    pthread_mutex_lock(&sim->lock);
+    if (sim->queue.empty() || sim->queue.front().due > until) {
+      if (until != UINT64_MAX && sim->now.load(std::memory_order_relaxed) < until) {
+        sim->now.store(until, std::memory_order_release);
+      }
+      pthread_mutex_unlock(&sim->lock);
+      break;
+    }
+    std::pop_heap(sim->queue.begin(), sim->queue.end(), phy_sim_event_later);
+    phy_sim_event_t e = sim->queue.back();
+    sim->queue.pop_back();
+    sim->now.store(e.due, std::memory_order_release);
+    pthread_mutex_unlock(&sim->lock);
+    // Deliver it (whatever it sends in turn gets scheduled from `e.due` on)
+    node_t *n = e.intf->att_node;
+    {
+      node_lock_guard_t guard(n);
+      layer2_node_recv_frame(n, e.intf, e.pkt);
+    }
+    pkt_buf_destroy(e.pkt);
+    count++;
+  }
+  pthread_mutex_unlock(&sim->run_lock);
+  __stats.events.fetch_add(count, std::memory_order_relaxed);
+  return count;
+}
+
+void phy_sim_wait(phy_sim_t *sim) {
+  EXPECT_RETURN(sim != nullptr, "Empty simulator param");
+  pthread_mutex_lock(&sim->lock);
+  while (sim->queue.empty()) {
+    pthread_cond_wait(&sim->cond, &sim->lock);
+  }
+  pthread_mutex_unlock(&sim->lock);
+}
+
+uint64_t phy_sim_now(phy_sim_t *sim) {
+  EXPECT_RETURN_VAL(sim != nullptr, "Empty simulator param", 0);
+  return sim->now.load(std::memory_order_acquire);
+}
+
+uint64_t phy_sim_pending(phy_sim_t *sim) {
+  EXPECT_RETURN_VAL(sim != nullptr, "Empty simulator param", 0);
+  pthread_mutex_lock(&sim->lock);
+  uint64_t pending = sim->queue.size();
+  pthread_mutex_unlock(&sim->lock);
+  return pending;
+}
+
+void phy_sim_stats_get(phy_sim_stats_t *stats) {
+  EXPECT_RETURN(stats != nullptr, "Empty stats param");
+  stats->events = __stats.events.load(std::memory_order_relaxed);
+  stats->drops = __stats.drops.load(std::memory_order_relaxed);
+}
+
+void phy_sim_stats_reset() {
+  __stats.events.store(0);
+  __stats.drops.store(0);
+}
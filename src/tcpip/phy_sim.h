@@ -0,0 +1,50 @@
+// phy_sim.h
+
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Discrete-event simulator backing PHY_TRANSPORT_SIM. Sent frames don't
+ * travel over sockets or rings, they become events that are due once the
+ * link's latency (`link_t::cost` x CONFIG_PHY_SIM_NS_PER_COST) has elapsed
+ * on the simulation clock. Events run one at a time in due order (ties in
+ * the order they were scheduled). Between events the clock jumps straight
+ * to the next one, so a run is deterministic and only as slow as the stack
+ * itself, however large the topology.
+ */
+
+typedef struct phy_sim_t phy_sim_t;
+typedef struct interface_t interface_t;
+typedef struct pkt_buf_t pkt_buf_t;
+typedef struct pkt_pool_t pkt_pool_t;
+
+phy_sim_t* phy_sim_create();
+void phy_sim_destroy(phy_sim_t *sim);
+pkt_pool_t* phy_sim_pool(); // Frames in flight live here (shared by all simulators)
+
+// Delivers a copy of `pkt` to `intf` (on its node, with the node's lock held)
+// `delay` ns from now. Drops the frame if `phy_sim_pool()` is exhausted.
+// Thread safe.
+bool phy_sim_schedule(phy_sim_t *sim, uint64_t delay, interface_t *intf, const pkt_buf_t *pkt);
+
+// Runs due events until there are none left, or the next one is due past
+// `until` (the clock then advances to `until`). Returns the number of events
+// processed. Only one thread runs a simulator at a time.
+uint64_t phy_sim_run(phy_sim_t *sim, uint64_t until = UINT64_MAX);
+void phy_sim_wait(phy_sim_t *sim); // Blocks until an event is pending
+
+uint64_t phy_sim_now(phy_sim_t *sim); // Simulation clock (ns). Thread safe
+uint64_t phy_sim_pending(phy_sim_t *sim); // Events not yet run. Thread safe
+
+#pragma mark -
+
+// Stats (all simulators)
+
+typedef struct phy_sim_stats_t {
+  uint64_t events;  // Frames delivered
+  uint64_t drops;   // Frames dropped (pool exhausted)
+} phy_sim_stats_t;
+
+void phy_sim_stats_get(phy_sim_stats_t *stats); // Thread safe
+void phy_sim_stats_reset(); // Thread safe
@@ -0,0 +1,157 @@
+// phy_uring.cpp
+
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "phy_uring.h"
+#include "utils.h"
+
+#pragma mark -
+
+// Private utility functions
+
+static int sys_io_uring_setup(uint32_t entries, struct io_uring_params *p) {
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int sys_io_uring_register(int fd, uint32_t opcode, void *arg, uint32_t nr_args) {
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+#pragma mark -
+
+// Public functions
+
+bool phy_uring_supported() {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int fd = sys_io_uring_setup(4, &p);
+  if (fd < 0) { return false; }
+  // Multishot recv showed up along with IORING_OP_SEND_ZC (6.0), so use that
+  // as a proxy (there's no feature flag for it)
+  size_t probe_size = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+  struct io_uring_probe *probe = (struct io_uring_probe *)calloc(1, probe_size);
+  int resp = sys_io_uring_register(fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST);
+  bool supported = (resp == 0 && probe->last_op >= IORING_OP_SEND_ZC && (probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED));
+  free(probe);
+  close(fd);
+  return supported;
+}
+
+bool phy_uring_init(phy_uring_t *u, uint32_t sq_entries, uint32_t cq_entries) {
+  EXPECT_RETURN_BOOL(u != nullptr, "Empty uring param", false);
+  memset(u, 0, sizeof(phy_uring_t));
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+  p.cq_entries = cq_entries;
+  int fd = sys_io_uring_setup(sq_entries, &p);
+  if (fd < 0 && errno == EINVAL) {
+    // Older kernel, try again without the task running hints
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = cq_entries;
+    fd = sys_io_uring_setup(sq_entries, &p);
+  }
+  EXPECT_RETURN_BOOL(fd >= 0, "io_uring_setup failed", false);
+  EXPECT_RETURN_BOOL(p.features & IORING_FEAT_SINGLE_MMAP, "io_uring lacks IORING_FEAT_SINGLE_MMAP", false);
+  u->fd = fd;
+  // Map rings (SQ and CQ share a single mapping)
+  u->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+  u->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (u->cq_ring_size > u->sq_ring_size) { u->sq_ring_size = u->cq_ring_size; }
+  u->cq_ring_size = u->sq_ring_size;
+  u->sq_ring_ptr = mmap(0, u->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  EXPECT_RETURN_BOOL(u->sq_ring_ptr != MAP_FAILED, "mmap (sq ring) failed", false);
+  u->cq_ring_ptr = u->sq_ring_ptr;
+  u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  u->sqes = (struct io_uring_sqe *)mmap(0, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  EXPECT_RETURN_BOOL(u->sqes != MAP_FAILED, "mmap (sqes) failed", false);
+  uint8_t *sq = (uint8_t *)u->sq_ring_ptr;
+  u->sq_head = (uint32_t *)(sq + p.sq_off.head);
+  u->sq_tail = (uint32_t *)(sq + p.sq_off.tail);
+  u->sq_array = (uint32_t *)(sq + p.sq_off.array);
+  u->sq_mask = *(uint32_t *)(sq + p.sq_off.ring_mask);
+  u->sq_entries = p.sq_entries;
+  u->sq_local_tail = *u->sq_tail;
+  uint8_t *cq = (uint8_t *)u->cq_ring_ptr;
+  u->cq_head = (uint32_t *)(cq + p.cq_off.head);
+  u->cq_tail = (uint32_t *)(cq + p.cq_off.tail);
+  u->cq_mask = *(uint32_t *)(cq + p.cq_off.ring_mask);
+  u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  // Identity map SQ array (sqes are used in ring order)
+  for (uint32_t i = 0; i < u->sq_entries; i++) {
+    u->sq_array[i] = i;
+  }
+  return true;
+}
+
+void phy_uring_exit(phy_uring_t *u) {
+  if (!u || u->fd <= 0) { return; }
+  munmap(u->sqes, u->sqes_size);
+  munmap(u->sq_ring_ptr, u->sq_ring_size);
+  close(u->fd);
+  memset(u, 0, sizeof(phy_uring_t));
+}
+
+struct io_uring_sqe* phy_uring_get_sqe(phy_uring_t *u) {
+  uint32_t head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+  if (u->sq_local_tail - head >= u->sq_entries) { return nullptr; }
+  struct io_uring_sqe *sqe = &u->sqes[u->sq_local_tail & u->sq_mask];
+  u->sq_local_tail++;
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  return sqe;
+}
+
+int phy_uring_submit_and_wait(phy_uring_t *u, uint32_t wait_nr) {
+  // Publish pending SQEs
+  uint32_t to_submit = u->sq_local_tail - *u->sq_tail;
+  __atomic_store_n(u->sq_tail, u->sq_local_tail, __ATOMIC_RELEASE);
+  uint32_t flags = (wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+  int resp = sys_io_uring_enter(u->fd, to_submit, wait_nr, flags);
+  return resp < 0 ? -errno : resp;
+}
+
+bool phy_uring_register_buffers(phy_uring_t *u, struct iovec *iovs, uint32_t count) {
+  EXPECT_RETURN_BOOL(u != nullptr, "Empty uring param", false);
+  int resp = sys_io_uring_register(u->fd, IORING_REGISTER_BUFFERS, iovs, count);
+  EXPECT_RETURN_BOOL(resp == 0, "IORING_REGISTER_BUFFERS failed", false);
+  return true;
+}
+
+bool phy_uring_setup_buf_ring(phy_uring_t *u, phy_uring_buf_ring_t *r, uint16_t bgid, uint16_t entries, uint32_t buffer_size, uint32_t headroom) {
+  EXPECT_RETURN_BOOL(u != nullptr, "Empty uring param", false);
+  EXPECT_RETURN_BOOL(r != nullptr, "Empty buffer ring param", false);
+  EXPECT_RETURN_BOOL(entries > 0 && (entries & (entries - 1)) == 0, "Buffer ring size must be a power of 2", false);
+  EXPECT_RETURN_BOOL(headroom < buffer_size, "Headroom larger than buffer", false);
+  memset(r, 0, sizeof(phy_uring_buf_ring_t));
+  // Ring of buffer descriptors (page aligned, as the kernel requires)
+  size_t ring_size = entries * sizeof(struct io_uring_buf);
+  void *ring = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  EXPECT_RETURN_BOOL(ring != MAP_FAILED, "mmap (buffer ring) failed", false);
+  r->br = (struct io_uring_buf_ring *)ring;
+  r->buffers = (uint8_t *)calloc(entries, buffer_size);
+  EXPECT_RETURN_BOOL(r->buffers != nullptr, "calloc failed", false);
+  r->buffer_size = buffer_size;
+  r->headroom = headroom;
+  r->entries = entries;
+  r->bgid = bgid;
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uint64_t)ring;
+  reg.ring_entries = entries;
+  reg.bgid = bgid;
+  int resp = sys_io_uring_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1);
+  EXPECT_RETURN_BOOL(resp == 0, "IORING_REGISTER_PBUF_RING failed", false);
+  // Hand all buffers to the kernel
+  for (uint16_t bid = 0; bid < entries; bid++) {
+    phy_uring_buf_ring_recycle(r, bid);
+  }
+  return true;
+}
@@ -0,0 +1,85 @@
+// phy_uring.h
+
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+/*
+ * Minimal io_uring wrapper (raw syscalls, no liburing dependency). Covers what
+ * the phy layer needs: SQE/CQE handling, registered (fixed) buffers and
+ * provided buffer rings.
+ */
+
+typedef struct phy_uring_t {
+  int fd;
+  // Submission queue
+  uint32_t *sq_head;
+  uint32_t *sq_tail;
+  uint32_t *sq_array;
+  uint32_t sq_mask;
+  uint32_t sq_entries;
+  uint32_t sq_local_tail;       // Includes SQEs not yet handed to the kernel
+  struct io_uring_sqe *sqes;
+  // Completion queue
+  uint32_t *cq_head;
+  uint32_t *cq_tail;
+  uint32_t cq_mask;
+  struct io_uring_cqe *cqes;
+  // Mappings
+  void *sq_ring_ptr;
+  size_t sq_ring_size;
+  void *cq_ring_ptr;
+  size_t cq_ring_size;
+  size_t sqes_size;
+} phy_uring_t;
+
+bool phy_uring_supported();
+bool phy_uring_init(phy_uring_t *u, uint32_t sq_entries, uint32_t cq_entries);
+void phy_uring_exit(phy_uring_t *u);
+struct io_uring_sqe* phy_uring_get_sqe(phy_uring_t *u); // nullptr if the SQ is full
+int phy_uring_submit_and_wait(phy_uring_t *u, uint32_t wait_nr);
+bool phy_uring_register_buffers(phy_uring_t *u, struct iovec *iovs, uint32_t count);
+
+static inline struct io_uring_cqe* phy_uring_peek_cqe(phy_uring_t *u) {
+  uint32_t head = *u->cq_head;
+  if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) { return nullptr; }
+  return &u->cqes[head & u->cq_mask];
+}
+
+static inline void phy_uring_cqe_seen(phy_uring_t *u) {
+  __atomic_store_n(u->cq_head, *u->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+#pragma mark -
+
+// Provided buffer ring
+
+typedef struct phy_uring_buf_ring_t {
+  struct io_uring_buf_ring *br;
+  uint8_t *buffers;
+  uint32_t buffer_size;
+  uint32_t headroom;      // The kernel writes past it
+  uint16_t entries;
+  uint16_t bgid;          // Buffer group id
+} phy_uring_buf_ring_t;
+
+bool phy_uring_setup_buf_ring(phy_uring_t *u, phy_uring_buf_ring_t *r, uint16_t bgid, uint16_t entries, uint32_t buffer_size, uint32_t headroom = 0);
+
+static inline uint8_t* phy_uring_buf_ring_buffer(phy_uring_buf_ring_t *r, uint16_t bid) {
+  return r->buffers + (size_t)bid * r->buffer_size;
+}
+
+// Hands a buffer back to the kernel
+static inline void phy_uring_buf_ring_recycle(phy_uring_buf_ring_t *r, uint16_t bid) {
+  uint16_t tail = r->br->tail;
+  // Not `r->br->bufs[]`, the kernel header's flex array lands at offset 8
+  // (rather than 0) when compiled as C++
+  struct io_uring_buf *buf = (struct io_uring_buf *)r->br + (tail & (r->entries - 1));
+  buf->addr = (uint64_t)(phy_uring_buf_ring_buffer(r, bid) + r->headroom);
+  buf->len = r->buffer_size - r->headroom;
+  buf->bid = bid;
+  __atomic_store_n(&r->br->tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+}
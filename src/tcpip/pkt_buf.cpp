@@ -0,0 +1,131 @@
+// pkt_buf.cpp
+
+#include <cstdlib>
+#include <cstring>
+#include "pkt_buf.h"
+#include "pkt_pool.h"
+
+#pragma mark -
+
+// Private utility functions
+
+// Drops a reference to a direct buffer, freeing it along with the last one
+static void pkt_buf_release(pkt_buf_t *pkt) {
+  // Sole owner, skip the atomic (nobody else can be racing us)
+  if (__atomic_load_n(&pkt->refcnt, __ATOMIC_ACQUIRE) != 1 &&
+      __atomic_sub_fetch(&pkt->refcnt, 1, __ATOMIC_ACQ_REL) != 0) {
+    return;
+  }
+  pkt->refcnt = 1; // Ready for reuse
+  if (pkt->pool) {
+    pkt_pool_free(pkt);
+  }
+  else if (pkt->owned) {
+    free(pkt);
+  }
+}
+
+#pragma mark -
+
+// Public functions
+
+pkt_buf_t* pkt_buf_create(uint32_t buf_len, uint32_t headroom) {
+  EXPECT_RETURN_VAL(headroom <= buf_len, "Headroom larger than buffer", nullptr);
+  // Single allocation (the storage trails the descriptor)
+  pkt_buf_t *pkt = (pkt_buf_t *)malloc(sizeof(pkt_buf_t) + buf_len);
+  EXPECT_RETURN_VAL(pkt != nullptr, "malloc failed", nullptr);
+  pkt_buf_init(pkt, (uint8_t *)(pkt + 1), buf_len, headroom);
+  pkt->owned = true;
+  return pkt;
+}
+
+void pkt_buf_destroy(pkt_buf_t *pkt) {
+  while (pkt) {
+    pkt_buf_t *next = pkt->next;
+    pkt->next = nullptr;
+    if (pkt->direct) {
+      // Indirect descriptors are never shared, only the data they point to
+      pkt_buf_detach(pkt);
+    }
+    pkt_buf_release(pkt);
+    pkt = next;
+  }
+}
+
+bool pkt_buf_init(pkt_buf_t *pkt, uint8_t *buf, uint32_t buf_len, uint32_t headroom) {
+  EXPECT_RETURN_BOOL(pkt != nullptr, "Empty packet buffer param", false);
+  EXPECT_RETURN_BOOL(buf != nullptr, "Empty buffer param", false);
+  EXPECT_RETURN_BOOL(headroom <= buf_len, "Headroom larger than buffer", false);
+  pkt->buf = buf;
+  pkt->buf_len = buf_len;
+  pkt->data_off = headroom;
+  pkt->data_len = 0;
+  pkt->priv_size = 0;
+  pkt->pool = nullptr;
+  pkt->owned = false;
+  pkt->refcnt = 1;
+  pkt->direct = nullptr;
+  pkt->next = nullptr;
+  pkt->rx_tstamp = 0;
+  pkt->trace_id = 0;
+  return true;
+}
+
+bool pkt_buf_attach(pkt_buf_t *mi, pkt_buf_t *m) {
+  EXPECT_RETURN_BOOL(mi != nullptr, "Empty indirect packet buffer param", false);
+  EXPECT_RETURN_BOOL(m != nullptr, "Empty packet buffer param", false);
+  EXPECT_RETURN_BOOL(mi != m, "Can't attach a buffer to itself", false);
+  EXPECT_RETURN_BOOL(mi->direct == nullptr, "Already attached", false);
+  // Cloning a clone references the original data
+  pkt_buf_t *direct = m->direct ? m->direct : m;
+  __atomic_add_fetch(&direct->refcnt, 1, __ATOMIC_RELAXED);
+  mi->direct = direct;
+  mi->buf = m->buf;
+  mi->buf_len = m->buf_len;
+  mi->data_off = m->data_off;
+  mi->data_len = m->data_len;
+  mi->rx_tstamp = m->rx_tstamp;
+  mi->trace_id = m->trace_id;
+  return true;
+}
+
+void pkt_buf_detach(pkt_buf_t *mi) {
+  EXPECT_RETURN(mi != nullptr, "Empty indirect packet buffer param");
+  EXPECT_RETURN(mi->direct != nullptr, "Not attached");
+  pkt_buf_t *direct = mi->direct;
+  mi->direct = nullptr;
+  mi->buf_len = 0;
+  mi->data_off = 0;
+  mi->data_len = 0;
+  pkt_buf_release(direct);
+}
+
+pkt_buf_t* pkt_buf_clone(pkt_buf_t *pkt, pkt_pool_t *pool) {
+  EXPECT_RETURN_VAL(pkt != nullptr, "Empty packet buffer param", nullptr);
+  EXPECT_RETURN_VAL(pool != nullptr, "Empty pool param", nullptr);
+  pkt_buf_t *head = nullptr;
+  pkt_buf_t **tail = &head;
+  for (pkt_buf_t *seg = pkt; seg; seg = seg->next) {
+    pkt_buf_t *mi = pkt_pool_alloc(pool, 0);
+    if (!mi) {
+      pkt_buf_destroy(head);
+      ERR_RETURN_BOOL("pkt_pool_alloc failed", nullptr);
+    }
+    pkt_buf_attach(mi, seg);
+    *tail = mi;
+    tail = &mi->next;
+  }
+  return head;
+}
+
+uint32_t pkt_buf_copy_data(const pkt_buf_t *pkt, uint8_t *dst, uint32_t dst_len) {
+  EXPECT_RETURN_VAL(pkt != nullptr, "Empty packet buffer param", 0);
+  EXPECT_RETURN_VAL(dst != nullptr, "Empty destination param", 0);
+  EXPECT_RETURN_VAL(pkt_buf_pkt_len(pkt) <= dst_len, "Destination too small", 0);
+  uint32_t len = 0;
+  for (; pkt; pkt = pkt->next) {
+    memcpy(dst + len, PKT_BUF_MTOD(pkt, uint8_t *), pkt->data_len);
+    len += pkt->data_len;
+  }
+  return len;
+}
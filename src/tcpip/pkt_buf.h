@@ -0,0 +1,122 @@
+// pkt_buf.h
+
+#pragma once
+
+#include <cstdint>
+#include "config.h"
+#include "utils.h"
+
+/*
+ * Packet buffer with explicit headroom and tailroom (same idea as DPDK's
+ * rte_mbuf, see `src/scratch/rte_mbufs.cpp`). The packet data lives in
+ * [buf + data_off, buf + data_off + data_len):
+ *
+ *   buf                                                       buf + buf_len
+ *   | headroom         | data                      | tailroom           |
+ *
+ * Headers are pushed with `pkt_buf_prepend()` and popped with `pkt_buf_adj()`.
+ * Both are O(1) (they only move `data_off`), so the payload never moves while
+ * a packet travels up or down the stack.
+ *
+ * Buffers are reference counted (see `src/scratch/rte_mbufs_indirect.cpp`).
+ * A clone is an indirect buffer: its own descriptor (own offsets, own
+ * headroom semantics), pointing at the data of a direct buffer that it keeps
+ * alive. The direct buffer goes back to its pool when its last reference is
+ * dropped. Shared data is read only, only a direct buffer with a single
+ * reference may be modified in place (see `pkt_buf_writable()`).
+ *
+ * Buffers can also be chained through `next` (e.g. a private header segment
+ * in front of a shared payload). Only the phy layer deals with chains, the
+ * rest of the stack expects a single segment.
+ */
+
+typedef struct pkt_pool_t pkt_pool_t;
+
+typedef struct pkt_buf_t {
+  uint8_t *buf;         // Underlying storage
+  uint32_t buf_len;
+  uint32_t data_off;    // Offset of the first data byte within `buf`
+  uint32_t data_len;
+  uint32_t priv_size;   // Size of the private area (pooled buffers only)
+  pkt_pool_t *pool;     // Owning pool, if any
+  bool owned;           // Storage allocated by `pkt_buf_create()`
+  uint16_t refcnt;      // Direct buffers only
+  struct pkt_buf_t *direct; // Buffer whose data we reference (indirect buffers only)
+  struct pkt_buf_t *next;   // Next segment
+  uint64_t rx_tstamp;   // Kernel ingress timestamp (ns, CLOCK_REALTIME), 0 if unknown
+  uint32_t trace_id;    // Packet tracer mark (see `trace.h`), 0 if not traced
+} pkt_buf_t;
+
+#define PKT_BUF_MTOD(PKT, TYPE) ((TYPE)((PKT)->buf + (PKT)->data_off))
+
+pkt_buf_t* pkt_buf_create(uint32_t buf_len, uint32_t headroom);
+void pkt_buf_destroy(pkt_buf_t *pkt); // Drops a reference (whole chain), pooled buffers go back to their pool
+bool pkt_buf_init(pkt_buf_t *pkt, uint8_t *buf, uint32_t buf_len, uint32_t headroom); // Wraps caller owned storage
+
+// Indirect buffers
+bool pkt_buf_attach(pkt_buf_t *mi, pkt_buf_t *m); // `mi` references the data of `m` (single segment)
+void pkt_buf_detach(pkt_buf_t *mi); // Drops the reference taken by `pkt_buf_attach()`
+pkt_buf_t* pkt_buf_clone(pkt_buf_t *pkt, pkt_pool_t *pool); // Whole chain, descriptors come from `pool`
+
+// Chains
+uint32_t pkt_buf_copy_data(const pkt_buf_t *pkt, uint8_t *dst, uint32_t dst_len); // Gathers the chain's data, 0 if it doesn't fit
+
+// Private area (trails the descriptor)
+static inline void* pkt_buf_priv(pkt_buf_t *pkt) {
+  return pkt->priv_size > 0 ? (void *)(pkt + 1) : nullptr;
+}
+
+static inline uint16_t pkt_buf_refcnt_read(const pkt_buf_t *pkt) {
+  return __atomic_load_n(&(pkt->direct ? pkt->direct : pkt)->refcnt, __ATOMIC_RELAXED);
+}
+
+// Data may be modified in place
+static inline bool pkt_buf_writable(const pkt_buf_t *pkt) {
+  return !pkt->direct && pkt_buf_refcnt_read(pkt) == 1;
+}
+
+// Total data length across all segments
+static inline uint32_t pkt_buf_pkt_len(const pkt_buf_t *pkt) {
+  uint32_t len = 0;
+  for (; pkt; pkt = pkt->next) { len += pkt->data_len; }
+  return len;
+}
+
+static inline uint32_t pkt_buf_headroom(const pkt_buf_t *pkt) {
+  return pkt->data_off;
+}
+
+static inline uint32_t pkt_buf_tailroom(const pkt_buf_t *pkt) {
+  return pkt->buf_len - pkt->data_off - pkt->data_len;
+}
+
+// Grows the data by `len` bytes at the front. Returns the new data start.
+static inline uint8_t* pkt_buf_prepend(pkt_buf_t *pkt, uint32_t len) {
+  EXPECT_RETURN_VAL(len <= pkt->data_off, "Not enough headroom", nullptr);
+  pkt->data_off -= len;
+  pkt->data_len += len;
+  return pkt->buf + pkt->data_off;
+}
+
+// Strips `len` bytes from the front. Returns the new data start.
+static inline uint8_t* pkt_buf_adj(pkt_buf_t *pkt, uint32_t len) {
+  EXPECT_RETURN_VAL(len <= pkt->data_len, "Not enough data", nullptr);
+  pkt->data_off += len;
+  pkt->data_len -= len;
+  return pkt->buf + pkt->data_off;
+}
+
+// Grows the data by `len` bytes at the end. Returns the start of the new bytes.
+static inline uint8_t* pkt_buf_append(pkt_buf_t *pkt, uint32_t len) {
+  EXPECT_RETURN_VAL(len <= pkt_buf_tailroom(pkt), "Not enough tailroom", nullptr);
+  uint8_t *tail = pkt->buf + pkt->data_off + pkt->data_len;
+  pkt->data_len += len;
+  return tail;
+}
+
+// Strips `len` bytes from the end
+static inline bool pkt_buf_trim(pkt_buf_t *pkt, uint32_t len) {
+  EXPECT_RETURN_BOOL(len <= pkt->data_len, "Not enough data", false);
+  pkt->data_len -= len;
+  return true;
+}
@@ -0,0 +1,294 @@
+// pkt_pool.cpp
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "pkt_pool.h"
+#include "utils.h"
+
+#define PKT_POOL_CACHELINE_SIZE 64
+#define PKT_POOL_ALIGN(X) (((X) + PKT_POOL_CACHELINE_SIZE - 1) & ~(size_t)(PKT_POOL_CACHELINE_SIZE - 1))
+
+#pragma mark -
+
+// Private types
+
+/*
+ * Bounded MPMC ring (Vyukov). Every cell carries a sequence number that tells
+ * producers and consumers whose turn it is, so both sides only ever CAS their
+ * own position.
+ */
+typedef struct pkt_pool_cell_t {
+  std::atomic<uint32_t> seq;
+  pkt_buf_t *obj;
+} pkt_pool_cell_t;
+
+struct pkt_pool_t {
+  uint32_t slot;                // Index in `__pools`
+  uint32_t size;
+  uint32_t cache_size;
+  uint32_t buf_len;
+  uint32_t priv_size;
+  uint32_t hdr_len;             // Descriptor and private area (the buffer trails it)
+  uint8_t *mem;                 // Descriptors, private areas and buffers
+  uint32_t mask;
+  pkt_pool_cell_t *cells;
+  alignas(PKT_POOL_CACHELINE_SIZE) std::atomic<uint32_t> enqueue_pos;
+  alignas(PKT_POOL_CACHELINE_SIZE) std::atomic<uint32_t> dequeue_pos;
+  alignas(PKT_POOL_CACHELINE_SIZE) std::atomic<uint64_t> cache_hits;
+  std::atomic<uint64_t> cache_misses;
+  std::atomic<uint64_t> alloc_failures;
+};
+
+typedef struct pkt_pool_cache_t {
+  pkt_pool_t *pool;
+  uint32_t len;
+  uint64_t hits;                // Not yet published to the pool
+  pkt_buf_t *objs[CONFIG_PKT_POOL_MAX_CACHE_SIZE * 2];
+} pkt_pool_cache_t;
+
+static void pkt_pool_cache_flush_to_ring(pkt_pool_cache_t *c, uint32_t keep);
+
+struct pkt_pool_thread_caches_t {
+  pkt_pool_cache_t caches[CONFIG_PKT_POOL_MAX_POOLS];
+  virtual ~pkt_pool_thread_caches_t();
+};
+
+#pragma mark -
+
+// Private static variables
+
+static std::atomic<pkt_pool_t *> __pools[CONFIG_PKT_POOL_MAX_POOLS];
+static thread_local pkt_pool_thread_caches_t __caches;
+
+pkt_pool_thread_caches_t::~pkt_pool_thread_caches_t() {
+  // Thread is going away, hand whatever it cached back
+  for (uint32_t i = 0; i < CONFIG_PKT_POOL_MAX_POOLS; i++) {
+    pkt_pool_cache_t *c = &caches[i];
+    if (c->pool && __pools[i].load() == c->pool) {
+      pkt_pool_cache_flush_to_ring(c, 0);
+    }
+  }
+}
+
+#pragma mark -
+
+// Private utility functions
+
+static bool pkt_pool_ring_enqueue(pkt_pool_t *pool, pkt_buf_t *obj) {
+  uint32_t pos = pool->enqueue_pos.load(std::memory_order_relaxed);
+  pkt_pool_cell_t *cell = nullptr;
+  while (true) {
+    cell = &pool->cells[pos & pool->mask];
+    int32_t diff = (int32_t)(cell->seq.load(std::memory_order_acquire) - pos);
+    if (diff == 0) {
+      if (pool->enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) { break; }
+    }
+    else if (diff < 0) {
+      return false; // Full
+    }
+    else {
+      pos = pool->enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+  cell->obj = obj;
+  cell->seq.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+static pkt_buf_t* pkt_pool_ring_dequeue(pkt_pool_t *pool) {
+  uint32_t pos = pool->dequeue_pos.load(std::memory_order_relaxed);
+  pkt_pool_cell_t *cell = nullptr;
+  while (true) {
+    cell = &pool->cells[pos & pool->mask];
+    int32_t diff = (int32_t)(cell->seq.load(std::memory_order_acquire) - (pos + 1));
+    if (diff == 0) {
+      if (pool->dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) { break; }
+    }
+    else if (diff < 0) {
+      return nullptr; // Empty
+    }
+    else {
+      pos = pool->dequeue_pos.load(std::memory_order_relaxed);
+    }
+  }
+  pkt_buf_t *obj = cell->obj;
+  cell->seq.store(pos + pool->mask + 1, std::memory_order_release);
+  return obj;
+}
+
+static void pkt_pool_cache_publish(pkt_pool_cache_t *c) {
+  if (c->hits == 0) { return; }
+  c->pool->cache_hits.fetch_add(c->hits, std::memory_order_relaxed);
+  c->hits = 0;
+}
+
+static void pkt_pool_cache_flush_to_ring(pkt_pool_cache_t *c, uint32_t keep) {
+  while (c->len > keep) {
+    bool resp = pkt_pool_ring_enqueue(c->pool, c->objs[--c->len]);
+    EXPECT_FATAL(resp == true, "pkt_pool_ring_enqueue failed (foreign buffer?)");
+  }
+  pkt_pool_cache_publish(c);
+}
+
+// Calling thread's cache for `pool`
+static inline pkt_pool_cache_t* pkt_pool_cache(pkt_pool_t *pool) {
+  pkt_pool_cache_t *c = &__caches.caches[pool->slot];
+  if (unlikely(c->pool != pool)) {
+    // First use, or the slot belonged to a pool that's since been destroyed
+    c->pool = pool;
+    c->len = 0;
+    c->hits = 0;
+  }
+  return c;
+}
+
+#pragma mark -
+
+// Public functions
+
+pkt_pool_t* pkt_pool_create(uint32_t size, uint32_t cache_size, uint32_t buf_len, uint32_t priv_size) {
+  EXPECT_RETURN_VAL(size > 0, "Empty pool size param", nullptr);
+  EXPECT_RETURN_VAL(cache_size <= CONFIG_PKT_POOL_MAX_CACHE_SIZE, "Cache size too large", nullptr);
+  void *mem = aligned_alloc(PKT_POOL_CACHELINE_SIZE, sizeof(pkt_pool_t));
+  EXPECT_RETURN_VAL(mem != nullptr, "aligned_alloc failed", nullptr);
+  pkt_pool_t *pool = new (mem) pkt_pool_t();
+  pool->size = size;
+  pool->cache_size = cache_size;
+  pool->buf_len = buf_len;
+  pool->priv_size = priv_size;
+  // Ring (rounded up to a power of 2, never fills up)
+  uint32_t ring_size = 1;
+  while (ring_size < size) { ring_size <<= 1; }
+  pool->mask = ring_size - 1;
+  pool->cells = (pkt_pool_cell_t *)calloc(ring_size, sizeof(pkt_pool_cell_t));
+  // Objects: [descriptor | private area][buffer], cache line aligned
+  pool->hdr_len = PKT_POOL_ALIGN(sizeof(pkt_buf_t) + priv_size);
+  size_t obj_len = pool->hdr_len + PKT_POOL_ALIGN(buf_len);
+  pool->mem = (uint8_t *)aligned_alloc(PKT_POOL_CACHELINE_SIZE, obj_len * size);
+  if (!pool->cells || !pool->mem) {
+    free(pool->cells);
+    free(pool->mem);
+    free(pool);
+    ERR_RETURN_BOOL("Failed to allocate pool memory", nullptr);
+  }
+  for (uint32_t i = 0; i < ring_size; i++) {
+    new (&pool->cells[i].seq) std::atomic<uint32_t>(i);
+  }
+  for (uint32_t i = 0; i < size; i++) {
+    pkt_buf_t *pkt = (pkt_buf_t *)(pool->mem + i * obj_len);
+    pkt_buf_init(pkt, (uint8_t *)pkt + pool->hdr_len, buf_len, 0);
+    pkt->priv_size = priv_size;
+    pkt->pool = pool;
+    pkt_pool_ring_enqueue(pool, pkt);
+  }
+  // Claim a slot for the per-thread caches
+  for (uint32_t i = 0; i < CONFIG_PKT_POOL_MAX_POOLS; i++) {
+    pkt_pool_t *expected = nullptr;
+    if (__pools[i].compare_exchange_strong(expected, pool)) {
+      pool->slot = i;
+      return pool;
+    }
+  }
+  pkt_pool_destroy(pool);
+  ERR_RETURN_BOOL("Too many pools", nullptr);
+}
+
+void pkt_pool_destroy(pkt_pool_t *pool) {
+  if (!pool) { return; }
+  if (__pools[pool->slot].load() == pool) {
+    __caches.caches[pool->slot].pool = nullptr;
+    __pools[pool->slot].store(nullptr);
+  }
+  free(pool->cells);
+  free(pool->mem);
+  pool->~pkt_pool_t();
+  free(pool);
+}
+
+pkt_pool_t* pkt_pool_default() {
+  static pkt_pool_t *pool = pkt_pool_create(
+    CONFIG_PKT_POOL_SIZE, 
+    CONFIG_PKT_POOL_CACHE_SIZE, 
+    CONFIG_PKT_BUF_HEADROOM + CONFIG_MAX_PACKET_BUFFER_SIZE, 
+    CONFIG_PKT_BUF_PRIV_SIZE
+  );
+  return pool;
+}
+
+pkt_buf_t* pkt_pool_alloc(pkt_pool_t *pool, uint32_t headroom) {
+  EXPECT_RETURN_VAL(pool != nullptr, "Empty pool param", nullptr);
+  EXPECT_RETURN_VAL(headroom <= pool->buf_len, "Headroom larger than buffer", nullptr);
+  pkt_pool_cache_t *c = pkt_pool_cache(pool);
+  pkt_buf_t *pkt = nullptr;
+  if (likely(c->len > 0)) {
+    pkt = c->objs[--c->len];
+    if (unlikely(++c->hits == pool->cache_size)) {
+      pkt_pool_cache_publish(c);
+    }
+  }
+  else {
+    // Cache miss, refill it (in one go) from the ring
+    pool->cache_misses.fetch_add(1, std::memory_order_relaxed);
+    pkt = pkt_pool_ring_dequeue(pool);
+    while (pkt && c->len < pool->cache_size) {
+      pkt_buf_t *obj = pkt_pool_ring_dequeue(pool);
+      if (!obj) { break; }
+      c->objs[c->len++] = obj;
+    }
+    if (unlikely(!pkt)) {
+      pool->alloc_failures.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+  }
+  // Was possibly used as a clone, point it back at its own storage
+  pkt->buf = (uint8_t *)pkt + pool->hdr_len;
+  pkt->buf_len = pool->buf_len;
+  pkt->data_off = headroom;
+  pkt->data_len = 0;
+  pkt->trace_id = 0;
+  return pkt;
+}
+
+void pkt_pool_free(pkt_buf_t *pkt) {
+  EXPECT_RETURN(pkt != nullptr, "Empty packet buffer param");
+  EXPECT_RETURN(pkt->pool != nullptr, "Packet buffer isn't pooled");
+  pkt_pool_cache_t *c = pkt_pool_cache(pkt->pool);
+  if (unlikely(c->pool->cache_size == 0)) {
+    pkt_pool_ring_enqueue(pkt->pool, pkt);
+    return;
+  }
+  c->objs[c->len++] = pkt;
+  if (unlikely(c->len == 2 * c->pool->cache_size)) {
+    // Overflowing, hand half of it back
+    pkt_pool_cache_flush_to_ring(c, c->pool->cache_size);
+  }
+}
+
+void pkt_pool_cache_flush(pkt_pool_t *pool) {
+  EXPECT_RETURN(pool != nullptr, "Empty pool param");
+  pkt_pool_cache_flush_to_ring(pkt_pool_cache(pool), 0);
+}
+
+void pkt_pool_stats_get(pkt_pool_t *pool, pkt_pool_stats_t *stats) {
+  EXPECT_RETURN(pool != nullptr, "Empty pool param");
+  EXPECT_RETURN(stats != nullptr, "Empty stats param");
+  uint32_t dequeued = pool->dequeue_pos.load(std::memory_order_relaxed);
+  uint32_t enqueued = pool->enqueue_pos.load(std::memory_order_relaxed);
+  stats->size = pool->size;
+  stats->available = enqueued - dequeued;
+  if (stats->available > pool->size) { stats->available = pool->size; } // Raced with enqueues
+  stats->in_use = pool->size - stats->available;
+  stats->cache_hits = pool->cache_hits.load(std::memory_order_relaxed);
+  stats->cache_misses = pool->cache_misses.load(std::memory_order_relaxed);
+  stats->alloc_failures = pool->alloc_failures.load(std::memory_order_relaxed);
+}
+
+void pkt_pool_stats_dump(pkt_pool_t *pool) {
+  pkt_pool_stats_t stats;
+  pkt_pool_stats_get(pool, &stats);
+  uint64_t allocs = stats.cache_hits + stats.cache_misses;
+  double hit_rate = allocs ? 100.0 * stats.cache_hits / allocs : 0.0;
+  dump_line("Packet buffers: %u in use, %u available (of %u), %lu allocation failures\n", stats.in_use, stats.available, stats.size, stats.alloc_failures);
+  dump_line("Packet buffer cache: %lu hits, %lu misses (hit rate: %.2f%%)\n", stats.cache_hits, stats.cache_misses, hit_rate);
+}
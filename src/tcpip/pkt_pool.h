@@ -0,0 +1,55 @@
+// pkt_pool.h
+
+#pragma once
+
+#include <cstdint>
+#include "config.h"
+#include "pkt_buf.h"
+
+/*
+ * Fixed size pool of packet buffers (same idea as DPDK's rte_mempool, see
+ * `src/scratch/rte_mempools.cpp`). All buffers are carved out of a single
+ * allocation up front. Free buffers sit in a lock-free MPMC ring shared by
+ * all threads, fronted by a per-thread cache, so that allocating and freeing
+ * on the same thread (the common case) touches no shared state at all. The
+ * cache only goes to the ring, `cache_size` buffers at a time, when it runs
+ * dry or overflows.
+ *
+ * Every buffer may carry a private area of `priv_size` bytes (see
+ * `pkt_buf_priv()`) for metadata that has to travel with the packet. A pool
+ * with a zero `buf_len` only holds descriptors, which is all clones need (see
+ * `pkt_buf_clone()`).
+ *
+ * A pool must only be destroyed once no other thread holds (or caches) any of
+ * its buffers.
+ */
+
+typedef struct pkt_pool_t pkt_pool_t;
+
+pkt_pool_t* pkt_pool_create(uint32_t size, uint32_t cache_size, uint32_t buf_len, uint32_t priv_size);
+void pkt_pool_destroy(pkt_pool_t *pool);
+pkt_pool_t* pkt_pool_default(); // Shared by the whole stack (created on first use)
+
+pkt_buf_t* pkt_pool_alloc(pkt_pool_t *pool, uint32_t headroom = CONFIG_PKT_BUF_HEADROOM); // nullptr if exhausted
+void pkt_pool_free(pkt_buf_t *pkt); // Skips reference counting, use `pkt_buf_destroy()` instead
+void pkt_pool_cache_flush(pkt_pool_t *pool); // Returns the calling thread's cached buffers to the ring
+
+#pragma mark -
+
+// Stats
+
+/*
+ * Cache hits are published in batches, flush the cache first for exact
+ * numbers on the calling thread.
+ */
+typedef struct pkt_pool_stats_t {
+  uint32_t size;
+  uint32_t available;       // Buffers in the shared ring
+  uint32_t in_use;          // Everything else (includes buffers parked in per-thread caches)
+  uint64_t cache_hits;      // Allocations served by the calling thread's cache
+  uint64_t cache_misses;    // Allocations that went to the ring
+  uint64_t alloc_failures;  // Pool exhausted
+} pkt_pool_stats_t;
+
+void pkt_pool_stats_get(pkt_pool_t *pool, pkt_pool_stats_t *stats); // Thread safe
+void pkt_pool_stats_dump(pkt_pool_t *pool);
@@ -0,0 +1,92 @@
+// prof.cpp
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include "prof.h"
+#include "utils.h"
+
+#define PROF_CALIBRATION_MS 20
+
+std::atomic<bool> __prof_enabled(false);
+uint64_t __prof_ns_per_tick_q32 = 1ull << 32;
+
+#pragma mark -
+
+// Private utility functions
+
+// Measures the tick rate against the monotonic clock (once)
+static void prof_calibrate() {
+  static std::once_flag once;
+  std::call_once(once, [] {
+#if defined(__x86_64__) || defined(__i386__)
+    auto start = std::chrono::steady_clock::now();
+    uint64_t start_ticks = prof_ticks();
+    std::this_thread::sleep_for(std::chrono::milliseconds(PROF_CALIBRATION_MS));
+    uint64_t ticks = prof_ticks() - start_ticks;
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    if (ticks > 0) {
+      __prof_ns_per_tick_q32 = (uint64_t)(ns / ticks * (double)(1ull << 32));
+    }
+#endif
+  });
+}
+
+#pragma mark -
+
+// Public functions
+
+void prof_set_enabled(bool enabled) {
+  if (enabled) {
+    prof_calibrate();
+  }
+  __prof_enabled.store(enabled, std::memory_order_release);
+}
+
+const char* prof_stage_str(prof_stage_t stage) {
+  switch (stage) {
+    case PROF_STAGE_PHY_RX: return "phy rx";
+    case PROF_STAGE_L2_RX: return "l2 rx";
+    case PROF_STAGE_L2_SWITCH: return "l2 switch";
+    case PROF_STAGE_L3_PROMOTE: return "l3 promote";
+    case PROF_STAGE_L3_DEMOTE: return "l3 demote";
+    case PROF_STAGE_L2_DEMOTE: return "l2 demote";
+    case PROF_STAGE_ARP_WAIT: return "arp wait";
+    case PROF_STAGE_PHY_TX: return "phy tx";
+    default: return "unknown";
+  }
+}
+
+node_prof_t* __node_prof_alloc(node_t *n) {
+  node_prof_t *prof = new node_prof_t();
+  for (uint32_t i = 0; i < PROF_STAGE_COUNT; i++) {
+    hist_init(&prof->stages[i]);
+  }
+  n->prof = prof;
+  return prof;
+}
+
+void node_prof_dump(node_t *n) {
+  EXPECT_RETURN(n != nullptr, "Empty node param");
+  if (!n->prof) {
+    dump_line("No samples (%s)\n", prof_enabled() ? "enabled" : "disabled");
+    return;
+  }
+  dump_line("%-12s %10s %10s %10s %10s %10s\n", "stage", "samples", "avg (us)", "p50 <", "p99 <", "p999 <");
+  for (uint32_t i = 0; i < PROF_STAGE_COUNT; i++) {
+    hist_t *h = &n->prof->stages[i];
+    uint64_t count = hist_count(h);
+    if (count == 0) { continue; }
+    dump_line("%-12s %10lu %10.2f %10.2f %10.2f %10.2f\n", prof_stage_str((prof_stage_t)i), count,
+      (double)h->sum.load(std::memory_order_relaxed) / count / 1000.0, hist_percentile(h, 50) / 1000.0,
+      hist_percentile(h, 99) / 1000.0, hist_percentile(h, 99.9) / 1000.0);
+  }
+}
+
+void node_prof_reset(node_t *n) {
+  EXPECT_RETURN(n != nullptr, "Empty node param");
+  if (!n->prof) { return; }
+  for (uint32_t i = 0; i < PROF_STAGE_COUNT; i++) {
+    hist_reset(&n->prof->stages[i]);
+  }
+}
@@ -0,0 +1,87 @@
+// prof.h
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <time.h>
+#include "hist.h"
+#include "graph.h"
+
+/*
+ * Per-node, per-stage latency of the netstack pipeline. Stages nest (e.g.
+ * PROF_STAGE_L2_RX includes everything the frame caused, sends included), so
+ * times are inclusive. Timestamps come from the TSC, converted to ns when
+ * recorded.
+ *
+ * Off by default. While off, every stage costs one relaxed load and a branch.
+ * Histograms are allocated on a node's first sample, with its lock held.
+ */
+
+enum prof_stage_t {
+  PROF_STAGE_PHY_RX = 0,      // Phy receive handling (header parsing onwards)
+  PROF_STAGE_L2_RX,           // `layer2_node_recv_frame()`
+  PROF_STAGE_L2_SWITCH,       // `layer2_switch_recv_frame()`
+  PROF_STAGE_L3_PROMOTE,      // `l3.promote`
+  PROF_STAGE_L3_DEMOTE,       // `l3.demote`
+  PROF_STAGE_L2_DEMOTE,       // `l2.demote`
+  PROF_STAGE_ARP_WAIT,        // Packets parked on an unresolved ARP entry
+  PROF_STAGE_PHY_TX,          // `phy.send`
+  PROF_STAGE_COUNT
+};
+
+typedef struct node_prof_t {
+  hist_t stages[PROF_STAGE_COUNT];
+} node_prof_t;
+
+extern std::atomic<bool> __prof_enabled;
+extern uint64_t __prof_ns_per_tick_q32; // ns per tick, 32.32 fixed point
+
+void prof_set_enabled(bool enabled); // Thread safe
+const char* prof_stage_str(prof_stage_t stage);
+node_prof_t* __node_prof_alloc(node_t *n); // Call with the node lock held
+void node_prof_dump(node_t *n); // Call with the node lock held
+void node_prof_reset(node_t *n); // Same
+
+static inline bool prof_enabled() {
+  return __prof_enabled.load(std::memory_order_acquire); // Pairs with the calibration
+}
+
+// Call with the node lock held
+static inline node_prof_t* node_prof_get(node_t *n) {
+  return n->prof ? n->prof : __node_prof_alloc(n);
+}
+
+static inline uint64_t prof_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc(); // Not `<x86intrin.h>`, it drags in every ISA extension
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+// Timestamp for a stage about to start, 0 while profiling is off
+static inline uint64_t prof_begin() {
+  return prof_enabled() ? prof_ticks() : 0;
+}
+
+// Call with the node lock held
+static inline void prof_end(node_t *n, prof_stage_t stage, uint64_t start) {
+  if (!start) { return; }
+  uint64_t ticks = prof_ticks() - start;
+  uint64_t ns = (uint64_t)(((unsigned __int128)ticks * __prof_ns_per_tick_q32) >> 32);
+  hist_record(&node_prof_get(n)->stages[stage], ns);
+}
+
+// Times a stage for the lifetime of the guard
+struct prof_stage_guard_t {
+  node_t *node;
+  prof_stage_t stage;
+  uint64_t start;
+  prof_stage_guard_t(node_t *n, prof_stage_t s) : node(n), stage(s), start(prof_begin()) {}
+  virtual ~prof_stage_guard_t() {
+    prof_end(node, stage, start);
+  }
+};
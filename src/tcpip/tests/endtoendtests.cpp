@@ -26,7 +26,8 @@ TEST_CASE("End-to-end tests", "[e2e]") {
   auto create_sync_phy_send = []() {
     // Creating a lambda for each node like so allow us to allocate memory in the stack
     // for every invocation
-    return [](node_t *n, interface_t *intf, uint8_t *frame, uint32_t framelen) -> int {
+    return [](node_t *n, interface_t *intf, pkt_buf_t *pkt) -> int {
+      uint32_t framelen = pkt_buf_pkt_len(pkt);
       // Get the neighbor node via the link
       link_t *link = intf->link;
       // If there's no link (e.g., SVI), just return success
@@ -43,7 +44,7 @@ TEST_CASE("End-to-end tests", "[e2e]") {
         printf("failing...\n");
         return -1;
       }
-      memcpy(frame_copy, frame, framelen);
+      pkt_buf_copy_data(pkt, frame_copy, sizeof(frame_copy));
       // Synchronously deliver the frame
        int resp = layer2_node_recv_frame_bytes(neighbor_node, neighbor_intf, frame_copy, framelen);
        #pragma unused(resp)
@@ -0,0 +1,117 @@
+// latbench.cpp
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <time.h>
+#include "graph.h"
+#include "topo.h"
+#include "phy.h"
+#include "layer3/rt.h"
+#include "layer5/layer5.h"
+#include "utils.h"
+
+#define BENCH_DEFAULT_PINGS 2000
+#define BENCH_HOPS 4 // H1 -> R1 -> SW -> R3 -> H3
+
+#pragma mark -
+
+// Helpers
+
+static std::atomic<uint64_t> __pings_received(0);
+
+static uint64_t cpu_time_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void node_add_route(node_t *n, const char *prefix, uint8_t mask, const char *gw, const char *oif) {
+  ipv4_addr_t prefix_addr;
+  ipv4_addr_t gw_addr;
+  EXPECT_FATAL(ipv4_addr_try_parse(prefix, &prefix_addr), "Invalid prefix");
+  EXPECT_FATAL(ipv4_addr_try_parse(gw, &gw_addr), "Invalid gateway");
+  interface_t *intf = node_get_interface_by_name(n, oif);
+  EXPECT_FATAL(intf != nullptr, "Unknown interface");
+  bool resp = rt_add_route(n->netprop.r_table, &prefix_addr, mask, &gw_addr, intf);
+  EXPECT_FATAL(resp == true, "rt_add_route failed");
+}
+
+// Sends a ping from H1 to H3, and waits for it to land
+static void ping_and_wait(node_t *H1, ipv4_addr_t *addr) {
+  uint64_t expected = __pings_received.load() + 1;
+  {
+    node_lock_guard_t guard(H1);
+    layer5_perform_ping(H1, addr, nullptr);
+  }
+  while (__pings_received.load() < expected) {
+    std::this_thread::yield(); // Receivers may share our core
+  }
+}
+
+/*
+ * Times `pings` sequential one-way pings from H1 to H3 (only one in flight
+ * at a time) under the given poll mode, and reports the average latency per
+ * hop along with the CPU time the whole process burnt per ping.
+ */
+static void bench_poll_mode(node_t *H1, ipv4_addr_t *addr, uint32_t pings, phy_poll_mode_t mode, uint32_t spin_budget) {
+  phy_set_poll_mode(mode, spin_budget);
+  ping_and_wait(H1, addr); // Wakes up receivers still blocked from the previous mode
+  phy_stats_reset();
+  uint64_t cpu_start = cpu_time_ns();
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < pings; i++) {
+    ping_and_wait(H1, addr);
+  }
+  auto end = std::chrono::steady_clock::now();
+  uint64_t cpu_end = cpu_time_ns();
+  double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  phy_stats_t stats;
+  phy_stats_get(&stats);
+  printf("  %-9s (spin budget %5u): %8.2f us/hop, %8.2f us/ping one-way, %8.2f us CPU/ping (%lu empty polls, %lu blocking waits)\n",
+    phy_poll_mode_str(mode), mode == PHY_POLL_ADAPTIVE ? spin_budget : 0,
+    ns / pings / BENCH_HOPS / 1000.0, ns / pings / 1000.0,
+    (double)(cpu_end - cpu_start) / pings / 1000.0, stats.poll_spins, stats.poll_sleeps);
+}
+
+#pragma mark -
+
+int main(int argc, const char **argv) {
+  uint32_t pings = argc > 1 ? (uint32_t)strtoul(argv[1], nullptr, 10) : BENCH_DEFAULT_PINGS;
+  uint32_t thread_count = argc > 2 ? (uint32_t)strtoul(argv[2], nullptr, 10) : 1;
+  uint32_t busy_poll = argc > 3 ? (uint32_t)strtoul(argv[3], nullptr, 10) : 0;
+  EXPECT_FATAL(pings > 0, "Invalid ping count");
+  phy_set_frame_logging(false);
+  phy_set_socket_busy_poll(busy_poll);
+  graph_t *topo = graph_create_three_router_one_switch_topology();
+  EXPECT_FATAL(topo != nullptr, "graph_create_three_router_one_switch_topology failed");
+  node_t *H1 = graph_find_node_by_name(topo, "H1");
+  node_t *R1 = graph_find_node_by_name(topo, "R1");
+  node_t *H3 = graph_find_node_by_name(topo, "H3");
+  node_add_route(H1, "30.0.0.0", 24, "10.0.0.1", "eth4/1");
+  node_add_route(R1, "30.0.0.0", 24, "40.0.0.3", "eth1/1");
+  NODE_NETSTACK(H3).l5.promote = [](node_t *n, interface_t *intf, uint8_t *payload, uint32_t len, ipv4_addr_t *addr, uint32_t prot) {
+    __pings_received++;
+  };
+  // Start receivers (they never exit, so just let them go)
+  bool resp = phy_receiver_set_thread_count(topo, thread_count);
+  EXPECT_FATAL(resp == true, "phy_receiver_set_thread_count failed");
+  for (uint32_t shard = 0; shard < thread_count; shard++) {
+    std::thread([topo, shard] { phy_receiver_thread_main(topo, shard); }).detach();
+  }
+  while (!phy_receiver_threads_ready(topo)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ipv4_addr_t addr = INTF_IP(node_get_interface_by_name(H3, "eth6/1"));
+  ping_and_wait(H1, &addr); // Resolves ARP along the path
+  printf("Pinging H1 -> H3 %u times (%s, %u hops, %u receiver thread(s), SO_BUSY_POLL: %u us)\n",
+    pings, topo->topology_name, BENCH_HOPS, thread_count, busy_poll);
+  bench_poll_mode(H1, &addr, pings, PHY_POLL_BLOCK, 0);
+  bench_poll_mode(H1, &addr, pings, PHY_POLL_ADAPTIVE, 100);
+  bench_poll_mode(H1, &addr, pings, PHY_POLL_ADAPTIVE, CONFIG_PHY_DEFAULT_SPIN_BUDGET);
+  bench_poll_mode(H1, &addr, pings, PHY_POLL_BUSY, 0);
+  phy_set_poll_mode(PHY_POLL_BLOCK);
+  return 0;
+}
@@ -0,0 +1,151 @@
+// macbench.cpp
+
+#include <chrono>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "graph.h"
+#include "topo.h"
+#include "phy.h"
+#include "layer2/ether_hdr.h"
+#include "layer2/mac_table.h"
+#include "utils.h"
+
+/*
+ * MAC learning under steady traffic between known hosts: every frame's
+ * source MAC has already been learnt on its ingress interface. Compares
+ * `mac_table_process_reply()` (read only unless a station is new or moved)
+ * with learning that rewrites the entry on every frame, in time and, when
+ * perf events are available, in cache misses.
+ *
+ * Usage: macbench [stations] [frames]
+ */
+
+#define BENCH_DEFAULT_STATIONS 1024
+#define BENCH_DEFAULT_FRAMES 200000
+
+#pragma mark -
+
+// Helpers
+
+typedef struct bench_counters_t {
+  int l1d_fd;   // L1D read misses
+  int llc_fd;   // Last level cache misses
+} bench_counters_t;
+
+static int perf_counter_open(uint32_t type, uint64_t config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void perf_counter_start(int fd) {
+  if (fd < 0) { return; }
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+// -1 if not available
+static int64_t perf_counter_stop(int fd) {
+  if (fd < 0) { return -1; }
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  uint64_t count = 0;
+  return read(fd, &count, sizeof(count)) == sizeof(count) ? (int64_t)count : -1;
+}
+
+// What learning used to do: build an entry, then look it up and overwrite it
+static void learn_write_always(mac_table_t *t, ether_hdr_t *ether_hdr, interface_t *intf, uint64_t now_ns) {
+  mac_entry_t entry = {0};
+  entry.mac_addr = ether_hdr_read_src_mac(ether_hdr);
+  entry.oif_ifindex = intf->ifindex;
+  glthread_init(&entry.mac_table_glue);
+  mac_table_add_entry(t, &entry);
+#pragma unused(now_ns)
+}
+
+static void learn_fast_path(mac_table_t *t, ether_hdr_t *ether_hdr, interface_t *intf, uint64_t now_ns) {
+  mac_table_process_reply(t, ether_hdr, intf, now_ns);
+}
+
+static void bench_learning(
+  const char *label, void (*learn)(mac_table_t *, ether_hdr_t *, interface_t *, uint64_t), mac_table_t *t,
+  std::vector<ether_hdr_t> &frames, std::vector<interface_t *> &ingress, bench_counters_t *counters
+) {
+  uint64_t moves = t->station_moves;
+  perf_counter_start(counters->l1d_fd);
+  perf_counter_start(counters->llc_fd);
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < frames.size(); i++) {
+    learn(t, &frames[i], ingress[i], phy_node_clock_ns(nullptr));
+  }
+  auto end = std::chrono::steady_clock::now();
+  int64_t l1d = perf_counter_stop(counters->l1d_fd);
+  int64_t llc = perf_counter_stop(counters->llc_fd);
+  double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  printf("  %-14s: %10.1f ns/frame", label, ns / frames.size());
+  if (l1d >= 0) { printf(", %8.2f L1D misses/frame", (double)l1d / frames.size()); }
+  if (llc >= 0) { printf(", %8.3f LLC misses/frame", (double)llc / frames.size()); }
+  printf(" (%lu station moves)\n", t->station_moves - moves);
+}
+
+#pragma mark -
+
+int main(int argc, const char **argv) {
+  uint32_t stations = argc > 1 ? (uint32_t)strtoul(argv[1], nullptr, 10) : BENCH_DEFAULT_STATIONS;
+  uint32_t frame_count = argc > 2 ? (uint32_t)strtoul(argv[2], nullptr, 10) : BENCH_DEFAULT_FRAMES;
+  EXPECT_FATAL(stations > 0, "Invalid station count");
+  EXPECT_FATAL(frame_count > 0, "Invalid frame count");
+  phy_set_frame_logging(false);
+  // Stations are spread over a switch's interfaces
+  graph_t *topo = graph_create_dual_switch_topology();
+  EXPECT_FATAL(topo != nullptr, "graph_create_dual_switch_topology failed");
+  node_t *SW1 = graph_find_node_by_name(topo, "SW1");
+  std::vector<interface_t *> intfs;
+  for (uint32_t i = 0; i < CONFIG_MAX_INTF_PER_NODE; i++) {
+    if (SW1->intf[i]) { intfs.push_back(SW1->intf[i]); }
+  }
+  // Frames between (pseudo random, but fixed) pairs of known stations
+  std::vector<ether_hdr_t> frames(frame_count);
+  std::vector<interface_t *> ingress(frame_count);
+  for (uint32_t i = 0; i < frame_count; i++) {
+    uint32_t src = ((uint64_t)i * 7919) % stations;
+    uint32_t dst = ((uint64_t)i * 104729 + 1) % stations;
+    mac_addr_t src_mac = {.bytes = {0x02, 0x00, 0x00, (uint8_t)(src >> 16), (uint8_t)(src >> 8), (uint8_t)src}};
+    mac_addr_t dst_mac = {.bytes = {0x02, 0x00, 0x00, (uint8_t)(dst >> 16), (uint8_t)(dst >> 8), (uint8_t)dst}};
+    ether_hdr_set_src_mac(&frames[i], &src_mac);
+    ether_hdr_set_dst_mac(&frames[i], &dst_mac);
+    ether_hdr_set_type(&frames[i], ETHER_TYPE_IPV4);
+    ingress[i] = intfs[src % intfs.size()];
+  }
+  bench_counters_t counters = {
+    .l1d_fd = perf_counter_open(PERF_TYPE_HW_CACHE,
+      PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)),
+    .llc_fd = perf_counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES)
+  };
+  printf("MAC learning, steady traffic: %u known stations, %u frames (%s)\n", stations, frame_count,
+    counters.l1d_fd >= 0 || counters.llc_fd >= 0 ? "perf counters on" : "perf counters unavailable");
+  // Every station gets learnt first, so that only steady state is measured
+  mac_table_t *t = nullptr;
+  mac_table_init(&t);
+  mac_table_set_max_entries(t, stations);
+  for (uint32_t i = 0; i < frame_count; i++) {
+    mac_table_process_reply(t, &frames[i], ingress[i], phy_node_clock_ns(nullptr));
+  }
+  for (uint32_t round = 0; round < 3; round++) {
+    bench_learning("write always", learn_write_always, t, frames, ingress, &counters);
+    bench_learning("fast path", learn_fast_path, t, frames, ingress, &counters);
+  }
+  mac_table_clear(t);
+  return 0;
+}
@@ -4,6 +4,8 @@
 #include "net.h"
 #include "graph.h"
 #include "topo.h"
+#include "layer2/mac_table.h"
+#include "layer3/rt.h"
 
 TEST_CASE("node_get_interface_matching_subnet - basic match", "[net][subnet]") {
   // Create a topology
@@ -319,3 +321,27 @@ TEST_CASE("node_is_local_address", "[net][node]") {
     REQUIRE(resp == true);
   }
 }
+
+TEST_CASE("Tables refer to interfaces by ifindex", "[net][node][ifindex]") {
+  graph_t *topo = graph_create_dual_switch_topology();
+  node_t *SW1 = graph_find_node_by_name(topo, "SW1");
+  // Every interface (links and SVIs) sits at its ifindex
+  for (uint16_t i = 0; i < CONFIG_MAX_INTF_PER_NODE; i++) {
+    if (!SW1->intf[i]) { continue; }
+    REQUIRE(SW1->intf[i]->ifindex == i);
+    REQUIRE(node_get_interface_by_index(SW1, i) == SW1->intf[i]);
+  }
+  REQUIRE(node_get_interface_by_index(SW1, CONFIG_MAX_INTF_PER_NODE) == nullptr);
+  // The SVI's MAC and subnet point at it
+  interface_t *svi = node_get_interface_by_name(SW1, "svi1/11");
+  REQUIRE(svi != nullptr);
+  mac_entry_t *mac_entry = nullptr;
+  REQUIRE(mac_table_lookup(SW1->netprop.mac_table, &INTF_NETPROP(svi).l2.mac_addr, &mac_entry));
+  REQUIRE(mac_entry->oif_ifindex == svi->ifindex);
+  ipv4_addr_t addr {.bytes={11, 0, 0, 1}};
+  rt_entry_t *rt_entry = nullptr;
+  REQUIRE(rt_lookup(SW1->netprop.r_table, &addr, &rt_entry));
+  REQUIRE(rt_entry_oif_is_configured(rt_entry));
+  REQUIRE(rt_entry_get_oif_ifindex(rt_entry) == svi->ifindex);
+  REQUIRE(strcmp(node_get_interface_name_by_index(SW1, svi->ifindex), "svi1/11") == 0);
+}
@@ -0,0 +1,291 @@
+// pcapreplay.cpp
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "graph.h"
+#include "topo.h"
+#include "phy.h"
+#include "hist.h"
+#include "layer2/layer2.h"
+#include "utils.h"
+
+/*
+ * Replays a capture (libpcap, or pcapng as written by `pcap_capture_start()`)
+ * into a node's interface, as if its frames had just come off the wire, and
+ * reports the rate achieved along with how long the stack took per frame.
+ *
+ * Usage: pcapreplay <file> <topology> <node> <interface> [mode] [loops] [receiver threads]
+ *   mode: `timing` (original inter-frame gaps), `rate:<pps>`, or `max` (default)
+ */
+
+#define REPLAY_SPIN_NS 50000 // Sleep until this close to a frame's due time, then spin
+
+#define PCAP_MAGIC_USEC 0xA1B2C3D4
+#define PCAP_MAGIC_NSEC 0xA1B23C4D
+#define PCAPNG_BLOCK_SHB 0x0A0D0D0A
+#define PCAPNG_BLOCK_IDB 0x00000001
+#define PCAPNG_BLOCK_EPB 0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+#define PCAPNG_OPT_IF_TSRESOL 9
+
+enum replay_mode_t {
+  REPLAY_MODE_MAX = 0,
+  REPLAY_MODE_TIMING,
+  REPLAY_MODE_RATE
+};
+
+typedef struct replay_frame_t {
+  const uint8_t *data;  // Within the mapped file
+  uint32_t len;
+  uint64_t ts;          // ns, from the capture
+} replay_frame_t;
+
+typedef struct replay_topology_t {
+  const char *name;
+  graph_t* (*create)();
+} replay_topology_t;
+
+static const replay_topology_t __topologies[] = {
+  {"three-node-ring", graph_create_three_node_ring_topology},
+  {"two-node-linear", graph_create_two_node_linear_topology},
+  {"three-node-linear", graph_create_three_node_linear_topology},
+  {"four-node-cross", graph_create_four_node_cross_topology},
+  {"dual-switch", graph_create_dual_switch_topology},
+  {"quad-switch-loop", graph_create_quad_switch_loop_topology},
+  {"three-router-one-switch", graph_create_three_router_one_switch_topology},
+};
+
+#pragma mark -
+
+// Capture parsing
+
+static inline uint32_t rd32(const uint8_t *p, bool swap) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return swap ? __builtin_bswap32(v) : v;
+}
+
+static inline uint16_t rd16(const uint8_t *p, bool swap) {
+  uint16_t v;
+  memcpy(&v, p, sizeof(v));
+  return swap ? __builtin_bswap16(v) : v;
+}
+
+static bool replay_parse_pcap(const uint8_t *data, size_t len, std::vector<replay_frame_t> *frames) {
+  EXPECT_RETURN_BOOL(len >= 24, "Truncated pcap header", false);
+  uint32_t magic = rd32(data, false);
+  bool swap = magic == __builtin_bswap32(PCAP_MAGIC_USEC) || magic == __builtin_bswap32(PCAP_MAGIC_NSEC);
+  magic = rd32(data, swap);
+  EXPECT_RETURN_BOOL(magic == PCAP_MAGIC_USEC || magic == PCAP_MAGIC_NSEC, "Not a pcap or pcapng capture", false);
+  uint64_t frac_ns = magic == PCAP_MAGIC_NSEC ? 1 : 1000;
+  size_t off = 24;
+  while (off + 16 <= len) {
+    uint32_t caplen = rd32(data + off + 8, swap);
+    EXPECT_RETURN_BOOL(off + 16 + caplen <= len, "Truncated pcap record", false);
+    replay_frame_t frame = {
+      .data = data + off + 16,
+      .len = caplen,
+      .ts = rd32(data + off, swap) * 1000000000ull + rd32(data + off + 4, swap) * frac_ns
+    };
+    frames->push_back(frame);
+    off += 16 + caplen;
+  }
+  return true;
+}
+
+// Reads the `if_tsresol` option of an IDB (ns per tick)
+static uint64_t replay_pcapng_idb_ns_per_tick(const uint8_t *block, uint32_t block_len, bool swap) {
+  uint32_t off = 16;
+  while (off + 4 <= block_len - 4) {
+    uint16_t code = rd16(block + off, swap);
+    uint16_t len = rd16(block + off + 2, swap);
+    if (code == 0) { break; }
+    if (code == PCAPNG_OPT_IF_TSRESOL && len >= 1) {
+      uint8_t resol = block[off + 4];
+      if (resol & 0x80) { break; } // Powers of 2, not worth it
+      uint64_t ns = 1;
+      for (int i = resol; i < 9; i++) { ns *= 10; }
+      return ns;
+    }
+    off += 4 + ((len + 3) & ~3);
+  }
+  return 1000; // Microseconds by default
+}
+
+static bool replay_parse_pcapng(const uint8_t *data, size_t len, std::vector<replay_frame_t> *frames) {
+  EXPECT_RETURN_BOOL(len >= 28, "Truncated pcapng header", false);
+  bool swap = rd32(data + 8, false) != PCAPNG_BYTE_ORDER_MAGIC;
+  EXPECT_RETURN_BOOL(rd32(data + 8, swap) == PCAPNG_BYTE_ORDER_MAGIC, "Bad pcapng byte order magic", false);
+  std::vector<uint64_t> ns_per_tick; // By interface ID
+  size_t off = 0;
+  while (off + 12 <= len) {
+    uint32_t type = rd32(data + off, swap);
+    uint32_t block_len = rd32(data + off + 4, swap);
+    EXPECT_RETURN_BOOL(block_len >= 12 && off + block_len <= len, "Truncated pcapng block", false);
+    const uint8_t *block = data + off;
+    if (type == PCAPNG_BLOCK_IDB) {
+      ns_per_tick.push_back(replay_pcapng_idb_ns_per_tick(block, block_len, swap));
+    }
+    else if (type == PCAPNG_BLOCK_EPB) {
+      EXPECT_RETURN_BOOL(block_len >= 32, "Truncated EPB", false);
+      uint32_t intf_id = rd32(block + 8, swap);
+      EXPECT_RETURN_BOOL(intf_id < ns_per_tick.size(), "EPB for an unknown interface", false);
+      uint64_t ticks = ((uint64_t)rd32(block + 12, swap) << 32) | rd32(block + 16, swap);
+      uint32_t caplen = rd32(block + 20, swap);
+      EXPECT_RETURN_BOOL(caplen <= block_len - 32, "EPB data overruns its block", false); // Fixed fields and trailing length
+      replay_frame_t frame = {.data = block + 28, .len = caplen, .ts = ticks * ns_per_tick[intf_id]};
+      frames->push_back(frame);
+    }
+    // Anything else (SHB of a new section included) is skipped
+    off += block_len;
+  }
+  return true;
+}
+
+#pragma mark -
+
+// Replay
+
+static void replay_wait_until(std::chrono::steady_clock::time_point due) {
+  auto now = std::chrono::steady_clock::now();
+  if (due - now > std::chrono::nanoseconds(REPLAY_SPIN_NS)) {
+    std::this_thread::sleep_for(due - now - std::chrono::nanoseconds(REPLAY_SPIN_NS));
+  }
+  while (std::chrono::steady_clock::now() < due) {}
+}
+
+static void replay(
+  node_t *n, interface_t *intf, const std::vector<replay_frame_t> &frames, replay_mode_t mode, uint64_t pps, uint32_t loops
+) {
+  hist_t latency;
+  hist_init(&latency);
+  uint64_t sent = 0;
+  uint64_t bytes = 0;
+  uint64_t skipped = 0;
+  uint64_t max_ns = 0;
+  uint64_t span = frames.back().ts - frames.front().ts;
+  uint64_t gap = frames.size() > 1 ? span / (frames.size() - 1) : 0; // Between loops
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t loop = 0; loop < loops; loop++) {
+    for (uint32_t i = 0; i < frames.size(); i++) {
+      const replay_frame_t *frame = &frames[i];
+      if (frame->len > CONFIG_MAX_PACKET_BUFFER_SIZE) {
+        skipped++;
+        continue;
+      }
+      // Pace
+      if (mode == REPLAY_MODE_TIMING) {
+        uint64_t offset = loop * (span + gap) + (frame->ts - frames.front().ts);
+        replay_wait_until(start + std::chrono::nanoseconds(offset));
+      }
+      else if (mode == REPLAY_MODE_RATE) {
+        uint64_t offset = (loop * frames.size() + i) * 1000000000ull / pps;
+        replay_wait_until(start + std::chrono::nanoseconds(offset));
+      }
+      // Inject (timing the stack, not the wait on the node lock)
+      node_lock_guard_t guard(n);
+      auto frame_start = std::chrono::steady_clock::now();
+      layer2_node_recv_frame_bytes(n, intf, (uint8_t *)frame->data, frame->len);
+      uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - frame_start).count();
+      hist_record(&latency, ns);
+      max_ns = ns > max_ns ? ns : max_ns;
+      sent++;
+      bytes += frame->len;
+    }
+  }
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("  %10lu frames in %8.3fs : %12.0f pps, %10.2f MB/s (%lu skipped, too large)\n",
+    sent, secs, sent / secs, bytes / secs / 1e6, skipped);
+  if (sent == 0) { return; }
+  // (Percentiles are bucket upper bounds, no point going past the max)
+  auto percentile_us = [&latency, max_ns](double p) { return std::min(hist_percentile(&latency, p), max_ns) / 1000.0; };
+  printf("  per frame (us)        : avg %8.2f, p50 < %8.2f, p99 < %8.2f, p999 < %8.2f, max %8.2f\n",
+    (double)latency.sum.load() / sent / 1000.0, percentile_us(50), percentile_us(99), percentile_us(99.9), max_ns / 1000.0);
+}
+
+#pragma mark -
+
+int main(int argc, const char **argv) {
+  if (argc < 5) {
+    printf("Usage: %s <file> <topology> <node> <interface> [timing | rate:<pps> | max] [loops] [receiver threads]\n", argv[0]);
+    printf("Topologies:");
+    for (const replay_topology_t &t : __topologies) { printf(" %s", t.name); }
+    printf("\n");
+    return 1;
+  }
+  const char *mode_str = argc > 5 ? argv[5] : "max";
+  uint32_t loops = argc > 6 ? (uint32_t)strtoul(argv[6], nullptr, 10) : 1;
+  uint32_t thread_count = argc > 7 ? (uint32_t)strtoul(argv[7], nullptr, 10) : 1;
+  EXPECT_FATAL(loops > 0, "Invalid loop count");
+  EXPECT_FATAL(thread_count > 0, "Invalid receiver thread count");
+  replay_mode_t mode = REPLAY_MODE_MAX;
+  uint64_t pps = 0;
+  if (strcmp(mode_str, "timing") == 0) {
+    mode = REPLAY_MODE_TIMING;
+  }
+  else if (strncmp(mode_str, "rate:", strlen("rate:")) == 0) {
+    mode = REPLAY_MODE_RATE;
+    pps = strtoull(mode_str + strlen("rate:"), nullptr, 10);
+    EXPECT_FATAL(pps > 0, "Invalid rate");
+  }
+  else {
+    EXPECT_FATAL(strcmp(mode_str, "max") == 0, "Unknown mode");
+  }
+  // Map the capture
+  int fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+  EXPECT_FATAL(fd >= 0, "Couldn't open the capture");
+  struct stat st;
+  EXPECT_FATAL(fstat(fd, &st) == 0 && st.st_size >= 4, "Empty capture");
+  const uint8_t *data = (const uint8_t *)mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  EXPECT_FATAL(data != MAP_FAILED, "mmap failed");
+  // Read front to back, starting right away (advice, not flags: one call each)
+  if (madvise((void *)data, st.st_size, MADV_SEQUENTIAL) < 0) {
+    LOG_ERR("madvise(MADV_SEQUENTIAL) failed (%s), ignored\n", strerror(errno));
+  }
+  if (madvise((void *)data, st.st_size, MADV_WILLNEED) < 0) {
+    LOG_ERR("madvise(MADV_WILLNEED) failed (%s), ignored\n", strerror(errno));
+  }
+  std::vector<replay_frame_t> frames;
+  bool resp = rd32(data, false) == PCAPNG_BLOCK_SHB ?
+    replay_parse_pcapng(data, st.st_size, &frames) : replay_parse_pcap(data, st.st_size, &frames);
+  EXPECT_FATAL(resp == true, "Couldn't parse the capture");
+  EXPECT_FATAL(!frames.empty(), "No frames in the capture");
+  // Set up the topology
+  const replay_topology_t *topology = nullptr;
+  for (const replay_topology_t &t : __topologies) {
+    if (strcmp(t.name, argv[2]) == 0) { topology = &t; }
+  }
+  EXPECT_FATAL(topology != nullptr, "Unknown topology");
+  phy_set_frame_logging(false);
+  graph_t *topo = topology->create();
+  EXPECT_FATAL(topo != nullptr, "Couldn't create the topology");
+  node_t *n = graph_find_node_by_name(topo, argv[3]);
+  EXPECT_FATAL(n != nullptr, "Unknown node");
+  interface_t *intf = node_get_interface_by_name(n, argv[4]);
+  EXPECT_FATAL(intf != nullptr, "Unknown interface");
+  // Start receivers (they never exit, so just let them go)
+  resp = phy_receiver_set_thread_count(topo, thread_count);
+  EXPECT_FATAL(resp == true, "phy_receiver_set_thread_count failed");
+  for (uint32_t shard = 0; shard < thread_count; shard++) {
+    std::thread([topo, shard] { phy_receiver_thread_main(topo, shard); }).detach();
+  }
+  while (!phy_receiver_threads_ready(topo)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  printf("Replaying %zu frames from %s into %s/%s (%s, %s, %u loop(s), %u receiver thread(s))\n",
+    frames.size(), argv[1], n->node_name, intf->if_name, topo->topology_name, mode_str, loops, thread_count);
+  replay(n, intf, frames, mode, pps, loops);
+  munmap((void *)data, st.st_size);
+  close(fd);
+  return 0;
+}
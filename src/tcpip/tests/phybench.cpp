@@ -0,0 +1,283 @@
+// phybench.cpp
+
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "graph.h"
+#include "topo.h"
+#include "phy.h"
+#include "phy_uring.h"
+#include "phy_hdr.h"
+#include "layer2/layer2.h"
+#include "layer2/ether_hdr.h"
+#include "layer2/arp_hdr.h"
+#include "utils.h"
+
+#define BENCH_DEFAULT_ITERATIONS 20000
+#define BENCH_TRANSPORT_WINDOW 128
+
+#pragma mark -
+
+// Baseline (per-frame socket) send path, kept here for comparison only
+
+static uint8_t __legacy_send_buffer[CONFIG_MAX_PACKET_BUFFER_SIZE];
+
+int legacy_phy_node_send_frame(node_t *n, interface_t *intf, pkt_buf_t *pkt) {
+  // Create socket
+  int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  EXPECT_RETURN_VAL(fd >= 0, "socket failed", -1);
+  interface_t *intf2 = nullptr;
+  bool found = link_get_other_interface(intf->link, intf, &intf2);
+  EXPECT_RETURN_VAL(found == true, "link_get_other_interface failed", -1);
+  node_t *nbr = intf2->att_node;
+  memset(__legacy_send_buffer, 0, CONFIG_MAX_PACKET_BUFFER_SIZE);
+  uint32_t hdrlen = phy_hdr_write(__legacy_send_buffer, intf2->ifindex, 0, 0, 0);
+  uint32_t framelen = pkt_buf_copy_data(pkt, __legacy_send_buffer + hdrlen, CONFIG_MAX_PACKET_BUFFER_SIZE - hdrlen);
+  struct sockaddr_in addr;
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(nbr->udp.port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  int resp = sendto(fd, __legacy_send_buffer, framelen + hdrlen, 0, (struct sockaddr *)&addr, sizeof(struct sockaddr));
+  close(fd);
+  EXPECT_RETURN_VAL(resp >= 0, "sendto failed", -1);
+  return resp - hdrlen;
+}
+
+#pragma mark -
+
+// Helpers
+
+static uint64_t __frames_sent = 0;
+
+static void topo_set_phy_send(graph_t *topo, phy_send_frame_fn_t fn) {
+  glthread_t *curr = nullptr;
+  GLTHREAD_FOREACH_BEGIN(&topo->node_list, curr) {
+    node_t *n = node_ptr_from_graph_glue(curr);
+    NODE_NETSTACK(n).phy.send = [fn](node_t *n, interface_t *intf, pkt_buf_t *pkt) -> int {
+      __frames_sent++;
+      return fn(n, intf, pkt);
+    };
+  }
+  GLTHREAD_FOREACH_END();
+}
+
+// Builds an (untagged) broadcast ARP request, as sent by H1
+static uint32_t build_broadcast_frame(uint8_t *frame, interface_t *src_intf) {
+  ether_hdr_t *ether_hdr = (ether_hdr_t *)frame;
+  mac_addr_t bcast_mac;
+  mac_addr_fill_broadcast(&bcast_mac);
+  ether_hdr_set_src_mac(ether_hdr, INTF_MAC_PTR(src_intf));
+  ether_hdr_set_dst_mac(ether_hdr, &bcast_mac);
+  ether_hdr_set_type(ether_hdr, ETHER_TYPE_ARP);
+  arp_hdr_t *arp_hdr = (arp_hdr_t *)(ether_hdr + 1);
+  arp_hdr_set_hw_type(arp_hdr, ARP_HW_TYPE_ETHERNET);
+  arp_hdr_set_proto_type(arp_hdr, ETHER_TYPE_IPV4);
+  arp_hdr_set_hw_addr_len(arp_hdr, 6);
+  arp_hdr_set_proto_addr_len(arp_hdr, 4);
+  arp_hdr_set_op_code(arp_hdr, ARP_OP_CODE_REQUEST);
+  arp_hdr_set_src_mac(arp_hdr, INTF_MAC_PTR(src_intf));
+  arp_hdr_set_src_ip(arp_hdr, INTF_IP_PTR(src_intf)->value);
+  arp_hdr_set_dst_mac(arp_hdr, MAC_ADDR_PTR_ZEROED);
+  ipv4_addr_t target = {.bytes = {10, 0, 0, 200}}; // Nobody owns this address
+  arp_hdr_set_dst_ip(arp_hdr, target.value);
+  return sizeof(ether_hdr_t) + sizeof(arp_hdr_t);
+}
+
+/*
+ * Injects `iterations` broadcast frames into SW1 (as if received from H1).
+ * Every frame is flooded across VLAN 10 (access ports, trunk and SVI), so the
+ * cost is dominated by phy.send.
+ */
+static double bench_flood(graph_t *topo, uint32_t iterations, uint32_t burst = 0) {
+  node_t *H1 = graph_find_node_by_name(topo, "H1");
+  node_t *SW1 = graph_find_node_by_name(topo, "SW1");
+  interface_t *h1_intf = node_get_interface_by_name(H1, "eth0/1");
+  interface_t *sw1_intf = node_get_interface_by_name(SW1, "eth0/2");
+  EXPECT_FATAL(h1_intf != nullptr && sw1_intf != nullptr, "Unexpected topology");
+  uint8_t template_frame[CONFIG_MAX_PACKET_BUFFER_SIZE] = {0};
+  uint32_t framelen = build_broadcast_frame(template_frame, h1_intf);
+  uint8_t buffer[CONFIG_PKT_BUF_HEADROOM + CONFIG_MAX_PACKET_BUFFER_SIZE];
+  pkt_buf_t pkt;
+  __frames_sent = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < iterations; i++) {
+    // Batch egress frames the way the receiver does for a burst of `burst`
+    if (burst > 0 && i % burst == 0) { phy_tx_batch_begin(); }
+    pkt_buf_init(&pkt, buffer, sizeof(buffer), CONFIG_PKT_BUF_HEADROOM);
+    memcpy(pkt_buf_append(&pkt, framelen), template_frame, framelen);
+    layer2_node_recv_frame(SW1, sw1_intf, &pkt);
+    if (burst > 0 && (i + 1) % burst == 0) { phy_tx_batch_flush(); }
+  }
+  phy_tx_batch_flush();
+  auto end = std::chrono::steady_clock::now();
+  double secs = std::chrono::duration<double>(end - start).count();
+  return __frames_sent / secs;
+}
+
+/*
+ * Pushes `iterations` frames from H0 to H1 (2-node linear topology, one
+ * receiver thread per node) over the given transport, and reports the rate at
+ * which H1's receiver picked them up. Frames are addressed to nobody, so H1
+ * drops them right after the layer 2 checks. At most `BENCH_TRANSPORT_WINDOW`
+ * frames are kept in flight, so that neither transport overflows (the ring
+ * holds CONFIG_PHY_RING_SIZE frames, the socket buffer a few hundred).
+ */
+static double bench_transport(phy_transport_t transport, uint32_t iterations, uint64_t *delivered) {
+  phy_set_default_transport(transport);
+  graph_t *topo = graph_create_two_node_linear_topology();
+  phy_set_default_transport(PHY_TRANSPORT_UDP);
+  EXPECT_FATAL(topo != nullptr, "graph_create_two_node_linear_topology failed");
+  node_t *H0 = graph_find_node_by_name(topo, "H0");
+  interface_t *intf = node_get_interface_by_name(H0, "eth0/1");
+  EXPECT_FATAL(intf != nullptr, "Unexpected topology");
+  // Start receivers (they never exit, so just let them go)
+  bool resp = phy_receiver_set_thread_count(topo, 2);
+  EXPECT_FATAL(resp == true, "phy_receiver_set_thread_count failed");
+  for (uint32_t shard = 0; shard < 2; shard++) {
+    std::thread([topo, shard] { phy_receiver_thread_main(topo, shard); }).detach();
+  }
+  while (!phy_receiver_threads_ready(topo)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  // Build frame
+  uint8_t frame[128] = {0};
+  ether_hdr_t *ether_hdr = (ether_hdr_t *)frame;
+  mac_addr_t nobody = {.bytes = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01}};
+  ether_hdr_set_src_mac(ether_hdr, INTF_MAC_PTR(intf));
+  ether_hdr_set_dst_mac(ether_hdr, &nobody);
+  ether_hdr_set_type(ether_hdr, ETHER_TYPE_IPV4);
+  pkt_buf_t pkt;
+  pkt_buf_init(&pkt, frame, sizeof(frame), 0);
+  pkt_buf_append(&pkt, sizeof(frame));
+  phy_stats_reset();
+  auto received = [] {
+    phy_stats_t stats;
+    phy_stats_get(&stats);
+    return stats.rx_frames + stats.ring_rx_frames + stats.uring_rx_frames;
+  };
+  // Send (holding the node lock, as a receiver would)
+  auto start = std::chrono::steady_clock::now();
+  uint64_t sent = 0;
+  while (sent < iterations) {
+    uint64_t inflight = sent - received();
+    if (inflight >= BENCH_TRANSPORT_WINDOW) {
+      std::this_thread::yield(); // Let the receiver run
+      continue;
+    }
+    node_lock_guard_t guard(H0);
+    for (uint64_t i = inflight; i < BENCH_TRANSPORT_WINDOW && sent < iterations; i++, sent++) {
+      NODE_NETSTACK(H0).phy.send(H0, intf, &pkt);
+    }
+  }
+  // Wait for the receiver to catch up (give up if it stops making progress,
+  // which would mean frames got dropped)
+  uint64_t count = received();
+  auto progress = std::chrono::steady_clock::now();
+  while (count < iterations) {
+    uint64_t latest = received();
+    auto now = std::chrono::steady_clock::now();
+    if (latest != count) {
+      count = latest;
+      progress = now;
+    }
+    else if (now - progress > std::chrono::seconds(1)) {
+      break;
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  *delivered = count;
+  double secs = std::chrono::duration<double>(end - start).count();
+  return count / secs;
+}
+
+static uint32_t open_fd_count() {
+  DIR *dir = opendir("/proc/self/fd");
+  EXPECT_RETURN_VAL(dir != nullptr, "opendir failed", 0);
+  uint32_t count = 0;
+  while (readdir(dir)) { count++; }
+  closedir(dir);
+  return count;
+}
+
+/*
+ * Builds a switch tree topology over the given transport, and reports how
+ * long that took (in seconds), along with the number of file descriptors it
+ * opened along the way.
+ */
+static double bench_startup(phy_transport_t transport, uint32_t fanout, uint32_t depth, uint32_t *nodes, uint32_t *fds) {
+  uint32_t before = open_fd_count();
+  auto start = std::chrono::steady_clock::now();
+  phy_set_default_transport(transport);
+  graph_t *topo = graph_create_switch_tree_topology(fanout, depth);
+  phy_set_default_transport(PHY_TRANSPORT_UDP);
+  auto end = std::chrono::steady_clock::now();
+  EXPECT_FATAL(topo != nullptr, "graph_create_switch_tree_topology failed");
+  *nodes = topo->phy.node_count;
+  *fds = open_fd_count() - before;
+  return std::chrono::duration<double>(end - start).count();
+}
+
+#pragma mark -
+
+int main(int argc, const char **argv) {
+  uint32_t iterations = argc > 1 ? (uint32_t)strtoul(argv[1], nullptr, 10) : BENCH_DEFAULT_ITERATIONS;
+  EXPECT_FATAL(iterations > 0, "Invalid iteration count");
+  graph_t *topo = graph_create_dual_switch_topology();
+  phy_set_frame_logging(false);
+  printf("Flooding %u broadcast frames through SW1 (%s)\n", iterations, topo->topology_name);
+  // Baseline: socket() + sendto() + close() per frame
+  topo_set_phy_send(topo, &legacy_phy_node_send_frame);
+  double legacy_fps = bench_flood(topo, iterations);
+  printf("  per-frame socket  : %12.0f frames/s\n", legacy_fps);
+  // Persistent, pre-connected per-interface sockets
+  topo_set_phy_send(topo, &__phy_node_send_frame);
+  double persistent_fps = bench_flood(topo, iterations);
+  printf("  persistent socket : %12.0f frames/s\n", persistent_fps);
+  printf("  speedup           : %12.2fx\n", persistent_fps / legacy_fps);
+  // Persistent sockets, with egress frames batched into sendmmsg() calls
+  phy_stats_reset();
+  double batched_fps = bench_flood(topo, iterations, CONFIG_PHY_DEFAULT_BURST);
+  phy_stats_t stats;
+  phy_stats_get(&stats);
+  printf("  sendmmsg batches  : %12.0f frames/s (burst: %u, avg frames/syscall: %.2f)\n", batched_fps, CONFIG_PHY_DEFAULT_BURST, stats.tx_batches ? (double)stats.tx_frames / stats.tx_batches : 0.0);
+  printf("  speedup (batched) : %12.2fx\n", batched_fps / legacy_fps);
+  // Transport throughput
+  printf("Sending %u frames from H0 to H1 (2-node linear topology)\n", iterations);
+  uint64_t udp_delivered = 0;
+  double udp_fps = bench_transport(PHY_TRANSPORT_UDP, iterations, &udp_delivered);
+  printf("  udp transport     : %12.0f frames/s (%lu delivered)\n", udp_fps, udp_delivered);
+  uint64_t ring_delivered = 0;
+  double ring_fps = bench_transport(PHY_TRANSPORT_RING, iterations, &ring_delivered);
+  phy_stats_get(&stats);
+  printf("  ring transport    : %12.0f frames/s (%lu delivered, %lu doorbells)\n", ring_fps, ring_delivered, stats.ring_doorbells);
+  printf("  speedup           : %12.2fx\n", ring_fps / udp_fps);
+  if (phy_uring_supported()) {
+    uint64_t uring_delivered = 0;
+    double uring_fps = bench_transport(PHY_TRANSPORT_URING, iterations, &uring_delivered);
+    phy_stats_get(&stats);
+    printf("  uring transport   : %12.0f frames/s (%lu delivered, %.2f frames/io_uring_enter)\n", uring_fps, uring_delivered, stats.uring_enters ? (double)stats.uring_rx_frames / stats.uring_enters : 0.0);
+    printf("  speedup           : %12.2fx\n", uring_fps / udp_fps);
+  }
+  else {
+    printf("  uring transport   : not supported by this kernel\n");
+  }
+  uint64_t shared_delivered = 0;
+  double shared_fps = bench_transport(PHY_TRANSPORT_UDP_SHARED, iterations, &shared_delivered);
+  printf("  udp-shared        : %12.0f frames/s (%lu delivered)\n", shared_fps, shared_delivered);
+  printf("  speedup           : %12.2fx\n", shared_fps / udp_fps);
+  // Topology startup (every udp node opens a socket, plus two per link)
+  printf("Building a switch tree topology (fanout 4, depth 4)\n");
+  uint32_t nodes = 0;
+  uint32_t fds = 0;
+  double udp_secs = bench_startup(PHY_TRANSPORT_UDP, 4, 4, &nodes, &fds);
+  printf("  udp transport     : %8.2f ms (%u nodes, %u fds)\n", udp_secs * 1000, nodes, fds);
+  double shared_secs = bench_startup(PHY_TRANSPORT_UDP_SHARED, 4, 4, &nodes, &fds);
+  printf("  udp-shared        : %8.2f ms (%u nodes, %u fds)\n", shared_secs * 1000, nodes, fds);
+  printf("  speedup           : %12.2fx\n", udp_secs / shared_secs);
+  return 0;
+}
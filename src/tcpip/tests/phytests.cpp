@@ -0,0 +1,643 @@
+// phytests.cpp
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "catch2.hpp"
+#include "phy_ring.h"
+#include "phy_uring.h"
+#include "phy_sim.h"
+#include "phy_hdr.h"
+#include "graph.h"
+#include "topo.h"
+#include "phy.h"
+#include "pkt_buf.h"
+#include "layer2/layer2.h"
+#include "layer5/layer5.h"
+
+#pragma mark - SPSC Ring Tests
+
+TEST_CASE("SPSC ring - creation", "[phy][ring]") {
+  err_logging_disable_guard_t guard;
+  SECTION("Power of 2 sizes are accepted") {
+    phy_ring_t *r = phy_ring_create(8);
+    REQUIRE(r != nullptr);
+    REQUIRE(r->mask == 7);
+    REQUIRE(phy_ring_empty(r) == true);
+    phy_ring_destroy(r);
+  }
+  SECTION("Other sizes are rejected") {
+    REQUIRE(phy_ring_create(0) == nullptr);
+    REQUIRE(phy_ring_create(1) == nullptr);
+    REQUIRE(phy_ring_create(6) == nullptr);
+  }
+}
+
+TEST_CASE("SPSC ring - produce and consume", "[phy][ring]") {
+  phy_ring_t *r = phy_ring_create(4);
+  REQUIRE(r != nullptr);
+  SECTION("Empty ring has nothing to consume") {
+    REQUIRE(phy_ring_consumer_slot(r) == nullptr);
+  }
+  SECTION("Ring fills up at its size") {
+    for (uint32_t i = 0; i < 4; i++) {
+      phy_ring_slot_t *slot = phy_ring_producer_slot(r);
+      REQUIRE(slot != nullptr);
+      slot->len = i;
+      phy_ring_produce(r);
+    }
+    REQUIRE(phy_ring_producer_slot(r) == nullptr);
+    // Freeing up a slot makes room for exactly one more
+    REQUIRE(phy_ring_consumer_slot(r)->len == 0);
+    phy_ring_consume(r);
+    REQUIRE(phy_ring_producer_slot(r) != nullptr);
+  }
+  SECTION("Slots come out in order across wraparound") {
+    uint32_t next_in = 0;
+    uint32_t next_out = 0;
+    for (uint32_t round = 0; round < 10; round++) {
+      for (uint32_t i = 0; i < 3; i++) {
+        phy_ring_slot_t *slot = phy_ring_producer_slot(r);
+        REQUIRE(slot != nullptr);
+        slot->len = next_in++;
+        phy_ring_produce(r);
+      }
+      phy_ring_slot_t *slot = nullptr;
+      while ((slot = phy_ring_consumer_slot(r)) != nullptr) {
+        REQUIRE(slot->len == next_out++);
+        phy_ring_consume(r);
+      }
+    }
+    REQUIRE(next_out == 30);
+    REQUIRE(phy_ring_empty(r) == true);
+  }
+  phy_ring_destroy(r);
+}
+
+TEST_CASE("SPSC ring - concurrent producer and consumer", "[phy][ring]") {
+  const uint32_t count = 200000;
+  phy_ring_t *r = phy_ring_create(64);
+  REQUIRE(r != nullptr);
+  std::thread producer([&] {
+    for (uint32_t i = 0; i < count; i++) {
+      phy_ring_slot_t *slot = nullptr;
+      while ((slot = phy_ring_producer_slot(r)) == nullptr) {
+        std::this_thread::yield();
+      }
+      slot->len = i;
+      memcpy(slot->data, &i, sizeof(i));
+      phy_ring_produce(r);
+    }
+  });
+  uint32_t received = 0;
+  bool in_order = true;
+  while (received < count) {
+    phy_ring_slot_t *slot = phy_ring_consumer_slot(r);
+    if (!slot) { continue; }
+    uint32_t payload = 0;
+    memcpy(&payload, slot->data, sizeof(payload));
+    in_order = in_order && slot->len == received && payload == received;
+    phy_ring_consume(r);
+    received++;
+  }
+  producer.join();
+  REQUIRE(in_order == true);
+  REQUIRE(phy_ring_empty(r) == true);
+  phy_ring_destroy(r);
+}
+
+#pragma mark - Phy Header Tests
+
+TEST_CASE("Phy header - encoding", "[phy][hdr]") {
+  uint8_t buf[PHY_HDR_MAX_LEN + 4] = {0};
+  phy_hdr_t hdr;
+  uint32_t node_id = 0;
+  uint64_t tstamp = 0;
+  SECTION("Plain header is four bytes") {
+    REQUIRE(phy_hdr_write(buf, 7, 0, 0, 0) == 4);
+    REQUIRE(phy_hdr_parse(buf, sizeof(buf), &hdr, &node_id, &tstamp) == 4);
+    REQUIRE(hdr.version == PHY_HDR_VERSION);
+    REQUIRE(hdr.ifindex == 7);
+    REQUIRE(hdr.flags == 0);
+  }
+  SECTION("Timestamp follows the header") {
+    REQUIRE(phy_hdr_write(buf, 3, PHY_HDR_F_TSTAMP, 0, 0x1122334455667788ull) == 12);
+    REQUIRE(phy_hdr_parse(buf, sizeof(buf), &hdr, &node_id, &tstamp) == 12);
+    REQUIRE(hdr.ifindex == 3);
+    REQUIRE(tstamp == 0x1122334455667788ull);
+  }
+  SECTION("Node id comes before the timestamp") {
+    REQUIRE(phy_hdr_write(buf, 2, PHY_HDR_F_NODE | PHY_HDR_F_TSTAMP, 20000, 42) == PHY_HDR_MAX_LEN);
+    REQUIRE(phy_hdr_parse(buf, sizeof(buf), &hdr, &node_id, &tstamp) == PHY_HDR_MAX_LEN);
+    REQUIRE(hdr.ifindex == 2);
+    REQUIRE(node_id == 20000);
+    REQUIRE(tstamp == 42);
+    REQUIRE(phy_hdr_write(buf, 2, PHY_HDR_F_NODE, 7, 0) == 8);
+    REQUIRE(phy_hdr_parse(buf, sizeof(buf), &hdr, &node_id, &tstamp) == 8);
+    REQUIRE(node_id == 7);
+    REQUIRE(tstamp == 0);
+  }
+  SECTION("Invalid headers are rejected") {
+    phy_hdr_write(buf, 3, PHY_HDR_F_TSTAMP, 0, 1);
+    REQUIRE(phy_hdr_parse(buf, sizeof(phy_hdr_t), &hdr, &node_id, &tstamp) == 0); // Truncated timestamp
+    buf[0] = PHY_HDR_VERSION + 1;
+    REQUIRE(phy_hdr_parse(buf, sizeof(buf), &hdr, &node_id, &tstamp) == 0);
+  }
+}
+
+TEST_CASE("Phy header - interfaces are found by index", "[phy][hdr]") {
+  graph_t *topo = graph_create_three_node_linear_topology();
+  node_t *R2 = graph_find_node_by_name(topo, "R2");
+  REQUIRE(R2 != nullptr);
+  for (uint16_t i = 0; i < CONFIG_MAX_INTF_PER_NODE; i++) {
+    interface_t *intf = node_get_interface_by_index(R2, i);
+    if (!intf) { continue; }
+    REQUIRE(intf->ifindex == i);
+    REQUIRE(node_get_interface_by_name(R2, intf->if_name) == intf);
+  }
+  REQUIRE(node_get_interface_by_name(R2, "eth0/2")->ifindex == 0);
+  REQUIRE(node_get_interface_by_name(R2, "eth0/3")->ifindex == 1);
+  REQUIRE(node_get_interface_by_index(R2, CONFIG_MAX_INTF_PER_NODE) == nullptr);
+}
+
+#pragma mark - Ring Transport Tests
+
+TEST_CASE("Ring transport - link setup and send", "[phy][ring][transport]") {
+  phy_set_default_transport(PHY_TRANSPORT_RING);
+  graph_t *topo = graph_create_two_node_linear_topology();
+  phy_set_default_transport(PHY_TRANSPORT_UDP);
+  REQUIRE(topo->phy.transport == PHY_TRANSPORT_RING);
+  node_t *H0 = graph_find_node_by_name(topo, "H0");
+  node_t *H1 = graph_find_node_by_name(topo, "H1");
+  interface_t *h0_intf = node_get_interface_by_name(H0, "eth0/1");
+  interface_t *h1_intf = node_get_interface_by_name(H1, "eth0/2");
+  SECTION("Nodes use a doorbell instead of a socket") {
+    REQUIRE(H0->phy.transport == PHY_TRANSPORT_RING);
+    REQUIRE(H0->phy.doorbell_fd > 0);
+    REQUIRE(H0->udp.fd == 0);
+    REQUIRE(h0_intf->udp.fd == 0);
+  }
+  SECTION("Each direction gets its own ring") {
+    REQUIRE(h0_intf->ring.tx != nullptr);
+    REQUIRE(h0_intf->ring.rx != nullptr);
+    REQUIRE(h0_intf->ring.tx != h0_intf->ring.rx);
+    REQUIRE(h0_intf->ring.tx == h1_intf->ring.rx);
+    REQUIRE(h0_intf->ring.rx == h1_intf->ring.tx);
+  }
+  SECTION("Sent frames land in the neighbor's rx ring") {
+    phy_set_frame_logging(false);
+    uint8_t frame[64];
+    for (uint32_t i = 0; i < sizeof(frame); i++) { frame[i] = i; }
+    pkt_buf_t pkt;
+    pkt_buf_init(&pkt, frame, sizeof(frame), 0);
+    pkt_buf_append(&pkt, sizeof(frame));
+    int resp = NODE_NETSTACK(H0).phy.send(H0, h0_intf, &pkt);
+    phy_set_frame_logging(true);
+    REQUIRE(resp == sizeof(frame));
+    phy_ring_slot_t *slot = phy_ring_consumer_slot(h1_intf->ring.rx);
+    REQUIRE(slot != nullptr);
+    REQUIRE(slot->len == sizeof(frame));
+    REQUIRE(memcmp(slot->data + CONFIG_PKT_BUF_HEADROOM, frame, sizeof(frame)) == 0);
+    REQUIRE(phy_ring_empty(h0_intf->ring.rx) == true);
+    // The idle receiver got woken up
+    REQUIRE(H1->phy.idle.load() == false);
+    uint64_t doorbell = 0;
+    REQUIRE(read(H1->phy.doorbell_fd, &doorbell, sizeof(doorbell)) == sizeof(doorbell));
+    REQUIRE(doorbell == 1);
+  }
+  SECTION("A full ring tail drops, without counting the frame as sent") {
+    phy_set_frame_logging(false);
+    uint8_t frame[64] = {0};
+    pkt_buf_t pkt;
+    pkt_buf_init(&pkt, frame, sizeof(frame), 0);
+    pkt_buf_append(&pkt, sizeof(frame));
+    uint32_t sent = 0;
+    while (layer2_node_send_frame(H0, h0_intf, &pkt) > 0) {
+      sent++;
+    }
+    phy_set_frame_logging(true);
+    REQUIRE(sent == CONFIG_PHY_RING_SIZE);
+    REQUIRE(h0_intf->stats.tx_frames.load() == sent);
+    REQUIRE(h0_intf->stats.tx_bytes.load() == sent * sizeof(frame));
+    REQUIRE(h0_intf->stats.tx_drops.load() == 1);
+    REQUIRE(H0->drops[DROP_PHY_RING_FULL].load() == 1);
+    REQUIRE(H0->drops[DROP_PHY_TX_FAILED].load() == 0);
+  }
+}
+
+#pragma mark - Shared Socket Transport Tests
+
+TEST_CASE("Shared socket transport - no per-node sockets", "[phy][shared][transport]") {
+  phy_set_default_transport(PHY_TRANSPORT_UDP_SHARED);
+  graph_t *topo = graph_create_two_node_linear_topology();
+  phy_set_default_transport(PHY_TRANSPORT_UDP);
+  REQUIRE(topo->phy.transport == PHY_TRANSPORT_UDP_SHARED);
+  REQUIRE(topo->phy.shared != nullptr);
+  node_t *H0 = graph_find_node_by_name(topo, "H0");
+  node_t *H1 = graph_find_node_by_name(topo, "H1");
+  REQUIRE(H0->phy.shared == topo->phy.shared);
+  REQUIRE(H0->udp.fd == 0);
+  REQUIRE(H1->udp.fd == 0);
+  REQUIRE(node_get_interface_by_name(H0, "eth0/1")->udp.fd == 0);
+  // Frames reach the right node through the shard's socket
+  std::atomic<uint32_t> received(0);
+  NODE_NETSTACK(H1).l5.promote = [&received](node_t *n, interface_t *intf, uint8_t *payload, uint32_t len, ipv4_addr_t *addr, uint32_t prot) {
+    received++;
+  };
+  REQUIRE(phy_receiver_set_thread_count(topo, 2) == true);
+  for (uint32_t shard = 0; shard < 2; shard++) {
+    std::thread([topo, shard] { phy_receiver_thread_main(topo, shard); }).detach();
+  }
+  while (!phy_receiver_threads_ready(topo)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  phy_set_frame_logging(false);
+  ipv4_addr_t addr = INTF_IP(node_get_interface_by_name(H1, "eth0/2"));
+  {
+    node_lock_guard_t guard(H0);
+    layer5_perform_ping(H0, &addr, nullptr);
+  }
+  for (uint32_t i = 0; i < 2000 && received.load() == 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  phy_set_frame_logging(true);
+  REQUIRE(received.load() == 1);
+  // The reply to the ARP request made it back (through the other shard)
+  REQUIRE(H0->phy.id % 2 != H1->phy.id % 2);
+}
+
+#pragma mark - Receiver Tests
+
+// Pings `dst`'s first address from `src`, returns whether it made it there
+static bool phy_test_ping(node_t *src, node_t *dst) {
+  // Shared, the callback stays installed after we're done waiting
+  auto received = std::make_shared<std::atomic<uint32_t>>(0);
+  NODE_NETSTACK(dst).l5.promote = [received](node_t *n, interface_t *intf, uint8_t *payload, uint32_t len, ipv4_addr_t *addr, uint32_t prot) {
+    (*received)++;
+  };
+  ipv4_addr_t addr = INTF_IP(node_get_interface_by_index(dst, 0));
+  phy_set_frame_logging(false);
+  {
+    node_lock_guard_t guard(src);
+    layer5_perform_ping(src, &addr, nullptr);
+  }
+  for (uint32_t i = 0; i < 5000 && received->load() == 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  phy_set_frame_logging(true);
+  return received->load() == 1;
+}
+
+TEST_CASE("Receivers - nodes added while they start up get registered", "[phy][receiver]") {
+  graph_t *topo = graph_init("Late nodes topology");
+  const uint32_t pairs = 64;
+  std::vector<std::pair<node_t *, node_t *>> nodes;
+  auto add_pair = [&](uint32_t i) {
+    char name0[CONFIG_NODE_NAME_SIZE], name1[CONFIG_NODE_NAME_SIZE], addr0[16], addr1[16];
+    snprintf(name0, sizeof(name0), "A%u", i);
+    snprintf(name1, sizeof(name1), "B%u", i);
+    snprintf(addr0, sizeof(addr0), "10.%u.0.1", i);
+    snprintf(addr1, sizeof(addr1), "10.%u.0.2", i);
+    node_t *n0 = graph_add_node(topo, name0);
+    node_t *n1 = graph_add_node(topo, name1);
+    link_nodes(n0, n1, "eth0/0", "eth0/0", 1);
+    node_interface_set_mode(n0, "eth0/0", INTF_MODE_L3);
+    node_interface_set_mode(n1, "eth0/0", INTF_MODE_L3);
+    node_interface_set_ipv4_address(n0, "eth0/0", addr0, 24);
+    node_interface_set_ipv4_address(n1, "eth0/0", addr1, 24);
+    nodes.push_back({n0, n1});
+  };
+  add_pair(0);
+  REQUIRE(phy_receiver_set_thread_count(topo, 2) == true);
+  for (uint32_t shard = 0; shard < 2; shard++) {
+    std::thread([topo, shard] { phy_receiver_thread_main(topo, shard); }).detach();
+  }
+  // Race the receivers walking the node list
+  for (uint32_t i = 1; i < pairs; i++) {
+    add_pair(i);
+  }
+  while (!phy_receiver_threads_ready(topo)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  // And keep adding once they're running
+  for (uint32_t i = pairs; i < 2 * pairs; i++) {
+    add_pair(i);
+  }
+  REQUIRE(graph_find_node_by_name(topo, "B127") == nodes.back().second);
+  for (auto [n0, n1] : nodes) {
+    REQUIRE(phy_test_ping(n0, n1) == true);
+  }
+}
+
+TEST_CASE("Receivers - large topologies", "[phy][receiver]") {
+  graph_t *topo = graph_create_switch_tree_topology(4, 4); // 341 switches, 1024 hosts
+  REQUIRE(topo != nullptr);
+  REQUIRE(topo->phy.node_count == 1365);
+  REQUIRE(phy_receiver_set_thread_count(topo, 4) == true);
+  for (uint32_t shard = 0; shard < 4; shard++) {
+    std::thread([topo, shard] { phy_receiver_thread_main(topo, shard); }).detach();
+  }
+  while (!phy_receiver_threads_ready(topo)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  // Across the whole tree, and between neighbors
+  node_t *H0 = graph_find_node_by_name(topo, "H0");
+  REQUIRE(phy_test_ping(H0, graph_find_node_by_name(topo, "H1023")) == true);
+  REQUIRE(phy_test_ping(graph_find_node_by_name(topo, "H512"), graph_find_node_by_name(topo, "H513")) == true);
+}
+
+#pragma mark - Tx Batching Tests
+
+TEST_CASE("Tx batching - frames that fail to send are counted as drops", "[phy][batch]") {
+  graph_t *topo = graph_create_two_node_linear_topology();
+  node_t *H0 = graph_find_node_by_name(topo, "H0");
+  interface_t *intf = node_get_interface_by_name(H0, "eth0/1");
+  uint8_t frame[64] = {0};
+  pkt_buf_t pkt;
+  pkt_buf_init(&pkt, frame, sizeof(frame), 0);
+  pkt_buf_append(&pkt, sizeof(frame));
+  // Not a socket, so sendmmsg() fails
+  int fd = intf->udp.fd;
+  intf->udp.fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+  REQUIRE(intf->udp.fd > 0);
+  phy_set_frame_logging(false);
+  SECTION("Flushed at the end of a burst") {
+    // Under the node lock, the way receivers flush
+    node_lock_guard_t guard(H0);
+    phy_tx_batch_begin();
+    REQUIRE(layer2_node_send_frame(H0, intf, &pkt) == sizeof(frame));
+    REQUIRE(layer2_node_send_frame(H0, intf, &pkt) == sizeof(frame));
+    REQUIRE(intf->stats.tx_frames.load() == 2); // Queued
+    err_logging_disable_guard_t err_guard;
+    phy_tx_batch_flush();
+    REQUIRE(intf->stats.tx_frames.load() == 0);
+    REQUIRE(intf->stats.tx_bytes.load() == 0);
+    REQUIRE(intf->stats.tx_drops.load() == 2);
+    REQUIRE(H0->drops[DROP_PHY_TX_FAILED].load() == 2);
+  }
+  SECTION("Flushed when the batch fills up") {
+    node_lock_guard_t guard(H0);
+    err_logging_disable_guard_t err_guard;
+    phy_tx_batch_begin();
+    for (uint32_t i = 0; i <= CONFIG_PHY_TX_BATCH_SIZE; i++) {
+      REQUIRE(layer2_node_send_frame(H0, intf, &pkt) == sizeof(frame));
+    }
+    REQUIRE(intf->stats.tx_frames.load() == 1); // Only the last one is still queued
+    REQUIRE(intf->stats.tx_drops.load() == CONFIG_PHY_TX_BATCH_SIZE);
+    phy_tx_batch_flush();
+    REQUIRE(intf->stats.tx_frames.load() == 0);
+    REQUIRE(intf->stats.tx_drops.load() == CONFIG_PHY_TX_BATCH_SIZE + 1);
+  }
+  phy_set_frame_logging(true);
+  close(intf->udp.fd);
+  intf->udp.fd = fd;
+}
+
+TEST_CASE("Tx batching - receivers survive failed sends", "[phy][batch]") {
+  graph_t *topo = graph_create_two_node_linear_topology();
+  node_t *H0 = graph_find_node_by_name(topo, "H0");
+  node_t *H1 = graph_find_node_by_name(topo, "H1");
+  // H1 answers H0's ARP request from its receiver, over a socket that isn't one
+  interface_t *intf = node_get_interface_by_name(H1, "eth0/2");
+  intf->udp.fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+  REQUIRE(intf->udp.fd > 0);
+  std::thread([topo] { phy_receiver_thread_main(topo, 0); }).detach();
+  while (!phy_receiver_threads_ready(topo)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  phy_set_frame_logging(false);
+  ipv4_addr_t addr = INTF_IP(intf);
+  {
+    err_logging_disable_guard_t guard;
+    {
+      node_lock_guard_t node_guard(H0);
+      layer5_perform_ping(H0, &addr, nullptr);
+    }
+    for (uint32_t i = 0; i < 2000 && H1->drops[DROP_PHY_TX_FAILED].load() == 0; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  phy_set_frame_logging(true);
+  REQUIRE(H1->drops[DROP_PHY_TX_FAILED].load() == 1);
+  // The receiver let go of H1's lock (rather than deadlocking on it)
+  bool unlocked = false;
+  for (uint32_t i = 0; i < 2000 && !unlocked; i++) {
+    unlocked = pthread_mutex_trylock(&H1->phy.lock) == 0;
+    if (!unlocked) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+  }
+  REQUIRE(unlocked == true);
+  REQUIRE(intf->stats.tx_drops.load() == 1);
+  REQUIRE(intf->stats.tx_frames.load() == 0);
+  node_unlock(H1);
+}
+
+#pragma mark - Poll Mode Tests
+
+TEST_CASE("Poll modes - adaptive receivers spin, then block", "[phy][poll]") {
+  REQUIRE(phy_get_poll_mode() == PHY_POLL_BLOCK);
+  REQUIRE(strcmp(phy_poll_mode_str(PHY_POLL_ADAPTIVE), "adaptive") == 0);
+  graph_t *topo = graph_create_two_node_linear_topology();
+  node_t *H0 = graph_find_node_by_name(topo, "H0");
+  node_t *H1 = graph_find_node_by_name(topo, "H1");
+  std::atomic<uint32_t> received(0);
+  NODE_NETSTACK(H1).l5.promote = [&received](node_t *n, interface_t *intf, uint8_t *payload, uint32_t len, ipv4_addr_t *addr, uint32_t prot) {
+    received++;
+  };
+  phy_set_poll_mode(PHY_POLL_ADAPTIVE, 50);
+  phy_stats_reset();
+  std::thread([topo] { phy_receiver_thread_main(topo, 0); }).detach();
+  while (!phy_receiver_threads_ready(topo)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  phy_set_frame_logging(false);
+  ipv4_addr_t addr = INTF_IP(node_get_interface_by_name(H1, "eth0/2"));
+  {
+    node_lock_guard_t guard(H0);
+    layer5_perform_ping(H0, &addr, nullptr);
+  }
+  for (uint32_t i = 0; i < 2000 && received.load() == 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  phy_set_frame_logging(true);
+  phy_set_poll_mode(PHY_POLL_BLOCK);
+  REQUIRE(received.load() == 1);
+  phy_stats_t stats;
+  phy_stats_get(&stats);
+  REQUIRE(stats.poll_spins >= 50); // Spent its budget at least once...
+  REQUIRE(stats.poll_sleeps >= 1); // ...and went to sleep
+}
+
+#pragma mark - Latency Tests
+
+TEST_CASE("Kernel timestamps - per-interface latency histograms", "[phy][latency]") {
+  phy_set_kernel_timestamps(true);
+  graph_t *topo = graph_create_two_node_linear_topology(); // Sockets get SO_TIMESTAMPNS
+  phy_set_kernel_timestamps(false);
+  node_t *H0 = graph_find_node_by_name(topo, "H0");
+  node_t *H1 = graph_find_node_by_name(topo, "H1");
+  interface_t *intf = node_get_interface_by_name(H1, "eth0/2");
+  REQUIRE(intf->latency == nullptr);
+  std::atomic<uint32_t> received(0);
+  NODE_NETSTACK(H1).l5.promote = [&received](node_t *n, interface_t *intf, uint8_t *payload, uint32_t len, ipv4_addr_t *addr, uint32_t prot) {
+    received++;
+  };
+  phy_set_kernel_timestamps(true); // Receivers ask for them
+  std::thread([topo] { phy_receiver_thread_main(topo, 0); }).detach();
+  while (!phy_receiver_threads_ready(topo)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  phy_set_frame_logging(false);
+  ipv4_addr_t addr = INTF_IP(intf);
+  {
+    node_lock_guard_t guard(H0);
+    layer5_perform_ping(H0, &addr, nullptr);
+  }
+  for (uint32_t i = 0; i < 2000 && received.load() == 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  phy_set_frame_logging(true);
+  phy_set_kernel_timestamps(false);
+  REQUIRE(received.load() == 1);
+  node_lock_guard_t guard(H1);
+  REQUIRE(intf->latency != nullptr);
+  REQUIRE(hist_count(&intf->latency->kernel) == 2); // ARP request and ping
+  REQUIRE(hist_count(&intf->latency->stack) == 1);  // ARP reply
+  phy_intf_latency_reset(intf);
+  REQUIRE(hist_count(&intf->latency->kernel) == 0);
+}
+
+#pragma mark - io_uring Tests
+
+TEST_CASE("io_uring - multishot recv into provided buffers", "[phy][uring]") {
+  if (!phy_uring_supported()) {
+    WARN("io_uring (multishot recv) not supported, skipping");
+    return;
+  }
+  phy_uring_t u;
+  REQUIRE(phy_uring_init(&u, 16, 64) == true);
+  phy_uring_buf_ring_t r;
+  REQUIRE(phy_uring_setup_buf_ring(&u, &r, 0, 4, CONFIG_MAX_PACKET_BUFFER_SIZE, CONFIG_PKT_BUF_HEADROOM) == true);
+  // Receiving socket
+  uint32_t port = 0;
+  int fd = 0;
+  REQUIRE(phy_setup_udp_socket(&port, &fd) == true);
+  int send_fd = 0;
+  REQUIRE(phy_setup_udp_send_socket(port, &send_fd) == true);
+  // Arm a single multishot recv
+  struct io_uring_sqe *sqe = phy_uring_get_sqe(&u);
+  REQUIRE(sqe != nullptr);
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = r.bgid;
+  sqe->user_data = 42;
+  REQUIRE(phy_uring_submit_and_wait(&u, 0) == 1);
+  // More datagrams than there are buffers (recycling as we go)
+  for (uint32_t i = 0; i < 10; i++) {
+    REQUIRE(send(send_fd, &i, sizeof(i), 0) == sizeof(i));
+    REQUIRE(phy_uring_submit_and_wait(&u, 1) >= 0);
+    struct io_uring_cqe *cqe = phy_uring_peek_cqe(&u);
+    REQUIRE(cqe != nullptr);
+    REQUIRE(cqe->user_data == 42);
+    REQUIRE(cqe->res == sizeof(i));
+    REQUIRE((cqe->flags & IORING_CQE_F_BUFFER) != 0);
+    REQUIRE((cqe->flags & IORING_CQE_F_MORE) != 0); // Still armed
+    uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    uint32_t payload = 0;
+    memcpy(&payload, phy_uring_buf_ring_buffer(&r, bid) + CONFIG_PKT_BUF_HEADROOM, sizeof(payload)); // Lands past the headroom
+    REQUIRE(payload == i);
+    phy_uring_buf_ring_recycle(&r, bid);
+    phy_uring_cqe_seen(&u);
+  }
+  close(send_fd);
+  close(fd);
+  phy_uring_exit(&u);
+}
+
+#pragma mark - Simulator Tests
+
+// Pings H0 -> H1 over a simulated two node topology, and runs it to completion
+static uint64_t sim_ping_run(graph_t *topo, uint32_t *received) {
+  node_t *H0 = graph_find_node_by_name(topo, "H0");
+  node_t *H1 = graph_find_node_by_name(topo, "H1");
+  NODE_NETSTACK(H1).l5.promote = [received](node_t *n, interface_t *intf, uint8_t *payload, uint32_t len, ipv4_addr_t *addr, uint32_t prot) {
+    (*received)++;
+  };
+  ipv4_addr_t addr = INTF_IP(node_get_interface_by_name(H1, "eth0/2"));
+  {
+    node_lock_guard_t guard(H0);
+    layer5_perform_ping(H0, &addr, nullptr);
+  }
+  return phy_sim_run(topo->phy.sim);
+}
+
+TEST_CASE("Simulator transport - virtual time delivery", "[phy][sim][transport]") {
+  phy_set_default_transport(PHY_TRANSPORT_SIM);
+  graph_t *topo = graph_create_two_node_linear_topology();
+  phy_set_default_transport(PHY_TRANSPORT_UDP);
+  REQUIRE(topo->phy.transport == PHY_TRANSPORT_SIM);
+  REQUIRE(topo->phy.sim != nullptr);
+  node_t *H0 = graph_find_node_by_name(topo, "H0");
+  phy_set_frame_logging(false);
+  SECTION("Nodes use neither sockets nor rings") {
+    REQUIRE(H0->phy.transport == PHY_TRANSPORT_SIM);
+    REQUIRE(H0->phy.sim == topo->phy.sim);
+    REQUIRE(H0->udp.fd == 0);
+    REQUIRE(node_get_interface_by_name(H0, "eth0/1")->ring.tx == nullptr);
+  }
+  SECTION("Frames are delivered once the link latency has elapsed") {
+    uint32_t received = 0;
+    uint64_t events = sim_ping_run(topo, &received);
+    REQUIRE(received == 1);
+    // ARP request, ARP reply, ICMP, each a hop over a link of cost 1
+    REQUIRE(events >= 3);
+    REQUIRE(phy_sim_now(topo->phy.sim) == events * CONFIG_PHY_SIM_NS_PER_COST);
+    REQUIRE(phy_sim_pending(topo->phy.sim) == 0);
+  }
+  SECTION("Runs stop at the given time") {
+    uint32_t received = 0;
+    node_t *H1 = graph_find_node_by_name(topo, "H1");
+    NODE_NETSTACK(H1).l5.promote = [&received](node_t *n, interface_t *intf, uint8_t *payload, uint32_t len, ipv4_addr_t *addr, uint32_t prot) {
+      received++;
+    };
+    ipv4_addr_t addr = INTF_IP(node_get_interface_by_name(H1, "eth0/2"));
+    {
+      node_lock_guard_t guard(H0);
+      layer5_perform_ping(H0, &addr, nullptr);
+    }
+    // Only the ARP request is due by then
+    REQUIRE(phy_sim_run(topo->phy.sim, CONFIG_PHY_SIM_NS_PER_COST + CONFIG_PHY_SIM_NS_PER_COST / 2) == 1);
+    REQUIRE(phy_sim_now(topo->phy.sim) == CONFIG_PHY_SIM_NS_PER_COST + CONFIG_PHY_SIM_NS_PER_COST / 2);
+    REQUIRE(phy_sim_pending(topo->phy.sim) == 1);
+    REQUIRE(received == 0);
+    phy_sim_run(topo->phy.sim);
+    REQUIRE(received == 1);
+    REQUIRE(phy_node_clock_ns(H0) == phy_sim_now(topo->phy.sim));
+  }
+  phy_set_frame_logging(true);
+}
+
+TEST_CASE("Simulator transport - runs are deterministic", "[phy][sim][transport]") {
+  phy_set_frame_logging(false);
+  uint64_t events[2] = {0};
+  uint64_t clock[2] = {0};
+  uint32_t received[2] = {0};
+  for (uint32_t i = 0; i < 2; i++) {
+    phy_set_default_transport(PHY_TRANSPORT_SIM);
+    graph_t *topo = graph_create_two_node_linear_topology();
+    phy_set_default_transport(PHY_TRANSPORT_UDP);
+    REQUIRE(topo != nullptr);
+    events[i] = sim_ping_run(topo, &received[i]);
+    clock[i] = phy_sim_now(topo->phy.sim);
+  }
+  phy_set_frame_logging(true);
+  REQUIRE(received[0] == 1);
+  REQUIRE(received[1] == 1);
+  REQUIRE(events[0] == events[1]);
+  REQUIRE(clock[0] == clock[1]);
+}
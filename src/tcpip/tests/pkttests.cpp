@@ -0,0 +1,190 @@
+// pkttests.cpp
+
+#include <thread>
+#include <vector>
+#include "catch2.hpp"
+#include "pkt_buf.h"
+#include "pkt_pool.h"
+
+#pragma mark - Packet Buffer Pool Tests
+
+TEST_CASE("Packet buffer pool - allocation", "[pkt][pool]") {
+  pkt_pool_t *pool = pkt_pool_create(8, 2, 256, 16);
+  REQUIRE(pool != nullptr);
+  SECTION("Buffers come out empty, with the requested headroom") {
+    pkt_buf_t *pkt = pkt_pool_alloc(pool, 32);
+    REQUIRE(pkt != nullptr);
+    REQUIRE(pkt->pool == pool);
+    REQUIRE(pkt->data_len == 0);
+    REQUIRE(pkt_buf_headroom(pkt) == 32);
+    REQUIRE(pkt_buf_tailroom(pkt) == 224);
+    REQUIRE(pkt_buf_priv(pkt) != nullptr);
+    REQUIRE((uint8_t *)pkt_buf_priv(pkt) + 16 <= pkt->buf); // Private area doesn't overlap the buffer
+    pkt_buf_destroy(pkt);
+  }
+  SECTION("The pool runs out at its size") {
+    err_logging_disable_guard_t guard;
+    std::vector<pkt_buf_t *> pkts;
+    for (uint32_t i = 0; i < 8; i++) {
+      pkt_buf_t *pkt = pkt_pool_alloc(pool);
+      REQUIRE(pkt != nullptr);
+      pkts.push_back(pkt);
+    }
+    REQUIRE(pkt_pool_alloc(pool) == nullptr);
+    pkt_pool_stats_t stats;
+    pkt_pool_stats_get(pool, &stats);
+    REQUIRE(stats.in_use == 8);
+    REQUIRE(stats.available == 0);
+    REQUIRE(stats.alloc_failures == 1);
+    // Freed buffers are reused
+    pkt_buf_destroy(pkts.back());
+    pkts.pop_back();
+    pkt_buf_t *pkt = pkt_pool_alloc(pool);
+    REQUIRE(pkt != nullptr);
+    pkts.push_back(pkt);
+    for (pkt_buf_t *p : pkts) { pkt_buf_destroy(p); }
+    pkt_pool_cache_flush(pool);
+    pkt_pool_stats_get(pool, &stats);
+    REQUIRE(stats.in_use == 0);
+    REQUIRE(stats.available == 8);
+  }
+  SECTION("Allocations are served by the thread's cache") {
+    for (uint32_t i = 0; i < 10; i++) {
+      pkt_buf_t *pkt = pkt_pool_alloc(pool);
+      REQUIRE(pkt != nullptr);
+      pkt_buf_destroy(pkt);
+    }
+    pkt_pool_cache_flush(pool);
+    pkt_pool_stats_t stats;
+    pkt_pool_stats_get(pool, &stats);
+    REQUIRE(stats.cache_misses == 1); // Only the very first one
+    REQUIRE(stats.cache_hits == 9);
+  }
+  pkt_pool_cache_flush(pool);
+  pkt_pool_destroy(pool);
+}
+
+TEST_CASE("Packet buffer pool - concurrent alloc and free", "[pkt][pool]") {
+  const uint32_t threads = 4;
+  const uint32_t iterations = 20000;
+  pkt_pool_t *pool = pkt_pool_create(128, 8, 64, 0); // Room for every thread's cache
+  REQUIRE(pool != nullptr);
+  std::atomic<uint32_t> failures(0);
+  std::vector<std::thread> workers;
+  for (uint32_t t = 0; t < threads; t++) {
+    workers.emplace_back([&, t] {
+      pkt_buf_t *held[4];
+      for (uint32_t i = 0; i < iterations; i++) {
+        uint32_t count = 1 + (i + t) % 4;
+        for (uint32_t j = 0; j < count; j++) {
+          held[j] = pkt_pool_alloc(pool, 0);
+          if (!held[j]) { failures++; count = j; break; }
+          // Scribble, so that a buffer handed out twice gets noticed
+          *pkt_buf_append(held[j], 1) = (uint8_t)t;
+        }
+        for (uint32_t j = 0; j < count; j++) {
+          if (*PKT_BUF_MTOD(held[j], uint8_t *) != (uint8_t)t) { failures++; }
+          pkt_buf_destroy(held[j]);
+        }
+      }
+      // Thread exit hands the cache back to the pool
+    });
+  }
+  for (auto &w : workers) { w.join(); }
+  REQUIRE(failures.load() == 0);
+  pkt_pool_stats_t stats;
+  pkt_pool_stats_get(pool, &stats);
+  REQUIRE(stats.available == 128);
+  REQUIRE(stats.in_use == 0);
+  pkt_pool_destroy(pool);
+}
+
+#pragma mark - Packet Buffer Clone Tests
+
+TEST_CASE("Packet buffer clones", "[pkt][clone]") {
+  pkt_pool_t *pool = pkt_pool_create(8, 0, 256, 0);
+  pkt_pool_t *indirect_pool = pkt_pool_create(8, 0, 0, 0);
+  REQUIRE(pool != nullptr);
+  REQUIRE(indirect_pool != nullptr);
+  pkt_buf_t *m = pkt_pool_alloc(pool, 32);
+  REQUIRE(m != nullptr);
+  memcpy(pkt_buf_append(m, 21), "Original packet data", 21);
+  REQUIRE(pkt_buf_refcnt_read(m) == 1);
+  REQUIRE(pkt_buf_writable(m) == true);
+  pkt_pool_stats_t stats;
+  SECTION("Clones share the data, but not the offsets") {
+    pkt_buf_t *c0 = pkt_buf_clone(m, indirect_pool);
+    pkt_buf_t *c1 = pkt_buf_clone(c0, indirect_pool); // Clone of a clone references the original
+    REQUIRE(c0 != nullptr);
+    REQUIRE(c1 != nullptr);
+    REQUIRE(c0->direct == m);
+    REQUIRE(c1->direct == m);
+    REQUIRE(pkt_buf_refcnt_read(m) == 3);
+    REQUIRE(pkt_buf_writable(m) == false);
+    REQUIRE(pkt_buf_writable(c0) == false);
+    REQUIRE(PKT_BUF_MTOD(c0, uint8_t *) == PKT_BUF_MTOD(m, uint8_t *));
+    pkt_buf_adj(c0, 9);
+    REQUIRE(strcmp(PKT_BUF_MTOD(c0, char *), "packet data") == 0);
+    REQUIRE(strcmp(PKT_BUF_MTOD(m, char *), "Original packet data") == 0);
+    REQUIRE(strcmp(PKT_BUF_MTOD(c1, char *), "Original packet data") == 0);
+    SECTION("Dropping the clones first") {
+      pkt_buf_destroy(c0);
+      pkt_buf_destroy(c1);
+      REQUIRE(pkt_buf_refcnt_read(m) == 1);
+      pkt_buf_destroy(m);
+    }
+    SECTION("Dropping the original first") {
+      pkt_buf_destroy(m);
+      pkt_buf_destroy(c0);
+      // Last clone keeps the data alive
+      pkt_pool_stats_get(pool, &stats);
+      REQUIRE(stats.in_use == 1);
+      REQUIRE(strcmp(PKT_BUF_MTOD(c1, char *), "Original packet data") == 0);
+      pkt_buf_destroy(c1);
+    }
+    pkt_pool_stats_get(pool, &stats);
+    REQUIRE(stats.in_use == 0);
+    pkt_pool_stats_get(indirect_pool, &stats);
+    REQUIRE(stats.in_use == 0);
+    // Descriptors come back pointing at their own (empty) storage
+    pkt_buf_t *reused = pkt_pool_alloc(indirect_pool, 0);
+    REQUIRE(reused != nullptr);
+    REQUIRE(reused->direct == nullptr);
+    REQUIRE(reused->buf_len == 0);
+    pkt_buf_destroy(reused);
+  }
+  SECTION("Chains are gathered and freed as a whole") {
+    uint8_t hdr_storage[4];
+    pkt_buf_t hdr;
+    pkt_buf_init(&hdr, hdr_storage, sizeof(hdr_storage), 0);
+    memcpy(pkt_buf_append(&hdr, 4), "HDR:", 4);
+    pkt_buf_t payload = {};
+    REQUIRE(pkt_buf_attach(&payload, m) == true);
+    hdr.next = &payload;
+    REQUIRE(pkt_buf_pkt_len(&hdr) == 25);
+    uint8_t out[32];
+    REQUIRE(pkt_buf_copy_data(&hdr, out, sizeof(out)) == 25);
+    REQUIRE(strcmp((char *)out, "HDR:Original packet data") == 0);
+    {
+      err_logging_disable_guard_t guard;
+      REQUIRE(pkt_buf_copy_data(&hdr, out, 24) == 0);
+    }
+    // Clone the whole chain, then drop every reference to the original
+    pkt_buf_t *clone = pkt_buf_clone(&hdr, indirect_pool);
+    REQUIRE(clone != nullptr);
+    REQUIRE(clone->next != nullptr);
+    REQUIRE(pkt_buf_pkt_len(clone) == 25);
+    pkt_buf_detach(&payload);
+    pkt_buf_destroy(m);
+    memset(out, 0, sizeof(out));
+    REQUIRE(pkt_buf_copy_data(clone, out, sizeof(out)) == 25);
+    REQUIRE(strcmp((char *)out, "HDR:Original packet data") == 0);
+    pkt_buf_destroy(clone);
+    pkt_pool_stats_get(pool, &stats);
+    REQUIRE(stats.in_use == 0);
+    pkt_pool_stats_get(indirect_pool, &stats);
+    REQUIRE(stats.in_use == 0);
+  }
+  pkt_pool_destroy(indirect_pool);
+  pkt_pool_destroy(pool);
+}
@@ -0,0 +1,95 @@
+// simbench.cpp
+
+#include <chrono>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include "graph.h"
+#include "topo.h"
+#include "phy.h"
+#include "phy_sim.h"
+#include "layer5/layer5.h"
+#include "utils.h"
+
+#define BENCH_DEFAULT_PINGS 200
+
+#pragma mark -
+
+// Helpers
+
+static uint64_t __pings_received = 0;
+
+// Collects hosts, and silences them (pings print otherwise)
+static std::vector<node_t *> topo_prepare_hosts(graph_t *topo) {
+  std::vector<node_t *> hosts;
+  glthread_t *curr = nullptr;
+  GLTHREAD_FOREACH_BEGIN(&topo->node_list, curr) {
+    node_t *n = node_ptr_from_graph_glue(curr);
+    if (n->node_name[0] != 'H') { continue; }
+    NODE_NETSTACK(n).l5.promote = [](node_t *n, interface_t *intf, uint8_t *payload, uint32_t len, ipv4_addr_t *addr, uint32_t prot) {
+      __pings_received++;
+    };
+    hosts.push_back(n);
+  }
+  GLTHREAD_FOREACH_END();
+  return hosts;
+}
+
+/*
+ * Pings between `pings` (pseudo random, but fixed) pairs of hosts of a switch
+ * tree, running the simulation to completion after each one. Every ping to a
+ * new destination starts with an ARP broadcast that floods the whole tree,
+ * so the event count grows with the topology.
+ */
+static void bench_switch_tree(uint32_t fanout, uint32_t depth, uint32_t pings) {
+  auto build_start = std::chrono::steady_clock::now();
+  phy_set_default_transport(PHY_TRANSPORT_SIM);
+  graph_t *topo = graph_create_switch_tree_topology(fanout, depth);
+  phy_set_default_transport(PHY_TRANSPORT_UDP);
+  EXPECT_FATAL(topo != nullptr, "graph_create_switch_tree_topology failed");
+  auto build_end = std::chrono::steady_clock::now();
+  std::vector<node_t *> hosts = topo_prepare_hosts(topo);
+  EXPECT_FATAL(hosts.size() > 1, "Not enough hosts");
+  __pings_received = 0;
+  phy_sim_stats_reset();
+  uint64_t events = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < pings; i++) {
+    node_t *src = hosts[((uint64_t)i * 7919) % hosts.size()];
+    node_t *dst = hosts[((uint64_t)i * 104729 + 1) % hosts.size()];
+    if (src == dst) { dst = hosts[(((uint64_t)i * 104729) + 2) % hosts.size()]; }
+    ipv4_addr_t addr = INTF_IP(node_get_interface_by_name(dst, "eth0/0"));
+    {
+      node_lock_guard_t guard(src);
+      layer5_perform_ping(src, &addr, nullptr);
+    }
+    events += phy_sim_run(topo->phy.sim);
+  }
+  auto end = std::chrono::steady_clock::now();
+  double build_secs = std::chrono::duration<double>(build_end - build_start).count();
+  double secs = std::chrono::duration<double>(end - start).count();
+  phy_sim_stats_t stats;
+  phy_sim_stats_get(&stats);
+  printf("  fanout %u, depth %u: %6u nodes (built in %.2fs)\n", fanout, depth, topo->phy.node_count, build_secs);
+  printf("    %10lu events in %8.3fs : %12.0f events/s\n", events, secs, events / secs);
+  printf("    %10.3f ms simulated\n", phy_sim_now(topo->phy.sim) / 1e6);
+  printf("    %10lu/%u pings received (%lu frames dropped)\n", __pings_received, pings, stats.drops);
+}
+
+#pragma mark -
+
+int main(int argc, const char **argv) {
+  uint32_t pings = argc > 1 ? (uint32_t)strtoul(argv[1], nullptr, 10) : BENCH_DEFAULT_PINGS;
+  EXPECT_FATAL(pings > 0, "Invalid ping count");
+  phy_set_frame_logging(false);
+  printf("Running %u pings per topology (PHY_TRANSPORT_SIM, %u ns per unit of link cost)\n", pings, CONFIG_PHY_SIM_NS_PER_COST);
+  // Optionally, a single topology (fanout, depth)
+  if (argc > 3) {
+    bench_switch_tree((uint32_t)strtoul(argv[2], nullptr, 10), (uint32_t)strtoul(argv[3], nullptr, 10), pings);
+    return 0;
+  }
+  bench_switch_tree(4, 3, pings);   //   341 nodes
+  bench_switch_tree(4, 5, pings);   //  5461 nodes
+  bench_switch_tree(4, 6, pings);   // 21845 nodes
+  return 0;
+}
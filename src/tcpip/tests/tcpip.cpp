@@ -2,30 +2,51 @@
 
 #include <thread>
 #include <chrono>
+#include <vector>
+#include <algorithm>
 #include <iostream>
 #include <string.h>
 #include "cli.h"
 #include "topo.h"
 #include "phy.h"
+#include "utils.h"
 
 int main(int argc, const char **argv) {
   setvbuf(stdout, NULL, _IOLBF, 0); // Disable buffering (for now, remove TODO)
+  // Transport (udp, ring, uring, sim or udp-shared)
+  for (phy_transport_t t : {PHY_TRANSPORT_UDP, PHY_TRANSPORT_RING, PHY_TRANSPORT_URING, PHY_TRANSPORT_SIM, PHY_TRANSPORT_UDP_SHARED}) {
+    if (argc > 3 && strcmp(argv[3], phy_transport_str(t)) == 0) {
+      phy_set_default_transport(t);
+    }
+  }
   graph_t *topo = graph_create_dual_switch_topology();
   // Setup CLI
   cli_init();
   // Create graph
   cli_set_topology(topo);
-  printf("Starting...\n");
-  // Start receiver thread
-  std::jthread receiver_thread([&] {
-    phy_receiver_thread_main(topo);
-  });
+  // Number of receiver threads (defaults to one per core)
+  uint32_t thread_count = argc > 1 ? (uint32_t)strtoul(argv[1], nullptr, 10) : std::thread::hardware_concurrency();
+  thread_count = std::clamp<uint32_t>(thread_count, 1, CONFIG_MAX_PHY_RECEIVER_THREADS);
+  bool resp = phy_receiver_set_thread_count(topo, thread_count);
+  EXPECT_FATAL(resp == true, "phy_receiver_set_thread_count failed");
+  // Receive burst size (frames per recvmmsg)
+  if (argc > 2) {
+    resp = phy_set_burst_size((uint32_t)strtoul(argv[2], nullptr, 10));
+    EXPECT_FATAL(resp == true, "phy_set_burst_size failed");
+  }
+  printf("Starting %u receiver thread(s) (transport: %s)...\n", thread_count, phy_transport_str(topo->phy.transport));
+  // Start receiver threads
+  std::vector<std::jthread> receiver_threads;
+  for (uint32_t shard = 0; shard < thread_count; shard++) {
+    receiver_threads.emplace_back([topo, shard] {
+      phy_receiver_thread_main(topo, shard);
+    });
+  }
   printf("Waiting...\n");
-  while (!phy_receiver_thread_ready()) {
+  while (!phy_receiver_threads_ready(topo)) {
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
   }
   // Start cli runloop
   cli_runloop();
   return 0;
 }
-
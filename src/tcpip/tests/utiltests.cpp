@@ -1,7 +1,12 @@
 // utiltests.cpp
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
 #include "catch2.hpp"
 #include "utils.h"
+#include "hist.h"
+#include "timer_wheel.h"
 
 #pragma mark - IPv4 Address Parsing Tests
 
@@ -288,3 +293,142 @@ TEST_CASE("IPv4 address parse-render round-trip", "[ipv4][roundtrip]") {
   }
 }
 
+
+#pragma mark - Histogram Tests
+
+TEST_CASE("Histogram - log-linear buckets", "[hist]") {
+  // Small values get a bucket each
+  for (uint64_t ns = 0; ns < HIST_SUB_BUCKETS; ns++) {
+    REQUIRE(hist_bucket(ns) == ns);
+  }
+  // Then every power of 2 is split in HIST_SUB_BUCKETS
+  REQUIRE(hist_bucket(8) == 8);
+  REQUIRE(hist_bucket(15) == 15);
+  REQUIRE(hist_bucket(16) == 16);
+  REQUIRE(hist_bucket(17) == 16);
+  REQUIRE(hist_bucket(18) == 17);
+  REQUIRE(hist_bucket(1024) == 64);
+  REQUIRE(hist_bucket(1151) == 64);
+  REQUIRE(hist_bucket(1152) == 65);
+  REQUIRE(hist_bucket(UINT64_MAX) == HIST_BUCKETS - 1);
+  // Bounds line up with the buckets, and are never too far apart
+  for (uint32_t i = 0; i + 1 < HIST_BUCKETS; i++) {
+    REQUIRE(hist_bucket(hist_bucket_lower(i)) == i);
+    REQUIRE(hist_bucket(hist_bucket_upper(i) - 1) == i);
+    REQUIRE(hist_bucket_upper(i) - hist_bucket_lower(i) <= std::max<uint64_t>(1, hist_bucket_lower(i) / HIST_SUB_BUCKETS));
+  }
+  REQUIRE(hist_bucket_upper(HIST_BUCKETS - 1) == 1ull << CONFIG_HIST_MAX_BITS);
+}
+
+TEST_CASE("Histogram - counts and percentiles", "[hist]") {
+  hist_t *h = new hist_t();
+  hist_init(h);
+  REQUIRE(hist_count(h) == 0);
+  REQUIRE(hist_percentile(h, 50) == 0);
+  for (uint32_t i = 0; i < 99; i++) {
+    hist_record(h, 1000); // [960, 1024)
+  }
+  hist_record(h, 100000); // [98304, 106496)
+  REQUIRE(hist_count(h) == 100);
+  REQUIRE(h->sum.load() == 99 * 1000 + 100000);
+  REQUIRE(hist_percentile(h, 50) == 1024);
+  REQUIRE(hist_percentile(h, 99) == 1024);
+  REQUIRE(hist_percentile(h, 100) == 106496);
+  REQUIRE(hist_percentile(h, 0) == 1024);
+  hist_reset(h);
+  REQUIRE(hist_count(h) == 0);
+  REQUIRE(h->sum.load() == 0);
+  delete h;
+}
+
+TEST_CASE("Histogram - percentile error is bounded", "[hist]") {
+  hist_t *h = new hist_t();
+  hist_init(h);
+  // Spread over several orders of magnitude
+  std::vector<uint64_t> samples;
+  for (uint64_t i = 1; i <= 10000; i++) {
+    samples.push_back(i * i * 37 % 50000000 + 100);
+  }
+  for (uint64_t ns : samples) {
+    hist_record(h, ns);
+  }
+  std::sort(samples.begin(), samples.end());
+  for (double p : {1.0, 10.0, 25.0, 50.0, 75.0, 90.0, 99.0, 99.9, 100.0}) {
+    uint64_t exact = samples[std::max<uint64_t>(1, (uint64_t)std::ceil(p / 100.0 * samples.size())) - 1];
+    uint64_t estimate = hist_percentile(h, p);
+    // An upper bound, within a sub-bucket of the real thing
+    REQUIRE(estimate > exact);
+    REQUIRE((double)(estimate - exact) / exact <= 1.0 / HIST_SUB_BUCKETS);
+  }
+  delete h;
+}
+
+
+#pragma mark - Timer Wheel Tests
+
+typedef struct test_timer_t {
+  timer_wheel_timer_t timer;  // First, so the wheel's pointer is ours
+  uint64_t expected;          // Tick it's due
+  uint64_t fired;             // Tick it fired on (0 if not yet)
+} test_timer_t;
+
+static void test_timer_fired(timer_wheel_timer_t *timer, uint64_t now_ns, void *ctx) {
+  auto w = (timer_wheel_t *)ctx;
+  ((test_timer_t *)timer)->fired = w->now;
+#pragma unused(now_ns)
+}
+
+TEST_CASE("Timer wheel - timers fire on their tick, across levels", "[timer]") {
+  timer_wheel_t *w = new timer_wheel_t();
+  timer_wheel_init(w, 1000, 0); // 1us ticks
+  // One per level, and past the top level's range
+  std::vector<uint64_t> expires_ns = {1, 999, 1000, 1001, 63000, 64000, 4095000, 4096000, 300000000, 20000000000ull};
+  // And spread out ones
+  for (uint64_t i = 1; i < 200; i++) {
+    expires_ns.push_back(i * i * i * 997);
+  }
+  std::vector<test_timer_t> timers(expires_ns.size());
+  for (uint32_t i = 0; i < timers.size(); i++) {
+    timer_wheel_timer_init(&timers[i].timer);
+    timers[i].expected = (expires_ns[i] + 999) / 1000;
+    timers[i].fired = 0;
+    timer_wheel_schedule(w, &timers[i].timer, expires_ns[i]);
+  }
+  REQUIRE(w->pending == timers.size());
+  // Cancelled timers never fire
+  timer_wheel_cancel(w, &timers[3].timer);
+  REQUIRE(w->pending == timers.size() - 1);
+  // Advance in uneven steps
+  uint32_t fired = 0;
+  for (uint64_t now_ns = 0; now_ns <= 20000000000ull; now_ns += 777777) {
+    fired += timer_wheel_advance(w, now_ns, test_timer_fired, w);
+  }
+  fired += timer_wheel_advance(w, 20000000000ull, test_timer_fired, w);
+  REQUIRE(fired == timers.size() - 1);
+  REQUIRE(w->pending == 0);
+  for (uint32_t i = 0; i < timers.size(); i++) {
+    if (i == 3) {
+      REQUIRE(timers[i].fired == 0);
+      continue;
+    }
+    REQUIRE(timers[i].fired == timers[i].expected);
+  }
+  delete w;
+}
+
+TEST_CASE("Timer wheel - past expiries fire on the next tick", "[timer]") {
+  timer_wheel_t *w = new timer_wheel_t();
+  timer_wheel_init(w, 1000, 5000);
+  REQUIRE(timer_wheel_advance(w, 10000, test_timer_fired, w) == 0);
+  REQUIRE(w->now == 5);
+  REQUIRE(!timer_wheel_is_due(w, 10999));
+  REQUIRE(timer_wheel_is_due(w, 11000));
+  test_timer_t timer = {};
+  timer_wheel_timer_init(&timer.timer);
+  timer_wheel_schedule(w, &timer.timer, 0);
+  REQUIRE(timer_wheel_advance(w, 10999, test_timer_fired, w) == 0);
+  REQUIRE(timer_wheel_advance(w, 11000, test_timer_fired, w) == 1);
+  REQUIRE(timer.fired == 6);
+  REQUIRE(!timer.timer.pending);
+  delete w;
+}
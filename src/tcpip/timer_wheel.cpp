@@ -0,0 +1,131 @@
+// timer_wheel.cpp
+
+#include "timer_wheel.h"
+#include "utils.h"
+
+#define TIMER_WHEEL_SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVEL_SHIFT(level) (CONFIG_TIMER_WHEEL_SLOT_BITS * (level))
+#define TIMER_WHEEL_RANGE (1ull << TIMER_WHEEL_LEVEL_SHIFT(CONFIG_TIMER_WHEEL_LEVELS))
+
+static_assert(TIMER_WHEEL_LEVEL_SHIFT(CONFIG_TIMER_WHEEL_LEVELS) < 64, "Timer wheel range doesn't fit 64 bits");
+
+#pragma mark -
+
+// Private utility functions
+
+static uint64_t timer_wheel_ticks(const timer_wheel_t *w, uint64_t ns) {
+  return ns > w->origin_ns ? (ns - w->origin_ns) / w->tick_ns : 0;
+}
+
+// Files `timer` in the lowest level covering its expiry (`timer->expires >= w->now`)
+static void timer_wheel_file(timer_wheel_t *w, timer_wheel_timer_t *timer) {
+  uint64_t delta = timer->expires - w->now;
+  uint64_t expires = timer->expires;
+  if (delta >= TIMER_WHEEL_RANGE) {
+    // Too far out, wait at the top level's horizon
+    expires = w->now + TIMER_WHEEL_RANGE - 1;
+    delta = TIMER_WHEEL_RANGE - 1;
+  }
+  uint32_t level = 0;
+  while (delta >= (1ull << TIMER_WHEEL_LEVEL_SHIFT(level + 1))) {
+    level++;
+  }
+  uint32_t slot = (expires >> TIMER_WHEEL_LEVEL_SHIFT(level)) & TIMER_WHEEL_SLOT_MASK;
+  glthread_add_next(&w->slots[level][slot], &timer->glue);
+}
+
+// Moves a slot's timers onto `out`, so callbacks can't disturb the walk
+static void timer_wheel_slot_take(glthread_t *slot, glthread_t *out) {
+  glthread_init(out);
+  out->right = slot->right;
+  if (out->right) { out->right->left = out; }
+  slot->right = nullptr;
+}
+
+static void timer_wheel_cascade(timer_wheel_t *w, uint32_t level) {
+  uint32_t slot = (w->now >> TIMER_WHEEL_LEVEL_SHIFT(level)) & TIMER_WHEEL_SLOT_MASK;
+  glthread_t timers;
+  timer_wheel_slot_take(&w->slots[level][slot], &timers);
+  while (timers.right) {
+    timer_wheel_timer_t *timer = timer_wheel_timer_ptr_from_glue(timers.right);
+    glthread_remove(&timer->glue);
+    timer_wheel_file(w, timer);
+  }
+}
+
+#pragma mark -
+
+// Public functions
+
+void timer_wheel_init(timer_wheel_t *w, uint64_t tick_ns, uint64_t now_ns) {
+  EXPECT_RETURN(w != nullptr, "Empty timer wheel param");
+  EXPECT_RETURN(tick_ns != 0, "Invalid tick param");
+  w->tick_ns = tick_ns;
+  w->origin_ns = now_ns;
+  w->now = 0;
+  w->pending = 0;
+  for (uint32_t level = 0; level < CONFIG_TIMER_WHEEL_LEVELS; level++) {
+    for (uint32_t slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+      glthread_init(&w->slots[level][slot]);
+    }
+  }
+}
+
+void timer_wheel_timer_init(timer_wheel_timer_t *timer) {
+  EXPECT_RETURN(timer != nullptr, "Empty timer param");
+  glthread_init(&timer->glue);
+  timer->expires = 0;
+  timer->pending = false;
+}
+
+void timer_wheel_schedule(timer_wheel_t *w, timer_wheel_timer_t *timer, uint64_t expires_ns) {
+  EXPECT_RETURN(w != nullptr, "Empty timer wheel param");
+  EXPECT_RETURN(timer != nullptr, "Empty timer param");
+  timer_wheel_cancel(w, timer);
+  // Round up, and never into a tick that's already been processed
+  uint64_t expires = timer_wheel_ticks(w, expires_ns + w->tick_ns - 1);
+  timer->expires = expires > w->now ? expires : w->now + 1;
+  timer->pending = true;
+  w->pending++;
+  timer_wheel_file(w, timer);
+}
+
+void timer_wheel_cancel(timer_wheel_t *w, timer_wheel_timer_t *timer) {
+  EXPECT_RETURN(w != nullptr, "Empty timer wheel param");
+  EXPECT_RETURN(timer != nullptr, "Empty timer param");
+  if (!timer->pending) { return; }
+  glthread_remove(&timer->glue);
+  timer->pending = false;
+  w->pending--;
+}
+
+uint32_t timer_wheel_advance(timer_wheel_t *w, uint64_t now_ns, timer_wheel_cb_t cb, void *ctx) {
+  EXPECT_RETURN_VAL(w != nullptr, "Empty timer wheel param", 0);
+  uint64_t target = timer_wheel_ticks(w, now_ns);
+  uint32_t fired = 0;
+  while (w->now < target) {
+    if (w->pending == 0) {
+      // Nothing to walk through
+      w->now = target;
+      break;
+    }
+    w->now++;
+    // Bring the next stretch of every level that wrapped down a level
+    for (uint32_t level = 1; level < CONFIG_TIMER_WHEEL_LEVELS; level++) {
+      if (w->now & ((1ull << TIMER_WHEEL_LEVEL_SHIFT(level)) - 1)) { break; }
+      timer_wheel_cascade(w, level);
+    }
+    // Fire
+    glthread_t due;
+    timer_wheel_slot_take(&w->slots[0][w->now & TIMER_WHEEL_SLOT_MASK], &due);
+    while (due.right) {
+      timer_wheel_timer_t *timer = timer_wheel_timer_ptr_from_glue(due.right);
+      glthread_remove(&timer->glue);
+      timer->pending = false;
+      w->pending--;
+      fired++;
+      if (cb) { cb(timer, now_ns, ctx); }
+    }
+  }
+  return fired;
+}
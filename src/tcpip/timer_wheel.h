@@ -0,0 +1,55 @@
+// timer_wheel.h
+
+#pragma once
+
+#include <cstdint>
+#include "config.h"
+#include "glthread.h"
+
+/*
+ * Hierarchical timer wheel (Varghese & Lauck). Time moves in ticks of
+ * `tick_ns`; level `l` has TIMER_WHEEL_SLOTS slots of TIMER_WHEEL_SLOTS^l
+ * ticks each. A timer is filed in the lowest level whose range covers it, and
+ * moves down a level (cascades) as its expiry comes within the range of the
+ * level below. Scheduling and cancelling are O(1), advancing costs O(1) per
+ * elapsed tick plus whatever fires or cascades. Timers past the top level's
+ * range wait in it and get refiled as they come closer.
+ *
+ * Not thread safe: callers bring their own lock (e.g. the node lock).
+ */
+
+#define TIMER_WHEEL_SLOTS (1u << CONFIG_TIMER_WHEEL_SLOT_BITS)
+
+typedef struct timer_wheel_timer_t {
+  glthread_t glue;
+  uint64_t expires;   // Tick
+  bool pending;
+} timer_wheel_timer_t;
+
+DEFINE_GLTHREAD_TO_STRUCT_FUNC(
+  timer_wheel_timer_ptr_from_glue,  // fn name
+  timer_wheel_timer_t,              // return type
+  glue                              // glthread_t field in timer_wheel_timer_t
+);
+
+typedef struct timer_wheel_t {
+  uint64_t tick_ns;
+  uint64_t origin_ns;   // Start of tick 0
+  uint64_t now;         // Last tick processed
+  uint32_t pending;     // Timers scheduled
+  glthread_t slots[CONFIG_TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+} timer_wheel_t;
+
+// Called for every timer that fires (no longer pending, so it may be rescheduled or freed)
+typedef void (*timer_wheel_cb_t)(timer_wheel_timer_t *timer, uint64_t now_ns, void *ctx);
+
+void timer_wheel_init(timer_wheel_t *w, uint64_t tick_ns, uint64_t now_ns);
+void timer_wheel_timer_init(timer_wheel_timer_t *timer);
+void timer_wheel_schedule(timer_wheel_t *w, timer_wheel_timer_t *timer, uint64_t expires_ns); // Reschedules if pending. Fires on the first tick at or past `expires_ns`
+void timer_wheel_cancel(timer_wheel_t *w, timer_wheel_timer_t *timer);
+uint32_t timer_wheel_advance(timer_wheel_t *w, uint64_t now_ns, timer_wheel_cb_t cb, void *ctx); // Fires every timer due by `now_ns`, returns how many
+
+// Cheap check for the datapath: has a tick elapsed since the last advance?
+static inline bool timer_wheel_is_due(const timer_wheel_t *w, uint64_t now_ns) {
+  return now_ns >= w->origin_ns + (w->now + 1) * w->tick_ns;
+}
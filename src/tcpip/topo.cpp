@@ -1,5 +1,6 @@
 // topo.cpp
 
+#include <vector>
 #include "topo.h"
 
 graph_t* graph_create_three_node_ring_topology() {
@@ -302,3 +303,66 @@ graph_t *graph_create_three_router_one_switch_topology() {
   return topo;
 }
 
+
+graph_t* graph_create_switch_tree_topology(uint32_t fanout, uint32_t depth) {
+  // Switches need a port for the SVI, the uplink and `fanout` more
+  EXPECT_RETURN_VAL(fanout > 0 && fanout + 2 <= CONFIG_MAX_INTF_PER_NODE, "Invalid fanout param", nullptr);
+  graph_t *topo = graph_init("Switch tree topology");
+  char name[CONFIG_NODE_NAME_SIZE];
+  char addr_str[16];
+  char intf_name[CONFIG_IF_NAME_SIZE];
+  uint32_t switch_count = 0;
+  uint32_t host_count = 0;
+  auto format_addr = [&](uint32_t addr) {
+    snprintf(addr_str, sizeof(addr_str), "%u.%u.%u.%u", addr >> 24, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF);
+  };
+  auto add_switch = [&](vlan_t **vlan) -> node_t * {
+    snprintf(name, sizeof(name), "S%u", switch_count);
+    node_t *sw = graph_add_node(topo, name);
+    EXPECT_RETURN_VAL(sw != nullptr, "graph_add_node failed", nullptr);
+    // SVI addresses come from the top of the subnet
+    format_addr(0x0AFFFFFE - switch_count);
+    *vlan = node_vlan_create(sw, 10, "svi/10", addr_str, 8);
+    EXPECT_RETURN_VAL(*vlan != nullptr, "node_vlan_create failed", nullptr);
+    switch_count++;
+    return sw;
+  };
+  // Build the tree level by level
+  std::vector<std::pair<node_t *, vlan_t *>> level(1);
+  level[0].first = add_switch(&level[0].second);
+  EXPECT_RETURN_VAL(level[0].first != nullptr, "add_switch failed", nullptr);
+  for (uint32_t d = 0; d <= depth; d++) {
+    std::vector<std::pair<node_t *, vlan_t *>> next;
+    for (auto [parent, parent_vlan] : level) {
+      for (uint32_t i = 1; i <= fanout; i++) {
+        snprintf(intf_name, sizeof(intf_name), "eth0/%u", i);
+        if (d < depth) {
+          // Switch, uplinked over TRUNK ports
+          vlan_t *vlan = nullptr;
+          node_t *sw = add_switch(&vlan);
+          EXPECT_RETURN_VAL(sw != nullptr, "add_switch failed", nullptr);
+          link_nodes(parent, sw, intf_name, "eth0/0", 1);
+          node_interface_set_mode(parent, intf_name, INTF_MODE_L2_TRUNK);
+          node_interface_set_mode(sw, "eth0/0", INTF_MODE_L2_TRUNK);
+          node_interface_add_vlan_membership(sw, "eth0/0", vlan);
+          next.push_back({sw, vlan});
+        }
+        else {
+          // Host, on an ACCESS port
+          snprintf(name, sizeof(name), "H%u", host_count);
+          node_t *host = graph_add_node(topo, name);
+          EXPECT_RETURN_VAL(host != nullptr, "graph_add_node failed", nullptr);
+          link_nodes(parent, host, intf_name, "eth0/0", 1);
+          node_interface_set_mode(parent, intf_name, INTF_MODE_L2_ACCESS);
+          format_addr(0x0A000001 + host_count);
+          node_interface_set_mode(host, "eth0/0", INTF_MODE_L3);
+          node_interface_set_ipv4_address(host, "eth0/0", addr_str, 8);
+          host_count++;
+        }
+        node_interface_add_vlan_membership(parent, intf_name, parent_vlan);
+      }
+    }
+    level.swap(next);
+  }
+  return topo;
+}
@@ -75,3 +75,23 @@ graph_t *graph_create_quad_switch_loop_topology();
  */
 graph_t *graph_create_three_router_one_switch_topology();
 
+
+/*
+ * Generated topology (for large scale runs, e.g. under PHY_TRANSPORT_SIM): a
+ * tree of L2 switches, `depth` levels below the root switch S0, each switch
+ * with `fanout` children. Every leaf switch has `fanout` hosts attached.
+ * Everything is in VLAN 10 (10.0.0.0/8): hosts are H0, H1, ... with
+ * addresses 10.0.0.1, 10.0.0.2, ... and switches uplink over TRUNK ports.
+ *
+ *                        +------+
+ *                        |  S0  |
+ *                        +--+---+
+ *                 eth0/1 |     | eth0/2          (fanout 2, depth 1)
+ *                 +------+     +------+
+ *              +--+---+            +--+---+
+ *              |  S1  |            |  S2  |
+ *              +--+---+            +--+---+
+ *             /       \           /       \
+ *           H0         H1       H2         H3
+ */
+graph_t* graph_create_switch_tree_topology(uint32_t fanout, uint32_t depth);
@@ -0,0 +1,184 @@
+// trace.cpp
+
+#include <algorithm>
+#include <mutex>
+#include <time.h>
+#include "trace.h"
+#include "utils.h"
+
+static_assert((CONFIG_TRACE_RING_SIZE & (CONFIG_TRACE_RING_SIZE - 1)) == 0, "CONFIG_TRACE_RING_SIZE must be a power of 2");
+
+typedef struct trace_slot_t {
+  std::atomic<uint64_t> seq;  // Index of the record + 1, 0 while being written
+  trace_rec_t rec;
+} trace_slot_t;
+
+typedef struct trace_ring_t {
+  std::atomic<uint64_t> head;     // Records ever written (owning thread only)
+  std::atomic<uint64_t> tail;     // First record still wanted (see `trace_clear()`)
+  std::atomic<bool> orphaned;     // Owning thread is gone
+  trace_slot_t slots[CONFIG_TRACE_RING_SIZE];
+} trace_ring_t;
+
+// Hands the thread's ring over to the registry when the thread exits
+struct trace_ring_owner_t {
+  trace_ring_t *ring = nullptr;
+  virtual ~trace_ring_owner_t() {
+    if (ring) { ring->orphaned.store(true, std::memory_order_release); }
+  }
+};
+
+static std::atomic<uint32_t> __trace_next_id(0);
+static std::mutex __trace_rings_lock;
+static std::vector<trace_ring_t *> __trace_rings; // Guarded by `__trace_rings_lock`
+static thread_local trace_ring_owner_t __trace_ring;
+
+#pragma mark -
+
+// Private utility functions
+
+static trace_ring_t* trace_ring_get() {
+  if (likely(__trace_ring.ring != nullptr)) { return __trace_ring.ring; }
+  trace_ring_t *ring = new trace_ring_t();
+  std::lock_guard<std::mutex> guard(__trace_rings_lock);
+  __trace_rings.push_back(ring);
+  __trace_ring.ring = ring;
+  return ring;
+}
+
+static uint64_t trace_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Copies out the ring's wanted records, skipping the ones being overwritten
+static void trace_ring_collect(trace_ring_t *ring, std::vector<trace_rec_t> *out) {
+  uint64_t head = ring->head.load(std::memory_order_acquire);
+  uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+  if (head > CONFIG_TRACE_RING_SIZE) {
+    tail = std::max(tail, head - CONFIG_TRACE_RING_SIZE);
+  }
+  for (uint64_t i = tail; i < head; i++) {
+    trace_slot_t *slot = &ring->slots[i & (CONFIG_TRACE_RING_SIZE - 1)];
+    if (slot->seq.load(std::memory_order_acquire) != i + 1) { continue; }
+    trace_rec_t rec = slot->rec;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot->seq.load(std::memory_order_relaxed) != i + 1) { continue; } // Torn
+    out->push_back(rec);
+  }
+}
+
+#pragma mark -
+
+// Public functions
+
+void trace_add(node_t *n, uint32_t count) {
+  EXPECT_RETURN(n != nullptr, "Empty node param");
+  n->trace_budget += count;
+}
+
+void trace_clear() {
+  std::lock_guard<std::mutex> guard(__trace_rings_lock);
+  auto it = __trace_rings.begin();
+  while (it != __trace_rings.end()) {
+    trace_ring_t *ring = *it;
+    if (ring->orphaned.load(std::memory_order_acquire)) {
+      delete ring;
+      it = __trace_rings.erase(it);
+      continue;
+    }
+    ring->tail.store(ring->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    it++;
+  }
+}
+
+std::vector<trace_rec_t> trace_records() {
+  std::vector<trace_rec_t> recs;
+  {
+    std::lock_guard<std::mutex> guard(__trace_rings_lock);
+    for (trace_ring_t *ring : __trace_rings) {
+      trace_ring_collect(ring, &recs);
+    }
+  }
+  std::stable_sort(recs.begin(), recs.end(), [](const trace_rec_t &a, const trace_rec_t &b) {
+    return a.trace_id != b.trace_id ? a.trace_id < b.trace_id : a.ts < b.ts;
+  });
+  return recs;
+}
+
+void trace_dump() {
+  std::vector<trace_rec_t> recs = trace_records();
+  if (recs.empty()) {
+    dump_line("No packets traced\n");
+    return;
+  }
+  uint64_t start = 0;
+  for (uint32_t i = 0; i < recs.size(); i++) {
+    trace_rec_t *rec = &recs[i];
+    if (i == 0 || rec->trace_id != recs[i - 1].trace_id) {
+      dump_line("Packet %u\n", rec->trace_id);
+      start = rec->ts;
+    }
+    // Decode
+    interface_t *intf = rec->ifindex != TRACE_NO_INTF ? node_get_interface_by_index(rec->node, rec->ifindex) : nullptr;
+    char detail[64] = "";
+    if (rec->decision == TRACE_DROPPED) {
+      snprintf(detail, sizeof(detail), " (%s)", drop_reason_str((drop_reason_t)rec->reason));
+    }
+    else if (rec->decision == TRACE_ROUTED || rec->decision == TRACE_ARP_PENDING) {
+      snprintf(detail, sizeof(detail), " (next hop " IPV4_ADDR_FMT ")", IPV4_ADDR_BYTES_BE(rec->nxt_hop));
+    }
+    else if (rec->vlan_id) {
+      snprintf(detail, sizeof(detail), " (VLAN %u)", rec->vlan_id);
+    }
+    dump_line(
+      "  %10.3f us  %-16s %-16s %-12s %s%s\n", (rec->ts - start) / 1000.0, rec->node->node_name,
+      intf ? intf->if_name : "-", prof_stage_str((prof_stage_t)rec->stage),
+      trace_decision_str((trace_decision_t)rec->decision), detail
+    );
+  }
+}
+
+const char* trace_decision_str(trace_decision_t decision) {
+  switch (decision) {
+    case TRACE_RECEIVED: return "received";
+    case TRACE_FORWARDED: return "forwarded";
+    case TRACE_FLOODED: return "flooded";
+    case TRACE_LOCAL: return "local";
+    case TRACE_ROUTED: return "routed";
+    case TRACE_ARP_PENDING: return "arp pending";
+    case TRACE_SENT: return "sent";
+    case TRACE_DROPPED: return "dropped";
+    default: return "unknown";
+  }
+}
+
+void __trace_mark(node_t *n, pkt_buf_t *pkt) {
+  n->trace_budget--;
+  pkt->trace_id = __trace_next_id.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+void __trace_record(
+  node_t *n, interface_t *intf, pkt_buf_t *pkt, prof_stage_t stage, trace_decision_t decision,
+  uint16_t vlan_id, drop_reason_t reason, const ipv4_addr_t *nxt_hop
+) {
+  trace_ring_t *ring = trace_ring_get();
+  uint64_t idx = ring->head.load(std::memory_order_relaxed);
+  trace_slot_t *slot = &ring->slots[idx & (CONFIG_TRACE_RING_SIZE - 1)];
+  // Seqlock style: readers racing the overwrite see a mismatching sequence
+  slot->seq.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  trace_rec_t *rec = &slot->rec;
+  rec->ts = trace_now_ns();
+  rec->node = n;
+  rec->trace_id = pkt->trace_id;
+  rec->nxt_hop.value = nxt_hop ? nxt_hop->value : 0;
+  rec->vlan_id = vlan_id;
+  rec->ifindex = intf ? (uint8_t)intf->ifindex : TRACE_NO_INTF;
+  rec->stage = (uint8_t)stage;
+  rec->decision = (uint8_t)decision;
+  rec->reason = (uint8_t)reason;
+  slot->seq.store(idx + 1, std::memory_order_release);
+  ring->head.store(idx + 1, std::memory_order_release);
+}
@@ -0,0 +1,88 @@
+// trace.h
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "config.h"
+#include "drop.h"
+#include "graph.h"
+#include "pkt_buf.h"
+#include "prof.h"
+
+/*
+ * Packet tracer (same idea as VPP's `trace add`). `trace_add()` marks the next
+ * N packets entering a node (their `pkt_buf_t::trace_id`), and every stage a
+ * marked packet goes through appends a compact binary record to the calling
+ * thread's ring. Nothing gets formatted until `trace_dump()`, which gathers
+ * every ring and prints the records grouped by packet.
+ *
+ * Unmarked packets cost a branch per stage. Rings are single producer (their
+ * thread), fixed size (CONFIG_TRACE_RING_SIZE), and overwrite their oldest
+ * records. Readers copy slots out under a per-slot sequence number and skip
+ * the ones being overwritten, so they never block the datapath.
+ *
+ * Marks don't survive the wire: trace every node you care about.
+ */
+
+#define TRACE_NO_INTF 0xff
+
+enum trace_decision_t {
+  TRACE_RECEIVED = 0, // Accepted on ingress
+  TRACE_FORWARDED,    // Switched to the interface a MAC was learnt on
+  TRACE_FLOODED,      // Switched to every qualified interface
+  TRACE_LOCAL,        // Consumed by the node (ARP, L5, IP-in-IP)
+  TRACE_ROUTED,       // Handed to L2, towards a next hop
+  TRACE_ARP_PENDING,  // Parked until the next hop resolves
+  TRACE_SENT,         // Handed to the phy layer
+  TRACE_DROPPED
+};
+
+typedef struct trace_rec_t {
+  uint64_t ts;          // CLOCK_MONOTONIC (ns)
+  node_t *node;
+  uint32_t trace_id;
+  ipv4_addr_t nxt_hop;  // TRACE_ROUTED and TRACE_ARP_PENDING only
+  uint16_t vlan_id;     // 0 if untagged (or not known at that stage)
+  uint8_t ifindex;      // TRACE_NO_INTF if none
+  uint8_t stage;        // prof_stage_t
+  uint8_t decision;     // trace_decision_t
+  uint8_t reason;       // drop_reason_t (TRACE_DROPPED only)
+} trace_rec_t;
+
+void trace_add(node_t *n, uint32_t count); // Call with the node lock held
+void trace_clear(); // Forgets every record so far (marks left to hand out are kept)
+std::vector<trace_rec_t> trace_records(); // Every record still around, by packet then time
+void trace_dump();
+const char* trace_decision_str(trace_decision_t decision);
+void __trace_mark(node_t *n, pkt_buf_t *pkt);
+void __trace_record(
+  node_t *n, interface_t *intf, pkt_buf_t *pkt, prof_stage_t stage, trace_decision_t decision,
+  uint16_t vlan_id, drop_reason_t reason, const ipv4_addr_t *nxt_hop
+);
+
+// Marks `pkt` if `n` has marks left. Call with the node lock held
+static inline void trace_mark(node_t *n, pkt_buf_t *pkt) {
+  if (likely(n->trace_budget == 0) || pkt->trace_id) { return; }
+  __trace_mark(n, pkt);
+}
+
+static inline bool trace_pkt_marked(const pkt_buf_t *pkt) {
+  return unlikely(pkt->trace_id != 0);
+}
+
+static inline void trace_pkt(node_t *n, interface_t *intf, pkt_buf_t *pkt, prof_stage_t stage, trace_decision_t decision, uint16_t vlan_id) {
+  if (!trace_pkt_marked(pkt)) { return; }
+  __trace_record(n, intf, pkt, stage, decision, vlan_id, DROP_NONE, nullptr);
+}
+
+static inline void trace_pkt_hop(node_t *n, interface_t *intf, pkt_buf_t *pkt, prof_stage_t stage, trace_decision_t decision, const ipv4_addr_t *nxt_hop) {
+  if (!trace_pkt_marked(pkt)) { return; }
+  __trace_record(n, intf, pkt, stage, decision, 0, DROP_NONE, nxt_hop);
+}
+
+static inline void trace_pkt_drop(node_t *n, interface_t *intf, pkt_buf_t *pkt, prof_stage_t stage, drop_reason_t reason) {
+  if (!trace_pkt_marked(pkt)) { return; }
+  __trace_record(n, intf, pkt, stage, TRACE_DROPPED, 0, reason, nullptr);
+}